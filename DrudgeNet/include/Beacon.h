@@ -2,13 +2,15 @@
 #define NET_BEACON_H
 
 #include "Socket.h"
+#include "SendAccumulator.h"
 
 namespace Net
 {
     // Beacon
     //  + sends broadcast UDP packets to the LAN
     //  + use a beacon to advertise the existence of a Server
-
+    //  + broadcasts once a second, a stall doesn't make it catch up with a burst of broadcasts
+    
     class Beacon
     {
     public:
@@ -33,7 +35,7 @@ namespace Net
         unsigned int serverPort;
         bool running;
         Socket socket;
-        double timeAccumulator;
+        SendAccumulator sendAccumulator;
     };
 }
 
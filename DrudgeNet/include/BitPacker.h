@@ -2,11 +2,34 @@
 #define NET_BITPACKER_H
 
 #include <cstdint>
+#include <cstring>
+#include <assert.h>
 
 namespace Net
 {
+    inline uint32_t HostToLittleEndian( uint32_t value )
+    {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        return ( value >> 24 ) | ( ( value >> 8 ) & 0xFF00 ) | ( ( value << 8 ) & 0xFF0000 ) | ( value << 24 );
+#else
+        return value;
+#endif
+    }
+    
     // bitpacker class
     //  + read and write non-8 multiples of bits efficiently
+    //  + bits go through a 64 bit scratch register, the buffer is read and written a 32 bit word at
+    //    a time (little endian). one bounds check per call, the buffer doesn't need zeroing
+    //  + 64 bit values can be any width up to 64, low 32 bits first
+    //  + each write stores the partial word as well, so the buffer can be read or sent after any
+    //    call. FlushBits has nothing left to do and stays for the streams' Flush
+    //  + format: values up to 32 bits give the same bytes as the old byte at a time packer. 64 bit
+    //    values used to go out as two full 32 bit words, high word first, whatever the width.
+    //    they now take their width, low 32 bits first, so 64 bit fields don't read across versions
+    //  + arrays of values the same width go in one call with one bounds check. SIMD kernels group
+    //    values up to 16 bits wide into one scratch register operation, same bits as one at a time
+    //  + byte blocks once aligned to a byte: the bytes up to a word boundary go through the scratch
+    //    register, whole words are copied straight to or from the buffer
     
     class BitPacker
     {
@@ -18,16 +41,92 @@ namespace Net
             Write
         };
         
+        // kernels for the array calls, the best compiled in is the default. AVX2 needs -mavx2,
+        // SSE2 is there on any x86-64
+        enum ArrayKernel
+        {
+            ScalarKernel,
+            SSE2Kernel,
+            AVX2Kernel
+        };
+        
+#if defined(__AVX2__)
+        static const ArrayKernel BestArrayKernel = AVX2Kernel;
+#elif defined(__SSE2__) || defined(_M_X64)
+        static const ArrayKernel BestArrayKernel = SSE2Kernel;
+#else
+        static const ArrayKernel BestArrayKernel = ScalarKernel;
+#endif
+        
         BitPacker( Mode mode, void * buffer, int bytes );
         
-        void WriteBits( unsigned int value, int bits = 32 );
+        // inline, these are the hot path of every serialize call
         
-        void ReadBits( unsigned int & value, int bits = 32 );
+        void WriteBits( unsigned int value, int bits = 32 )
+        {
+            assert( mode == Write );
+            assert( bits > 0 );
+            assert( bits <= 32 );
+            assert( bits_processed + bits <= bytes * 8 );
+            if ( bits < 32 )
+                value &= ( 1u << bits ) - 1;
+            scratch |= (uint64_t) value << scratch_bits;
+            scratch_bits += bits;
+            bits_processed += bits;
+            if ( scratch_bits >= 32 )
+            {
+                StoreWord( (uint32_t) scratch );
+                scratch >>= 32;
+                scratch_bits -= 32;
+            }
+            if ( scratch_bits > 0 )
+                StorePartialWord();
+        }
+        
+        void ReadBits( unsigned int & value, int bits = 32 )
+        {
+            assert( mode == Read );
+            assert( bits > 0 );
+            assert( bits <= 32 );
+            assert( bits_processed + bits <= bytes * 8 );
+            if ( scratch_bits < bits )
+            {
+                scratch |= (uint64_t) LoadWord() << scratch_bits;
+                scratch_bits += 32;
+            }
+            value = (unsigned int) scratch;
+            if ( bits < 32 )
+                value &= ( 1u << bits ) - 1;
+            scratch >>= bits;
+            scratch_bits -= bits;
+            bits_processed += bits;
+        }
         
         void WriteBits( uint64_t value, int bits = 64 );
         
         void ReadBits( uint64_t & value, int bits = 64 );
         
+        // a kernel that isn't compiled in falls back to the next best
+        void WriteArray( const unsigned int values[], int count, int bits, ArrayKernel kernel = BestArrayKernel );
+        
+        void ReadArray( unsigned int values[], int count, int bits, ArrayKernel kernel = BestArrayKernel );
+        
+        // zero bits up to the next byte boundary
+        inline int GetAlignBits() const { return ( 8 - bits_processed % 8 ) % 8; };
+        
+        void WriteAlign();
+        
+        // false if the padding isn't zero
+        bool ReadAlign();
+        
+        // byte aligned only
+        void WriteBytes( const unsigned char data[], int count );
+        
+        void ReadBytes( unsigned char data[], int count );
+        
+        // every write is already in the buffer
+        inline void FlushBits() {};
+        
         void * GetData();
         
         int GetBits() const;
@@ -41,8 +140,32 @@ namespace Net
         bool IsValid() const;
     private:
         
-        int bit_index;
-        unsigned char * ptr;
+        void StoreWord( uint32_t word );
+        
+        // the bits in the scratch register, without moving on to the next word
+        inline void StorePartialWord()
+        {
+            if ( word_index * 4 + 4 <= bytes )
+            {
+                const uint32_t value = HostToLittleEndian( (uint32_t) scratch );
+                memcpy( buffer + word_index * 4, &value, 4 );
+            }
+            else
+                StoreTail();
+        }
+        
+        void StoreTail();
+        
+        uint32_t LoadWord();
+        
+        inline void PutChunk( uint64_t & bits, int & count, uint32_t chunk, int width );
+        
+        inline uint32_t GetChunk( uint64_t & bits, int & count, int width );
+        
+        uint64_t scratch;
+        int scratch_bits;                       // bits written but not stored, or loaded but not read
+        int word_index;                         // next word to store or load
+        int bits_processed;
         unsigned char * buffer;
         int bytes;
         Mode mode;
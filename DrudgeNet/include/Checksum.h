@@ -0,0 +1,44 @@
+#ifndef NET_CHECKSUM_H
+#define NET_CHECKSUM_H
+
+#include <cstdint>
+
+namespace Net
+{
+    // crc32c packet checksums
+    //  + the crc instructions where compiled in, SSE4.2 needs -msse4.2 and ARMv8 needs the crc
+    //    extension. without them a slicing by 8 table, the same result 8 bytes a step
+    //  + a packet checksum runs the protocol id through first and is sent in place of it, so no
+    //    bytes are added and a packet for another protocol fails the check like a corrupted one
+    //  + catches any burst of errors up to 32 bits and truncated packets, it is no defence
+    //    against a sender who means harm
+    
+    enum ChecksumKernel
+    {
+        TableChecksum,
+        SSE42Checksum,
+        ARMv8Checksum
+    };
+
+#if defined(__SSE4_2__)
+    static const ChecksumKernel BestChecksumKernel = SSE42Checksum;
+#elif defined(__ARM_FEATURE_CRC32)
+    static const ChecksumKernel BestChecksumKernel = ARMv8Checksum;
+#else
+    static const ChecksumKernel BestChecksumKernel = TableChecksum;
+#endif
+    
+    // crc continues a checksum, so CRC32C of a block after CRC32C of the one before is the
+    // checksum of both. a kernel not compiled in falls back to the table
+    uint32_t CRC32C( const unsigned char data[], int bytes, uint32_t crc = 0, ChecksumKernel kernel = BestChecksumKernel );
+    
+    uint32_t PacketChecksum( unsigned int protocolId, const unsigned char data[], int bytes );
+    
+    // the first four bytes of a packet, the protocol id or the checksum of the bytes after them
+    void WritePacketHeader( unsigned char packet[], int bytes, unsigned int protocolId, bool checksum );
+    
+    // false for a packet too short to have a header
+    bool CheckPacketHeader( const unsigned char packet[], int bytes, unsigned int protocolId, bool checksum );
+}
+
+#endif /* NET_CHECKSUM_H */
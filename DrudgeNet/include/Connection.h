@@ -5,6 +5,12 @@
 
 namespace Net
 {
+    // connection
+    //  + one client and one server over a socket, packets start with the protocol id
+    //  + with checksums on, a crc32c of the protocol id and payload goes in place of the protocol
+    //    id. both ends must agree, a corrupted or truncated packet is dropped before the
+    //    connection state sees it
+    
     class Connection
     {
     public:
@@ -48,6 +54,10 @@ namespace Net
         
         int GetHeaderSize() const { return 4; }
         
+        void SetChecksum( bool enabled ) { checksum = enabled; }
+        
+        bool IsChecksumEnabled() const { return checksum; }
+        
     protected:
         
         virtual void OnStart()		{}
@@ -70,6 +80,7 @@ namespace Net
         
         unsigned int protocolId;
         float timeout;
+        bool checksum;
         
         bool running;
         Mode mode;
@@ -0,0 +1,257 @@
+#ifndef NET_DELTA_ENCODING_H
+#define NET_DELTA_ENCODING_H
+
+#include "SerializeCompressed.h"
+#include "SequenceBuffer.h"
+#include "Sequence.h"
+
+namespace Net
+{
+    // delta field serialization against a baseline value both sides have
+    //  + unchanged costs one bit, a small change two bits plus delta_bits, anything else two bits
+    //    plus the full range
+    //  + compressed floats are delta encoded on their quantized steps, so the receiver rebuilds
+    //    exactly what it would have got from a full send and the error never builds up
+    
+    template <typename StreamType>
+    bool SerializeDeltaInteger( StreamType & stream, int & value, int baseline, int min, int max, int delta_bits = 4 )
+    {
+        assert( min < max );
+        assert( delta_bits >= 1 );
+        assert( delta_bits <= 16 );
+        // small deltas are [-half,-1] and [1,half], zero is unchanged
+        const int half = 1 << ( delta_bits - 1 );
+        bool changed = false;
+        bool small = false;
+        unsigned int code = 0;
+        if ( !stream.IsReading() )
+        {
+            const int delta = value - baseline;
+            changed = delta != 0;
+            small = changed && delta >= -half && delta <= half;
+            if ( small )
+                code = (unsigned int) ( delta < 0 ? delta + half : delta + half - 1 );
+        }
+        if ( !stream.SerializeBoolean( changed ) )
+            return false;
+        if ( !changed )
+        {
+            if ( stream.IsReading() )
+                value = baseline;
+            return true;
+        }
+        if ( !stream.SerializeBoolean( small ) )
+            return false;
+        if ( !small )
+            return stream.SerializeInteger( value, min, max );
+        if ( !stream.SerializeBits( code, delta_bits ) )
+            return false;
+        if ( stream.IsReading() )
+        {
+            const int delta = (int) code < half ? (int) code - half : (int) code - half + 1;
+            value = baseline + delta;
+            if ( value < min || value > max )
+                return false;
+        }
+        return true;
+    }
+    
+    template <typename StreamType>
+    bool SerializeDeltaCompressedFloat( StreamType & stream, float & value, float baseline, float min, float max, float resolution, int delta_bits = 4 )
+    {
+        const unsigned int steps = CompressedFloatSteps( min, max, resolution );
+        assert( steps <= 0x7FFFFFFF );
+        int integer = 0;
+        if ( !stream.IsReading() )
+            integer = (int) QuantizeFloat( value, min, max, steps );
+        if ( !SerializeDeltaInteger( stream, integer, (int) QuantizeFloat( baseline, min, max, steps ), 0, (int) steps, delta_bits ) )
+            return false;
+        if ( stream.IsReading() )
+            value = DequantizeFloat( (unsigned int) integer, min, max, steps );
+        return true;
+    }
+    
+    // delta sender, one per peer
+    //  + keeps a ring of the snapshots sent, keyed by the sequence of the packet they went out in
+    //  + the newest snapshot the receiver says it decoded becomes the baseline, the next snapshots
+    //    are written against it. the receiver has every snapshot it decoded, so loss, reordering or
+    //    a snapshot that fails to read can't desync the two sides
+    //  + the reliability system's acks aren't enough: a packet is acked when it arrives, before
+    //    the snapshot in it is read. the receiver sends its own ack back with SerializeAcks
+    //  + with no baseline, or one too old for the ring, the snapshot goes against a default one
+    //  + Sequence is the sequence policy of the packets, the same one as the reliability system
+    //  + Snapshot is default constructible and has
+    //    template <typename StreamType> bool Serialize( StreamType & stream, const Snapshot & baseline )
+    //    written with the delta field helpers
+    
+    template <typename Snapshot, typename Sequence = Sequence32>
+    class DeltaSender
+    {
+    public:
+        
+        // size must match the receiver
+        DeltaSender( int size = 256, unsigned int max_sequence = Sequence::DefaultMaxSequence ) : sent( size ), sequence( max_sequence )
+        {
+            assert( size >= 3 );
+            Reset();
+        }
+        
+        void Reset()
+        {
+            sent.Reset();
+            has_baseline = false;
+            baseline = 0;
+        }
+        
+        // the receiver decoded the snapshot sent with this packet sequence
+        void ProcessAck( unsigned int ack )
+        {
+            if ( !sent.Exists( ack ) )
+                return;
+            if ( !has_baseline || sequence.IsMoreRecent( ack, baseline ) )
+            {
+                baseline = ack;
+                has_baseline = true;
+            }
+        }
+        
+        // reads the ack written by DeltaReceiver::SerializeAcks
+        template <typename StreamType> bool SerializeAcks( StreamType & stream )
+        {
+            assert( stream.IsReading() );
+            bool decoded = false;
+            if ( !stream.SerializeBoolean( decoded ) )
+                return false;
+            if ( !decoded )
+                return true;
+            unsigned int ack = 0;
+            if ( !stream.SerializeInteger( ack, 0, sequence.GetMax() ) )
+                return false;
+            ProcessAck( ack );
+            return true;
+        }
+        
+        // writes (or measures) the snapshot for the packet going out with this sequence
+        template <typename StreamType> bool Serialize( StreamType & stream, unsigned int packet_sequence, Snapshot & snapshot )
+        {
+            assert( !stream.IsReading() );
+            const Snapshot * base = GetBaseline( packet_sequence );
+            bool delta = base != NULL;
+            if ( !stream.SerializeBoolean( delta ) )
+                return false;
+            if ( delta )
+            {
+                unsigned int distance = sequence.Difference( packet_sequence, baseline );
+                if ( !stream.SerializeInteger( distance, 1, sent.GetSize() - 1 ) )
+                    return false;
+            }
+            const Snapshot empty = Snapshot();
+            if ( !snapshot.Serialize( stream, delta ? *base : empty ) )
+                return false;
+            if ( stream.IsWriting() )
+                *sent.Insert( packet_sequence ) = snapshot;
+            return true;
+        }
+        
+        inline bool HasBaseline() const { return has_baseline; };
+        
+        inline unsigned int GetBaselineSequence() const { return baseline; };
+        
+    private:
+        
+        const Snapshot * GetBaseline( unsigned int packet_sequence ) const
+        {
+            if ( !has_baseline || !sequence.IsMoreRecent( packet_sequence, baseline ) )
+                return NULL;
+            if ( sequence.Difference( packet_sequence, baseline ) >= (unsigned int) sent.GetSize() )
+                return NULL;
+            return sent.Find( baseline );
+        }
+        
+        SequenceBuffer<Snapshot> sent;
+        Sequence sequence;
+        bool has_baseline;
+        unsigned int baseline;                  // sequence of the newest decoded snapshot
+    };
+    
+    // delta receiver, one per peer
+    //  + keeps a ring of the snapshots it read, keyed by packet sequence, to find the baselines
+    //    the sender refers to
+    //  + a snapshot against a baseline it doesn't have fails to read and isn't kept
+    //  + remembers the newest snapshot it decoded, SerializeAcks writes that back to the sender in
+    //    the packets going the other way. send it in every packet, a lost one costs nothing
+    
+    template <typename Snapshot, typename Sequence = Sequence32>
+    class DeltaReceiver
+    {
+    public:
+        
+        // size must match the sender
+        DeltaReceiver( int size = 256, unsigned int max_sequence = Sequence::DefaultMaxSequence ) : received( size ), sequence( max_sequence )
+        {
+            assert( size >= 3 );
+            Reset();
+        }
+        
+        void Reset()
+        {
+            received.Reset();
+            has_ack = false;
+            ack = 0;
+        }
+        
+        // reads the snapshot that came in the packet with this sequence
+        template <typename StreamType> bool Serialize( StreamType & stream, unsigned int packet_sequence, Snapshot & snapshot )
+        {
+            assert( stream.IsReading() );
+            bool delta = false;
+            if ( !stream.SerializeBoolean( delta ) )
+                return false;
+            const Snapshot empty = Snapshot();
+            const Snapshot * base = &empty;
+            if ( delta )
+            {
+                unsigned int distance = 0;
+                if ( !stream.SerializeInteger( distance, 1, received.GetSize() - 1 ) )
+                    return false;
+                base = received.Find( sequence.Previous( packet_sequence, distance ) );
+                if ( !base )
+                    return false;
+            }
+            if ( !snapshot.Serialize( stream, *base ) )
+                return false;
+            *received.Insert( packet_sequence ) = snapshot;
+            if ( !has_ack || sequence.IsMoreRecent( packet_sequence, ack ) )
+            {
+                ack = packet_sequence;
+                has_ack = true;
+            }
+            return true;
+        }
+        
+        // writes (or measures) the newest decoded sequence for DeltaSender::SerializeAcks
+        template <typename StreamType> bool SerializeAcks( StreamType & stream )
+        {
+            assert( !stream.IsReading() );
+            bool decoded = has_ack;
+            if ( !stream.SerializeBoolean( decoded ) )
+                return false;
+            if ( !decoded )
+                return true;
+            return stream.SerializeInteger( ack, 0, sequence.GetMax() );
+        }
+        
+        inline bool HasAck() const { return has_ack; };
+        
+        inline unsigned int GetAckSequence() const { return ack; };
+        
+    private:
+        
+        SequenceBuffer<Snapshot> received;
+        Sequence sequence;
+        bool has_ack;
+        unsigned int ack;                       // sequence of the newest decoded snapshot
+    };
+}
+
+#endif /* NET_DELTA_ENCODING_H */
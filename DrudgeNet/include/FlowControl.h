@@ -1,24 +1,118 @@
 #ifndef NET_FLOWCONTROL_H
 #define NET_FLOWCONTROL_H
 
+#include "RateEstimator.h"
+
 namespace Net
 {
-    // simple binary flow control
-    //  + two modes of operation: good and bad mode
-    //  + if RTT exceeds 250ms drop to bad mode immediately
-    //  + if RTT is under 250ms for a period of time, return to good mode
-
+    // flow control, decides how much to send
+    //  + binary mode (the original): good and bad mode
+    //     - if RTT exceeds 250ms drop to bad mode immediately
+    //     - if RTT is under 250ms for a period of time, return to good mode
+    //  + aimd mode: rate based congestion control with a bytes per second budget
+    //     - additive increase: the budget grows by a fixed step per round trip of good acks,
+    //       but only while the application actually sends close to the budget
+    //     - multiplicative decrease on packet loss or when RTT inflates well above the
+    //       minimum RTT (queues building up), at most once per round trip
+    //     - the budget always stays within the application's min/max bandwidth limits
+    //  + bbr mode: model based, does not wait for loss or queueing to find the link capacity
+    //     - bottleneck bandwidth is the max of the ack rate measured each round trip over the
+    //       last ten round trips, min RTT comes from the reliability system
+    //     - paces at a gain times the bottleneck bandwidth and caps bytes in flight at twice
+    //       the bandwidth delay product, so queues along the path stay short
+    //     - startup doubles the rate each round trip until the bandwidth stops growing, drain
+    //       empties the queue that made, then probe bandwidth cycles the gain around 1 to
+    //       find more capacity. every 10 seconds probe rtt cuts bytes in flight to refresh min RTT
+    //  + ledbat mode: low priority, for bulk transfers sharing a link with real-time traffic
+    //     - fed one way delay samples, the clocks don't need to agree since only growth counts.
+    //       base delay is the minimum over the last minute, queuing delay is the minimum of the
+    //       latest few samples above it
+    //     - grows the budget by up to one additive step per round trip while queuing delay is
+    //       under the target, scaled by how far under it is, and cuts it multiplicatively once
+    //       queuing delay goes over the target or a packet is lost. so it backs off before the
+    //       queue it builds delays anything else, and fills whatever bandwidth is spare
+    //     - the target is the target delay, or a quarter of the min RTT (2ms at least) if that's
+    //       lower, so on a short path it doesn't keep a queue many round trips long
+    //  + any mode: the send rate (packets per second) is the budget over the average packet size
+    //  + feed it sent, acked and lost bytes as they happen and the RTT each update
+    
     class FlowControl
     {
     public:
         
-        FlowControl();
+        enum Mode
+        {
+            Binary,
+            AIMD,
+            BBR,
+            LEDBAT
+        };
+        
+        FlowControl( Mode mode = Binary );
         
         void Reset();
         
-        void Update( float deltaTime, float rtt );
+        // rtt and min_rtt in milliseconds. min_rtt of zero tracks the minimum here instead
+        void Update( float deltaTime, float rtt, float min_rtt = 0.0f );
+        
+        void PacketSent( int size );
+        
+        void PacketsAcked( int bytes );
+        
+        void PacketLost( int size );
+        
+        // one way delay in milliseconds, plus any offset between the two clocks
+        void DelaySample( float delay );
+        
+        // packets per second to pace sends at
+        float GetSendRate() const;
+        
+        // bytes per second budget
+        float GetBandwidth() const;
+        
+        // bytes allowed in flight, zero for no limit
+        float GetWindow() const;
+        
+        inline bool CanSend() const { return GetWindow() <= 0.0f || bytes_in_flight < GetWindow(); };
+        
+        inline int GetBytesInFlight() const { return bytes_in_flight; };
+        
+        // bbr model, bytes per second and seconds
+        
+        inline float GetBottleneckBandwidth() const { return bottleneck_bandwidth; };
+        
+        inline float GetMinRoundTripTime() const { return min_rtt; };
+        
+        // ledbat, seconds
+        
+        inline void SetTargetDelay( float target ) { assert( target > 0.0f ); target_delay = target; };
+        
+        inline float GetTargetDelay() const { return target_delay; };
+        
+        // the target in use, the target delay or a fraction of the min RTT if that's lower
+        float GetQueuingTarget() const;
+        
+        float GetQueuingDelay() const;
+        
+        void SetMode( Mode mode );
+        
+        inline Mode GetMode() const { return mode; };
         
-        inline float GetSendRate() { return mode == Good ? 30.0f : 10.0f; };
+        void SetBandwidthLimits( float minimum, float maximum );
+        
+        inline float GetMinBandwidth() const { return min_bandwidth; };
+        
+        inline float GetMaxBandwidth() const { return max_bandwidth; };
+        
+        inline void SetAdditiveIncrease( float increase ) { additive_increase = increase; };
+        
+        inline float GetAdditiveIncrease() const { return additive_increase; };
+        
+        inline void SetMultiplicativeDecrease( float decrease ) { assert( decrease > 0.0f && decrease < 1.0f ); multiplicative_decrease = decrease; };
+        
+        inline float GetMultiplicativeDecrease() const { return multiplicative_decrease; };
+        
+        inline float GetAveragePacketSize() const { return packet_size; };
         
     private:
         
@@ -27,10 +121,84 @@ namespace Net
             Bad
         };
         
-        FlowMode mode;
+        enum ModelState {
+            Startup,
+            Drain,
+            ProbeBandwidth,
+            ProbeRoundTripTime
+        };
+        
+        static const int BandwidthFilterRounds = 10;
+        static const int GainCycleLength = 8;
+        static const int BaseDelayBuckets = 10;
+        static const int CurrentDelaySamples = 4;
+        
+        void UpdateBinary( float deltaTime, float rtt );
+        
+        void UpdateAIMD( float deltaTime );
+        
+        void Decrease();
+        
+        void UpdateRoundTripTime( float deltaTime, float rtt, float min_rtt );
+        
+        void UpdateBBR( float deltaTime );
+        
+        void UpdateLEDBAT( float deltaTime );
+        
+        void EndRound();
+        
+        void EnterState( ModelState state );
+        
+        inline bool IsAppLimited() const { return sent_rate.GetRate() < GetBandwidth() * 0.5f; };
+        
+        Mode mode;
+        
+        // binary mode
+        FlowMode flow_mode;
         float penalty_time;
         float good_conditions_time;
         float penalty_reduction_accumulator;
+        
+        // aimd mode
+        float bandwidth;                    // current budget in bytes per second
+        float min_bandwidth;                // application limits for the budget
+        float max_bandwidth;
+        float additive_increase;            // bytes per second added per round trip of good acks
+        float multiplicative_decrease;      // budget is scaled by this on loss or rtt inflation
+        float rtt_inflation;                // rtt above min rtt times this counts as congestion...
+        float rtt_inflation_slack;          // ...as long as it is also this many seconds above it
+        float recovery_time;                // time left before the budget may be cut again
+        float rtt;                          // latest rtt in seconds
+        float min_rtt;                      // minimum rtt in seconds
+        float min_rtt_age;                  // time since min_rtt last went down
+        float packet_size;                  // moving average of sent packet sizes
+        RateEstimator sent_rate;            // bytes per second actually sent
+        int bytes_in_flight;                // sent bytes not acked or lost yet
+        
+        // bbr mode
+        ModelState state;
+        float bottleneck_bandwidth;         // max delivery rate over the filter window
+        float bandwidth_samples[BandwidthFilterRounds];  // delivery rate per round, ring buffer
+        int round_count;                    // rounds (one min rtt each) since reset
+        float round_time;                   // time into the current round
+        double model_time;                  // time since reset
+        double interval_start;              // time of the ack starting the delivery rate interval, negative for none yet
+        double interval_end;                // time of the latest ack in the interval
+        int interval_acked;                 // bytes acked in the interval, after the first ack
+        float full_bandwidth;               // bottleneck bandwidth when startup last saw growth
+        int full_bandwidth_rounds;          // rounds startup has gone without 25% growth
+        float pacing_gain;                  // pacing rate is this times bottleneck bandwidth
+        float window_gain;                  // bytes in flight are capped at this times the bdp
+        int cycle_index;                    // phase of the probe bandwidth gain cycle
+        float probe_rtt_time;               // time left in probe rtt
+        
+        // ledbat mode
+        float target_delay;                 // queuing delay to stay under, seconds
+        float base_delay[BaseDelayBuckets]; // minimum one way delay per bucket, ring buffer
+        int base_delay_index;               // bucket being filled
+        float base_delay_time;              // time into that bucket
+        float current_delay[CurrentDelaySamples];  // latest one way delays, ring buffer
+        int delay_samples;                  // one way delays seen since reset
     };
 }
 
@@ -2,11 +2,18 @@
 #define NET_MESH_H
 
 #include "Socket.h"
+#include "Pacer.h"
+#include "SendAccumulator.h"
 #include <vector>
 #include <map>
 
 namespace Net
 {
+    // mesh
+    //  + accepts nodes and tells every node where the others are, every send rate seconds
+    //  + packets to each node are spread across the send rate by a pacer, not sent in one burst
+    //  + optional checksums in place of the protocol id, the nodes must have them on too
+    
     class Mesh
     {
         struct NodeState
@@ -24,7 +31,7 @@ namespace Net
                 timeoutAccumulator = 0.0f;
             }
         };
-
+        
     public:
         
         Mesh(unsigned int protocolId,
@@ -48,6 +55,10 @@ namespace Net
         
         void Reserve( int nodeId, const Address & address );
         
+        void SetChecksum( bool enabled ) { checksum = enabled; }
+        
+        bool IsChecksumEnabled() const { return checksum; }
+        
     protected:
         
         void ReceivePackets();
@@ -60,9 +71,12 @@ namespace Net
         
     private:
         
+        static bool SendPacedPacket( void * context, int nodeId, const unsigned char data[], int size );
+        
         unsigned int protocolId;
         float sendRate;
         float timeout;
+        bool checksum;
         
         Socket socket;
         std::vector<NodeState> nodes;
@@ -71,7 +85,8 @@ namespace Net
         IdToNode id2node;
         AddrToNode addr2node;
         bool running;
-        float sendAccumulator;
+        SendAccumulator sendAccumulator;
+        Pacer pacer;
     };
 }
 
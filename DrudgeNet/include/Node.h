@@ -2,6 +2,7 @@
 #define NET_NODE_H
 
 #include "Socket.h"
+#include "SendAccumulator.h"
 
 #include <stack>
 #include <vector>
@@ -42,10 +43,19 @@ namespace Net
         
         int GetMaxNodes() const;
         
+        // largest packet SendPacket takes, maxPacketSize less the checksum when that's on
+        int GetMaxPacketSize() const;
+        
         bool SendPacket( int nodeId, const unsigned char data[], int size );
         
         int ReceivePacket( int & nodeId, unsigned char data[], int size );
         
+        // checksums on packets to and from the mesh, and on packets between nodes, which then
+        // carry four bytes of the maxPacketSize. see Connection
+        void SetChecksum( bool enabled ) { checksum = enabled; }
+        
+        bool IsChecksumEnabled() const { return checksum; }
+        
     protected:
         
         void ReceivePackets();
@@ -85,6 +95,7 @@ namespace Net
         float sendRate;
         float timeout;
         int maxPacketSize;
+        bool checksum;
         
         Socket socket;
         std::vector<NodeState> nodes;
@@ -92,7 +103,7 @@ namespace Net
         typedef std::map<Address,NodeState*> AddrToNode;
         AddrToNode addr2node;
         bool running;
-        float sendAccumulator;
+        SendAccumulator sendAccumulator;
         float timeoutAccumulator;
         
         enum State
@@ -0,0 +1,93 @@
+#ifndef NET_PACER_H
+#define NET_PACER_H
+
+#include <vector>
+#include <deque>
+
+namespace Net
+{
+    // pacer, spreads datagrams out in time instead of sending them in one burst per tick
+    //  + datagrams are queued per peer and released by Update once their send time comes
+    //  + each peer gets its own offset within the spread interval (usually the tick or send rate),
+    //    peer n of N goes out n/N of the way through, so peers don't all get their packets at once
+    //  + optional token bucket per peer: released at the configured rate with a limited burst.
+    //    tokens stop filling at the burst size, so a stall is never followed by a catch up burst
+    //  + packets are handed to a send function once released, the pacer doesn't own a socket
+    //  + Update can be called more often than once per tick to release packets closer to their
+    //    send time, GetTimeToNextSend says how long until the next one is due
+    
+    class Pacer
+    {
+    public:
+        
+        typedef bool (*SendFunction)( void * context, int peer, const unsigned char data[], int size );
+        
+        Pacer( int peers = 0, float interval = 0.0f );
+        
+        void SetSendFunction( SendFunction function, void * context );
+        
+        // bytes per second and burst size in bytes. zero rate leaves the peer unlimited
+        void SetRate( int peer, float rate, float burst );
+        
+        inline float GetRate( int peer ) const { return peer < (int) peers.size() ? peers[peer].rate : 0.0f; };
+        
+        // interval sends to each peer are spread across, zero sends everything when queued
+        inline void SetInterval( float interval ) { this->interval = interval; };
+        
+        inline float GetInterval() const { return interval; };
+        
+        inline void SetMaxQueuedBytes( int bytes ) { max_queued_bytes = bytes; };
+        
+        // queues a datagram for the peer, false if the peer's queue is full
+        bool Enqueue( int peer, const unsigned char data[], int size );
+        
+        void Update( float deltaTime );
+        
+        void Clear();
+        
+        void Clear( int peer );
+        
+        // negative when nothing is queued
+        float GetTimeToNextSend() const;
+        
+        inline int GetQueuedPackets( int peer ) const { return peer < (int) peers.size() ? (int) peers[peer].queue.size() : 0; };
+        
+        inline int GetQueuedBytes( int peer ) const { return peer < (int) peers.size() ? peers[peer].queued_bytes : 0; };
+        
+    private:
+        
+        struct QueuedPacket
+        {
+            double time;                        // time the packet may be sent
+            std::vector<unsigned char> data;
+        };
+        
+        struct PeerState
+        {
+            float rate;                         // bytes per second, zero for unlimited
+            float burst;                        // most tokens that can build up
+            float tokens;                       // bytes that may be sent now
+            int queued_bytes;
+            std::deque<QueuedPacket> queue;
+            PeerState()
+            {
+                rate = 0.0f;
+                burst = 0.0f;
+                tokens = 0.0f;
+                queued_bytes = 0;
+            }
+        };
+        
+        PeerState & GetPeer( int peer );
+        
+        double time;                            // time since the pacer was created
+        float interval;
+        int peer_slots;                         // offsets are spread over this many peers at least
+        int max_queued_bytes;                   // per peer
+        SendFunction send_function;
+        void * send_context;
+        std::vector<PeerState> peers;
+    };
+}
+
+#endif
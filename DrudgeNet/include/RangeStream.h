@@ -0,0 +1,517 @@
+#ifndef NET_RANGE_STREAM_H
+#define NET_RANGE_STREAM_H
+
+#include "StaticStream.h"
+#include <assert.h>
+#include <string.h>
+
+namespace Net
+{
+    // adaptive models for the range stream, one per field that opts in
+    //  + a model learns the field's statistics as values go through it, the reader's copy learns
+    //    the same from the values it reads. both sides must start from the same state: reset the
+    //    models (or construct new ones) for each packet, a lost packet would desync models kept
+    //    across packets
+    //  + with any other stream a model field is sent plain, the same as a fixed range
+    
+    // probability of a boolean being false, in 1/4096ths
+    class AdaptiveBitModel
+    {
+    public:
+        
+        enum
+        {
+            ProbabilityBits = 12,
+            AdaptShift = 5                      // moves 1/32 of the way to each value seen
+        };
+        
+        AdaptiveBitModel() { Reset(); }
+        
+        inline void Reset() { probability = 1 << ( ProbabilityBits - 1 ); };
+        
+        inline void Update( bool value )
+        {
+            if ( value )
+                probability -= probability >> AdaptShift;
+            else
+                probability += ( ( 1 << ProbabilityBits ) - probability ) >> AdaptShift;
+        }
+        
+        unsigned int probability;
+    };
+    
+    // frequency counts for values in [0,Symbols), small alphabets such as types or small deltas
+    template <int Symbols> class AdaptiveModel
+    {
+    public:
+        
+        static_assert( Symbols >= 2 && Symbols <= 1024, "symbol count out of range" );
+        
+        enum
+        {
+            Increment = 32,
+            MaxTotal = 1 << 16                  // the coder needs range / total to keep some precision
+        };
+        
+        AdaptiveModel() { Reset(); }
+        
+        void Reset()
+        {
+            for ( int i = 0; i < Symbols; ++i )
+                frequency[i] = 1;
+            total = Symbols;
+        }
+        
+        inline unsigned int GetStart( unsigned int symbol ) const
+        {
+            unsigned int start = 0;
+            for ( unsigned int i = 0; i < symbol; ++i )
+                start += frequency[i];
+            return start;
+        }
+        
+        void Update( unsigned int symbol )
+        {
+            if ( total + Increment > MaxTotal )
+            {
+                // halve, keeping every symbol codable
+                total = 0;
+                for ( int i = 0; i < Symbols; ++i )
+                {
+                    frequency[i] = ( frequency[i] + 1 ) / 2;
+                    total += frequency[i];
+                }
+            }
+            frequency[symbol] += Increment;
+            total += Increment;
+        }
+        
+        unsigned short frequency[Symbols];
+        unsigned int total;
+    };
+    
+    // range stream, a static stream entropy coded with a range coder instead of packed bits
+    //  + same serialize calls as Stream, plain fields cost the bits they would in a bitpacker
+    //  + fields that opt in with SerializeSymbol or SerializeBoolean and a model cost about their
+    //    entropy under the model, skewed fields such as entity types, flags and small deltas shrink
+    //  + carry propagating coder with 32 bits of range and bytewise output (as in LZMA), about 4
+    //    bytes of flush per packet
+    //  + measure codes without storing, so measuring updates models like a write. no journal
+    //  + use the RangeReadStream, RangeWriteStream and RangeMeasureStream typedefs
+    
+    template <Stream::Mode StreamMode>
+    class RangeStream
+    {
+    public:
+        
+        // buffer can be NULL when measuring
+        RangeStream( void * buffer, int bytes )
+        {
+            assert( bytes >= 0 );
+            this->buffer = (unsigned char*) buffer;
+            this->bytes = bytes;
+            position = 0;
+            low = 0;
+            range = 0xFFFFFFFF;
+            code = 0;
+            cache = 0;
+            has_cache = false;
+            pending = 0;
+            failed = false;
+            flushed = false;
+            if ( IsReading() )
+            {
+                for ( int i = 0; i < 4; ++i )
+                    code = ( code << 8 ) | ReadByte();
+            }
+        }
+        
+        inline bool IsReading() const { return StreamMode == Stream::Read; };
+        
+        inline bool IsWriting() const { return StreamMode == Stream::Write; };
+        
+        inline bool IsMeasuring() const { return StreamMode == Stream::Measure; };
+        
+        inline void Field( const char *, const char *, int ) {};
+        
+        bool SerializeBoolean( bool & value )
+        {
+            unsigned int tmp = value ? 1 : 0;
+            if ( !SerializeBits( tmp, 1 ) )
+                return false;
+            value = tmp != 0;
+            return true;
+        }
+        
+        bool SerializeByte( char & value, char min = -128, char max = 127 ) { return SerializeRange( value, min, max ); }
+        
+        bool SerializeByte( signed char & value, signed char min = -128, signed char max = 127 ) { return SerializeRange( value, min, max ); }
+        
+        bool SerializeByte( unsigned char & value, unsigned char min = 0, unsigned char max = 0xFF ) { return SerializeRange( value, min, max ); }
+        
+        bool SerializeShort( signed short & value, signed short min = -32768, signed short max = 32767 ) { return SerializeRange( value, min, max ); }
+        
+        bool SerializeShort( unsigned short & value, unsigned short min = 0, unsigned short max = 0xFFFF ) { return SerializeRange( value, min, max ); }
+        
+        bool SerializeInteger( signed int & value, signed int min = -2147483647 - 1, signed int max = 2147483647 ) { return SerializeRange( value, min, max ); }
+        
+        bool SerializeInteger( unsigned int & value, unsigned int min = 0, unsigned int max = 0xFFFFFFFF ) { return SerializeRange( value, min, max ); }
+        
+        bool SerializeFloat( float & value )
+        {
+            unsigned int bits = 0;
+            if ( !IsReading() )
+                memcpy( &bits, &value, 4 );
+            if ( !SerializeBits( bits, 32 ) )
+                return false;
+            if ( IsReading() )
+                memcpy( &value, &bits, 4 );
+            return true;
+        }
+        
+        bool SerializeDouble( double & value )
+        {
+            uint64_t bits = 0;
+            if ( !IsReading() )
+                memcpy( &bits, &value, 8 );
+            if ( !SerializeBits( bits, 64 ) )
+                return false;
+            if ( IsReading() )
+                memcpy( &value, &bits, 8 );
+            return true;
+        }
+        
+        bool SerializeBits( unsigned int & value, int bits )
+        {
+            assert( bits >= 1 );
+            assert( bits <= 32 );
+            if ( !Reserve() )
+                return false;
+            if ( bits <= 16 )
+                return Direct( value, bits );
+            unsigned int low_bits = value & 0xFFFF;
+            unsigned int high_bits = value >> 16;
+            if ( !Direct( low_bits, 16 ) || !Direct( high_bits, bits - 16 ) )
+                return false;
+            value = low_bits | ( high_bits << 16 );
+            return true;
+        }
+        
+        bool SerializeBits( uint64_t & value, int bits )
+        {
+            assert( bits >= 1 );
+            assert( bits <= 64 );
+            unsigned int low_bits = (unsigned int) value;
+            if ( bits <= 32 )
+            {
+                if ( !SerializeBits( low_bits, bits ) )
+                    return false;
+                value = low_bits;
+                return true;
+            }
+            unsigned int high_bits = (unsigned int) ( value >> 32 );
+            if ( !SerializeBits( low_bits, 32 ) || !SerializeBits( high_bits, bits - 32 ) )
+                return false;
+            value = ( (uint64_t) high_bits << 32 ) | low_bits;
+            return true;
+        }
+        
+        // no bulk path, the coder goes a value at a time
+        bool SerializeArray( unsigned int values[], int count, int bits )
+        {
+            for ( int i = 0; i < count; ++i )
+            {
+                if ( !SerializeBits( values[i], bits ) )
+                    return false;
+            }
+            return true;
+        }
+        
+        // nothing is aligned in a range coded stream, bytes are coded eight bits at a time
+        inline bool SerializeAlign() { return !failed; };
+        
+        inline int GetAlignBits() const { return 0; };
+        
+        bool SerializeBytes( unsigned char data[], int bytes )
+        {
+            assert( bytes >= 0 );
+            for ( int i = 0; i < bytes; ++i )
+            {
+                unsigned int value = data[i];
+                if ( !SerializeBits( value, 8 ) )
+                    return false;
+                data[i] = (unsigned char) value;
+            }
+            return true;
+        }
+        
+        bool SerializeString( char string[], int buffer_size )
+        {
+            assert( buffer_size >= 2 );
+            unsigned int length = 0;
+            if ( !IsReading() )
+            {
+                length = (unsigned int) strlen( string );
+                assert( length < (unsigned int) buffer_size );
+            }
+            if ( !SerializeBits( length, BitsRequired( 0, buffer_size - 1 ) ) )
+                return false;
+            if ( length >= (unsigned int) buffer_size )
+                return Fail();
+            if ( !SerializeBytes( (unsigned char*) string, length ) )
+                return false;
+            if ( IsReading() )
+                string[length] = '\0';
+            return true;
+        }
+        
+        // value in [0,Symbols) coded with the model
+        template <int Symbols> bool SerializeSymbol( unsigned int & value, AdaptiveModel<Symbols> & model )
+        {
+            if ( !Reserve() )
+                return false;
+            if ( !IsReading() )
+            {
+                assert( value < (unsigned int) Symbols );
+                range /= model.total;
+                low += (uint64_t) model.GetStart( value ) * range;
+                range *= model.frequency[value];
+                Normalize();
+            }
+            else
+            {
+                range /= model.total;
+                const unsigned int threshold = code / range;
+                if ( threshold >= model.total )
+                    return Fail();
+                unsigned int symbol = 0;
+                unsigned int start = 0;
+                while ( start + model.frequency[symbol] <= threshold )
+                    start += model.frequency[symbol++];
+                code -= start * range;
+                range *= model.frequency[symbol];
+                Normalize();
+                value = symbol;
+            }
+            model.Update( value );
+            return !failed;
+        }
+        
+        bool SerializeBoolean( bool & value, AdaptiveBitModel & model )
+        {
+            if ( !Reserve() )
+                return false;
+            const uint32_t bound = ( range >> AdaptiveBitModel::ProbabilityBits ) * model.probability;
+            if ( IsReading() )
+                value = code >= bound;
+            if ( value )
+            {
+                if ( IsReading() )
+                    code -= bound;
+                else
+                    low += bound;
+                range -= bound;
+            }
+            else
+                range = bound;
+            Normalize();
+            model.Update( value );
+            return !failed;
+        }
+        
+        bool Checkpoint()
+        {
+            const unsigned int magic = 0x12345678;
+            unsigned int value = magic;
+            if ( !SerializeBits( value, 32 ) )
+            {
+                printf( "not enough bits remaining for checkpoint\n" );
+                return false;
+            }
+            if ( value != magic )
+            {
+                printf( "checkpoint failed!\n" );
+                return false;
+            }
+            return true;
+        }
+        
+        // writes out the bytes still held by the coder, call once done. nothing can follow it
+        void Flush()
+        {
+            if ( IsReading() || flushed )
+                return;
+            for ( int i = 0; i < 5; ++i )
+                ShiftLow();
+            flushed = true;
+        }
+        
+        // once flushed these are exact, before that they count the flush to come
+        inline int GetBitsProcessed() const { return GetDataBytes() * 8; };
+        
+        inline int GetBitsRemaining() const { return ( bytes - GetDataBytes() ) * 8; };
+        
+        inline int GetDataBytes() const { return IsReading() || flushed ? position : position + ( has_cache ? 1 : 0 ) + pending + 4; };
+        
+        // ran out of buffer, or read something that was never written
+        inline bool HasFailed() const { return failed; };
+        
+    private:
+        
+        enum { TopValue = 1 << 24 };
+        
+        // worst case bytes a single serialize call can produce, checked up front
+        bool Reserve()
+        {
+            if ( failed )
+                return false;
+            assert( !flushed );
+            if ( !IsReading() && GetDataBytes() + 4 > bytes )
+                return Fail();
+            return true;
+        }
+        
+        inline bool Fail()
+        {
+            failed = true;
+            return false;
+        }
+        
+        // bits with every value equally likely
+        bool Direct( unsigned int & value, int bits )
+        {
+            range >>= bits;
+            if ( IsReading() )
+            {
+                value = code / range;
+                if ( value >> bits )
+                    return Fail();
+                code -= value * range;
+            }
+            else
+            {
+                assert( ( value >> bits ) == 0 );
+                low += (uint64_t) value * range;
+            }
+            Normalize();
+            return !failed;
+        }
+        
+        inline void Normalize()
+        {
+            while ( range < TopValue )
+            {
+                range <<= 8;
+                if ( IsReading() )
+                    code = ( code << 8 ) | ReadByte();
+                else
+                    ShiftLow();
+            }
+        }
+        
+        // the top byte of low goes out once no carry can reach it. 0xFF bytes wait in pending
+        // until the carry is known
+        void ShiftLow()
+        {
+            if ( (uint32_t) low < 0xFF000000 || ( low >> 32 ) != 0 )
+            {
+                const unsigned char carry = (unsigned char) ( low >> 32 );
+                // the first byte is held back too, the interval never leaves [0,1) so it has no carry
+                if ( has_cache )
+                    WriteByte( cache + carry );
+                for ( ; pending > 0; --pending )
+                    WriteByte( 0xFF + carry );
+                cache = (unsigned char) ( low >> 24 );
+                has_cache = true;
+            }
+            else
+                pending++;
+            low = ( low & 0x00FFFFFF ) << 8;
+        }
+        
+        inline void WriteByte( unsigned char value )
+        {
+            assert( position < bytes );
+            if ( buffer )
+                buffer[position] = value;
+            position++;
+        }
+        
+        inline unsigned char ReadByte()
+        {
+            if ( position >= bytes )
+            {
+                failed = true;
+                return 0;
+            }
+            return buffer[position++];
+        }
+        
+        // any integer type, sent as its offset from min like the other streams
+        template <typename T> bool SerializeRange( T & value, T min, T max )
+        {
+            assert( min < max );
+            if ( !IsReading() )
+            {
+                assert( value >= min );
+                assert( value <= max );
+            }
+            const unsigned int maximum = (unsigned int) max - (unsigned int) min;
+            unsigned int bits = (unsigned int) value - (unsigned int) min;
+            if ( !SerializeBits( bits, BitsRequired( 0, maximum ) ) )
+                return false;
+            if ( IsReading() )
+            {
+                if ( bits > maximum )
+                    return Fail();
+                value = (T) ( bits + (unsigned int) min );
+            }
+            return true;
+        }
+        
+        unsigned char * buffer;
+        int bytes;
+        int position;                           // bytes written or read
+        uint64_t low;                           // encoder interval start, bit 32 is the carry
+        uint32_t range;
+        uint32_t code;                          // decoder value within the interval
+        unsigned char cache;                    // last byte out, waiting for a carry
+        bool has_cache;
+        int pending;                            // 0xFF bytes waiting for a carry
+        bool failed;
+        bool flushed;
+    };
+    
+    typedef RangeStream<Stream::Read> RangeReadStream;
+    typedef RangeStream<Stream::Write> RangeWriteStream;
+    typedef RangeStream<Stream::Measure> RangeMeasureStream;
+    
+    // model fields, entropy coded by a range stream and sent plain by any other stream, so a
+    // serialize function templated on the stream type can opt in field by field
+    
+    template <typename StreamType, int Symbols>
+    inline bool SerializeSymbol( StreamType & stream, unsigned int & value, AdaptiveModel<Symbols> & )
+    {
+        return SerializeInteger<0, Symbols - 1>( stream, value );
+    }
+    
+    template <Stream::Mode StreamMode, int Symbols>
+    inline bool SerializeSymbol( RangeStream<StreamMode> & stream, unsigned int & value, AdaptiveModel<Symbols> & model )
+    {
+        return stream.SerializeSymbol( value, model );
+    }
+    
+    template <typename StreamType>
+    inline bool SerializeBoolean( StreamType & stream, bool & value, AdaptiveBitModel & )
+    {
+        return stream.SerializeBoolean( value );
+    }
+    
+    template <Stream::Mode StreamMode>
+    inline bool SerializeBoolean( RangeStream<StreamMode> & stream, bool & value, AdaptiveBitModel & model )
+    {
+        return stream.SerializeBoolean( value, model );
+    }
+}
+
+#endif /* NET_RANGE_STREAM_H */
@@ -0,0 +1,55 @@
+#ifndef NET_RATE_ESTIMATOR_H
+#define NET_RATE_ESTIMATOR_H
+
+#include <assert.h>
+
+namespace Net
+{
+    // rate estimator for per second stats (bytes, packets)
+    //  + amounts are added as they happen and folded in once per update, so cost is O(1)
+    //  + exponentially weighted moving average, the window sets how quickly old samples fade out
+    
+    class RateEstimator
+    {
+    public:
+        
+        RateEstimator( float window = 1.0f ) : window( window )
+        {
+            assert( window > 0.0f );
+            Reset();
+        }
+        
+        void Reset()
+        {
+            rate = 0.0f;
+            pending = 0.0f;
+        }
+        
+        inline void Add( float amount ) { pending += amount; };
+        
+        void Update( float deltaTime )
+        {
+            if ( deltaTime <= 0.0f )
+                return;
+            float alpha = deltaTime / window;
+            if ( alpha > 1.0f )
+                alpha = 1.0f;
+            rate += ( pending / deltaTime - rate ) * alpha;
+            pending = 0.0f;
+        }
+        
+        inline float GetRate() const { return rate; };
+        
+        inline void SetWindow( float window ) { assert( window > 0.0f ); this->window = window; };
+        
+        inline float GetWindow() const { return window; };
+        
+    private:
+        
+        float window;               // averaging window in seconds
+        float rate;                 // estimated amount per second
+        float pending;              // amount added since the last update
+    };
+}
+
+#endif
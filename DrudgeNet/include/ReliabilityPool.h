@@ -0,0 +1,175 @@
+#ifndef NET_RELIABILITY_POOL_H
+#define NET_RELIABILITY_POOL_H
+
+#include "SequenceBuffer.h"
+#include "Sequence.h"
+#include <vector>
+
+namespace Net
+{
+    template <typename Sequence> class BasicReliabilitySystem;
+    
+    // reliability pool
+    //  + reliability state for any number of peers, stored as structure of arrays
+    //  + each peer is a slot in the pool, ReliabilitySystem is a handle to one slot
+    //  + one Update ticks every peer: clocks, ack timers and stats are tight loops over
+    //    contiguous arrays, loss detection only visits peers with packets in flight
+    //  + the pool grows when a peer is added to a full pool, handles stay valid
+    //  + sequence arithmetic comes from the Sequence policy (see Sequence.h), ReliabilityPool
+    //    takes max_sequence at runtime, ReliabilityPool16/32 wrap at a fixed width
+    
+    template <typename Sequence> class BasicReliabilityPool
+    {
+    public:
+        
+        typedef typename Sequence::Type SequenceType;
+        
+        typedef void (*PacketLostCallback)( void * context, unsigned int sequence, int size );
+        
+        BasicReliabilityPool( int capacity = 0, unsigned int max_sequence = Sequence::DefaultMaxSequence );
+        
+        ~BasicReliabilityPool();
+        
+        int AddPeer();
+        
+        void RemovePeer( int peer );
+        
+        void ResetPeer( int peer );
+        
+        BasicReliabilitySystem<Sequence> & GetPeer( int peer );
+        
+        void Update( float deltaTime );
+        
+        void SetStatsWindow( float window );
+        
+        inline float GetStatsWindow() const { return stats_window; };
+        
+        inline bool IsPeerActive( int peer ) const { return peer >= 0 && peer < capacity && active[peer]; };
+        
+        inline int GetCapacity() const { return capacity; };
+        
+        inline int GetPeerCount() const { return peer_count; };
+        
+        inline unsigned int GetMaxSequence() const { return sequence.GetMax(); };
+        
+        static const int PacketBufferSize = 256;   // sent and received packets tracked per peer (fewer if max_sequence is smaller)
+        
+    private:
+        
+        friend class BasicReliabilitySystem<Sequence>;
+        
+        // not copyable, handles point back at the pool
+        BasicReliabilityPool( const BasicReliabilityPool & other );
+        BasicReliabilityPool & operator = ( const BasicReliabilityPool & other );
+        
+        struct SentPacketData
+        {
+            double time;                    // time the packet was sent
+            int size;                       // packet size in bytes
+            bool acked;                     // true once the packet has been acked
+            bool lost;                      // true once the packet has been declared lost
+        };
+        
+        struct ReceivedPacketData
+        {
+            double time;                    // time the packet was received
+            int size;                       // packet size in bytes
+        };
+        
+        enum Rate
+        {
+            SentBytes,
+            AckedBytes,
+            ReceivedBytes,
+            SentPackets,
+            ReceivedPackets,
+            RateCount
+        };
+        
+        void Grow( int capacity );
+        
+        void PacketSent( int peer, int size );
+        
+        void PacketReceived( int peer, unsigned int packet_sequence, int size );
+        
+        void ProcessAck( int peer, unsigned int packet_ack, unsigned int ack_bits );
+        
+        void AckSent( int peer );
+        
+        bool IsAckRequired( int peer ) const;
+        
+        void UpdatePeer( int peer, float deltaTime );
+        
+        void Validate( int peer ) const;
+        
+        void AckPacket( int peer, SequenceType packet, bool sample_rtt );
+        
+        void UpdateRoundTripTime( int peer, float sample );
+        
+        void DetectLostPackets( int peer );
+        
+        void PacketLost( int peer, SequenceType packet, SentPacketData & data );
+        
+        Sequence sequence;                  // sequence arithmetic, wraps after max sequence. shared by all peers
+        int buffer_size;                    // sent and received packets tracked per peer
+        float stats_window;                 // averaging window for bandwidth and packet rates, shared by all peers
+        int capacity;                       // peer slots allocated
+        int peer_count;                     // peer slots in use
+        
+        // per peer state, one entry per slot
+        
+        std::vector<unsigned char> active;              // non-zero if the slot holds a peer
+        std::vector<double> time;                       // local time, advanced each update
+        std::vector<float> update_interval;             // delta time of the last update, loss can't be detected more finely than this
+        
+        std::vector<SequenceType> local_sequence;       // local sequence number for most recently sent packet
+        std::vector<SequenceType> remote_sequence;      // remote sequence number for most recently received packet
+        std::vector<unsigned int> ack_bits;             // received packets preceding remote_sequence, bit n set if remote_sequence - n - 1 was received
+        std::vector<SequenceType> pending_sequence;     // oldest sent sequence not yet acked or lost
+        std::vector<SequenceType> largest_acked;        // most recent sequence acked by the ack field
+        std::vector<unsigned char> largest_acked_valid; // non-zero once anything has been acked
+        
+        std::vector<unsigned int> sent_packets;         // total number of packets sent
+        std::vector<unsigned int> recv_packets;         // total number of packets received
+        std::vector<unsigned int> lost_packets;         // total number of packets lost
+        std::vector<unsigned int> acked_packets;        // total number of packets acked
+        std::vector<int> sent_bytes_total;              // total bandwidth sent
+        std::vector<int> recv_bytes_total;              // total bandwidth received
+        std::vector<int> acked_bytes_total;             // total bandwidth acked, counted as acks arrive
+        
+        std::vector<float> rates[RateCount];            // moving averages per second
+        std::vector<float> rates_pending[RateCount];    // amounts added since the last update
+        
+        std::vector<float> srtt;                        // smoothed round trip time
+        std::vector<float> rttvar;                      // round trip time variation
+        std::vector<float> rto;                         // retransmit timeout, packets not acked within this are lost
+        std::vector<float> rto_minimum;                 // lower bound for rto
+        std::vector<float> rtt_maximum;                 // maximum expected round trip time, upper bound for rto (hard coded to one second for the moment)
+        std::vector<float> min_rtt;                     // smallest round trip time sampled within min_rtt_window
+        std::vector<float> min_rtt_window;              // how long a minimum round trip time sample is kept
+        std::vector<double> min_rtt_time;               // time min_rtt was sampled
+        std::vector<float> latest_rtt;                  // most recent round trip time sample
+        std::vector<unsigned char> rtt_sampled;         // non-zero once the first round trip time sample arrived
+        
+        std::vector<float> ack_delay;                   // how long to hold acks back, hoping to piggyback them on an outgoing packet
+        std::vector<int> max_unacked_packets;           // received packets that force an ack only packet regardless of delay (at most 32)
+        std::vector<int> unacked_packets;               // received packets that have not been acked by any outgoing packet yet
+        std::vector<float> ack_pending_time;            // time since the oldest unacked received packet arrived
+        
+        std::vector<unsigned int> loss_packet_threshold; // packets acked after a packet that mark it lost (K)
+        std::vector<float> loss_time_threshold;         // round trips after which a packet is lost once a later packet is acked
+        std::vector<PacketLostCallback> packet_lost_callback;
+        std::vector<void*> packet_lost_context;
+        
+        std::vector< std::vector<unsigned int> > acks;                  // acked packets since the last update, per peer
+        std::vector< SequenceBuffer<SentPacketData> > sentPackets;      // sent packets, for acks and loss
+        std::vector< SequenceBuffer<ReceivedPacketData> > receivedPackets; // received packets, for duplicate detection and acks to send
+        std::vector<BasicReliabilitySystem<Sequence>*> handles;         // handle per slot, created on demand
+    };
+    
+    typedef BasicReliabilityPool<SequenceRuntime> ReliabilityPool;
+    typedef BasicReliabilityPool<Sequence16> ReliabilityPool16;
+    typedef BasicReliabilityPool<Sequence32> ReliabilityPool32;
+}
+
+#endif /* NET_RELIABILITY_POOL_H */
@@ -2,18 +2,37 @@
 #define NET_RELIABILITY_H
 
 // reliability system to support reliable connection
-//  + manages sent, received, pending ack and acked packet queues
+//  + tracks sent and received packets in fixed size sequence buffers (no allocation per packet)
+//  + ack bits to send are kept up to date as packets arrive, generating them costs nothing
+//  + round trip time estimated as in RFC 6298 (srtt, rttvar, rto) plus a windowed minimum,
+//    packets not acked within the retransmit timeout (rto) are lost and the rto backs off
+//  + faster loss detection as in QUIC: a packet is lost once a packet sent K later is acked,
+//    or 9/8 of a round trip after it was sent when a later packet was acked
+//  + optional callback for each lost packet, so flow control or a resend layer can react right away
+//  + bandwidth and packet rate stats are moving averages updated as packets come and go
+//  + schedules ack only packets when acks are pending and nothing has been sent for a while
+//  + the state lives in a ReliabilityPool, this is a handle to one peer in it. constructed
+//    on its own it owns a pool with a single peer
+//  + ReliabilitySystem takes max_sequence at runtime (so tests can wrap at small values),
+//    ReliabilitySystem16/32 wrap at a fixed width and compare sequences in an instruction or two
 //  + separated out from reliable connection because it is quite complex and i want to unit test it!
 #include "PacketQueue.h"
+#include "ReliabilityPool.h"
 #include <vector>
 
 namespace Net
 {
-    class ReliabilitySystem
+    template <typename Sequence> class BasicReliabilitySystem
     {
     public:
         
-        ReliabilitySystem( unsigned int max_sequence = 0xFFFFFFFF );
+        typedef BasicReliabilityPool<Sequence> Pool;
+        
+        typedef typename Pool::PacketLostCallback PacketLostCallback;
+        
+        BasicReliabilitySystem( unsigned int max_sequence = Sequence::DefaultMaxSequence );
+        
+        ~BasicReliabilitySystem();
         
         void Reset();
         
@@ -21,10 +40,14 @@ namespace Net
         
         void PacketReceived( unsigned int sequence, int size );
         
-        unsigned int GenerateAckBits();
+        inline unsigned int GenerateAckBits() const { return pool->ack_bits[peer]; };
         
         void ProcessAck( unsigned int ack, unsigned int ack_bits );
         
+        void AckSent();
+        
+        bool IsAckRequired() const;
+        
         void Update( float deltaTime );
         
         void Validate();
@@ -33,6 +56,8 @@ namespace Net
         
         static bool IsSequenceMoreRecent( unsigned int s1, unsigned int s2, unsigned int max_sequence );
         
+        static unsigned int SequenceDifference( unsigned int s1, unsigned int s2, unsigned int max_sequence );
+        
         static int BitIndexForSequence( unsigned int sequence, unsigned int ack, unsigned int max_sequence );
         
         static unsigned int GenerateAckBits( unsigned int ack, const PacketQueue & received_queue, unsigned int max_sequence );
@@ -44,70 +69,119 @@ namespace Net
         
         // data accessors
         
-        inline unsigned int GetLocalSequence() const { return local_sequence; };
+        inline Pool & GetPool() const { return *pool; };
+        
+        inline int GetPeer() const { return peer; };
         
-        inline unsigned int GetRemoteSequence() const { return remote_sequence; };
+        inline unsigned int GetLocalSequence() const { return pool->local_sequence[peer]; };
         
-        inline unsigned int GetMaxSequence() const { return max_sequence; };
+        inline unsigned int GetRemoteSequence() const { return pool->remote_sequence[peer]; };
+        
+        inline unsigned int GetMaxSequence() const { return pool->GetMaxSequence(); };
         
         inline void GetAcks( unsigned int ** acks, int & count ) {
-            *acks = &this->acks[0];
-            count = (int)this->acks.size();
+            std::vector<unsigned int> & peer_acks = pool->acks[peer];
+            *acks = peer_acks.empty() ? NULL : &peer_acks[0];
+            count = (int)peer_acks.size();
         };
         
-        inline unsigned int GetSentPackets() const { return sent_packets; };
+        inline unsigned int GetSentPackets() const { return pool->sent_packets[peer]; };
+        
+        inline unsigned int GetReceivedPackets() const { return pool->recv_packets[peer]; };
         
-        inline unsigned int GetReceivedPackets() const { return recv_packets; };
+        inline unsigned int GetLostPackets() const { return pool->lost_packets[peer]; };
         
-        inline unsigned int GetLostPackets() const { return lost_packets; };
+        inline unsigned int GetAckedPackets() const { return pool->acked_packets[peer]; };
         
-        inline unsigned int GetAckedPackets() const { return acked_packets; };
+        inline float GetSentBandwidth() const { return pool->rates[Pool::SentBytes][peer] * ( 8 / 1000.0f ); };
         
-        inline float GetSentBandwidth() const { return sent_bandwidth; };
+        inline float GetAckedBandwidth() const { return pool->rates[Pool::AckedBytes][peer] * ( 8 / 1000.0f ); }
         
-        inline float GetAckedBandwidth() const { return acked_bandwidth; }
+        inline float GetReceivedBandwidth() const { return pool->rates[Pool::ReceivedBytes][peer] * ( 8 / 1000.0f ); };
         
-        inline float GetRoundTripTime() const { return rtt; };
+        inline float GetSentPacketRate() const { return pool->rates[Pool::SentPackets][peer]; };
         
-        inline int GetSentTotal() const { return sent_bytes_total; };
+        inline float GetReceivedPacketRate() const { return pool->rates[Pool::ReceivedPackets][peer]; };
         
-        inline int GetReceivedTotal() const { return recv_bytes_total; };
+        inline float GetRoundTripTime() const { return pool->srtt[peer]; };
+        
+        inline float GetRoundTripTimeVariance() const { return pool->rttvar[peer]; };
+        
+        inline float GetMinRoundTripTime() const { return pool->min_rtt[peer]; };
+        
+        inline float GetRetransmitTimeout() const { return pool->rto[peer]; };
+        
+        inline int GetSentTotal() const { return pool->sent_bytes_total[peer]; };
+        
+        inline int GetReceivedTotal() const { return pool->recv_bytes_total[peer]; };
+        
+        inline int GetAckedTotal() const { return pool->acked_bytes_total[peer]; };
         
         inline int GetHeaderSize() const { return 12; };
         
-    protected:
+        // round trip time
         
-        void AdvanceQueueTime( float deltaTime );
+        inline void SetMinRetransmitTimeout( float timeout ) { assert( timeout > 0.0f ); pool->rto_minimum[peer] = timeout; };
         
-        void UpdateQueues();
+        inline float GetMinRetransmitTimeout() const { return pool->rto_minimum[peer]; };
         
-        void UpdateStats();
+        inline void SetMinRoundTripTimeWindow( float window ) { pool->min_rtt_window[peer] = window; };
         
-    private:
+        inline float GetMinRoundTripTimeWindow() const { return pool->min_rtt_window[peer]; };
+        
+        // loss detection
         
-        unsigned int max_sequence;			// maximum sequence value before wrap around (used to test sequence wrap at low # values)
-        unsigned int local_sequence;		// local sequence number for most recently sent packet
-        unsigned int remote_sequence;		// remote sequence number for most recently received packet
+        inline void SetPacketLostCallback( PacketLostCallback callback, void * context ) {
+            pool->packet_lost_callback[peer] = callback;
+            pool->packet_lost_context[peer] = context;
+        };
+        
+        inline void SetLossPacketThreshold( unsigned int threshold ) { assert( threshold >= 1 ); pool->loss_packet_threshold[peer] = threshold; };
+        
+        inline unsigned int GetLossPacketThreshold() const { return pool->loss_packet_threshold[peer]; };
+        
+        inline void SetLossTimeThreshold( float threshold ) { assert( threshold >= 1.0f ); pool->loss_time_threshold[peer] = threshold; };
+        
+        inline float GetLossTimeThreshold() const { return pool->loss_time_threshold[peer]; };
+        
+        // stats, the window is shared by every peer in the pool
+        
+        inline void SetStatsWindow( float window ) { pool->SetStatsWindow( window ); };
+        
+        inline float GetStatsWindow() const { return pool->GetStatsWindow(); };
+        
+        // ack scheduling
+        
+        inline void SetAckDelay( float delay ) { pool->ack_delay[peer] = delay; };
+        
+        inline float GetAckDelay() const { return pool->ack_delay[peer]; };
+        
+        inline void SetMaxUnackedPackets( int count ) { assert( count >= 1 && count <= 32 ); pool->max_unacked_packets[peer] = count; };
+        
+        inline int GetMaxUnackedPackets() const { return pool->max_unacked_packets[peer]; };
+        
+        inline int GetUnackedPackets() const { return pool->unacked_packets[peer]; };
+        
+        static const int PacketBufferSize = Pool::PacketBufferSize;   // sent and received packets tracked (fewer if max_sequence is smaller)
+        
+    private:
         
-        unsigned int sent_packets;			// total number of packets sent
-        unsigned int recv_packets;			// total number of packets received
-        unsigned int lost_packets;			// total number of packets lost
-        unsigned int acked_packets;			// total number of packets acked
+        friend class BasicReliabilityPool<Sequence>;
         
-        float sent_bandwidth;				// approximate sent bandwidth over the last second
-        float acked_bandwidth;				// approximate acked bandwidth over the last second
-        float rtt;							// estimated round trip time
-        float rtt_maximum;					// maximum expected round trip time (hard coded to one second for the moment)
-        int sent_bytes_total;               // total bandwidth sent
-        int recv_bytes_total;               // total bandwidth received
+        BasicReliabilitySystem( Pool & pool, int peer );
         
-        std::vector<unsigned int> acks;		// acked packets from last set of packet receives. cleared each update!
+        // not copyable, a standalone system owns its pool
+        BasicReliabilitySystem( const BasicReliabilitySystem & other );
+        BasicReliabilitySystem & operator = ( const BasicReliabilitySystem & other );
         
-        PacketQueue sentQueue;              // sent packets used to calculate sent bandwidth (kept until rtt_maximum)
-        PacketQueue pendingAckQueue;		// sent packets which have not been acked yet (kept until rtt_maximum * 2 )
-        PacketQueue receivedQueue;          // received packets for determining acks to send (kept up to most recent recv sequence - 32)
-        PacketQueue ackedQueue;             // acked packets (kept until rtt_maximum * 2)
+        Pool * pool;                        // pool holding the state
+        int peer;                           // slot in the pool
+        bool owns_pool;                     // true if the pool was created for this system alone
     };
+    
+    typedef BasicReliabilitySystem<SequenceRuntime> ReliabilitySystem;
+    typedef BasicReliabilitySystem<Sequence16> ReliabilitySystem16;
+    typedef BasicReliabilitySystem<Sequence32> ReliabilitySystem32;
 }
 
 #endif
@@ -3,18 +3,28 @@
 
 #include "Connection.h"
 #include "ReliabilitySystem.h"
+#include "FlowControl.h"
 
 // connection with reliability (seq/ack)
+//  + acks are piggybacked on outgoing packets, when the application goes quiet
+//    a header only "ack packet" is sent instead once the ack delay expires
+//  + OnPacketLost is called as soon as the reliability system declares a sent packet lost
+//  + flow control (aimd by default) is fed sent, acked and lost packets and the rtt,
+//    GetFlowControl().GetSendRate() is how fast the application should send
+//  + ReliableConnection wraps sequences at 32 bits like the header it sends,
+//    ReliableConnectionRuntime takes max_sequence at runtime so tests can wrap at small values
 
 namespace Net
 {
-    class ReliableConnection : public Connection
+    template <typename Sequence> class BasicReliableConnection : public Connection
     {
     public:
         
-        ReliableConnection( unsigned int protocolId, float timeout, unsigned int max_sequence = 0xFFFFFFFF );
+        typedef BasicReliabilitySystem<Sequence> Reliability;
         
-        ~ReliableConnection();
+        BasicReliableConnection( unsigned int protocolId, float timeout, unsigned int max_sequence = Sequence::DefaultMaxSequence );
+        
+        ~BasicReliableConnection();
         
         // overriden functions from "Connection"
         
@@ -26,8 +36,10 @@ namespace Net
         
         int GetHeaderSize() const;
         
-        ReliabilitySystem & GetReliabilitySystem() { return reliabilitySystem; }
-
+        Reliability & GetReliabilitySystem() { return reliabilitySystem; }
+        
+        FlowControl & GetFlowControl() { return flowControl; }
+        
     protected:
         
         void WriteInteger( unsigned char * data, unsigned int value );
@@ -38,17 +50,27 @@ namespace Net
         
         void ReadHeader( const unsigned char * header, unsigned int & sequence, unsigned int & ack, unsigned int & ack_bits );
         
+        bool SendAckPacket();
+        
         virtual void OnStop();
         
         virtual void OnDisconnect();
         
+        virtual void OnPacketLost( unsigned int /*sequence*/ ) {}
+        
     private:
         
         void ClearData();
         
-        ReliabilitySystem reliabilitySystem;	// reliability system: manages sequence numbers and acks, tracks network stats etc.
+        static void PacketLost( void * context, unsigned int sequence, int size );
+        
+        Reliability reliabilitySystem;          // reliability system: manages sequence numbers and acks, tracks network stats etc.
+        FlowControl flowControl;                // flow control: send budget from loss and rtt
+        int ackedTotal;                         // acked bytes already passed on to flow control
     };
-
+    
+    typedef BasicReliableConnection<Sequence32> ReliableConnection;
+    typedef BasicReliableConnection<SequenceRuntime> ReliableConnectionRuntime;
 }
 
 #endif /* ReliableConnection_h */
@@ -0,0 +1,59 @@
+#ifndef NET_SEND_ACCUMULATOR_H
+#define NET_SEND_ACCUMULATOR_H
+
+#include <assert.h>
+
+namespace Net
+{
+    // send accumulator for things sent at a fixed interval (keep alives, beacons)
+    //  + add the time each update, it says how many sends are due
+    //  + no catch up policy (the default): after a stall only one send is due, the missed ones are
+    //    dropped instead of going out back to back in one burst. the phase of the interval is kept
+    //  + catch up policy: every missed send is due, for when the count of sends matters
+    
+    class SendAccumulator
+    {
+    public:
+        
+        enum Policy
+        {
+            NoCatchUp,
+            CatchUp
+        };
+        
+        SendAccumulator( float interval = 1.0f, Policy policy = NoCatchUp ) : interval( interval ), policy( policy )
+        {
+            assert( interval > 0.0f );
+            Reset();
+        }
+        
+        // start part way into the interval, an accumulator of interval sends on the first update
+        inline void Reset( float accumulator = 0.0f ) { this->accumulator = accumulator; };
+        
+        int Update( float deltaTime )
+        {
+            accumulator += deltaTime;
+            if ( accumulator < interval )
+                return 0;
+            const int due = (int) ( accumulator / interval );
+            accumulator -= due * interval;
+            return policy == CatchUp ? due : 1;
+        }
+        
+        inline void SetInterval( float interval ) { assert( interval > 0.0f ); this->interval = interval; };
+        
+        inline float GetInterval() const { return interval; };
+        
+        inline void SetPolicy( Policy policy ) { this->policy = policy; };
+        
+        inline Policy GetPolicy() const { return policy; };
+        
+    private:
+        
+        float interval;             // seconds between sends
+        Policy policy;
+        float accumulator;          // time since the last send was due
+    };
+}
+
+#endif
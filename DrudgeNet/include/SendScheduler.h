@@ -0,0 +1,122 @@
+#ifndef NET_SEND_SCHEDULER_H
+#define NET_SEND_SCHEDULER_H
+
+#include "RateEstimator.h"
+#include <vector>
+#include <deque>
+
+namespace Net
+{
+    // send scheduler, shares one uplink bandwidth budget between every peer
+    //  + datagrams are queued per peer and per priority, Update releases as many as the budget allows
+    //  + weighted fair queuing across peers: each peer's next packet gets a virtual finish time of
+    //    its size over the peer's weight, the earliest goes first. backlogged peers get bandwidth in
+    //    proportion to their weights and a light peer never waits behind a heavy one
+    //  + strict priority within a peer, high before normal before low
+    //  + once the budget runs out, queued packets at the drop priority or below are dropped (stale
+    //    unreliable data isn't worth sending late), the rest are deferred to the next update
+    //  + zero bandwidth is unlimited, everything goes out each update in fair queuing order
+    //  + per peer send rate and usage of its fair share of the budget, for monitoring
+    
+    class SendScheduler
+    {
+    public:
+        
+        enum Priority
+        {
+            High,
+            Normal,
+            Low,
+            PriorityCount
+        };
+        
+        typedef bool (*SendFunction)( void * context, int peer, const unsigned char data[], int size );
+        
+        SendScheduler( float bandwidth = 0.0f );
+        
+        void SetSendFunction( SendFunction function, void * context );
+        
+        // bytes per second for all peers together, zero for no limit
+        void SetBandwidth( float bandwidth );
+        
+        inline float GetBandwidth() const { return bandwidth; };
+        
+        // most budget that builds up while there is nothing to send
+        inline void SetBurst( float burst ) { burst_size = burst; };
+        
+        inline float GetBurst() const { return burst_size; };
+        
+        void SetWeight( int peer, float weight );
+        
+        inline float GetWeight( int peer ) const { return peer < (int) peers.size() ? peers[peer].weight : 1.0f; };
+        
+        inline void SetDropPriority( Priority priority ) { drop_priority = priority; };
+        
+        inline Priority GetDropPriority() const { return drop_priority; };
+        
+        inline void SetMaxQueuedBytes( int bytes ) { max_queued_bytes = bytes; };
+        
+        // queues a datagram for the peer, false if the peer's queue is full
+        bool Enqueue( int peer, const unsigned char data[], int size, Priority priority = Normal );
+        
+        void Update( float deltaTime );
+        
+        void Clear();
+        
+        void Clear( int peer );
+        
+        // monitoring
+        
+        inline int GetQueuedBytes( int peer ) const { return peer < (int) peers.size() ? peers[peer].queued_bytes : 0; };
+        
+        int GetQueuedPackets( int peer ) const;
+        
+        // bytes per second released to the peer
+        inline float GetSendRate( int peer ) const { return peer < (int) peers.size() ? peers[peer].send_rate.GetRate() : 0.0f; };
+        
+        // bytes per second the peer is due by weight, out of the peers that had something to send
+        float GetBudget( int peer ) const;
+        
+        // send rate over budget, zero when the bandwidth is unlimited
+        float GetUsage( int peer ) const;
+        
+        inline unsigned int GetDroppedPackets( int peer ) const { return peer < (int) peers.size() ? peers[peer].dropped_packets : 0; };
+        
+    private:
+        
+        struct PeerState
+        {
+            float weight;
+            double finish;                      // virtual finish time of the last packet released
+            int queued_bytes;
+            bool active;                        // had packets queued during the last update
+            unsigned int dropped_packets;
+            RateEstimator send_rate;
+            std::deque< std::vector<unsigned char> > queues[PriorityCount];
+            PeerState()
+            {
+                weight = 1.0f;
+                finish = 0.0;
+                queued_bytes = 0;
+                active = false;
+                dropped_packets = 0;
+            }
+        };
+        
+        PeerState & GetPeer( int peer );
+        
+        std::deque< std::vector<unsigned char> > * GetNextQueue( PeerState & state );
+        
+        float bandwidth;
+        float burst_size;
+        float tokens;                           // bytes that may be released now
+        double virtual_time;                    // start time of the last packet released
+        Priority drop_priority;
+        int max_queued_bytes;                   // per peer
+        SendFunction send_function;
+        void * send_context;
+        std::vector<PeerState> peers;
+    };
+}
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef NET_SEQUENCE_H
+#define NET_SEQUENCE_H
+
+#include <cstdint>
+#include <assert.h>
+
+namespace Net
+{
+    // sequence number arithmetic policies for the reliability system
+    //  + SequenceWidth wraps at the natural width of an unsigned type: comparisons are a
+    //    subtract and a signed test, all constexpr so they inline down to one or two instructions
+    //  + SequenceRuntime wraps at any max_sequence chosen at runtime, so tests can exercise
+    //    wrap around with small numbers. it pays for that with general modular arithmetic
+    //  + "more recent" means less than half the sequence space ahead, with wrap around
+    
+    template <typename T, typename SignedT> struct SequenceWidth
+    {
+        typedef T Type;
+        
+        static const unsigned int DefaultMaxSequence = (T) ~(T) 0;
+        
+        SequenceWidth( unsigned int max_sequence = DefaultMaxSequence )
+        {
+            assert( max_sequence == DefaultMaxSequence );
+        }
+        
+        static constexpr unsigned int GetMax() { return (T) ~(T) 0; }
+        
+        // s1 is ahead of s2
+        static constexpr bool IsMoreRecent( T s1, T s2 ) { return (SignedT) (T) ( s1 - s2 ) > 0; }
+        
+        // distance from s2 forward to s1
+        static constexpr T Difference( T s1, T s2 ) { return (T) ( s1 - s2 ); }
+        
+        static constexpr T Next( T s ) { return (T) ( s + 1 ); }
+        
+        // n sequences before s
+        static constexpr T Previous( T s, unsigned int n ) { return (T) ( s - n ); }
+    };
+    
+    typedef SequenceWidth<uint16_t,int16_t> Sequence16;
+    typedef SequenceWidth<uint32_t,int32_t> Sequence32;
+    
+    struct SequenceRuntime
+    {
+        typedef unsigned int Type;
+        
+        static const unsigned int DefaultMaxSequence = 0xFFFFFFFF;
+        
+        SequenceRuntime( unsigned int max_sequence = DefaultMaxSequence ) : max_sequence( max_sequence ) {}
+        
+        inline unsigned int GetMax() const { return max_sequence; }
+        
+        inline bool IsMoreRecent( unsigned int s1, unsigned int s2 ) const
+        {
+            return (( s1 > s2 ) && ( s1 - s2 <= max_sequence/2 )) || ((( s2 > s1 ) && ( s2 - s1 > max_sequence/2 )));
+        }
+        
+        inline unsigned int Difference( unsigned int s1, unsigned int s2 ) const
+        {
+            if ( s1 >= s2 )
+                return s1 - s2;
+            return s1 + ( max_sequence - s2 ) + 1;
+        }
+        
+        inline unsigned int Next( unsigned int s ) const { return s == max_sequence ? 0 : s + 1; }
+        
+        inline unsigned int Previous( unsigned int s, unsigned int n ) const { return s >= n ? s - n : max_sequence - ( n - s ) + 1; }
+        
+        unsigned int max_sequence;          // maximum sequence value before wrap around
+    };
+}
+
+#endif /* NET_SEQUENCE_H */
@@ -0,0 +1,100 @@
+#ifndef NET_SEQUENCE_BUFFER_H
+#define NET_SEQUENCE_BUFFER_H
+
+#include <vector>
+#include <assert.h>
+#include <stddef.h>
+
+namespace Net
+{
+    // sequence buffer to store per packet data indexed by sequence number
+    //  + fixed size ring buffer allocated once, entry for a sequence lives at index sequence % size
+    //  + every slot is tagged with the sequence stored in it, so insert, lookup and
+    //    duplicate checks are all O(1) and never allocate
+    //  + inserting a sequence overwrites whatever older sequence shared its slot
+    
+    template <typename T> class SequenceBuffer
+    {
+    public:
+        
+        SequenceBuffer( int size ) : entries( size ), sequences( size ), valid( size )
+        {
+            assert( size > 0 );
+            Reset();
+        }
+        
+        void Reset()
+        {
+            for ( size_t i = 0; i < valid.size(); ++i )
+                valid[i] = 0;
+        }
+        
+        T * Insert( unsigned int sequence )
+        {
+            const int index = GetIndex( sequence );
+            sequences[index] = sequence;
+            valid[index] = 1;
+            entries[index] = T();
+            return &entries[index];
+        }
+        
+        void Remove( unsigned int sequence )
+        {
+            const int index = GetIndex( sequence );
+            if ( valid[index] && sequences[index] == sequence )
+                valid[index] = 0;
+        }
+        
+        bool Exists( unsigned int sequence ) const
+        {
+            const int index = GetIndex( sequence );
+            return valid[index] && sequences[index] == sequence;
+        }
+        
+        T * Find( unsigned int sequence )
+        {
+            const int index = GetIndex( sequence );
+            return ( valid[index] && sequences[index] == sequence ) ? &entries[index] : NULL;
+        }
+        
+        const T * Find( unsigned int sequence ) const
+        {
+            const int index = GetIndex( sequence );
+            return ( valid[index] && sequences[index] == sequence ) ? &entries[index] : NULL;
+        }
+        
+        T * GetAtIndex( int index )
+        {
+            assert( index >= 0 );
+            assert( index < GetSize() );
+            return valid[index] ? &entries[index] : NULL;
+        }
+        
+        const T * GetAtIndex( int index ) const
+        {
+            assert( index >= 0 );
+            assert( index < GetSize() );
+            return valid[index] ? &entries[index] : NULL;
+        }
+        
+        unsigned int GetSequenceAtIndex( int index ) const
+        {
+            assert( index >= 0 );
+            assert( index < GetSize() );
+            assert( valid[index] );
+            return sequences[index];
+        }
+        
+        inline int GetIndex( unsigned int sequence ) const { return (int) ( sequence % sequences.size() ); }
+        
+        inline int GetSize() const { return (int) sequences.size(); }
+        
+    private:
+        
+        std::vector<T> entries;                 // per packet data, contiguous
+        std::vector<unsigned int> sequences;    // sequence stored in each slot
+        std::vector<unsigned char> valid;       // non-zero if the slot holds an entry
+    };
+}
+
+#endif /* NET_SEQUENCE_BUFFER_H */
@@ -0,0 +1,141 @@
+#ifndef NET_SERIALIZE_COMPRESSED_H
+#define NET_SERIALIZE_COMPRESSED_H
+
+#include "StaticStream.h"
+#include <math.h>
+
+namespace Net
+{
+    // compressed serialization for physics state, works with Stream and the static streams
+    //  + floats quantized to a resolution within a range, written values outside it are clamped.
+    //    a value reads back within half the resolution
+    //  + bounded vectors, the same range and resolution for each component
+    //  + velocities with an at rest flag: a vector that would read back as zero costs one bit
+    //  + quaternions as the smallest three components, the largest is rebuilt from unit length.
+    //    2 bits for the index plus bits per component
+    
+    // number of steps a range is split into, the bits sent are enough for steps + 1 values
+    inline unsigned int CompressedFloatSteps( float min, float max, float resolution )
+    {
+        assert( max > min );
+        assert( resolution > 0.0f );
+        const float steps = ceilf( ( max - min ) / resolution );
+        assert( steps < 4294967295.0f );
+        return steps < 1.0f ? 1 : (unsigned int) steps;
+    }
+    
+    // step in [0,steps] nearest to the value, clamped to the range
+    inline unsigned int QuantizeFloat( float value, float min, float max, unsigned int steps )
+    {
+        float normalized = ( value - min ) / ( max - min );
+        normalized = normalized < 0.0f ? 0.0f : normalized > 1.0f ? 1.0f : normalized;
+        return (unsigned int) floor( normalized * steps + 0.5 );
+    }
+    
+    // quantizing the result gives the same step back
+    inline float DequantizeFloat( unsigned int integer, float min, float max, unsigned int steps )
+    {
+        return min + (float) ( (double) integer / steps * ( max - min ) );
+    }
+    
+    template <typename StreamType>
+    bool SerializeCompressedFloat( StreamType & stream, float & value, float min, float max, float resolution )
+    {
+        const unsigned int steps = CompressedFloatSteps( min, max, resolution );
+        const int bits = BitsRequired( 0, steps );
+        unsigned int integer = 0;
+        if ( !stream.IsReading() )
+            integer = QuantizeFloat( value, min, max, steps );
+        if ( !stream.SerializeBits( integer, bits ) )
+            return false;
+        if ( stream.IsReading() )
+        {
+            if ( integer > steps )
+                return false;
+            value = DequantizeFloat( integer, min, max, steps );
+        }
+        return true;
+    }
+    
+    template <typename StreamType>
+    bool SerializeCompressedVector( StreamType & stream, float vector[3], float min, float max, float resolution )
+    {
+        for ( int i = 0; i < 3; ++i )
+        {
+            if ( !SerializeCompressedFloat( stream, vector[i], min, max, resolution ) )
+                return false;
+        }
+        return true;
+    }
+    
+    // components in [-max,max]
+    template <typename StreamType>
+    bool SerializeVelocity( StreamType & stream, float velocity[3], float max, float resolution )
+    {
+        bool at_rest = false;
+        if ( !stream.IsReading() )
+            at_rest = fabsf( velocity[0] ) < resolution * 0.5f && fabsf( velocity[1] ) < resolution * 0.5f && fabsf( velocity[2] ) < resolution * 0.5f;
+        if ( !stream.SerializeBoolean( at_rest ) )
+            return false;
+        if ( at_rest )
+        {
+            if ( stream.IsReading() )
+                velocity[0] = velocity[1] = velocity[2] = 0.0f;
+            return true;
+        }
+        return SerializeCompressedVector( stream, velocity, -max, max, resolution );
+    }
+    
+    // x, y, z, w. unit length, q and -q are the same rotation so either may read back
+    template <typename StreamType>
+    bool SerializeQuaternion( StreamType & stream, float quaternion[4], int bits )
+    {
+        assert( bits >= 2 );
+        assert( bits <= 16 );
+        // the three smaller components are within +/- 1/sqrt(2)
+        const float Bound = 0.70710678f;
+        const unsigned int steps = ( 1u << bits ) - 1;
+        unsigned int largest = 0;
+        unsigned int integers[3] = { 0, 0, 0 };
+        if ( !stream.IsReading() )
+        {
+            for ( int i = 1; i < 4; ++i )
+            {
+                if ( fabsf( quaternion[i] ) > fabsf( quaternion[largest] ) )
+                    largest = i;
+            }
+            // send the rotation with a positive largest component, its sign is then implied
+            const float sign = quaternion[largest] < 0.0f ? -1.0f : 1.0f;
+            for ( int i = 0, j = 0; i < 4; ++i )
+            {
+                if ( i == (int) largest )
+                    continue;
+                float normalized = ( quaternion[i] * sign + Bound ) / ( 2.0f * Bound );
+                normalized = normalized < 0.0f ? 0.0f : normalized > 1.0f ? 1.0f : normalized;
+                integers[j++] = (unsigned int) floor( normalized * steps + 0.5 );
+            }
+        }
+        if ( !stream.SerializeBits( largest, 2 ) )
+            return false;
+        for ( int j = 0; j < 3; ++j )
+        {
+            if ( !stream.SerializeBits( integers[j], bits ) )
+                return false;
+        }
+        if ( stream.IsReading() )
+        {
+            float sum = 0.0f;
+            for ( int i = 0, j = 0; i < 4; ++i )
+            {
+                if ( i == (int) largest )
+                    continue;
+                quaternion[i] = (float) integers[j++] / steps * ( 2.0f * Bound ) - Bound;
+                sum += quaternion[i] * quaternion[i];
+            }
+            quaternion[largest] = sum < 1.0f ? sqrtf( 1.0f - sum ) : 0.0f;
+        }
+        return true;
+    }
+}
+
+#endif /* NET_SERIALIZE_COMPRESSED_H */
@@ -0,0 +1,150 @@
+#ifndef NET_SERIALIZE_VARINT_H
+#define NET_SERIALIZE_VARINT_H
+
+#include "StaticStream.h"
+
+namespace Net
+{
+    // variable length integers, works with Stream and the static streams
+    //  + varints as in LEB128: 7 bits a group and a bit saying another group follows, so a value
+    //    costs 8 bits per 7 significant bits. 32 bit values take 8 to 40 bits, 64 bit up to 80
+    //  + signed values are zigzag encoded first, small negatives are as cheap as small positives
+    //  + relative integers send the difference from a previous value both sides have, in tiers
+    //    of growing size picked with a unary prefix. a value near the previous costs 3 bits, any
+    //    other value at most 37
+    //  + a reader rejects encodings too long for the type (5 groups for 32 bits, 10 for 64), with
+    //    bits past its width, or ending in a zero group that could have been left off
+    
+    inline constexpr uint32_t ZigZagEncode( int32_t value ) { return ( (uint32_t) value << 1 ) ^ (uint32_t) ( value >> 31 ); }
+    
+    inline constexpr int32_t ZigZagDecode( uint32_t value ) { return (int32_t) ( value >> 1 ) ^ -(int32_t) ( value & 1 ); }
+    
+    inline constexpr uint64_t ZigZagEncode( int64_t value ) { return ( (uint64_t) value << 1 ) ^ (uint64_t) ( value >> 63 ); }
+    
+    inline constexpr int64_t ZigZagDecode( uint64_t value ) { return (int64_t) ( value >> 1 ) ^ -(int64_t) ( value & 1 ); }
+    
+    // the groups of a varint for a type bits wide: at most 5 groups for 32 bits, 10 for 64
+    template <typename StreamType>
+    bool SerializeVarintGroups( StreamType & stream, uint64_t & value, int bits )
+    {
+        assert( bits == 32 || bits == 64 );
+        uint64_t remaining = value;
+        uint64_t result = 0;
+        for ( int shift = 0; shift < bits; shift += 7 )
+        {
+            unsigned int group = 0;
+            if ( !stream.IsReading() )
+            {
+                group = (unsigned int) ( remaining & 0x7F );
+                remaining >>= 7;
+                if ( remaining )
+                    group |= 0x80;
+            }
+            if ( !stream.SerializeBits( group, 8 ) )
+                return false;
+            if ( stream.IsReading() )
+            {
+                // the last group a type has room for holds its top bits only
+                if ( bits - shift < 7 && ( group & 0x7F ) >> ( bits - shift ) )
+                    return false;
+                result |= (uint64_t) ( group & 0x7F ) << shift;
+            }
+            if ( !( group & 0x80 ) )
+            {
+                // a zero group past the first could have been left off, only one encoding reads
+                if ( stream.IsReading() && shift > 0 && group == 0 )
+                    return false;
+                if ( stream.IsReading() )
+                    value = result;
+                return true;
+            }
+        }
+        return false;
+    }
+    
+    template <typename StreamType>
+    bool SerializeVarint( StreamType & stream, uint64_t & value )
+    {
+        return SerializeVarintGroups( stream, value, 64 );
+    }
+    
+    template <typename StreamType>
+    bool SerializeVarint( StreamType & stream, uint32_t & value )
+    {
+        uint64_t wide = value;
+        if ( !SerializeVarintGroups( stream, wide, 32 ) )
+            return false;
+        value = (uint32_t) wide;
+        return true;
+    }
+    
+    template <typename StreamType>
+    bool SerializeVarint( StreamType & stream, int64_t & value )
+    {
+        uint64_t encoded = ZigZagEncode( value );
+        if ( !SerializeVarint( stream, encoded ) )
+            return false;
+        value = ZigZagDecode( encoded );
+        return true;
+    }
+    
+    template <typename StreamType>
+    bool SerializeVarint( StreamType & stream, int32_t & value )
+    {
+        uint32_t encoded = ZigZagEncode( value );
+        if ( !SerializeVarint( stream, encoded ) )
+            return false;
+        value = ZigZagDecode( encoded );
+        return true;
+    }
+    
+    // difference from previous, wrapping, so every value can be sent whatever the previous.
+    // for sequences, ids in sorted order, timers, positions on a grid
+    template <typename StreamType>
+    bool SerializeRelativeInteger( StreamType & stream, uint32_t & value, uint32_t previous )
+    {
+        // tier widths for the zigzagged difference, each tier starts where the last one ended
+        static const int TierBits[] = { 2, 4, 8, 12, 16, 32 };
+        const int TierCount = sizeof( TierBits ) / sizeof( TierBits[0] );
+        uint32_t difference = 0;
+        if ( !stream.IsReading() )
+            difference = ZigZagEncode( (int32_t) ( value - previous ) );
+        uint32_t base = 0;
+        for ( int tier = 0; tier < TierCount; ++tier )
+        {
+            const int bits = TierBits[tier];
+            const uint64_t size = (uint64_t) 1 << bits;
+            // the last tier needs no flag, and with 32 bits it holds any difference as it is
+            const bool last = tier == TierCount - 1;
+            bool in_tier = last || (uint64_t) difference - base < size;
+            if ( !last && !stream.SerializeBoolean( in_tier ) )
+                return false;
+            if ( !in_tier )
+            {
+                base += (uint32_t) size;
+                continue;
+            }
+            if ( last )
+                base = 0;
+            unsigned int offset = difference - base;
+            if ( !stream.SerializeBits( offset, bits ) )
+                return false;
+            if ( stream.IsReading() )
+                value = previous + (uint32_t) ZigZagDecode( base + offset );
+            return true;
+        }
+        return false;
+    }
+    
+    template <typename StreamType>
+    bool SerializeRelativeInteger( StreamType & stream, int32_t & value, int32_t previous )
+    {
+        uint32_t unsigned_value = (uint32_t) value;
+        if ( !SerializeRelativeInteger( stream, unsigned_value, (uint32_t) previous ) )
+            return false;
+        value = (int32_t) unsigned_value;
+        return true;
+    }
+}
+
+#endif /* NET_SERIALIZE_VARINT_H */
@@ -0,0 +1,324 @@
+#ifndef NET_STATIC_STREAM_H
+#define NET_STATIC_STREAM_H
+
+#include "Stream.h"
+#include "StreamJournal.h"
+#include <assert.h>
+#include <string.h>
+
+namespace Net
+{
+    // bits needed for a value in [minimum,maximum], the same count as Stream::BitsRequired.
+    // constexpr, a constant range costs nothing at run time
+    
+    constexpr int BitsRequiredForMaximum( unsigned int maximum )
+    {
+        return maximum <= 1 ? 1 : 1 + BitsRequiredForMaximum( maximum >> 1 );
+    }
+    
+    constexpr int BitsRequired( unsigned int minimum, unsigned int maximum )
+    {
+        return maximum - minimum >= 0x7FFFFFF ? 32 : BitsRequiredForMaximum( maximum - minimum );
+    }
+    
+    // static stream, a stream with its mode fixed at compile time
+    //  + same serialize calls as Stream, so a serialize function written as a template on the
+    //    stream type works with either. the same bits go on the wire
+    //  + mode checks are constants and fold away, with everything inline a serialize function
+    //    compiles down to the bitpacker's shifts and ors
+    //  + the journal is a policy: DebugJournal names the field and line of a desync, NoJournal
+    //    compiles out. the typedefs use DefaultJournal, debug in debug builds and none in release
+    //  + use the ReadStream, WriteStream and MeasureStream typedefs
+    
+    template <Stream::Mode StreamMode, typename Journal = DefaultJournal>
+    class StaticStream
+    {
+    public:
+        
+        // buffer can be NULL when measuring, measuring never journals
+        StaticStream( void * buffer, int bytes, void * journal_buffer = NULL, int journal_bytes = 0 )
+        : bitpacker( StreamMode == Stream::Read ? BitPacker::Read : BitPacker::Write, StreamMode == Stream::Measure ? NULL : buffer, StreamMode == Stream::Measure ? 0 : bytes ),
+        journal( StreamMode == Stream::Read ? BitPacker::Read : BitPacker::Write, StreamMode == Stream::Measure ? NULL : journal_buffer, StreamMode == Stream::Measure ? 0 : journal_bytes )
+        {
+            assert( bytes >= 0 );
+            measured_bits = 0;
+            measure_bytes = StreamMode == Stream::Measure ? bytes : 0;
+        }
+        
+        inline bool IsReading() const { return StreamMode == Stream::Read; };
+        
+        inline bool IsWriting() const { return StreamMode == Stream::Write; };
+        
+        inline bool IsMeasuring() const { return StreamMode == Stream::Measure; };
+        
+        // names the field the next serialize calls are for, see NET_SERIALIZE
+        inline void Field( const char * name, const char * file, int line ) { journal.Field( name, file, line ); };
+        
+        bool SerializeBoolean( bool & value )
+        {
+            unsigned int tmp = value ? 1 : 0;
+            if ( !SerializeBits( tmp, 1 ) )
+                return false;
+            value = tmp != 0;
+            return true;
+        }
+        
+        bool SerializeByte( char & value, char min = -128, char max = 127 ) { return SerializeRange( value, min, max ); }
+        
+        bool SerializeByte( signed char & value, signed char min = -128, signed char max = 127 ) { return SerializeRange( value, min, max ); }
+        
+        bool SerializeByte( unsigned char & value, unsigned char min = 0, unsigned char max = 0xFF ) { return SerializeRange( value, min, max ); }
+        
+        bool SerializeShort( signed short & value, signed short min = -32768, signed short max = 32767 ) { return SerializeRange( value, min, max ); }
+        
+        bool SerializeShort( unsigned short & value, unsigned short min = 0, unsigned short max = 0xFFFF ) { return SerializeRange( value, min, max ); }
+        
+        bool SerializeInteger( signed int & value, signed int min = -2147483647 - 1, signed int max = 2147483647 ) { return SerializeRange( value, min, max ); }
+        
+        bool SerializeInteger( unsigned int & value, unsigned int min = 0, unsigned int max = 0xFFFFFFFF )
+        {
+            assert( min < max );
+            if ( !IsReading() )
+            {
+                assert( value >= min );
+                assert( value <= max );
+            }
+            unsigned int bits = value - min;
+            if ( !SerializeBits( bits, BitsRequired( min, max ) ) )
+                return false;
+            if ( IsReading() )
+                value = bits + min;
+            return true;
+        }
+        
+        bool SerializeFloat( float & value )
+        {
+            unsigned int bits = 0;
+            if ( !IsReading() )
+                memcpy( &bits, &value, 4 );
+            if ( !SerializeBits( bits, 32 ) )
+                return false;
+            if ( IsReading() )
+                memcpy( &value, &bits, 4 );
+            return true;
+        }
+        
+        bool SerializeDouble( double & value )
+        {
+            uint64_t bits = 0;
+            if ( !IsReading() )
+                memcpy( &bits, &value, 8 );
+            if ( !SerializeBits( bits, 64 ) )
+                return false;
+            if ( IsReading() )
+                memcpy( &value, &bits, 8 );
+            return true;
+        }
+        
+        bool SerializeBits( unsigned int & value, int bits )
+        {
+            assert( bits >= 1 );
+            assert( bits <= 32 );
+            if ( GetBitsRemaining() < bits )
+                return false;
+            if ( !IsMeasuring() && !journal.Bits( bits ) )
+                return false;
+            Process( value, bits );
+            return true;
+        }
+        
+        bool SerializeBits( uint64_t & value, int bits )
+        {
+            assert( bits >= 1 );
+            assert( bits <= 64 );
+            if ( GetBitsRemaining() < bits )
+                return false;
+            if ( !IsMeasuring() && !journal.Bits( bits ) )
+                return false;
+            Process( value, bits );
+            return true;
+        }
+        
+        // count values of the same width in one call, see Stream::SerializeArray
+        bool SerializeArray( unsigned int values[], int count, int bits )
+        {
+            assert( bits >= 1 );
+            assert( bits <= 32 );
+            assert( count >= 0 );
+            if ( GetBitsRemaining() < count * bits )
+                return false;
+            if ( IsMeasuring() )
+            {
+                measured_bits += count * bits;
+                return true;
+            }
+            // an entry per value, compiles out with NoJournal
+            for ( int i = 0; i < count; ++i )
+            {
+                if ( !journal.Bits( bits ) )
+                    return false;
+            }
+            if ( IsReading() )
+                bitpacker.ReadArray( values, count, bits );
+            else
+                bitpacker.WriteArray( values, count, bits );
+            return true;
+        }
+        
+        // see Stream::SerializeAlign, SerializeBytes and SerializeString
+        bool SerializeAlign()
+        {
+            const int bits = GetAlignBits();
+            if ( GetBitsRemaining() < bits )
+                return false;
+            if ( IsMeasuring() )
+                measured_bits += bits;
+            else if ( IsReading() )
+                return bitpacker.ReadAlign();
+            else
+                bitpacker.WriteAlign();
+            return true;
+        }
+        
+        inline int GetAlignBits() const { return ( 8 - GetBitsProcessed() % 8 ) % 8; };
+        
+        bool SerializeBytes( unsigned char data[], int bytes )
+        {
+            assert( bytes >= 0 );
+            if ( !SerializeAlign() )
+                return false;
+            if ( bytes > GetBitsRemaining() / 8 )
+                return false;
+            if ( IsMeasuring() )
+            {
+                measured_bits += bytes * 8;
+                return true;
+            }
+            if ( !journal.Bytes( bytes ) )
+                return false;
+            if ( IsReading() )
+                bitpacker.ReadBytes( data, bytes );
+            else
+                bitpacker.WriteBytes( data, bytes );
+            return true;
+        }
+        
+        bool SerializeString( char string[], int buffer_size )
+        {
+            assert( buffer_size >= 2 );
+            unsigned int length = 0;
+            if ( !IsReading() )
+            {
+                length = (unsigned int) strlen( string );
+                assert( length < (unsigned int) buffer_size );
+            }
+            if ( !SerializeBits( length, BitsRequired( 0, buffer_size - 1 ) ) )
+                return false;
+            if ( length >= (unsigned int) buffer_size )
+                return false;
+            if ( !SerializeBytes( (unsigned char*) string, length ) )
+                return false;
+            if ( IsReading() )
+                string[length] = '\0';
+            return true;
+        }
+        
+        bool Checkpoint()
+        {
+            if ( !IsMeasuring() && !journal.Checkpoint() )
+                return false;
+            const unsigned int magic = 0x12345678;
+            unsigned int value = magic;
+            if ( GetBitsRemaining() < 32 )
+            {
+                printf( "not enough bits remaining for checkpoint\n" );
+                return false;
+            }
+            Process( value, 32 );
+            if ( value != magic )
+            {
+                printf( "checkpoint failed!\n" );
+                return false;
+            }
+            return true;
+        }
+        
+        // writes out bits still held by the bitpacker, and ends the journal
+        inline void Flush() { if ( IsWriting() ) { bitpacker.FlushBits(); journal.Flush(); } };
+        
+        inline int GetBitsProcessed() const { return IsMeasuring() ? measured_bits : bitpacker.GetBits(); };
+        
+        inline int GetBitsRemaining() const { return IsMeasuring() ? measure_bytes * 8 - measured_bits : bitpacker.BitsRemaining(); };
+        
+        inline int GetDataBytes() const { return ( GetBitsProcessed() + 7 ) / 8; };
+        
+        inline int GetJournalBytes() const { return journal.GetBytes(); };
+        
+        // the last desync the journal caught
+        inline const char * GetJournalError() const { return journal.GetError(); };
+        
+        inline void DumpJournal() { journal.Dump(); };
+        
+    private:
+        
+        template <typename T> inline void Process( T & value, int bits )
+        {
+            if ( IsMeasuring() )
+                measured_bits += bits;
+            else if ( IsReading() )
+                bitpacker.ReadBits( value, bits );
+            else
+                bitpacker.WriteBits( value, bits );
+        }
+        
+        // any integer type, sent as its offset from min so it matches Stream on the wire
+        template <typename T> bool SerializeRange( T & value, T min, T max )
+        {
+            assert( min < max );
+            if ( !IsReading() )
+            {
+                assert( value >= min );
+                assert( value <= max );
+            }
+            unsigned int bits = (unsigned int) value - (unsigned int) min;
+            if ( !SerializeBits( bits, BitsRequired( 0, (unsigned int) max - (unsigned int) min ) ) )
+                return false;
+            if ( IsReading() )
+                value = (T) ( bits + (unsigned int) min );
+            return true;
+        }
+        
+        int measured_bits;
+        int measure_bytes;
+        BitPacker bitpacker;
+        Journal journal;
+    };
+    
+    typedef StaticStream<Stream::Read> ReadStream;
+    typedef StaticStream<Stream::Write> WriteStream;
+    typedef StaticStream<Stream::Measure> MeasureStream;
+    
+    // integer in a range known at compile time, for serialize functions templated on the stream type.
+    // the bit count is a constant whatever the stream, SerializeInteger<0,11>( stream, type )
+    
+    template <int64_t Min, int64_t Max, typename StreamType, typename T>
+    inline bool SerializeInteger( StreamType & stream, T & value )
+    {
+        static_assert( Min < Max, "empty range" );
+        static_assert( Max - Min <= 0xFFFFFFFFLL, "range needs more than 32 bits" );
+        enum { Bits = BitsRequired( 0, (unsigned int) ( Max - Min ) ) };
+        if ( !stream.IsReading() )
+        {
+            assert( (int64_t) value >= Min );
+            assert( (int64_t) value <= Max );
+        }
+        unsigned int bits = (unsigned int) ( (int64_t) value - Min );
+        if ( !stream.SerializeBits( bits, Bits ) )
+            return false;
+        if ( stream.IsReading() )
+            value = (T) ( Min + (int64_t) bits );
+        return true;
+    }
+}
+
+#endif /* NET_STATIC_STREAM_H */
@@ -2,6 +2,7 @@
 #define NET_STREAM_H
 
 #include "BitPacker.h"
+#include "StreamJournal.h"
 #include <stdio.h>
 #include <cstdint>
 
@@ -10,6 +11,14 @@ namespace Net
     // stream class
     //  + unifies read and write into a serialize operation
     //  + provides attribution of stream for debugging purposes
+    //  + the buffer holds every bit written after each call. Flush is there so code can treat
+    //    every stream alike, RangeStream needs it
+    //  + journal tokens are 7 bits (they were 6) so 64 bit widths fit, a journal written by an
+    //    older build won't read
+    //  + measure mode runs the same serialize calls but only counts bits, no buffer or journal
+    //    is touched. bytes is the budget, serialize fails once it would go over
+    //  + the signed defaults are the whole range of the type, as in the static and range coded
+    //    streams. they used to overflow (char max +128) and sent each default as 32 bits
     
     class Stream
     {
@@ -18,24 +27,26 @@ namespace Net
         enum Mode
         {
             Read,
-            Write
+            Write,
+            Measure
         };
         
+        // buffer can be NULL when measuring
         Stream( Mode mode, void * buffer, int bytes, void * journal_buffer = NULL, int journal_bytes = 0 );
         
         bool SerializeBoolean( bool & value );
         
-        bool SerializeByte( char & value, char min = -127, char max = +128 );
+        bool SerializeByte( char & value, char min = -128, char max = 127 );
         
-        bool SerializeByte( signed char & value, signed char min = -127, signed char max = +128 );
+        bool SerializeByte( signed char & value, signed char min = -128, signed char max = 127 );
         
         bool SerializeByte( unsigned char & value, unsigned char min = 0, unsigned char max = 0xFF );
         
-        bool SerializeShort( signed short & value, signed short min = -32767, signed short max = +32768 );
+        bool SerializeShort( signed short & value, signed short min = -32768, signed short max = 32767 );
         
         bool SerializeShort( unsigned short & value, unsigned short min = 0, unsigned short max = 0xFFFF );
         
-        bool SerializeInteger( signed int & value, signed int min = -2147483646, signed int max = +2147483647 );
+        bool SerializeInteger( signed int & value, signed int min = -2147483647 - 1, signed int max = 2147483647 );
         
         bool SerializeInteger( unsigned int & value, unsigned int min = 0, unsigned int max = 0xFFFFFFFF );
         
@@ -46,13 +57,37 @@ namespace Net
         bool SerializeBits( unsigned int & value, int bits );
         
         bool SerializeBits( uint64_t & value, int bits );
+        
+        // count values of the same width, the same bits as SerializeBits on each in turn.
+        // one bounds check and a SIMD kernel, a journal still gets an entry per value
+        bool SerializeArray( unsigned int values[], int count, int bits );
+        
+        // zero bits up to a byte boundary, a reader fails on anything else
+        bool SerializeAlign();
+        
+        int GetAlignBits() const;
+        
+        // aligns, then copies the block a word at a time
+        bool SerializeBytes( unsigned char data[], int bytes );
+        
+        // null terminated, at most buffer_size - 1 characters. the length goes first in just
+        // enough bits for that, a reader fails on a longer one
+        bool SerializeString( char string[], int buffer_size );
 
         bool Checkpoint();
         
+        // writes out bits still held by the bitpacker (and journal)
+        void Flush();
+        
         bool IsReading() const;
         
         bool IsWriting() const;
         
+        bool IsMeasuring() const;
+        
+        // names the field the next serialize calls are for, desync errors report it. see NET_SERIALIZE
+        void Field( const char * name, const char * file, int line );
+        
         int GetBitsProcessed() const;
         
         int GetBitsRemaining() const;
@@ -68,6 +103,16 @@ namespace Net
         void DumpJournal();
     private:
         
+        bool JournalBits( int bits );
+        
+        bool JournalBytes( int bytes );
+        
+        Mode mode;
+        int measured_bits;
+        int measure_bytes;
+        const char * field_name;
+        const char * field_file;
+        int field_line;
         BitPacker bitpacker;
         BitPacker journal;
     };
@@ -0,0 +1,229 @@
+#ifndef NET_STREAM_JOURNAL_H
+#define NET_STREAM_JOURNAL_H
+
+#include "BitPacker.h"
+#include <stdio.h>
+#include <string.h>
+
+// serialize call tagged with its field name and source location, for the debug journal.
+// NET_SERIALIZE( stream, stream.SerializeInteger( health, -100, 1000 ) ) or
+// NET_SERIALIZE( stream, SerializeInteger<0, 11>( stream, type ) )
+#define NET_SERIALIZE( stream, ... ) ( (stream).Field( #__VA_ARGS__, __FILE__, __LINE__ ), ( __VA_ARGS__ ) )
+
+namespace Net
+{
+    // journal policies for StaticStream, kept in a side buffer next to the data
+    
+    // no journal, every call is empty and compiles out
+    
+    class NoJournal
+    {
+    public:
+        
+        NoJournal( BitPacker::Mode, void *, int ) {}
+        
+        inline void Field( const char *, const char *, int ) {}
+        
+        inline bool Bits( int ) { return true; }
+        
+        inline bool Bytes( int ) { return true; }
+        
+        inline bool Checkpoint() { return true; }
+        
+        inline void Flush() {}
+        
+        inline int GetBytes() const { return 0; }
+        
+        inline const char * GetError() const { return ""; }
+        
+        inline void Dump() { printf( "no journal exists!\n" ); }
+    };
+    
+    // debug journal
+    //  + each serialize call writes an entry: bits written (or checkpoint), field name and line.
+    //    a block of bytes is one entry with its length
+    //  + the reader checks each call against the entry the writer made, a desync error names the
+    //    field and source line on both sides, and catches a field read as another of the same size
+    //  + fields are named with NET_SERIALIZE, a call that isn't tagged goes under the last name
+    //  + stops recording when its buffer is full, the reader stops checking at the same point
+    //  + a NULL buffer turns it off
+    
+    class DebugJournal
+    {
+    public:
+        
+        DebugJournal( BitPacker::Mode mode, void * buffer, int bytes ) : packer( mode, buffer, bytes )
+        {
+            name = "";
+            file = "";
+            line = 0;
+            ended = buffer == NULL;
+            terminated = false;
+            error[0] = '\0';
+        }
+        
+        inline void Field( const char * name, const char * file, int line )
+        {
+            this->name = name ? name : "";
+            this->file = file ? file : "";
+            this->line = line;
+        }
+        
+        inline bool Bits( int bits ) { return ended || Entry( 2 + bits, name ); }
+        
+        inline bool Bytes( int bytes ) { return ended || Entry( BytesToken, name, (unsigned int) bytes ); }
+        
+        inline bool Checkpoint() { return ended || Entry( 1, "" ); }
+        
+        // ends the journal when writing, call once done
+        void Flush()
+        {
+            if ( !packer.IsValid() || packer.GetMode() != BitPacker::Write )
+                return;
+            if ( !terminated && packer.BitsRemaining() >= TokenBits )
+                packer.WriteBits( 0u, TokenBits );
+            terminated = true;
+            ended = true;
+            packer.FlushBits();
+        }
+        
+        inline int GetBytes() const { return packer.GetBytes(); }
+        
+        // the last desync, empty if there was none
+        inline const char * GetError() const { return error; }
+        
+        void Dump()
+        {
+            if ( !packer.IsValid() )
+            {
+                printf( "no journal exists!\n" );
+                return;
+            }
+            // a writer's journal ends here
+            Flush();
+            printf( "-----------------------------\n" );
+            printf( "dump journal:\n" );
+            BitPacker reader( BitPacker::Read, packer.GetData(), packer.GetBytes() );
+            while ( reader.BitsRemaining() >= TokenBits )
+            {
+                unsigned int token = 0;
+                char entry_name[256];
+                unsigned int entry_line = 0;
+                unsigned int entry_bytes = 0;
+                reader.ReadBits( token, TokenBits );
+                if ( token == 0 )
+                    break;
+                ReadEntry( reader, token, entry_name, entry_line, entry_bytes );
+                if ( token == 1 )
+                    printf( " (checkpoint) line %d\n", entry_line );
+                else if ( token == BytesToken )
+                    printf( " + %d bytes %s line %d\n", entry_bytes, entry_name, entry_line );
+                else
+                    printf( " + %d bits %s line %d\n", token - 2, entry_name, entry_line );
+            }
+            printf( "-----------------------------\n" );
+        }
+        
+    private:
+        
+        enum
+        {
+            TokenBits = 7,                      // 0 = end, 1 = checkpoint, [2,66] = n - 2 bits written, 67 = bytes
+            BytesToken = 67,                    // followed by the byte count
+            ByteCountBits = 32,
+            LineBits = 16,
+            LengthBits = 8
+        };
+        
+        // writes the entry, or reads the writer's and checks it matches
+        bool Entry( unsigned int token, const char * name, unsigned int bytes = 0 )
+        {
+            if ( packer.GetMode() == BitPacker::Write )
+            {
+                int length = (int) strlen( name );
+                if ( length > 255 )
+                    length = 255;
+                if ( packer.BitsRemaining() < TokenBits + ByteCountBits + LineBits + LengthBits + length * 8 + TokenBits )
+                {
+                    // leave room for an end token, the reader stops checking there
+                    ended = true;
+                    return true;
+                }
+                packer.WriteBits( token, TokenBits );
+                if ( token == BytesToken )
+                    packer.WriteBits( bytes, ByteCountBits );
+                packer.WriteBits( (unsigned int) line & 0xFFFF, LineBits );
+                packer.WriteBits( (unsigned int) length, LengthBits );
+                for ( int i = 0; i < length; ++i )
+                    packer.WriteBits( (unsigned int) (unsigned char) name[i], 8 );
+                return true;
+            }
+            unsigned int written = 0;
+            if ( packer.BitsRemaining() >= TokenBits )
+                packer.ReadBits( written, TokenBits );
+            if ( written == 0 )
+            {
+                ended = true;
+                return true;
+            }
+            char written_name[256];
+            unsigned int written_line = 0;
+            unsigned int written_bytes = 0;
+            ReadEntry( packer, written, written_name, written_line, written_bytes );
+            const bool same_name = name[0] == '\0' || written_name[0] == '\0' || strcmp( name, written_name ) == 0;
+            if ( written == token && written_bytes == bytes && same_name )
+                return true;
+            const char * reading = token == 1 ? "checkpoint" : name[0] ? name : "field";
+            const char * wrote = written == 1 ? "checkpoint" : written_name[0] ? written_name : "field";
+            char reading_size[32];
+            char written_size[32];
+            DescribeSize( reading_size, token, bytes );
+            DescribeSize( written_size, written, written_bytes );
+            snprintf( error, sizeof( error ), "desync read/write: reading %s (%s) at %s:%d, but %s (%s) was written at line %d", reading, reading_size, file, line, wrote, written_size, written_line );
+            printf( "%s\n", error );
+            return false;
+        }
+        
+        static void ReadEntry( BitPacker & reader, unsigned int token, char entry_name[256], unsigned int & entry_line, unsigned int & entry_bytes )
+        {
+            unsigned int length = 0;
+            entry_bytes = 0;
+            if ( token == BytesToken )
+                reader.ReadBits( entry_bytes, ByteCountBits );
+            reader.ReadBits( entry_line, LineBits );
+            reader.ReadBits( length, LengthBits );
+            for ( int i = 0; i < (int) length; ++i )
+            {
+                unsigned int c = 0;
+                reader.ReadBits( c, 8 );
+                entry_name[i] = (char) c;
+            }
+            entry_name[length] = '\0';
+        }
+        
+        static void DescribeSize( char size[32], unsigned int token, unsigned int bytes )
+        {
+            if ( token == BytesToken )
+                snprintf( size, 32, "%d bytes", (int) bytes );
+            else
+                snprintf( size, 32, "%d bits", token > 1 ? (int) token - 2 : 0 );
+        }
+        
+        BitPacker packer;
+        const char * name;                      // field being serialized, set by Field
+        const char * file;
+        int line;
+        bool ended;                             // off, full, or read past what was written
+        bool terminated;                        // end token written
+        char error[512];
+    };
+    
+    // debug builds journal, release builds compile it out
+#ifdef DEBUG
+    typedef DebugJournal DefaultJournal;
+#else
+    typedef NoJournal DefaultJournal;
+#endif
+}
+
+#endif /* NET_STREAM_JOURNAL_H */
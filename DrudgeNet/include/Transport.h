@@ -1,6 +1,8 @@
 #ifndef NET_TRANSPORT_H
 #define NET_TRANSPORT_H
 
+#include "ReliabilitySystem.h"
+
 namespace Net
 {
     // transport type
@@ -39,11 +41,14 @@ namespace Net
         
         virtual int GetMaxNodes() const = 0;
         
+        // largest payload SendPacket takes
+        virtual int GetMaxPacketSize() const = 0;
+        
         virtual bool SendPacket( int nodeId, const unsigned char data[], int size ) = 0;
         
         virtual int ReceivePacket( int & nodeId, unsigned char data[], int size ) = 0;
         
-        virtual class ReliabilitySystem & GetReliability( int nodeId ) = 0;
+        virtual ReliabilitySystem32 & GetReliability( int nodeId ) = 0;
         
         virtual void Update( float deltaTime ) = 0;
         
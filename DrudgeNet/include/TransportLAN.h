@@ -2,6 +2,12 @@
 #define NET_TRANSPORT_LAN_H
 
 #include "Transport.h"
+#include "ReliabilityPool.h"
+#include "FlowControl.h"
+#include "Pacer.h"
+#include "SendAccumulator.h"
+#include "SendScheduler.h"
+#include "SequenceBuffer.h"
 #include <vector>
 #include <map>
 
@@ -12,6 +18,22 @@ namespace Net
     //  + lan lobby is filled via net listener
     //  + a mesh runs on the server IP and manages node connections
     //  + a node runs on each transport, including a local node on the server with the mesh
+    //  + header only ack packets are sent to nodes we have gone quiet towards
+    //  + reliability for every node lives in one pool and is updated in a single pass
+    //  + each node has its own flow control, fed from its reliability stats
+    //  + packets are paced: queued per node and released across the tick at the flow control
+    //    bandwidth, with at most pacingBurst bytes back to back. they are sequenced as they go
+    //    out so queueing doesn't look like loss to the reliability system
+    //  + background packets (bulk transfers) are paced separately, at a ledbat flow control
+    //    budget that backs off as soon as the queue it builds delays the real-time packets.
+    //    the header carries a send timestamp and echoes back the one way delay last measured
+    //    from the other side, which feeds it
+    //  + packets go through a send scheduler first, which shares the uplink bandwidth between the
+    //    nodes by weighted fair queuing and sends by priority within a node. low priority packets
+    //    that don't fit the budget are dropped, the rest wait for the next update
+    //  + with checksum set every packet carries a crc32c, the node drops a corrupted one before
+    //    the header is read or the reliability system sees it. its four bytes come out of
+    //    GetMaxPacketSize
     
     class TransportLAN : public Transport
     {
@@ -40,9 +62,16 @@ namespace Net
             unsigned short beaconPort;
             unsigned short listenerPort;
             unsigned int protocolId;
+            bool checksum;
             float meshSendRate;
             float timeout;
             int maxNodes;
+            FlowControl::Mode flowControlMode;
+            float minBandwidth;
+            float maxBandwidth;
+            float pacingBurst;
+            float backgroundTargetDelay;
+            float uplinkBandwidth;
             
             Config()
             {
@@ -52,9 +81,16 @@ namespace Net
                 beaconPort = 40000;
                 listenerPort = 40001;
                 protocolId = 0x12345678;
+                checksum = false;
                 meshSendRate = 0.25f;
                 timeout = 10.0f;
                 maxNodes = 4;
+                flowControlMode = FlowControl::AIMD;
+                minBandwidth = 1024.0f;
+                maxBandwidth = 1024.0f * 1024.0f;
+                pacingBurst = 4096.0f;
+                backgroundTargetDelay = 0.01f;
+                uplinkBandwidth = 0.0f;
             }
         };
         
@@ -93,6 +129,9 @@ namespace Net
         
         int GetMaxNodes() const;
         
+        // the node's packet size less the header, and the checksum when that's on
+        int GetMaxPacketSize() const;
+        
         bool SendPacket(int nodeId,
                         const unsigned char data[],
                         int size);
@@ -101,38 +140,97 @@ namespace Net
                           unsigned char data[],
                           int size);
         
-        class ReliabilitySystem & GetReliability( int nodeId );
+        bool SendPacket(int nodeId,
+                        const unsigned char data[],
+                        int size,
+                        SendScheduler::Priority priority);
+        
+        // low priority, only uses bandwidth the real-time packets leave spare. received the same way
+        bool SendBackgroundPacket(int nodeId,
+                                  const unsigned char data[],
+                                  int size);
+        
+        ReliabilitySystem32 & GetReliability( int nodeId );
+        
+        FlowControl & GetFlowControl( int nodeId );
+        
+        FlowControl & GetBackgroundFlowControl( int nodeId );
+        
+        // node weights, and budget usage per node for monitoring
+        SendScheduler & GetScheduler() { return scheduler; }
+        
+        // call Update again by then to release paced packets on time, negative when none are queued
+        float GetTimeToNextSend() const;
         
         void Update( float deltaTime );
         
         TransportType GetType() const;
         
     private:
+        static const int HeaderSize = 20;
+        static const unsigned int NoDelay = 0x80000000;     // no one way delay measured yet
+        
+        bool SendAckPacket( int nodeId );
+        
+        bool SendQueuedPacket( int nodeId, const unsigned char data[], int size, bool background );
+        
+        void ProcessHeader( int nodeId, unsigned int timestamp, unsigned int delay );
+        
         void WriteHeader(unsigned char * header,
                          unsigned int sequence,
                          unsigned int ack,
-                         unsigned int ack_bits);
+                         unsigned int ack_bits,
+                         unsigned int timestamp,
+                         unsigned int delay);
         
         void ReadHeader(const unsigned char * header,
                         unsigned int & sequence,
                         unsigned int & ack,
-                        unsigned int & ack_bits);
+                        unsigned int & ack_bits,
+                        unsigned int & timestamp,
+                        unsigned int & delay);
         
         Config config;
         class Mesh * mesh;
         class Node * node;
         class Beacon * beacon;
         class Listener * listener;
-        float beaconAccumulator;
+        SendAccumulator beaconAccumulator;
         
         bool connectingByName;
         char connectName[65];
         float connectAccumulator;
         bool connectFailed;
         
-        std::vector<ReliabilitySystem> reliabilitySystems;
-        typedef std::map<int,ReliabilitySystem*> IdToReliability;
-        IdToReliability id2reliability;
+        static void PacketLost( void * context, unsigned int sequence, int size );
+        
+        static bool SendPacedPacket( void * context, int nodeId, const unsigned char data[], int size );
+        
+        static bool SendBackgroundPacedPacket( void * context, int nodeId, const unsigned char data[], int size );
+        
+        static bool SendScheduledPacket( void * context, int nodeId, const unsigned char data[], int size );
+        
+        struct PeerFlowControl
+        {
+            FlowControl flowControl;
+            int ackedTotal;             // acked bytes already passed on to flow control
+            FlowControl background;
+            int backgroundAcked;        // acked background bytes not passed on yet
+            SequenceBuffer<int> backgroundSent;     // size of each background packet in flight
+            unsigned int remoteDelay;   // one way delay of the latest packet from the node, echoed back
+            unsigned int delayBase;     // first delay echoed to us, the samples passed on are relative to it
+            bool delayBaseSet;
+            PeerFlowControl() : background( FlowControl::LEDBAT ), backgroundSent( ReliabilitySystem32::PacketBufferSize ) {}
+        };
+        
+        ReliabilityPool32 reliabilityPool;
+        typedef std::map<int,int> IdToPeer;
+        IdToPeer id2peer;
+        typedef std::map<int,PeerFlowControl> IdToFlowControl;
+        IdToFlowControl id2flow;
+        SendScheduler scheduler;
+        Pacer pacer;
+        Pacer backgroundPacer;
     };
 }
 
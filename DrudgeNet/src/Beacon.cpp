@@ -47,8 +47,7 @@ namespace Net
     
     void Beacon::Update( double delta ) {
         assert( running );
-        timeAccumulator += delta;
-        if ( timeAccumulator >= 1.0f ) {
+        if ( sendAccumulator.Update( (float) delta ) ) {
             // Broadcast beacon advertising server
             unsigned char *packet;
             packet = new unsigned char[12+1+64];
@@ -63,7 +62,6 @@ namespace Net
                 printf( "Beacon: failed to send broadcast packet\n" );
             }
             delete [] packet;
-            timeAccumulator -= 1.0f;
         }
     }
 }
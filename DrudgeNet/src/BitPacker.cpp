@@ -1,6 +1,13 @@
 #include "BitPacker.h"
 #include <cassert>
-#include <algorithm>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
 
 namespace Net
 {
@@ -9,99 +16,327 @@ namespace Net
         assert( bytes >= 0 );
         this->mode = mode;
         this->buffer = (unsigned char*) buffer;
-        this->ptr = (unsigned char*) buffer;
         this->bytes = bytes;
-        bit_index = 0;
-        if ( mode == Write )
-            memset( buffer, 0, bytes );
+        scratch = 0;
+        scratch_bits = 0;
+        word_index = 0;
+        bits_processed = 0;
     }
     
-    void BitPacker::WriteBits( unsigned int value, int bits )
+    void BitPacker::WriteBits( uint64_t value, int bits )
     {
-        assert( ptr );
-        assert( buffer );
         assert( bits > 0 );
-        assert( bits <= 32 );
-        assert( mode == Write );
-        if ( bits < 32 )
+        assert( bits <= 64 );
+        if ( bits <= 32 )
         {
-            const unsigned int mask = ( 1 << bits ) - 1;
-            value &= mask;
+            WriteBits( (unsigned int) value, bits );
+            return;
         }
-        do
+        WriteBits( (unsigned int) value, 32 );
+        WriteBits( (unsigned int) ( value >> 32 ), bits - 32 );
+    }
+    
+    void BitPacker::ReadBits( uint64_t & value, int bits )
+    {
+        assert( bits > 0 );
+        assert( bits <= 64 );
+        unsigned int low = 0;
+        if ( bits <= 32 )
         {
-            assert( ptr - buffer < bytes );
-            *ptr |= (unsigned char) ( value << bit_index );
-            assert( bit_index < 8 );
-            const int bits_written = std::min( bits, 8 - bit_index );
-            assert( bits_written > 0 );
-            assert( bits_written <= 8 );
-            bit_index += bits_written;
-            if ( bit_index >= 8 )
-            {
-                ptr++;
-                bit_index = 0;
-                value >>= bits_written;
-            }
-            bits -= bits_written;
-            assert( bits >= 0 );
-            assert( bits <= 32 );
+            ReadBits( low, bits );
+            value = low;
+            return;
         }
-        while ( bits > 0 );
+        unsigned int high = 0;
+        ReadBits( low, 32 );
+        ReadBits( high, bits - 32 );
+        value = ( (uint64_t) high << 32 ) | low;
     }
     
-    void BitPacker::WriteBits( uint64_t value, int bits )
+    // array values are grouped into chunks of up to 32 bits that go through the scratch register
+    // in one operation: pairs up to 16 bits wide, fours up to 8 bits, eights up to 4 bits (AVX2).
+    // the first value is in the low bits of a chunk, so the bits are the same as one at a time
+    
+    inline void BitPacker::PutChunk( uint64_t & bits, int & count, uint32_t chunk, int width )
     {
-        uint32_t x = (uint32_t)(value>>32);
-        uint32_t y = (uint32_t)value;
-        WriteBits(x);
-        WriteBits(y);
+        bits |= (uint64_t) chunk << count;
+        count += width;
+        if ( count >= 32 )
+        {
+            StoreWord( (uint32_t) bits );
+            bits >>= 32;
+            count -= 32;
+        }
     }
     
-    void BitPacker::ReadBits( uint64_t & value, int bits )
+    inline uint32_t BitPacker::GetChunk( uint64_t & bits, int & count, int width )
     {
-        uint32_t x, y;
-        ReadBits(x, 32);
-        ReadBits(y, 32);
-        value = ((uint64_t)x) << 32 | y;
+        if ( count < width )
+        {
+            bits |= (uint64_t) LoadWord() << count;
+            count += 32;
+        }
+        uint32_t chunk = (uint32_t) bits;
+        if ( width < 32 )
+            chunk &= ( 1u << width ) - 1;
+        bits >>= width;
+        count -= width;
+        return chunk;
     }
     
-    void BitPacker::ReadBits( unsigned int & value, int bits )
+    void BitPacker::WriteArray( const unsigned int values[], int count, int bits, ArrayKernel kernel )
     {
-        assert( ptr );
-        assert( buffer );
+        assert( mode == Write );
         assert( bits > 0 );
         assert( bits <= 32 );
+        assert( count >= 0 );
+        assert( bits_processed + count * bits <= bytes * 8 );
+        const uint32_t mask = bits < 32 ? ( 1u << bits ) - 1 : 0xFFFFFFFF;
+        // the scratch register in locals, stores to the buffer can't make the compiler reload it
+        uint64_t local_scratch = scratch;
+        int local_bits = scratch_bits;
+        int i = 0;
+#if defined(__AVX2__)
+        if ( kernel >= AVX2Kernel && bits <= 16 )
+        {
+            const __m256i value_mask = _mm256_set1_epi32( (int) mask );
+            const __m256i low_mask = _mm256_set1_epi64x( 0xFFFFFFFF );
+            const __m128i shift = _mm_cvtsi32_si128( bits );
+            const __m128i shift_pair = _mm_cvtsi32_si128( bits * 2 );
+            for ( ; i + 8 <= count; i += 8 )
+            {
+                const __m256i v = _mm256_and_si256( _mm256_loadu_si256( (const __m256i*) ( values + i ) ), value_mask );
+                // each 64 bit lane holds a pair, v0 | v1 << bits
+                const __m256i pairs = _mm256_or_si256( _mm256_and_si256( v, low_mask ), _mm256_sll_epi64( _mm256_srli_epi64( v, 32 ), shift ) );
+                if ( bits > 8 )
+                {
+                    alignas(32) uint64_t lanes[4];
+                    _mm256_store_si256( (__m256i*) lanes, pairs );
+                    for ( int j = 0; j < 4; ++j )
+                        PutChunk( local_scratch, local_bits, (uint32_t) lanes[j], bits * 2 );
+                    continue;
+                }
+                // the low lane of each 128 bit half holds four
+                const __m256i fours = _mm256_or_si256( pairs, _mm256_sll_epi64( _mm256_srli_si256( pairs, 8 ), shift_pair ) );
+                const uint32_t low = (uint32_t) _mm_cvtsi128_si32( _mm256_castsi256_si128( fours ) );
+                const uint32_t high = (uint32_t) _mm_cvtsi128_si32( _mm256_extracti128_si256( fours, 1 ) );
+                if ( bits > 4 )
+                {
+                    PutChunk( local_scratch, local_bits, low, bits * 4 );
+                    PutChunk( local_scratch, local_bits, high, bits * 4 );
+                }
+                else
+                    PutChunk( local_scratch, local_bits, low | high << ( bits * 4 ), bits * 8 );
+            }
+        }
+#endif
+#if defined(__SSE2__) || defined(_M_X64)
+        if ( kernel >= SSE2Kernel && bits <= 16 )
+        {
+            const __m128i value_mask = _mm_set1_epi32( (int) mask );
+            const __m128i low_mask = _mm_set_epi32( 0, -1, 0, -1 );
+            const __m128i shift = _mm_cvtsi32_si128( bits );
+            const __m128i shift_pair = _mm_cvtsi32_si128( bits * 2 );
+            for ( ; i + 4 <= count; i += 4 )
+            {
+                const __m128i v = _mm_and_si128( _mm_loadu_si128( (const __m128i*) ( values + i ) ), value_mask );
+                const __m128i pairs = _mm_or_si128( _mm_and_si128( v, low_mask ), _mm_sll_epi64( _mm_srli_epi64( v, 32 ), shift ) );
+                if ( bits > 8 )
+                {
+                    PutChunk( local_scratch, local_bits, (uint32_t) _mm_cvtsi128_si32( pairs ), bits * 2 );
+                    PutChunk( local_scratch, local_bits, (uint32_t) _mm_cvtsi128_si32( _mm_srli_si128( pairs, 8 ) ), bits * 2 );
+                    continue;
+                }
+                const __m128i fours = _mm_or_si128( pairs, _mm_sll_epi64( _mm_srli_si128( pairs, 8 ), shift_pair ) );
+                PutChunk( local_scratch, local_bits, (uint32_t) _mm_cvtsi128_si32( fours ), bits * 4 );
+            }
+        }
+#endif
+        for ( ; i < count; ++i )
+            PutChunk( local_scratch, local_bits, values[i] & mask, bits );
+        scratch = local_scratch;
+        scratch_bits = local_bits;
+        bits_processed += count * bits;
+        if ( scratch_bits > 0 )
+            StorePartialWord();
+    }
+    
+    void BitPacker::ReadArray( unsigned int values[], int count, int bits, ArrayKernel kernel )
+    {
         assert( mode == Read );
-        int original_bits = bits;
-        int value_index = 0;
-        value = 0;
-        do
+        assert( bits > 0 );
+        assert( bits <= 32 );
+        assert( count >= 0 );
+        assert( bits_processed + count * bits <= bytes * 8 );
+        const uint32_t mask = bits < 32 ? ( 1u << bits ) - 1 : 0xFFFFFFFF;
+        uint64_t local_scratch = scratch;
+        int local_bits = scratch_bits;
+        int i = 0;
+#if defined(__AVX2__)
+        if ( kernel >= AVX2Kernel && bits <= 16 )
         {
-            assert( ptr - buffer < bytes );
-            assert( bits >= 0 );
-            assert( bits <= 32 );
-            int bits_to_read = std::min( 8 - bit_index, bits );
-            assert( bits_to_read > 0 );
-            assert( bits_to_read <= 8 );
-            value |= ( *ptr >> bit_index ) << value_index;
-            bits -= bits_to_read;
-            bit_index += bits_to_read;
-            value_index += bits_to_read;
-            assert( value_index >= 0 );
-            assert( value_index <= 32 );
-            if ( bit_index >= 8 )
+            const __m256i value_mask = _mm256_set1_epi32( (int) mask );
+            // each lane shifts its value down out of the chunk it came in
+            const int b = bits;
+            const __m256i shifts = bits > 8 ? _mm256_setr_epi32( 0, b, 0, b, 0, b, 0, b ) : bits > 4 ? _mm256_setr_epi32( 0, b, 2 * b, 3 * b, 0, b, 2 * b, 3 * b ) : _mm256_setr_epi32( 0, b, 2 * b, 3 * b, 4 * b, 5 * b, 6 * b, 7 * b );
+            for ( ; i + 8 <= count; i += 8 )
             {
-                ptr++;
-                bit_index = 0;
+                __m256i chunks;
+                if ( bits > 8 )
+                {
+                    const int c0 = (int) GetChunk( local_scratch, local_bits, bits * 2 );
+                    const int c1 = (int) GetChunk( local_scratch, local_bits, bits * 2 );
+                    const int c2 = (int) GetChunk( local_scratch, local_bits, bits * 2 );
+                    const int c3 = (int) GetChunk( local_scratch, local_bits, bits * 2 );
+                    chunks = _mm256_setr_epi32( c0, c0, c1, c1, c2, c2, c3, c3 );
+                }
+                else if ( bits > 4 )
+                {
+                    const int c0 = (int) GetChunk( local_scratch, local_bits, bits * 4 );
+                    const int c1 = (int) GetChunk( local_scratch, local_bits, bits * 4 );
+                    chunks = _mm256_setr_epi32( c0, c0, c0, c0, c1, c1, c1, c1 );
+                }
+                else
+                    chunks = _mm256_set1_epi32( (int) GetChunk( local_scratch, local_bits, bits * 8 ) );
+                _mm256_storeu_si256( (__m256i*) ( values + i ), _mm256_and_si256( _mm256_srlv_epi32( chunks, shifts ), value_mask ) );
             }
         }
-        while ( bits > 0 );
-        if ( original_bits < 32 )
+#endif
+#if defined(__SSE2__) || defined(_M_X64)
+        if ( kernel >= SSE2Kernel && bits <= 16 )
+        {
+            const __m128i value_mask = _mm_set1_epi32( (int) mask );
+            const __m128i shift = _mm_cvtsi32_si128( bits );
+            const __m128i shift_pair = _mm_cvtsi32_si128( bits * 2 );
+            for ( ; i + 4 <= count; i += 4 )
+            {
+                // 64 bit lanes holding the chunks for values 0 and 2
+                __m128i even;
+                if ( bits > 8 )
+                {
+                    const int c0 = (int) GetChunk( local_scratch, local_bits, bits * 2 );
+                    const int c1 = (int) GetChunk( local_scratch, local_bits, bits * 2 );
+                    even = _mm_setr_epi32( c0, 0, c1, 0 );
+                }
+                else
+                {
+                    const __m128i chunk = _mm_cvtsi32_si128( (int) GetChunk( local_scratch, local_bits, bits * 4 ) );
+                    even = _mm_unpacklo_epi64( chunk, _mm_srl_epi64( chunk, shift_pair ) );
+                }
+                // and shifted down once more for values 1 and 3, then interleaved
+                const __m128i odd = _mm_srl_epi64( even, shift );
+                const __m128i v = _mm_unpacklo_epi64( _mm_unpacklo_epi32( even, odd ), _mm_unpackhi_epi32( even, odd ) );
+                _mm_storeu_si128( (__m128i*) ( values + i ), _mm_and_si128( v, value_mask ) );
+            }
+        }
+#endif
+        for ( ; i < count; ++i )
+            values[i] = GetChunk( local_scratch, local_bits, bits );
+        scratch = local_scratch;
+        scratch_bits = local_bits;
+        bits_processed += count * bits;
+    }
+    
+    void BitPacker::WriteAlign()
+    {
+        const int bits = GetAlignBits();
+        if ( bits )
+            WriteBits( 0u, bits );
+    }
+    
+    bool BitPacker::ReadAlign()
+    {
+        const int bits = GetAlignBits();
+        if ( !bits )
+            return true;
+        unsigned int padding = 0;
+        ReadBits( padding, bits );
+        return padding == 0;
+    }
+    
+    void BitPacker::WriteBytes( const unsigned char data[], int count )
+    {
+        assert( mode == Write );
+        assert( GetAlignBits() == 0 );
+        assert( count >= 0 );
+        assert( bits_processed + count * 8 <= bytes * 8 );
+        int i = 0;
+        for ( ; i < count && scratch_bits != 0; ++i )
+            WriteBits( (unsigned int) data[i], 8 );
+        // word aligned with nothing in the scratch register, the buffer holds bytes in stream order
+        const int words = ( count - i ) / 4;
+        if ( words > 0 )
+        {
+            memcpy( buffer + word_index * 4, data + i, words * 4 );
+            word_index += words;
+            bits_processed += words * 32;
+            i += words * 4;
+        }
+        for ( ; i < count; ++i )
+            WriteBits( (unsigned int) data[i], 8 );
+    }
+    
+    void BitPacker::ReadBytes( unsigned char data[], int count )
+    {
+        assert( mode == Read );
+        assert( GetAlignBits() == 0 );
+        assert( count >= 0 );
+        assert( bits_processed + count * 8 <= bytes * 8 );
+        unsigned int value = 0;
+        int i = 0;
+        for ( ; i < count && scratch_bits != 0; ++i )
+        {
+            ReadBits( value, 8 );
+            data[i] = (unsigned char) value;
+        }
+        const int words = ( count - i ) / 4;
+        if ( words > 0 )
+        {
+            memcpy( data + i, buffer + word_index * 4, words * 4 );
+            word_index += words;
+            bits_processed += words * 32;
+            i += words * 4;
+        }
+        for ( ; i < count; ++i )
+        {
+            ReadBits( value, 8 );
+            data[i] = (unsigned char) value;
+        }
+    }
+    
+    void BitPacker::StoreTail()
+    {
+        // the last word of a buffer that isn't a multiple of four bytes, only the bytes in use
+        const uint32_t word = (uint32_t) scratch;
+        const int count = ( scratch_bits + 7 ) / 8;
+        unsigned char * ptr = buffer + word_index * 4;
+        for ( int i = 0; i < count; ++i )
+            ptr[i] = (unsigned char) ( word >> ( i * 8 ) );
+    }
+    
+    void BitPacker::StoreWord( uint32_t word )
+    {
+        // only full words are stored, so the whole word is always inside the buffer
+        const uint32_t value = HostToLittleEndian( word );
+        memcpy( buffer + word_index * 4, &value, 4 );
+        word_index++;
+    }
+    
+    uint32_t BitPacker::LoadWord()
+    {
+        const int offset = word_index * 4;
+        word_index++;
+        if ( offset + 4 <= bytes )
         {
-            const unsigned int mask = ( 1 << original_bits ) - 1;
-            value &= mask;
+            uint32_t value;
+            memcpy( &value, buffer + offset, 4 );
+            return HostToLittleEndian( value );
         }
+        // the tail of a buffer that isn't a multiple of four bytes
+        uint32_t value = 0;
+        for ( int i = 0; offset + i < bytes; ++i )
+            value |= (uint32_t) buffer[offset + i] << ( i * 8 );
+        return value;
     }
     
     void * BitPacker::GetData()
@@ -111,17 +346,17 @@ namespace Net
     
     int BitPacker::GetBits() const
     {
-        return (int)( ptr - buffer ) * 8 + bit_index;
+        return bits_processed;
     }
     
     int BitPacker::GetBytes() const
     {
-        return (int)( ptr - buffer ) + ( bit_index > 0 ? 1 : 0 );
+        return ( bits_processed + 7 ) / 8;
     }
     
     int BitPacker::BitsRemaining() const
     {
-        return (int)(bytes * 8 - ( ( ptr - buffer ) * 8 + bit_index ));
+        return bytes * 8 - bits_processed;
     }
     
     BitPacker::Mode BitPacker::GetMode() const
@@ -0,0 +1,126 @@
+#include "Checksum.h"
+#include "Serialization.h"
+#include <cassert>
+#include <cstring>
+
+#if defined(__SSE4_2__)
+#include <nmmintrin.h>
+#endif
+#if defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#endif
+
+namespace Net
+{
+    // reflected castagnoli polynomial
+    static const uint32_t Polynomial = 0x82F63B78;
+    
+    // table[k][n] is the crc of byte n followed by k zero bytes
+    struct ChecksumTable
+    {
+        uint32_t table[8][256];
+        
+        ChecksumTable()
+        {
+            for ( uint32_t n = 0; n < 256; ++n )
+            {
+                uint32_t crc = n;
+                for ( int bit = 0; bit < 8; ++bit )
+                    crc = crc & 1 ? ( crc >> 1 ) ^ Polynomial : crc >> 1;
+                table[0][n] = crc;
+            }
+            for ( int k = 1; k < 8; ++k )
+            {
+                for ( int n = 0; n < 256; ++n )
+                    table[k][n] = ( table[k-1][n] >> 8 ) ^ table[0][table[k-1][n] & 0xFF];
+            }
+        }
+    };
+    
+    static uint32_t TableCRC( const unsigned char data[], int bytes, uint32_t crc )
+    {
+        static const ChecksumTable tables;
+        const uint32_t (*table)[256] = tables.table;
+        int i = 0;
+        for ( ; i + 8 <= bytes; i += 8 )
+        {
+            // bytes in stream order, as if loaded little endian
+            const uint32_t low = crc ^ ( (uint32_t) data[i] | (uint32_t) data[i+1] << 8 | (uint32_t) data[i+2] << 16 | (uint32_t) data[i+3] << 24 );
+            crc = table[7][low & 0xFF] ^ table[6][( low >> 8 ) & 0xFF] ^ table[5][( low >> 16 ) & 0xFF] ^ table[4][low >> 24] ^
+                  table[3][data[i+4]] ^ table[2][data[i+5]] ^ table[1][data[i+6]] ^ table[0][data[i+7]];
+        }
+        for ( ; i < bytes; ++i )
+            crc = ( crc >> 8 ) ^ table[0][( crc ^ data[i] ) & 0xFF];
+        return crc;
+    }
+    
+    uint32_t CRC32C( const unsigned char data[], int bytes, uint32_t crc, ChecksumKernel kernel )
+    {
+        assert( bytes >= 0 );
+        assert( data || bytes == 0 );
+        crc = ~crc;
+#if defined(__SSE4_2__)
+        if ( kernel == SSE42Checksum )
+        {
+            int i = 0;
+#if defined(__x86_64__) || defined(_M_X64)
+            uint64_t wide = crc;
+            for ( ; i + 8 <= bytes; i += 8 )
+            {
+                uint64_t value;
+                memcpy( &value, data + i, 8 );
+                wide = _mm_crc32_u64( wide, value );
+            }
+            crc = (uint32_t) wide;
+#endif
+            for ( ; i + 4 <= bytes; i += 4 )
+            {
+                uint32_t value;
+                memcpy( &value, data + i, 4 );
+                crc = _mm_crc32_u32( crc, value );
+            }
+            for ( ; i < bytes; ++i )
+                crc = _mm_crc32_u8( crc, data[i] );
+            return ~crc;
+        }
+#endif
+#if defined(__ARM_FEATURE_CRC32)
+        if ( kernel == ARMv8Checksum )
+        {
+            int i = 0;
+            for ( ; i + 8 <= bytes; i += 8 )
+            {
+                uint64_t value;
+                memcpy( &value, data + i, 8 );
+                crc = __crc32cd( crc, value );
+            }
+            for ( ; i < bytes; ++i )
+                crc = __crc32cb( crc, data[i] );
+            return ~crc;
+        }
+#endif
+        (void) kernel;
+        return ~TableCRC( data, bytes, crc );
+    }
+    
+    uint32_t PacketChecksum( unsigned int protocolId, const unsigned char data[], int bytes )
+    {
+        const unsigned char id[4] = { (unsigned char) ( protocolId >> 24 ), (unsigned char) ( protocolId >> 16 ), (unsigned char) ( protocolId >> 8 ), (unsigned char) protocolId };
+        return CRC32C( data, bytes, CRC32C( id, 4 ) );
+    }
+    
+    void WritePacketHeader( unsigned char packet[], int bytes, unsigned int protocolId, bool checksum )
+    {
+        assert( bytes >= 4 );
+        Serialization::WriteInteger( packet, checksum ? PacketChecksum( protocolId, packet + 4, bytes - 4 ) : protocolId );
+    }
+    
+    bool CheckPacketHeader( const unsigned char packet[], int bytes, unsigned int protocolId, bool checksum )
+    {
+        if ( bytes < 4 )
+            return false;
+        unsigned int header;
+        Serialization::ReadInteger( packet, header );
+        return header == ( checksum ? PacketChecksum( protocolId, packet + 4, bytes - 4 ) : protocolId );
+    }
+}
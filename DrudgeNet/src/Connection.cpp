@@ -1,4 +1,5 @@
 #include "Connection.h"
+#include "Checksum.h"
 #include <cassert>
 #include <stdio.h>
 #include <algorithm>
@@ -9,6 +10,7 @@ namespace Net
     {
         this->protocolId = protocolId;
         this->timeout = timeout;
+        checksum = false;
         mode = None;
         running = false;
         ClearData();
@@ -99,11 +101,8 @@ namespace Net
         if ( address.GetAddress() == 0 )
             return false;
         unsigned char* packet = new unsigned char[size+4];
-        packet[0] = (unsigned char) ( protocolId >> 24 );
-        packet[1] = (unsigned char) ( ( protocolId >> 16 ) & 0xFF );
-        packet[2] = (unsigned char) ( ( protocolId >> 8 ) & 0xFF );
-        packet[3] = (unsigned char) ( ( protocolId ) & 0xFF );
         memcpy( &packet[4], data, size );
+        WritePacketHeader( packet, size + 4, protocolId, checksum );
         bool res = socket.Send( address, packet, size + 4 );
         delete [] packet;
         return res;
@@ -125,10 +124,7 @@ namespace Net
             delete [] packet;
             return 0;
         }
-        if ( packet[0] != (unsigned char) ( protocolId >> 24 ) ||
-            packet[1] != (unsigned char) ( ( protocolId >> 16 ) & 0xFF ) ||
-            packet[2] != (unsigned char) ( ( protocolId >> 8 ) & 0xFF ) ||
-            packet[3] != (unsigned char) ( protocolId & 0xFF ) )
+        if ( !CheckPacketHeader( packet, bytes_read, protocolId, checksum ) )
         {
             delete [] packet;
             return 0;
@@ -3,30 +3,239 @@
 
 namespace Net
 {
-    FlowControl::FlowControl()
+    FlowControl::FlowControl( Mode mode )
     {
-        printf( "Network flow control initialized\n" );
+        this->mode = mode;
+        min_bandwidth = 1024.0f;
+        max_bandwidth = 1024.0f * 1024.0f;
+        additive_increase = 1024.0f;
+        multiplicative_decrease = 0.7f;
+        rtt_inflation = 2.0f;
+        rtt_inflation_slack = 0.02f;
+        target_delay = 0.01f;
         Reset();
     }
     
     void FlowControl::Reset()
     {
-        mode = Bad;
+        flow_mode = Bad;
         penalty_time = 4.0f;
         good_conditions_time = 0.0f;
         penalty_reduction_accumulator = 0.0f;
+        
+        bandwidth = 8.0f * 1024.0f;
+        if ( bandwidth < min_bandwidth )
+            bandwidth = min_bandwidth;
+        if ( bandwidth > max_bandwidth )
+            bandwidth = max_bandwidth;
+        recovery_time = 0.0f;
+        rtt = 0.0f;
+        min_rtt = 0.0f;
+        min_rtt_age = 0.0f;
+        packet_size = 256.0f;
+        sent_rate.Reset();
+        bytes_in_flight = 0;
+        
+        // the model starts from the initial budget until acks measure the real thing
+        bottleneck_bandwidth = bandwidth;
+        for ( int i = 0; i < BandwidthFilterRounds; ++i )
+            bandwidth_samples[i] = bandwidth;
+        round_count = 0;
+        round_time = 0.0f;
+        model_time = 0.0;
+        interval_start = -1.0;
+        interval_end = 0.0;
+        interval_acked = 0;
+        full_bandwidth = 0.0f;
+        full_bandwidth_rounds = 0;
+        cycle_index = 0;
+        probe_rtt_time = 0.0f;
+        EnterState( Startup );
+        
+        for ( int i = 0; i < BaseDelayBuckets; ++i )
+            base_delay[i] = 0.0f;
+        base_delay_index = 0;
+        base_delay_time = 0.0f;
+        for ( int i = 0; i < CurrentDelaySamples; ++i )
+            current_delay[i] = 0.0f;
+        delay_samples = 0;
+    }
+    
+    void FlowControl::Update( float deltaTime, float rtt, float min_rtt )
+    {
+        sent_rate.Update( deltaTime );
+        if ( mode == Binary )
+        {
+            UpdateBinary( deltaTime, rtt );
+            return;
+        }
+        UpdateRoundTripTime( deltaTime, rtt / 1000.0f, min_rtt / 1000.0f );
+        if ( mode == AIMD )
+            UpdateAIMD( deltaTime );
+        else if ( mode == BBR )
+            UpdateBBR( deltaTime );
+        else
+            UpdateLEDBAT( deltaTime );
+    }
+    
+    void FlowControl::PacketSent( int size )
+    {
+        sent_rate.Add( (float) size );
+        packet_size += ( size - packet_size ) * 0.1f;
+        bytes_in_flight += size;
+    }
+    
+    void FlowControl::PacketsAcked( int bytes )
+    {
+        if ( bytes <= 0 )
+            return;
+        bytes_in_flight -= bytes;
+        if ( bytes_in_flight < 0 )
+            bytes_in_flight = 0;
+        if ( mode == BBR )
+        {
+            // a delivery rate interval runs from one ack to a later one, the bytes of the first don't count
+            if ( interval_start < 0.0 )
+            {
+                interval_start = model_time;
+            }
+            else
+            {
+                interval_acked += bytes;
+                interval_end = model_time;
+            }
+        }
+        if ( mode != AIMD || recovery_time > 0.0f || IsAppLimited() )
+            return;
+        // one budget's worth of bytes acked per round trip adds one additive increase per round trip
+        const float round_trip = rtt > 0.01f ? rtt : 0.01f;
+        bandwidth += additive_increase * bytes / ( bandwidth * round_trip );
+        if ( bandwidth > max_bandwidth )
+            bandwidth = max_bandwidth;
+    }
+    
+    void FlowControl::PacketLost( int size )
+    {
+        bytes_in_flight -= size;
+        if ( bytes_in_flight < 0 )
+            bytes_in_flight = 0;
+        if ( mode == AIMD || mode == LEDBAT )
+            Decrease();
+    }
+    
+    void FlowControl::DelaySample( float delay )
+    {
+        delay /= 1000.0f;
+        // the first sample of each bucket starts it, later ones can only lower it
+        if ( delay_samples == 0 )
+        {
+            for ( int i = 0; i < BaseDelayBuckets; ++i )
+                base_delay[i] = delay;
+        }
+        else if ( delay < base_delay[base_delay_index] )
+        {
+            base_delay[base_delay_index] = delay;
+        }
+        current_delay[delay_samples % CurrentDelaySamples] = delay;
+        delay_samples++;
     }
     
-    void FlowControl::Update( float deltaTime, float rtt )
+    float FlowControl::GetQueuingDelay() const
+    {
+        if ( delay_samples == 0 )
+            return 0.0f;
+        float base = base_delay[0];
+        for ( int i = 1; i < BaseDelayBuckets; ++i )
+        {
+            if ( base_delay[i] < base )
+                base = base_delay[i];
+        }
+        // the minimum of the latest few filters out one packet unlucky enough to wait behind a burst
+        const int count = delay_samples < CurrentDelaySamples ? delay_samples : CurrentDelaySamples;
+        float current = current_delay[0];
+        for ( int i = 1; i < count; ++i )
+        {
+            if ( current_delay[i] < current )
+                current = current_delay[i];
+        }
+        return current > base ? current - base : 0.0f;
+    }
+    
+    float FlowControl::GetQueuingTarget() const
+    {
+        // a fixed target would let a sub millisecond path queue many round trips' worth ahead of
+        // everything else. scaled to the min RTT the queue stays a small part of the round trip,
+        // the floor keeps a tick of measurement jitter from reading as over the target
+        const float RoundTripFraction = 0.25f;
+        const float MinTarget = 0.002f;
+        if ( min_rtt <= 0.0f )
+            return target_delay;
+        float target = min_rtt * RoundTripFraction;
+        if ( target < MinTarget )
+            target = MinTarget;
+        return target < target_delay ? target : target_delay;
+    }
+    
+    float FlowControl::GetSendRate() const
+    {
+        if ( mode == Binary )
+            return flow_mode == Good ? 30.0f : 10.0f;
+        return GetBandwidth() / packet_size;
+    }
+    
+    float FlowControl::GetBandwidth() const
+    {
+        if ( mode == Binary )
+            return GetSendRate() * packet_size;
+        if ( mode != BBR )
+            return bandwidth;
+        const float pacing_rate = pacing_gain * bottleneck_bandwidth;
+        if ( pacing_rate < min_bandwidth )
+            return min_bandwidth;
+        if ( pacing_rate > max_bandwidth )
+            return max_bandwidth;
+        return pacing_rate;
+    }
+    
+    float FlowControl::GetWindow() const
+    {
+        if ( mode != BBR || min_rtt <= 0.0f )
+            return 0.0f;
+        const float minimum = 4.0f * packet_size;
+        if ( state == ProbeRoundTripTime )
+            return minimum;
+        const float window = window_gain * bottleneck_bandwidth * min_rtt;
+        return window > minimum ? window : minimum;
+    }
+    
+    void FlowControl::SetMode( Mode mode )
+    {
+        this->mode = mode;
+        Reset();
+    }
+    
+    void FlowControl::SetBandwidthLimits( float minimum, float maximum )
+    {
+        assert( minimum > 0.0f );
+        assert( minimum <= maximum );
+        min_bandwidth = minimum;
+        max_bandwidth = maximum;
+        if ( bandwidth < min_bandwidth )
+            bandwidth = min_bandwidth;
+        if ( bandwidth > max_bandwidth )
+            bandwidth = max_bandwidth;
+    }
+    
+    void FlowControl::UpdateBinary( float deltaTime, float rtt )
     {
         const float RTT_Threshold = 250.0f;
         
-        if ( mode == Good )
+        if ( flow_mode == Good )
         {
             if ( rtt > RTT_Threshold )
             {
                 printf( "FlowControl: *** dropping to bad mode ***\n" );
-                mode = Bad;
+                flow_mode = Bad;
                 if ( good_conditions_time < 10.0f && penalty_time < 60.0f )
                 {
                     penalty_time *= 2.0f;
@@ -52,7 +261,7 @@ namespace Net
             }
         }
         
-        if ( mode == Bad )
+        if ( flow_mode == Bad )
         {
             if ( rtt <= RTT_Threshold )
                 good_conditions_time += deltaTime;
@@ -64,9 +273,209 @@ namespace Net
                 printf( "FlowControl: *** upgrading to good mode ***\n" );
                 good_conditions_time = 0.0f;
                 penalty_reduction_accumulator = 0.0f;
-                mode = Good;
+                flow_mode = Good;
+                return;
+            }
+        }
+    }
+    
+    void FlowControl::UpdateRoundTripTime( float deltaTime, float rtt, float min_rtt )
+    {
+        const float MinRoundTripTimeWindow = 10.0f;
+        
+        this->rtt = rtt;
+        min_rtt_age += deltaTime;
+        if ( min_rtt > 0.0f )
+        {
+            // from the reliability system, which keeps its own window
+            if ( this->min_rtt <= 0.0f || min_rtt < this->min_rtt )
+                min_rtt_age = 0.0f;
+            this->min_rtt = min_rtt;
+        }
+        else if ( rtt > 0.0f )
+        {
+            if ( this->min_rtt <= 0.0f || rtt <= this->min_rtt || min_rtt_age > MinRoundTripTimeWindow )
+            {
+                this->min_rtt = rtt;
+                min_rtt_age = 0.0f;
+            }
+        }
+    }
+    
+    void FlowControl::UpdateAIMD( float deltaTime )
+    {
+        if ( recovery_time > 0.0f )
+            recovery_time -= deltaTime;
+        
+        // queues building up along the path show as rtt well above the minimum
+        if ( min_rtt > 0.0f && rtt > min_rtt * rtt_inflation && rtt - min_rtt > rtt_inflation_slack )
+            Decrease();
+    }
+    
+    void FlowControl::UpdateLEDBAT( float deltaTime )
+    {
+        // base delay buckets cover a minute, old enough buckets fall out so clock drift and route
+        // changes don't leave a stale minimum behind
+        const float BaseDelayInterval = 6.0f;
+        
+        if ( recovery_time > 0.0f )
+            recovery_time -= deltaTime;
+        if ( delay_samples == 0 )
+            return;
+        
+        base_delay_time += deltaTime;
+        if ( base_delay_time >= BaseDelayInterval )
+        {
+            base_delay_time = 0.0f;
+            const int latest = ( delay_samples - 1 ) % CurrentDelaySamples;
+            base_delay_index = ( base_delay_index + 1 ) % BaseDelayBuckets;
+            base_delay[base_delay_index] = current_delay[latest];
+        }
+        
+        // the budget moves in proportion to how far off target the queuing delay is. over the target
+        // it comes down by up to the multiplicative decrease, once per round trip
+        const float target = GetQueuingTarget();
+        const float queuing_delay = GetQueuingDelay();
+        const float off_target = ( target - queuing_delay ) / target;
+        if ( off_target < 0.0f )
+        {
+            if ( recovery_time > 0.0f )
                 return;
+            const float over = off_target > -1.0f ? -off_target : 1.0f;
+            bandwidth *= 1.0f - ( 1.0f - multiplicative_decrease ) * over;
+            if ( bandwidth < min_bandwidth )
+                bandwidth = min_bandwidth;
+            recovery_time = rtt > 0.01f ? rtt : 0.01f;
+            return;
+        }
+        if ( recovery_time > 0.0f || IsAppLimited() )
+            return;
+        const float round_trip = rtt > 0.01f ? rtt : 0.01f;
+        bandwidth += additive_increase * off_target * deltaTime / round_trip;
+        if ( bandwidth > max_bandwidth )
+            bandwidth = max_bandwidth;
+    }
+    
+    void FlowControl::Decrease()
+    {
+        // losses and inflated rtt from one round trip are one congestion event
+        if ( recovery_time > 0.0f )
+            return;
+        bandwidth *= multiplicative_decrease;
+        if ( bandwidth < min_bandwidth )
+            bandwidth = min_bandwidth;
+        recovery_time = rtt > 0.01f ? rtt : 0.01f;
+    }
+    
+    void FlowControl::UpdateBBR( float deltaTime )
+    {
+        const float ProbeRoundTripTimeInterval = 10.0f;
+        const float ProbeRoundTripTimeDuration = 0.2f;
+        
+        // rounds are one min rtt long, nothing to measure until the first rtt sample
+        if ( min_rtt <= 0.0f )
+            return;
+        
+        model_time += deltaTime;
+        round_time += deltaTime;
+        if ( round_time >= min_rtt )
+            EndRound();
+        
+        if ( state == Drain && bytes_in_flight <= bottleneck_bandwidth * min_rtt )
+            EnterState( ProbeBandwidth );
+        
+        // min rtt hasn't gone down for a while, drain the queue for a moment so it can
+        if ( state != ProbeRoundTripTime && min_rtt_age > ProbeRoundTripTimeInterval )
+        {
+            EnterState( ProbeRoundTripTime );
+            probe_rtt_time = ProbeRoundTripTimeDuration + min_rtt;
+        }
+        
+        if ( state == ProbeRoundTripTime )
+        {
+            probe_rtt_time -= deltaTime;
+            if ( probe_rtt_time <= 0.0f )
+            {
+                min_rtt_age = 0.0f;
+                EnterState( full_bandwidth_rounds >= 3 ? ProbeBandwidth : Startup );
+            }
+        }
+    }
+    
+    void FlowControl::EndRound()
+    {
+        // delivery rate from ack to ack. measuring over the round instead over estimates whenever
+        // an ack lands right at its end, and the max filter would hold on to that
+        round_count++;
+        round_time = 0.0f;
+        if ( interval_acked == 0 || interval_end <= interval_start )
+            return;
+        const float sample = (float) ( interval_acked / ( interval_end - interval_start ) );
+        interval_start = interval_end;
+        interval_acked = 0;
+        
+        // app limited samples only count if they show more bandwidth
+        const int index = round_count % BandwidthFilterRounds;
+        bandwidth_samples[index] = IsAppLimited() && sample < bottleneck_bandwidth ? bottleneck_bandwidth : sample;
+        
+        bottleneck_bandwidth = bandwidth_samples[0];
+        for ( int i = 1; i < BandwidthFilterRounds; ++i )
+        {
+            if ( bandwidth_samples[i] > bottleneck_bandwidth )
+                bottleneck_bandwidth = bandwidth_samples[i];
+        }
+        if ( bottleneck_bandwidth < min_bandwidth )
+            bottleneck_bandwidth = min_bandwidth;
+        
+        if ( state == Startup )
+        {
+            // the pipe is full once three rounds in a row fail to grow bandwidth by 25%
+            if ( bottleneck_bandwidth >= full_bandwidth * 1.25f )
+            {
+                full_bandwidth = bottleneck_bandwidth;
+                full_bandwidth_rounds = 0;
             }
+            else if ( ++full_bandwidth_rounds >= 3 )
+            {
+                EnterState( Drain );
+            }
+        }
+        else if ( state == ProbeBandwidth )
+        {
+            // the phase pacing below the bottleneck lasts until whatever queue built up is gone,
+            // so a slightly high bandwidth estimate can't leave a standing queue behind
+            if ( pacing_gain < 1.0f && bytes_in_flight > bottleneck_bandwidth * min_rtt )
+                return;
+            cycle_index = ( cycle_index + 1 ) % GainCycleLength;
+            EnterState( ProbeBandwidth );
+        }
+    }
+    
+    void FlowControl::EnterState( ModelState state )
+    {
+        // 2/ln(2) doubles the delivery rate every round trip
+        const float StartupGain = 2.885f;
+        const float GainCycle[GainCycleLength] = { 1.25f, 0.75f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f };
+        
+        this->state = state;
+        switch ( state )
+        {
+            case Startup:
+                pacing_gain = StartupGain;
+                window_gain = StartupGain;
+                break;
+            case Drain:
+                pacing_gain = 1.0f / StartupGain;
+                window_gain = StartupGain;
+                break;
+            case ProbeBandwidth:
+                pacing_gain = GainCycle[cycle_index];
+                window_gain = 2.0f;
+                break;
+            case ProbeRoundTripTime:
+                pacing_gain = 1.0f;
+                window_gain = 1.0f;
+                break;
         }
     }
 }
@@ -1,5 +1,6 @@
 #include "Mesh.h"
 #include "Serialization.h"
+#include "Checksum.h"
 #include <cassert>
 
 namespace Net
@@ -14,9 +15,12 @@ namespace Net
         this->protocolId = protocolId;
         this->sendRate = sendRate;
         this->timeout = timeout;
+        checksum = false;
         nodes.resize( maxNodes );
         running = false;
-        sendAccumulator = 0.0f;
+        sendAccumulator.SetInterval( sendRate );
+        pacer = Pacer( maxNodes, sendRate );
+        pacer.SetSendFunction( SendPacedPacket, this );
     }
     
     Mesh::~Mesh()
@@ -45,7 +49,8 @@ namespace Net
         for ( unsigned int i = 0; i < nodes.size(); ++i )
             nodes[i] = NodeState();
         running = false;
-        sendAccumulator = 0.0f;
+        sendAccumulator.Reset();
+        pacer.Clear();
     }
     
     void Mesh::Update( float deltaTime )
@@ -53,6 +58,7 @@ namespace Net
         assert( running );
         ReceivePackets();
         SendPackets( deltaTime );
+        pacer.Update( deltaTime );
         CheckForTimeouts( deltaTime );
     }
     
@@ -106,12 +112,8 @@ namespace Net
         assert( sender != Address() );
         assert( size > 0 );
         assert( data );
-        // ignore packets that dont have the correct protocol id
-        unsigned int firstIntegerInPacket;
-        Serialization::ReadInteger(data, firstIntegerInPacket);
-        //( unsigned(data[0]) << 24 ) | ( unsigned(data[1]) << 16 ) |
-        //( unsigned(data[2]) << 8 )  | unsigned(data[3]);
-        if ( firstIntegerInPacket != protocolId )
+        // ignore packets that dont have the correct protocol id, or checksum
+        if ( size < 5 || !CheckPacketHeader( data, size, protocolId, checksum ) )
             return;
         // determine packet type
         enum PacketType { JoinRequest, KeepAlive };
@@ -180,8 +182,7 @@ namespace Net
     
     void Mesh::SendPackets( float deltaTime )
     {
-        sendAccumulator += deltaTime;
-        while ( sendAccumulator > sendRate )
+        if ( sendAccumulator.Update( deltaTime ) )
         {
             for ( unsigned int i = 0; i < nodes.size(); ++i )
             {
@@ -189,11 +190,11 @@ namespace Net
                 {
                     // node is negotiating join: send "connection accepted" packets
                     unsigned char packet[7];
-                    Serialization::WriteInteger(packet, protocolId);
                     packet[4] = 0;
                     packet[5] = (unsigned char) i;
                     packet[6] = (unsigned char) nodes.size();
-                    socket.Send( nodes[i].address, packet, sizeof(packet) );
+                    WritePacketHeader( packet, sizeof(packet), protocolId, checksum );
+                    pacer.Enqueue( i, packet, sizeof(packet) );
                 }
                 else if ( nodes[i].mode == NodeState::Connected )
                 {
@@ -201,7 +202,6 @@ namespace Net
                     unsigned char *packet;
                     int packetSize = (int)(5+10*nodes.size());
                     packet = new unsigned char[packetSize];
-                    Serialization::WriteInteger(packet, protocolId);
                     packet[4] = 1;
                     unsigned char * ptr = &packet[5];
                     for ( unsigned int j = 0; j < nodes.size(); ++j )
@@ -218,13 +218,23 @@ namespace Net
                         ptr[9] = (unsigned char) ( ( nodes[j].nodeId ) & 0xFF );
                         ptr += 10;
                     }
-                    socket.Send( nodes[i].address, packet, packetSize );
+                    WritePacketHeader( packet, packetSize, protocolId, checksum );
+                    pacer.Enqueue( i, packet, packetSize );
+                    delete [] packet;
                 }
             }
-            sendAccumulator -= sendRate;
         }
     }
     
+    bool Mesh::SendPacedPacket( void * context, int nodeId, const unsigned char data[], int size )
+    {
+        // the node may have timed out while its packet waited
+        Mesh * mesh = (Mesh*) context;
+        if ( mesh->nodes[nodeId].mode == NodeState::Disconnected )
+            return false;
+        return mesh->socket.Send( mesh->nodes[nodeId].address, data, size );
+    }
+    
     void Mesh::CheckForTimeouts( float deltaTime )
     {
         for ( unsigned int i = 0; i < nodes.size(); ++i )
@@ -1,5 +1,6 @@
 #include "Node.h"
 #include "Serialization.h"
+#include "Checksum.h"
 #include <cassert>
 
 namespace Net
@@ -13,6 +14,8 @@ namespace Net
         this->sendRate = sendRate;
         this->timeout = timeout;
         this->maxPacketSize = maxPacketSize;
+        checksum = false;
+        sendAccumulator.SetInterval( sendRate );
         state = Disconnected;
         running = false;
         ClearData();
@@ -84,6 +87,11 @@ namespace Net
         return (int) nodes.size();
     }
     
+    int Node::GetMaxPacketSize() const
+    {
+        return checksum ? maxPacketSize - 4 : maxPacketSize;
+    }
+    
     bool Node::SendPacket( int nodeId, const unsigned char data[], int size )
     {
         assert( running );
@@ -95,10 +103,17 @@ namespace Net
             return false;
         if ( !nodes[nodeId].connected )
             return false;
-        assert( size <= maxPacketSize );
-        if ( size > maxPacketSize )
+        assert( size <= GetMaxPacketSize() );
+        if ( size > GetMaxPacketSize() )
             return false;
-        return socket.Send( nodes[nodeId].address, data, size );
+        if ( !checksum )
+            return socket.Send( nodes[nodeId].address, data, size );
+        unsigned char * packet = new unsigned char[size+4];
+        memcpy( &packet[4], data, size );
+        WritePacketHeader( packet, size + 4, protocolId, checksum );
+        bool res = socket.Send( nodes[nodeId].address, packet, size + 4 );
+        delete [] packet;
+        return res;
     }
     
     int Node::ReceivePacket( int & nodeId, unsigned char data[], int size )
@@ -125,7 +140,7 @@ namespace Net
         }
         return 0;
     }
-     
+    
     void Node::ReceivePackets()
     {
         while ( true )
@@ -150,12 +165,10 @@ namespace Net
         if ( sender == meshAddress )
         {
 //            printf("Node %i: received %i bytes from mesh\n", localNodeId, size);
-
+            
             // *** packet sent from the mesh ***
-            // ignore packets that dont have the correct protocol id
-            unsigned int firstIntegerInPacket;
-            Serialization::ReadInteger(data, firstIntegerInPacket);
-            if ( firstIntegerInPacket != protocolId )
+            // ignore packets that dont have the correct protocol id, or checksum
+            if ( size < 5 || !CheckPacketHeader( data, size, protocolId, checksum ) )
                 return;
             // determine packet type
             enum PacketType { ConnectionAccepted, Update };
@@ -262,6 +275,13 @@ namespace Net
             if ( itor != addr2node.end() )
             {
                 // *** packet sent from another node ***
+                if ( checksum )
+                {
+                    if ( size <= 4 || !CheckPacketHeader( data, size, protocolId, checksum ) )
+                        return;
+                    data += 4;
+                    size -= 4;
+                }
                 NodeState * node = itor->second;
                 assert( node );
                 int nodeId = (int) ( node - &nodes[0] );
@@ -279,26 +299,24 @@ namespace Net
     
     void Node::SendPackets( float deltaTime )
     {
-        sendAccumulator += deltaTime;
-        while ( sendAccumulator > sendRate )
+        if ( sendAccumulator.Update( deltaTime ) )
         {
             if ( state == Joining )
             {
                 // node is joining: send "join request" packets
                 unsigned char packet[5];
-                Serialization::WriteInteger(packet, protocolId);
                 packet[4] = 0;
+                WritePacketHeader( packet, sizeof(packet), protocolId, checksum );
                 socket.Send( meshAddress, packet, sizeof(packet) );
             }
             else if ( state == Joined )
             {
                 // node is joined: send "keep alive" packets
                 unsigned char packet[5];
-                Serialization::WriteInteger(packet, protocolId);
                 packet[4] = 1;
+                WritePacketHeader( packet, sizeof(packet), protocolId, checksum );
                 socket.Send( meshAddress, packet, sizeof(packet) );
             }
-            sendAccumulator -= sendRate;
         }
     }
     
@@ -334,7 +352,7 @@ namespace Net
             delete packet;
             receivedPackets.pop();
         }
-        sendAccumulator = 0.0f;
+        sendAccumulator.Reset();
         timeoutAccumulator = 0.0f;
         localNodeId = -1;
         meshAddress = Address();
@@ -0,0 +1,135 @@
+#include "Pacer.h"
+#include <cassert>
+#include <string.h>
+
+namespace Net
+{
+    Pacer::Pacer( int peers, float interval )
+    {
+        assert( peers >= 0 );
+        assert( interval >= 0.0f );
+        this->time = 0.0;
+        this->interval = interval;
+        this->peer_slots = peers;
+        this->peers.resize( peers );
+        max_queued_bytes = 64 * 1024;
+        send_function = NULL;
+        send_context = NULL;
+    }
+    
+    void Pacer::SetSendFunction( SendFunction function, void * context )
+    {
+        send_function = function;
+        send_context = context;
+    }
+    
+    void Pacer::SetRate( int peer, float rate, float burst )
+    {
+        assert( rate >= 0.0f );
+        assert( burst >= 0.0f );
+        PeerState & state = GetPeer( peer );
+        // a newly limited peer starts with a full bucket
+        if ( state.rate <= 0.0f )
+            state.tokens = burst;
+        state.rate = rate;
+        state.burst = burst;
+        if ( state.tokens > burst )
+            state.tokens = burst;
+    }
+    
+    bool Pacer::Enqueue( int peer, const unsigned char data[], int size )
+    {
+        assert( data );
+        assert( size > 0 );
+        PeerState & state = GetPeer( peer );
+        if ( state.queued_bytes + size > max_queued_bytes )
+            return false;
+        QueuedPacket packet;
+        const int slots = peer_slots > (int) peers.size() ? peer_slots : (int) peers.size();
+        packet.time = time + interval * peer / slots;
+        // keep the peer's packets in order
+        if ( !state.queue.empty() && state.queue.back().time > packet.time )
+            packet.time = state.queue.back().time;
+        packet.data.assign( data, data + size );
+        state.queue.push_back( packet );
+        state.queued_bytes += size;
+        return true;
+    }
+    
+    void Pacer::Update( float deltaTime )
+    {
+        time += deltaTime;
+        for ( int i = 0; i < (int) peers.size(); ++i )
+        {
+            PeerState & state = peers[i];
+            if ( state.rate > 0.0f )
+            {
+                // tokens stop at the burst size, time spent idle or stalled can't be made up later
+                state.tokens += state.rate * deltaTime;
+                if ( state.tokens > state.burst )
+                    state.tokens = state.burst;
+            }
+            while ( !state.queue.empty() && state.queue.front().time <= time )
+            {
+                QueuedPacket & packet = state.queue.front();
+                const int size = (int) packet.data.size();
+                // a packet bigger than the burst goes once the bucket is full
+                if ( state.rate > 0.0f && state.tokens < size && state.tokens < state.burst )
+                    break;
+                if ( send_function )
+                    send_function( send_context, i, &packet.data[0], size );
+                if ( state.rate > 0.0f )
+                    state.tokens -= size;
+                state.queued_bytes -= size;
+                state.queue.pop_front();
+            }
+        }
+    }
+    
+    void Pacer::Clear()
+    {
+        for ( int i = 0; i < (int) peers.size(); ++i )
+            Clear( i );
+    }
+    
+    void Pacer::Clear( int peer )
+    {
+        if ( peer >= (int) peers.size() )
+            return;
+        peers[peer].queue.clear();
+        peers[peer].queued_bytes = 0;
+    }
+    
+    float Pacer::GetTimeToNextSend() const
+    {
+        float next = -1.0f;
+        for ( int i = 0; i < (int) peers.size(); ++i )
+        {
+            const PeerState & state = peers[i];
+            if ( state.queue.empty() )
+                continue;
+            float wait = (float) ( state.queue.front().time - time );
+            if ( state.rate > 0.0f )
+            {
+                const float size = (float) state.queue.front().data.size();
+                const float needed = size < state.burst ? size : state.burst;
+                const float refill = ( needed - state.tokens ) / state.rate;
+                if ( refill > wait )
+                    wait = refill;
+            }
+            if ( wait < 0.0f )
+                wait = 0.0f;
+            if ( next < 0.0f || wait < next )
+                next = wait;
+        }
+        return next;
+    }
+    
+    Pacer::PeerState & Pacer::GetPeer( int peer )
+    {
+        assert( peer >= 0 );
+        if ( peer >= (int) peers.size() )
+            peers.resize( peer + 1 );
+        return peers[peer];
+    }
+}
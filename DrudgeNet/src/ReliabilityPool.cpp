@@ -0,0 +1,505 @@
+#include "ReliabilityPool.h"
+#include "ReliabilitySystem.h"
+#include <math.h>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace Net
+{
+    static inline int CountTrailingZeros( unsigned int value )
+    {
+        assert( value != 0 );
+#if defined(__GNUC__) || defined(__clang__)
+        return __builtin_ctz( value );
+#elif defined(_MSC_VER)
+        unsigned long index;
+        _BitScanForward( &index, value );
+        return (int) index;
+#else
+        int count = 0;
+        while ( ( value & 1 ) == 0 )
+        {
+            value >>= 1;
+            count++;
+        }
+        return count;
+#endif
+    }
+    
+    template <typename Sequence>
+    BasicReliabilityPool<Sequence>::BasicReliabilityPool( int capacity, unsigned int max_sequence ) : sequence( max_sequence )
+    {
+        assert( capacity >= 0 );
+        // with a small sequence space every sequence gets its own slot, so wrap around never aliases
+        buffer_size = PacketBufferSize;
+        if ( sequence.GetMax() < (unsigned int) PacketBufferSize )
+            buffer_size = (int) sequence.GetMax() + 1;
+        stats_window = 1.0f;
+        this->capacity = 0;
+        peer_count = 0;
+        Grow( capacity );
+    }
+    
+    template <typename Sequence>
+    BasicReliabilityPool<Sequence>::~BasicReliabilityPool()
+    {
+        for ( size_t i = 0; i < handles.size(); ++i )
+            delete handles[i];
+    }
+    
+    template <typename Sequence>
+    void BasicReliabilityPool<Sequence>::Grow( int capacity )
+    {
+        if ( capacity <= this->capacity )
+            return;
+        this->capacity = capacity;
+        active.resize( capacity, 0 );
+        time.resize( capacity );
+        update_interval.resize( capacity );
+        local_sequence.resize( capacity );
+        remote_sequence.resize( capacity );
+        ack_bits.resize( capacity );
+        pending_sequence.resize( capacity );
+        largest_acked.resize( capacity );
+        largest_acked_valid.resize( capacity );
+        sent_packets.resize( capacity );
+        recv_packets.resize( capacity );
+        lost_packets.resize( capacity );
+        acked_packets.resize( capacity );
+        sent_bytes_total.resize( capacity );
+        recv_bytes_total.resize( capacity );
+        acked_bytes_total.resize( capacity );
+        for ( int i = 0; i < RateCount; ++i )
+        {
+            rates[i].resize( capacity );
+            rates_pending[i].resize( capacity );
+        }
+        srtt.resize( capacity );
+        rttvar.resize( capacity );
+        rto.resize( capacity );
+        rto_minimum.resize( capacity );
+        rtt_maximum.resize( capacity );
+        min_rtt.resize( capacity );
+        min_rtt_window.resize( capacity );
+        min_rtt_time.resize( capacity );
+        latest_rtt.resize( capacity );
+        rtt_sampled.resize( capacity );
+        ack_delay.resize( capacity );
+        max_unacked_packets.resize( capacity );
+        unacked_packets.resize( capacity );
+        ack_pending_time.resize( capacity );
+        loss_packet_threshold.resize( capacity );
+        loss_time_threshold.resize( capacity );
+        packet_lost_callback.resize( capacity, NULL );
+        packet_lost_context.resize( capacity, NULL );
+        acks.resize( capacity );
+        sentPackets.resize( capacity, SequenceBuffer<SentPacketData>( buffer_size ) );
+        receivedPackets.resize( capacity, SequenceBuffer<ReceivedPacketData>( buffer_size ) );
+        handles.resize( capacity, NULL );
+    }
+    
+    template <typename Sequence>
+    int BasicReliabilityPool<Sequence>::AddPeer()
+    {
+        int peer = 0;
+        while ( peer < capacity && active[peer] )
+            peer++;
+        if ( peer == capacity )
+            Grow( capacity > 0 ? capacity * 2 : 1 );
+        active[peer] = 1;
+        peer_count++;
+        ack_delay[peer] = 0.05f;
+        max_unacked_packets[peer] = 16;
+        rto_minimum[peer] = 0.05f;
+        min_rtt_window[peer] = 10.0f;
+        loss_packet_threshold[peer] = 3;
+        loss_time_threshold[peer] = 9.0f / 8.0f;
+        packet_lost_callback[peer] = NULL;
+        packet_lost_context[peer] = NULL;
+        acks[peer].reserve( buffer_size );
+        ResetPeer( peer );
+        return peer;
+    }
+    
+    template <typename Sequence>
+    void BasicReliabilityPool<Sequence>::RemovePeer( int peer )
+    {
+        assert( IsPeerActive( peer ) );
+        ResetPeer( peer );
+        active[peer] = 0;
+        peer_count--;
+    }
+    
+    template <typename Sequence>
+    void BasicReliabilityPool<Sequence>::ResetPeer( int peer )
+    {
+        assert( peer >= 0 && peer < capacity );
+        time[peer] = 0.0;
+        update_interval[peer] = 0.0f;
+        local_sequence[peer] = 0;
+        remote_sequence[peer] = 0;
+        ack_bits[peer] = 0;
+        pending_sequence[peer] = 0;
+        largest_acked[peer] = 0;
+        largest_acked_valid[peer] = 0;
+        sent_packets[peer] = 0;
+        recv_packets[peer] = 0;
+        lost_packets[peer] = 0;
+        acked_packets[peer] = 0;
+        sent_bytes_total[peer] = 0;
+        recv_bytes_total[peer] = 0;
+        acked_bytes_total[peer] = 0;
+        for ( int i = 0; i < RateCount; ++i )
+        {
+            rates[i][peer] = 0.0f;
+            rates_pending[i][peer] = 0.0f;
+        }
+        rtt_maximum[peer] = 1.0f;
+        srtt[peer] = 0.0f;
+        rttvar[peer] = 0.0f;
+        rto[peer] = rtt_maximum[peer];
+        min_rtt[peer] = 0.0f;
+        min_rtt_time[peer] = 0.0;
+        latest_rtt[peer] = 0.0f;
+        rtt_sampled[peer] = 0;
+        unacked_packets[peer] = 0;
+        ack_pending_time[peer] = 0.0f;
+        acks[peer].clear();
+        sentPackets[peer].Reset();
+        receivedPackets[peer].Reset();
+    }
+    
+    template <typename Sequence>
+    BasicReliabilitySystem<Sequence> & BasicReliabilityPool<Sequence>::GetPeer( int peer )
+    {
+        assert( IsPeerActive( peer ) );
+        if ( !handles[peer] )
+            handles[peer] = new BasicReliabilitySystem<Sequence>( *this, peer );
+        return *handles[peer];
+    }
+    
+    template <typename Sequence>
+    void BasicReliabilityPool<Sequence>::SetStatsWindow( float window )
+    {
+        assert( window > 0.0f );
+        stats_window = window;
+    }
+    
+    template <typename Sequence>
+    void BasicReliabilityPool<Sequence>::Update( float deltaTime )
+    {
+        // clocks and ack timers, free slots tick along too so the loop has no branches
+        for ( int i = 0; i < capacity; ++i )
+        {
+            time[i] += deltaTime;
+            update_interval[i] = deltaTime;
+            ack_pending_time[i] += unacked_packets[i] > 0 ? deltaTime : 0.0f;
+        }
+        
+        // fold amounts added since the last update into the moving averages
+        if ( deltaTime > 0.0f )
+        {
+            float alpha = deltaTime / stats_window;
+            if ( alpha > 1.0f )
+                alpha = 1.0f;
+            const float scale = 1.0f / deltaTime;
+            for ( int r = 0; r < RateCount; ++r )
+            {
+                float * rate = capacity > 0 ? &rates[r][0] : NULL;
+                float * pending = capacity > 0 ? &rates_pending[r][0] : NULL;
+                for ( int i = 0; i < capacity; ++i )
+                {
+                    rate[i] += ( pending[i] * scale - rate[i] ) * alpha;
+                    pending[i] = 0.0f;
+                }
+            }
+        }
+        
+        // acks and loss, only peers with packets in flight have anything to expire
+        for ( int i = 0; i < capacity; ++i )
+        {
+            acks[i].clear();
+            if ( active[i] && pending_sequence[i] != local_sequence[i] )
+                DetectLostPackets( i );
+        }
+    }
+    
+    template <typename Sequence>
+    void BasicReliabilityPool<Sequence>::UpdatePeer( int peer, float deltaTime )
+    {
+        acks[peer].clear();
+        time[peer] += deltaTime;
+        update_interval[peer] = deltaTime;
+        if ( unacked_packets[peer] > 0 )
+            ack_pending_time[peer] += deltaTime;
+        // no acks needed, time alone can push packets past the time threshold or rto
+        DetectLostPackets( peer );
+        if ( deltaTime > 0.0f )
+        {
+            float alpha = deltaTime / stats_window;
+            if ( alpha > 1.0f )
+                alpha = 1.0f;
+            for ( int r = 0; r < RateCount; ++r )
+            {
+                rates[r][peer] += ( rates_pending[r][peer] / deltaTime - rates[r][peer] ) * alpha;
+                rates_pending[r][peer] = 0.0f;
+            }
+        }
+    }
+    
+    template <typename Sequence>
+    void BasicReliabilityPool<Sequence>::PacketSent( int peer, int size )
+    {
+        SequenceBuffer<SentPacketData> & sent = sentPackets[peer];
+        // a packet still waiting for its ack when its slot gets reused can never be acked now
+        const int index = sent.GetIndex( local_sequence[peer] );
+        SentPacketData * evicted = sent.GetAtIndex( index );
+        if ( evicted && !evicted->acked && !evicted->lost )
+            PacketLost( peer, sent.GetSequenceAtIndex( index ), *evicted );
+        SentPacketData * data = sent.Insert( local_sequence[peer] );
+        data->time = time[peer];
+        data->size = size;
+        data->acked = false;
+        data->lost = false;
+        sent_bytes_total[peer] += size;
+        sent_packets[peer]++;
+        rates_pending[SentBytes][peer] += (float) size;
+        rates_pending[SentPackets][peer] += 1.0f;
+        AckSent( peer );
+        local_sequence[peer] = sequence.Next( local_sequence[peer] );
+    }
+    
+    template <typename Sequence>
+    void BasicReliabilityPool<Sequence>::PacketReceived( int peer, unsigned int packet_sequence, int size )
+    {
+        SequenceBuffer<ReceivedPacketData> & received = receivedPackets[peer];
+        SequenceType & remote = remote_sequence[peer];
+        unsigned int & bits = ack_bits[peer];
+        const SequenceType packet = (SequenceType) packet_sequence;
+        assert( packet == packet_sequence );
+        recv_packets[peer]++;
+        rates_pending[ReceivedPackets][peer] += 1.0f;
+        if ( sequence.IsMoreRecent( packet, remote ) )
+        {
+            // shift the ack bits along, the previous remote sequence becomes bit gap - 1
+            const unsigned int gap = sequence.Difference( packet, remote );
+            const bool remote_received = received.Exists( remote );
+            bits = gap < 32 ? bits << gap : 0;
+            if ( remote_received && gap <= 32 )
+                bits |= 1u << ( gap - 1 );
+            // forget whatever was stored for the sequences we skipped over, they were not received
+            SequenceType stale = remote;
+            for ( unsigned int i = 1; i < gap && i <= (unsigned int) received.GetSize(); ++i )
+            {
+                stale = sequence.Next( stale );
+                received.Remove( stale );
+            }
+            remote = packet;
+        }
+        else
+        {
+            if ( received.Exists( packet ) )
+                return;
+            const unsigned int distance = sequence.Difference( remote, packet );
+            // too old to track, the ack bits can't reach it anyway
+            if ( distance >= (unsigned int) received.GetSize() )
+            {
+                recv_bytes_total[peer] += size;
+                rates_pending[ReceivedBytes][peer] += (float) size;
+                return;
+            }
+            if ( distance >= 1 && distance <= 32 )
+                bits |= 1u << ( distance - 1 );
+        }
+        ReceivedPacketData * data = received.Insert( packet );
+        data->time = time[peer];
+        data->size = size;
+        recv_bytes_total[peer] += size;
+        rates_pending[ReceivedBytes][peer] += (float) size;
+        if ( unacked_packets[peer] == 0 )
+            ack_pending_time[peer] = 0.0f;
+        unacked_packets[peer]++;
+    }
+    
+    template <typename Sequence>
+    void BasicReliabilityPool<Sequence>::ProcessAck( int peer, unsigned int packet_ack, unsigned int ack_bits )
+    {
+        const SequenceType ack = (SequenceType) packet_ack;
+        // only the packet named by ack was certainly just received, the rest may have been acked
+        // long ago by packets we never got, so only it gives an unambiguous round trip time sample
+        AckPacket( peer, ack, true );
+        if ( sentPackets[peer].Exists( ack ) &&
+             ( !largest_acked_valid[peer] || sequence.IsMoreRecent( ack, largest_acked[peer] ) ) )
+        {
+            largest_acked[peer] = ack;
+            largest_acked_valid[peer] = 1;
+        }
+        // with a tiny sequence space the high bits would alias sequences already covered
+        if ( sequence.GetMax() < 32 )
+            ack_bits &= ( 1u << sequence.GetMax() ) - 1;
+        // visit only the set bits, lowest first
+        while ( ack_bits )
+        {
+            const unsigned int bit_index = (unsigned int) CountTrailingZeros( ack_bits );
+            ack_bits &= ack_bits - 1;
+            AckPacket( peer, sequence.Previous( ack, bit_index + 1 ), false );
+        }
+        DetectLostPackets( peer );
+    }
+    
+    template <typename Sequence>
+    void BasicReliabilityPool<Sequence>::AckSent( int peer )
+    {
+        unacked_packets[peer] = 0;
+        ack_pending_time[peer] = 0.0f;
+    }
+    
+    template <typename Sequence>
+    bool BasicReliabilityPool<Sequence>::IsAckRequired( int peer ) const
+    {
+        if ( unacked_packets[peer] == 0 )
+            return false;
+        return ack_pending_time[peer] >= ack_delay[peer] || unacked_packets[peer] >= max_unacked_packets[peer];
+    }
+    
+    template <typename Sequence>
+    void BasicReliabilityPool<Sequence>::Validate( int peer ) const
+    {
+        const SequenceBuffer<SentPacketData> & sent = sentPackets[peer];
+        for ( int i = 0; i < sent.GetSize(); ++i )
+        {
+            const SentPacketData * data = sent.GetAtIndex( i );
+            if ( !data )
+                continue;
+            assert( sent.GetSequenceAtIndex( i ) <= sequence.GetMax() );
+            assert( sent.GetIndex( sent.GetSequenceAtIndex( i ) ) == i );
+            assert( data->time <= time[peer] );
+        }
+        const SequenceBuffer<ReceivedPacketData> & received = receivedPackets[peer];
+        for ( int i = 0; i < received.GetSize(); ++i )
+        {
+            const ReceivedPacketData * data = received.GetAtIndex( i );
+            if ( !data )
+                continue;
+            assert( received.GetSequenceAtIndex( i ) <= sequence.GetMax() );
+            assert( received.GetIndex( received.GetSequenceAtIndex( i ) ) == i );
+            assert( data->time <= time[peer] );
+        }
+    }
+    
+    template <typename Sequence>
+    void BasicReliabilityPool<Sequence>::AckPacket( int peer, SequenceType packet, bool sample_rtt )
+    {
+        SentPacketData * data = sentPackets[peer].Find( packet );
+        if ( !data || data->acked )
+            return;
+        data->acked = true;
+        if ( data->lost )
+        {
+            // it arrived after all, but it is unclear how long ago so don't sample it (Karn)
+            data->lost = false;
+            lost_packets[peer]--;
+        }
+        else if ( sample_rtt )
+        {
+            UpdateRoundTripTime( peer, (float) ( time[peer] - data->time ) );
+        }
+        acks[peer].push_back( packet );
+        acked_packets[peer]++;
+        acked_bytes_total[peer] += data->size;
+        rates_pending[AckedBytes][peer] += (float) data->size;
+    }
+    
+    template <typename Sequence>
+    void BasicReliabilityPool<Sequence>::UpdateRoundTripTime( int peer, float sample )
+    {
+        latest_rtt[peer] = sample;
+        if ( !rtt_sampled[peer] || sample <= min_rtt[peer] || time[peer] - min_rtt_time[peer] > min_rtt_window[peer] )
+        {
+            min_rtt[peer] = sample;
+            min_rtt_time[peer] = time[peer];
+        }
+        if ( !rtt_sampled[peer] )
+        {
+            srtt[peer] = sample;
+            rttvar[peer] = sample * 0.5f;
+            rtt_sampled[peer] = 1;
+        }
+        else
+        {
+            rttvar[peer] += ( fabsf( srtt[peer] - sample ) - rttvar[peer] ) * 0.25f;
+            srtt[peer] += ( sample - srtt[peer] ) * 0.125f;
+        }
+        const float variation = 4.0f * rttvar[peer];
+        float timeout = srtt[peer] + ( variation > update_interval[peer] ? variation : update_interval[peer] );
+        if ( timeout < rto_minimum[peer] )
+            timeout = rto_minimum[peer];
+        if ( timeout > rtt_maximum[peer] )
+            timeout = rtt_maximum[peer];
+        rto[peer] = timeout;
+    }
+    
+    template <typename Sequence>
+    void BasicReliabilityPool<Sequence>::DetectLostPackets( int peer )
+    {
+        const float epsilon = 0.001f;
+        
+        // a packet is lost once a packet sent loss_packet_threshold later has been acked,
+        // or once it is older than loss_time_threshold round trips and a later packet has been acked
+        float loss_delay = srtt[peer] > latest_rtt[peer] ? srtt[peer] : latest_rtt[peer];
+        loss_delay *= loss_time_threshold[peer];
+        if ( loss_delay < update_interval[peer] )
+            loss_delay = update_interval[peer];
+        
+        // walk outstanding packets oldest first. they were sent in order, so once one is neither
+        // expired nor over a threshold none of the packets sent after it can be either
+        SequenceBuffer<SentPacketData> & sent = sentPackets[peer];
+        SequenceType & pending = pending_sequence[peer];
+        bool expired = false;
+        while ( pending != local_sequence[peer] )
+        {
+            SentPacketData * data = sent.Find( pending );
+            if ( data && !data->acked && !data->lost )
+            {
+                const float age = (float) ( time[peer] - data->time );
+                bool lost = age > rto[peer] + epsilon;
+                if ( lost )
+                    expired = true;
+                else if ( largest_acked_valid[peer] && sequence.IsMoreRecent( largest_acked[peer], pending ) )
+                {
+                    lost = sequence.Difference( largest_acked[peer], pending ) >= loss_packet_threshold[peer] ||
+                           ( rtt_sampled[peer] && age >= loss_delay );
+                }
+                if ( !lost )
+                    break;
+                // keep it around flagged, a late ack still gets reported
+                PacketLost( peer, pending, *data );
+            }
+            pending = sequence.Next( pending );
+        }
+        
+        // back off until a fresh sample arrives, otherwise a jump in round trip time would have every
+        // packet expire before its ack and Karn's rule would never let the estimate catch up
+        if ( expired )
+        {
+            rto[peer] *= 2.0f;
+            if ( rto[peer] > rtt_maximum[peer] )
+                rto[peer] = rtt_maximum[peer];
+        }
+    }
+    
+    template <typename Sequence>
+    void BasicReliabilityPool<Sequence>::PacketLost( int peer, SequenceType packet, SentPacketData & data )
+    {
+        data.lost = true;
+        lost_packets[peer]++;
+        if ( packet_lost_callback[peer] )
+            packet_lost_callback[peer]( packet_lost_context[peer], packet, data.size );
+    }
+    
+    template class BasicReliabilityPool<SequenceRuntime>;
+    template class BasicReliabilityPool<Sequence16>;
+    template class BasicReliabilityPool<Sequence32>;
+}
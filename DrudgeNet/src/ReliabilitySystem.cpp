@@ -2,95 +2,74 @@
 
 namespace Net
 {
-    ReliabilitySystem::ReliabilitySystem( unsigned int max_sequence )
-    {
-        this->max_sequence = max_sequence;
-        Reset();
-    }
-    
-    void ReliabilitySystem::Reset()
-    {
-        local_sequence = 0;
-        remote_sequence = 0;
-        sentQueue.clear();
-        receivedQueue.clear();
-        pendingAckQueue.clear();
-        ackedQueue.clear();
-        sent_packets = 0;
-        recv_packets = 0;
-        lost_packets = 0;
-        acked_packets = 0;
-        sent_bandwidth = 0.0f;
-        acked_bandwidth = 0.0f;
-        sent_bytes_total = 0;
-        recv_bytes_total = 0;
-        rtt = 0.0f;
-        rtt_maximum = 1.0f;
-    }
-    
-    void ReliabilitySystem::PacketSent( int size ) {
-        if ( sentQueue.Exists( local_sequence ) ) {
-            printf( "ReliabilitySystem: local sequence %d exists\n", local_sequence );
-            for ( PacketQueue::iterator itor = sentQueue.begin(); itor != sentQueue.end(); ++itor )
-                printf( " + %d\n", itor->sequence );
-        }
-        assert( !sentQueue.Exists( local_sequence ) );
-        assert( !pendingAckQueue.Exists( local_sequence ) );
-        PacketData data;
-        data.sequence = local_sequence;
-        data.time = 0.0f;
-        data.size = size;
-        sent_bytes_total += size;
-        sentQueue.push_back( data );
-        pendingAckQueue.push_back( data );
-        sent_packets++;
-        local_sequence++;
-        if ( local_sequence > max_sequence )
-            local_sequence = 0;
-    }
-    
-    void ReliabilitySystem::PacketReceived( unsigned int sequence, int size ) {
-        recv_packets++;
-        if ( receivedQueue.Exists( sequence ) )
-            return;
-        PacketData data;
-        data.sequence = sequence;
-        data.time = 0.0f;
-        data.size = size;
-        recv_bytes_total += size;
-        receivedQueue.push_back( data );
-        if ( IsSequenceMoreRecent( sequence, remote_sequence, max_sequence ) )
-            remote_sequence = sequence;
+    template <typename Sequence>
+    BasicReliabilitySystem<Sequence>::BasicReliabilitySystem( unsigned int max_sequence ) {
+        pool = new Pool( 1, max_sequence );
+        peer = pool->AddPeer();
+        owns_pool = true;
+    }
+    
+    template <typename Sequence>
+    BasicReliabilitySystem<Sequence>::BasicReliabilitySystem( Pool & pool, int peer ) {
+        this->pool = &pool;
+        this->peer = peer;
+        owns_pool = false;
+    }
+    
+    template <typename Sequence>
+    BasicReliabilitySystem<Sequence>::~BasicReliabilitySystem() {
+        if ( owns_pool )
+            delete pool;
+    }
+    
+    template <typename Sequence>
+    void BasicReliabilitySystem<Sequence>::Reset() {
+        pool->ResetPeer( peer );
     }
     
-    unsigned int ReliabilitySystem::GenerateAckBits() {
-        return GenerateAckBits( GetRemoteSequence(), receivedQueue, max_sequence );
+    template <typename Sequence>
+    void BasicReliabilitySystem<Sequence>::PacketSent( int size ) {
+        pool->PacketSent( peer, size );
     }
     
-    void ReliabilitySystem::ProcessAck( unsigned int ack, unsigned int ack_bits ) {
-        ProcessAck( ack, ack_bits, pendingAckQueue, ackedQueue, acks, acked_packets, rtt, max_sequence );
+    template <typename Sequence>
+    void BasicReliabilitySystem<Sequence>::PacketReceived( unsigned int sequence, int size ) {
+        pool->PacketReceived( peer, sequence, size );
     }
     
-    void ReliabilitySystem::Update( float deltaTime ) {
-        acks.clear();
-        AdvanceQueueTime( deltaTime );
-        UpdateQueues();
-        UpdateStats();
+    template <typename Sequence>
+    void BasicReliabilitySystem<Sequence>::ProcessAck( unsigned int ack, unsigned int ack_bits ) {
+        pool->ProcessAck( peer, ack, ack_bits );
     }
     
-    void ReliabilitySystem::Validate() {
-        sentQueue.VerifySorted( max_sequence );
-        receivedQueue.VerifySorted( max_sequence );
-        pendingAckQueue.VerifySorted( max_sequence );
-        ackedQueue.VerifySorted( max_sequence );
+    template <typename Sequence>
+    void BasicReliabilitySystem<Sequence>::AckSent() {
+        pool->AckSent( peer );
     }
     
+    template <typename Sequence>
+    bool BasicReliabilitySystem<Sequence>::IsAckRequired() const {
+        return pool->IsAckRequired( peer );
+    }
+    
+    template <typename Sequence>
+    void BasicReliabilitySystem<Sequence>::Update( float deltaTime ) {
+        // ticks this peer only, ReliabilityPool::Update ticks every peer at once
+        pool->UpdatePeer( peer, deltaTime );
+    }
+    
+    template <typename Sequence>
+    void BasicReliabilitySystem<Sequence>::Validate() {
+        pool->Validate( peer );
+    }
     
-    bool ReliabilitySystem::IsSequenceMoreRecent( unsigned int s1, unsigned int s2, unsigned int max_sequence ) {
+    template <typename Sequence>
+    bool BasicReliabilitySystem<Sequence>::IsSequenceMoreRecent( unsigned int s1, unsigned int s2, unsigned int max_sequence ) {
         return (( s1 > s2 ) && ( s1 - s2 <= max_sequence/2 )) || ((( s2 > s1 ) && ( s2 - s1 > max_sequence/2 )));
     }
     
-    int ReliabilitySystem::BitIndexForSequence( unsigned int sequence, unsigned int ack, unsigned int max_sequence ) {
+    template <typename Sequence>
+    int BasicReliabilitySystem<Sequence>::BitIndexForSequence( unsigned int sequence, unsigned int ack, unsigned int max_sequence ) {
         assert( sequence != ack );
         assert( !IsSequenceMoreRecent( sequence, ack, max_sequence ) );
         if ( sequence > ack ) {
@@ -105,7 +84,16 @@ namespace Net
         }
     }
     
-    unsigned int ReliabilitySystem::GenerateAckBits(unsigned int ack,
+    template <typename Sequence>
+    unsigned int BasicReliabilitySystem<Sequence>::SequenceDifference( unsigned int s1, unsigned int s2, unsigned int max_sequence ) {
+        // distance from s2 forward to s1 in a sequence space of [0,max_sequence]
+        if ( s1 >= s2 )
+            return s1 - s2;
+        return s1 + ( max_sequence - s2 ) + 1;
+    }
+    
+    template <typename Sequence>
+    unsigned int BasicReliabilitySystem<Sequence>::GenerateAckBits(unsigned int ack,
                                                     const PacketQueue & received_queue,
                                                     unsigned int max_sequence ) {
         unsigned int ack_bits = 0;
@@ -119,7 +107,8 @@ namespace Net
         return ack_bits;
     }
     
-    void ReliabilitySystem::ProcessAck( unsigned int ack, unsigned int ack_bits,
+    template <typename Sequence>
+    void BasicReliabilitySystem<Sequence>::ProcessAck( unsigned int ack, unsigned int ack_bits,
                             PacketQueue & pending_ack_queue, PacketQueue & acked_queue,
                             std::vector<unsigned int> & acks, unsigned int & acked_packets,
                             float & rtt, unsigned int max_sequence ) {
@@ -151,57 +140,7 @@ namespace Net
         }
     }
     
-    void ReliabilitySystem::AdvanceQueueTime( float deltaTime ) {
-        for ( PacketQueue::iterator itor = sentQueue.begin(); itor != sentQueue.end(); itor++ )
-            itor->time += deltaTime;
-        
-        for ( PacketQueue::iterator itor = receivedQueue.begin(); itor != receivedQueue.end(); itor++ )
-            itor->time += deltaTime;
-        
-        for ( PacketQueue::iterator itor = pendingAckQueue.begin(); itor != pendingAckQueue.end(); itor++ )
-            itor->time += deltaTime;
-        
-        for ( PacketQueue::iterator itor = ackedQueue.begin(); itor != ackedQueue.end(); itor++ )
-            itor->time += deltaTime;
-    }
-    
-    void ReliabilitySystem::UpdateQueues() {
-        const float epsilon = 0.001f;
-        
-        while ( sentQueue.size() && sentQueue.front().time > rtt_maximum + epsilon )
-            sentQueue.pop_front();
-        
-        if ( receivedQueue.size() ) {
-            const unsigned int latest_sequence = receivedQueue.back().sequence;
-            const unsigned int minimum_sequence = latest_sequence >= 34 ? ( latest_sequence - 34 ) : max_sequence - ( 34 - latest_sequence );
-            while ( receivedQueue.size() && !IsSequenceMoreRecent( receivedQueue.front().sequence, minimum_sequence, max_sequence ) )
-                receivedQueue.pop_front();
-        }
-        
-        while ( ackedQueue.size() && ackedQueue.front().time > rtt_maximum * 2 - epsilon )
-            ackedQueue.pop_front();
-        
-        while ( pendingAckQueue.size() && pendingAckQueue.front().time > rtt_maximum + epsilon ) {
-            pendingAckQueue.pop_front();
-            lost_packets++;
-        }
-    }
-    
-    void ReliabilitySystem::UpdateStats() {
-        int sent_bytes_per_second = 0;
-        for ( PacketQueue::iterator itor = sentQueue.begin(); itor != sentQueue.end(); ++itor )
-            sent_bytes_per_second += itor->size;
-        int acked_packets_per_second = 0;
-        int acked_bytes_per_second = 0;
-        for ( PacketQueue::iterator itor = ackedQueue.begin(); itor != ackedQueue.end(); ++itor ) {
-            if ( itor->time >= rtt_maximum ) {
-                acked_packets_per_second++;
-                acked_bytes_per_second += itor->size;
-            }
-        }
-        sent_bytes_per_second = (int)(sent_bytes_per_second / rtt_maximum);
-        acked_bytes_per_second = (int)(acked_bytes_per_second / rtt_maximum);
-        sent_bandwidth = sent_bytes_per_second * ( 8 / 1000.0f );
-        acked_bandwidth = acked_bytes_per_second * ( 8 / 1000.0f );
-    }
+    template class BasicReliabilitySystem<SequenceRuntime>;
+    template class BasicReliabilitySystem<Sequence16>;
+    template class BasicReliabilitySystem<Sequence32>;
 }
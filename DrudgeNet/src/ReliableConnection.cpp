@@ -2,16 +2,20 @@
 
 namespace Net
 {
-    ReliableConnection::ReliableConnection(unsigned int protocolId,
-                                           float timeout,
-                                           unsigned int max_sequence ) :
+    template <typename Sequence>
+    BasicReliableConnection<Sequence>::BasicReliableConnection(unsigned int protocolId,
+                                                               float timeout,
+                                                               unsigned int max_sequence ) :
     Connection( protocolId, timeout ),
-    reliabilitySystem( max_sequence )
+    reliabilitySystem( max_sequence ),
+    flowControl( FlowControl::AIMD )
     {
+        reliabilitySystem.SetPacketLostCallback( PacketLost, this );
         ClearData();
     }
     
-    ReliableConnection::~ReliableConnection()
+    template <typename Sequence>
+    BasicReliableConnection<Sequence>::~BasicReliableConnection()
     {
         if ( IsRunning() )
             Stop();
@@ -19,7 +23,8 @@ namespace Net
     
     // overriden functions from "Connection"
     
-    bool ReliableConnection::SendPacket( const unsigned char data[], int size )
+    template <typename Sequence>
+    bool BasicReliableConnection<Sequence>::SendPacket( const unsigned char data[], int size )
     {
         const int header = 12;
         unsigned char * packet = new unsigned char[header+size];
@@ -31,31 +36,41 @@ namespace Net
         if ( !Connection::SendPacket( packet, size + header ) )
             return false;
         reliabilitySystem.PacketSent( size );
+        flowControl.PacketSent( size );
         delete [] packet;
         return true;
     }
     
-    int ReliableConnection::ReceivePacket( unsigned char data[], int size )
+    template <typename Sequence>
+    int BasicReliableConnection<Sequence>::ReceivePacket( unsigned char data[], int size )
     {
         const int header = 12;
         if ( size <= header )
             return false;
         unsigned char * packet = new unsigned char[header+size];
-        int received_bytes = Connection::ReceivePacket( packet, size + header );
-        if ( received_bytes == 0 )
-        {
-            delete [] packet;
-            return false;
-        }
-        if ( received_bytes <= header )
-        {
-            delete [] packet;
-            return false;
-        }
+        int received_bytes = 0;
         unsigned int packet_sequence = 0;
         unsigned int packet_ack = 0;
         unsigned int packet_ack_bits = 0;
-        ReadHeader( packet, packet_sequence, packet_ack, packet_ack_bits );
+        while ( true )
+        {
+            received_bytes = Connection::ReceivePacket( packet, size + header );
+            if ( received_bytes == 0 )
+            {
+                delete [] packet;
+                return false;
+            }
+            if ( received_bytes < header )
+            {
+                delete [] packet;
+                return false;
+            }
+            ReadHeader( packet, packet_sequence, packet_ack, packet_ack_bits );
+            if ( received_bytes > header )
+                break;
+            // ack packet: header only, carries acks but is not sequenced itself
+            reliabilitySystem.ProcessAck( packet_ack, packet_ack_bits );
+        }
         reliabilitySystem.PacketReceived( packet_sequence, received_bytes - header );
         reliabilitySystem.ProcessAck( packet_ack, packet_ack_bits );
         memcpy( data, packet + header, received_bytes - header );
@@ -63,18 +78,26 @@ namespace Net
         return received_bytes - header;
     }
     
-    void ReliableConnection::Update( float deltaTime )
+    template <typename Sequence>
+    void BasicReliableConnection<Sequence>::Update( float deltaTime )
     {
         Connection::Update( deltaTime );
         reliabilitySystem.Update( deltaTime );
+        flowControl.PacketsAcked( reliabilitySystem.GetAckedTotal() - ackedTotal );
+        ackedTotal = reliabilitySystem.GetAckedTotal();
+        flowControl.Update( deltaTime, reliabilitySystem.GetRoundTripTime() * 1000.0f, reliabilitySystem.GetMinRoundTripTime() * 1000.0f );
+        if ( IsConnected() && reliabilitySystem.IsAckRequired() )
+            SendAckPacket();
     }
     
-    int ReliableConnection::GetHeaderSize() const
+    template <typename Sequence>
+    int BasicReliableConnection<Sequence>::GetHeaderSize() const
     {
         return Connection::GetHeaderSize() + reliabilitySystem.GetHeaderSize();
     }
     
-    void ReliableConnection::WriteInteger( unsigned char * data, unsigned int value )
+    template <typename Sequence>
+    void BasicReliableConnection<Sequence>::WriteInteger( unsigned char * data, unsigned int value )
     {
         data[0] = (unsigned char) ( value >> 24 );
         data[1] = (unsigned char) ( ( value >> 16 ) & 0xFF );
@@ -82,39 +105,73 @@ namespace Net
         data[3] = (unsigned char) ( value & 0xFF );
     }
     
-    void ReliableConnection::WriteHeader( unsigned char * header, unsigned int sequence, unsigned int ack, unsigned int ack_bits )
+    template <typename Sequence>
+    void BasicReliableConnection<Sequence>::WriteHeader( unsigned char * header, unsigned int sequence, unsigned int ack, unsigned int ack_bits )
     {
         WriteInteger( header, sequence );
         WriteInteger( header + 4, ack );
         WriteInteger( header + 8, ack_bits );
     }
     
-    void ReliableConnection::ReadInteger( const unsigned char * data, unsigned int & value )
+    template <typename Sequence>
+    void BasicReliableConnection<Sequence>::ReadInteger( const unsigned char * data, unsigned int & value )
     {
         value = ( ( (unsigned int)data[0] << 24 ) | ( (unsigned int)data[1] << 16 ) |
                  ( (unsigned int)data[2] << 8 )  | ( (unsigned int)data[3] ) );
     }
     
-    void ReliableConnection::ReadHeader( const unsigned char * header, unsigned int & sequence, unsigned int & ack, unsigned int & ack_bits )
+    template <typename Sequence>
+    void BasicReliableConnection<Sequence>::ReadHeader( const unsigned char * header, unsigned int & sequence, unsigned int & ack, unsigned int & ack_bits )
     {
         ReadInteger( header, sequence );
         ReadInteger( header + 4, ack );
         ReadInteger( header + 8, ack_bits );
     }
     
-    void ReliableConnection::OnStop()
+    template <typename Sequence>
+    bool BasicReliableConnection<Sequence>::SendAckPacket()
+    {
+        const int header = 12;
+        unsigned char packet[header];
+        unsigned int seq = reliabilitySystem.GetLocalSequence();
+        unsigned int ack = reliabilitySystem.GetRemoteSequence();
+        unsigned int ack_bits = reliabilitySystem.GenerateAckBits();
+        WriteHeader( packet, seq, ack, ack_bits );
+        if ( !Connection::SendPacket( packet, header ) )
+            return false;
+        reliabilitySystem.AckSent();
+        return true;
+    }
+    
+    template <typename Sequence>
+    void BasicReliableConnection<Sequence>::OnStop()
     {
         ClearData();
     }
     
-    void ReliableConnection::OnDisconnect()
+    template <typename Sequence>
+    void BasicReliableConnection<Sequence>::OnDisconnect()
     {
         ClearData();
     }
     
     
-    void ReliableConnection::ClearData()
+    template <typename Sequence>
+    void BasicReliableConnection<Sequence>::ClearData()
     {
         reliabilitySystem.Reset();
+        flowControl.Reset();
+        ackedTotal = 0;
     }
-}
\ No newline at end of file
+    
+    template <typename Sequence>
+    void BasicReliableConnection<Sequence>::PacketLost( void * context, unsigned int sequence, int size )
+    {
+        BasicReliableConnection * connection = (BasicReliableConnection*) context;
+        connection->flowControl.PacketLost( size );
+        connection->OnPacketLost( sequence );
+    }
+    
+    template class BasicReliableConnection<Sequence32>;
+    template class BasicReliableConnection<SequenceRuntime>;
+}
@@ -0,0 +1,194 @@
+#include "SendScheduler.h"
+#include <cassert>
+
+namespace Net
+{
+    SendScheduler::SendScheduler( float bandwidth )
+    {
+        assert( bandwidth >= 0.0f );
+        this->bandwidth = bandwidth;
+        burst_size = 4096.0f;
+        tokens = 0.0f;
+        virtual_time = 0.0;
+        drop_priority = Low;
+        max_queued_bytes = 64 * 1024;
+        send_function = NULL;
+        send_context = NULL;
+    }
+    
+    void SendScheduler::SetSendFunction( SendFunction function, void * context )
+    {
+        send_function = function;
+        send_context = context;
+    }
+    
+    void SendScheduler::SetBandwidth( float bandwidth )
+    {
+        assert( bandwidth >= 0.0f );
+        this->bandwidth = bandwidth;
+    }
+    
+    void SendScheduler::SetWeight( int peer, float weight )
+    {
+        assert( weight > 0.0f );
+        GetPeer( peer ).weight = weight;
+    }
+    
+    bool SendScheduler::Enqueue( int peer, const unsigned char data[], int size, Priority priority )
+    {
+        assert( data );
+        assert( size > 0 );
+        assert( priority >= High && priority < PriorityCount );
+        PeerState & state = GetPeer( peer );
+        if ( state.queued_bytes + size > max_queued_bytes )
+            return false;
+        // a peer that was idle starts from now in virtual time, it can't spend credit saved up while idle
+        if ( state.queued_bytes == 0 && state.finish < virtual_time )
+            state.finish = virtual_time;
+        state.queues[priority].push_back( std::vector<unsigned char>( data, data + size ) );
+        state.queued_bytes += size;
+        return true;
+    }
+    
+    void SendScheduler::Update( float deltaTime )
+    {
+        const bool limited = bandwidth > 0.0f;
+        float capacity = 0.0f;
+        if ( limited )
+        {
+            // budget doesn't build up past a burst, a quiet spell can't be made up for later
+            capacity = bandwidth * deltaTime > burst_size ? bandwidth * deltaTime : burst_size;
+            tokens += bandwidth * deltaTime;
+            if ( tokens > capacity )
+                tokens = capacity;
+        }
+        
+        for ( int i = 0; i < (int) peers.size(); ++i )
+            peers[i].active = peers[i].queued_bytes > 0;
+        
+        while ( true )
+        {
+            // the peer whose next packet would finish first in virtual time
+            int next = -1;
+            double next_start = 0.0;
+            double next_finish = 0.0;
+            for ( int i = 0; i < (int) peers.size(); ++i )
+            {
+                PeerState & state = peers[i];
+                std::deque< std::vector<unsigned char> > * queue = GetNextQueue( state );
+                if ( !queue )
+                    continue;
+                const double start = state.finish;
+                const double finish = start + queue->front().size() / state.weight;
+                if ( next < 0 || finish < next_finish )
+                {
+                    next = i;
+                    next_start = start;
+                    next_finish = finish;
+                }
+            }
+            if ( next < 0 )
+                break;
+            
+            PeerState & state = peers[next];
+            std::deque< std::vector<unsigned char> > * queue = GetNextQueue( state );
+            const int size = (int) queue->front().size();
+            // a packet bigger than the burst goes once the budget is full
+            if ( limited && tokens < size && tokens < capacity )
+                break;
+            
+            bool sent = true;
+            if ( send_function )
+                sent = send_function( send_context, next, &queue->front()[0], size );
+            if ( sent )
+                state.send_rate.Add( (float) size );
+            else
+                state.dropped_packets++;
+            if ( limited )
+                tokens -= size;
+            state.finish = next_finish;
+            virtual_time = next_start;
+            state.queued_bytes -= size;
+            queue->pop_front();
+        }
+        
+        for ( int i = 0; i < (int) peers.size(); ++i )
+        {
+            PeerState & state = peers[i];
+            for ( int priority = drop_priority; priority < PriorityCount; ++priority )
+            {
+                std::deque< std::vector<unsigned char> > & queue = state.queues[priority];
+                while ( !queue.empty() )
+                {
+                    state.queued_bytes -= (int) queue.front().size();
+                    state.dropped_packets++;
+                    queue.pop_front();
+                }
+            }
+            state.send_rate.Update( deltaTime );
+        }
+    }
+    
+    void SendScheduler::Clear()
+    {
+        for ( int i = 0; i < (int) peers.size(); ++i )
+            Clear( i );
+        tokens = 0.0f;
+    }
+    
+    void SendScheduler::Clear( int peer )
+    {
+        if ( peer >= (int) peers.size() )
+            return;
+        for ( int priority = 0; priority < PriorityCount; ++priority )
+            peers[peer].queues[priority].clear();
+        peers[peer].queued_bytes = 0;
+    }
+    
+    int SendScheduler::GetQueuedPackets( int peer ) const
+    {
+        if ( peer >= (int) peers.size() )
+            return 0;
+        int count = 0;
+        for ( int priority = 0; priority < PriorityCount; ++priority )
+            count += (int) peers[peer].queues[priority].size();
+        return count;
+    }
+    
+    float SendScheduler::GetBudget( int peer ) const
+    {
+        if ( bandwidth <= 0.0f || peer >= (int) peers.size() )
+            return 0.0f;
+        float total_weight = 0.0f;
+        for ( int i = 0; i < (int) peers.size(); ++i )
+        {
+            if ( peers[i].active || i == peer )
+                total_weight += peers[i].weight;
+        }
+        return bandwidth * peers[peer].weight / total_weight;
+    }
+    
+    float SendScheduler::GetUsage( int peer ) const
+    {
+        const float budget = GetBudget( peer );
+        return budget > 0.0f ? GetSendRate( peer ) / budget : 0.0f;
+    }
+    
+    SendScheduler::PeerState & SendScheduler::GetPeer( int peer )
+    {
+        assert( peer >= 0 );
+        if ( peer >= (int) peers.size() )
+            peers.resize( peer + 1 );
+        return peers[peer];
+    }
+    
+    std::deque< std::vector<unsigned char> > * SendScheduler::GetNextQueue( PeerState & state )
+    {
+        for ( int priority = 0; priority < PriorityCount; ++priority )
+        {
+            if ( !state.queues[priority].empty() )
+                return &state.queues[priority];
+        }
+        return NULL;
+    }
+}
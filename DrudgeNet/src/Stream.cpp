@@ -1,12 +1,25 @@
 #include "Stream.h"
 #include <cassert>
+#include <cstring>
 
 namespace Net
 {    
+    // journal tokens: 0 = end, 1 = checkpoint, [2,66] = n - 2 bits written, 67 = a block of
+    // bytes with its length in the next 32 bits
+    const int JournalTokenBits = 7;
+    const unsigned int JournalBytesToken = 67;
+    
     Stream::Stream( Mode mode, void * buffer, int bytes, void * journal_buffer, int journal_bytes )
-    : bitpacker( mode == Write ? BitPacker::Write : BitPacker::Read, buffer, bytes ),
-    journal( mode == Write ? BitPacker::Write : BitPacker::Read, journal_buffer, journal_bytes )
+    : mode( mode ),
+    measured_bits( 0 ),
+    measure_bytes( mode == Measure ? bytes : 0 ),
+    field_name( NULL ),
+    field_file( NULL ),
+    field_line( 0 ),
+    bitpacker( mode == Read ? BitPacker::Read : BitPacker::Write, mode == Measure ? NULL : buffer, mode == Measure ? 0 : bytes ),
+    journal( mode == Read ? BitPacker::Read : BitPacker::Write, mode == Measure ? NULL : journal_buffer, mode == Measure ? 0 : journal_bytes )
     {
+        assert( bytes >= 0 );
     }
     
     bool Stream::SerializeBoolean( bool & value )
@@ -17,20 +30,22 @@ namespace Net
         return result;
     }
     
+    // signed values go as their offset from min, the same bits as before for any range inside the
+    // type. the offset is taken in unsigned arithmetic so the full range of the type works
+    
     bool Stream::SerializeByte( char & value, char min, char max )
     {
-        // wtf: why do I have to do this!?
-        unsigned int tmp = (unsigned int) ( value + 127 );
-        bool result = SerializeInteger( tmp, (unsigned int ) ( min + 127 ), ( max + 127 ) );
-        value = ( (char) tmp ) - 127;
+        unsigned int tmp = (unsigned int) ( value - min );
+        bool result = SerializeInteger( tmp, 0, (unsigned int) ( max - min ) );
+        value = (char) ( tmp + min );
         return result;
     }
     
     bool Stream::SerializeByte( signed char & value, signed char min, signed char max )
     {
-        unsigned int tmp = (unsigned int) ( value + 127 );
-        bool result = SerializeInteger( tmp, (unsigned int ) ( min + 127 ), ( max + 127 ) );
-        value = ( (signed char) tmp ) - 127;
+        unsigned int tmp = (unsigned int) ( value - min );
+        bool result = SerializeInteger( tmp, 0, (unsigned int) ( max - min ) );
+        value = (signed char) ( tmp + min );
         return result;
     }
     
@@ -44,9 +59,9 @@ namespace Net
     
     bool Stream::SerializeShort( signed short & value, signed short min, signed short max )
     {
-        unsigned int tmp = (unsigned int) ( value + 32767 );
-        bool result = SerializeInteger( tmp, (unsigned int ) ( min + 32767 ), ( max + 32767 ) );
-        value = ( (signed short) tmp ) - 32767;
+        unsigned int tmp = (unsigned int) ( value - min );
+        bool result = SerializeInteger( tmp, 0, (unsigned int) ( max - min ) );
+        value = (signed short) ( tmp + min );
         return result;
     }
     
@@ -60,16 +75,16 @@ namespace Net
     
     bool Stream::SerializeInteger( signed int & value, signed int min, signed int max )
     {
-        unsigned int tmp = (unsigned int) ( value + 2147483646 );
-        bool result = SerializeInteger( tmp, (unsigned int ) ( min + 2147483646 ), ( max + 2147483646 ) );
-        value = ( (signed int) tmp ) - 2147483646;
+        unsigned int tmp = (unsigned int) value - (unsigned int) min;
+        bool result = SerializeInteger( tmp, 0, (unsigned int) max - (unsigned int) min );
+        value = (signed int) ( tmp + (unsigned int) min );
         return result;
     }
     
     bool Stream::SerializeInteger( unsigned int & value, unsigned int min, unsigned int max )
     {
         assert( min < max );
-        if ( IsWriting() )
+        if ( !IsReading() )
         {
             assert( value >= min );
             assert( value <= max );
@@ -136,26 +151,17 @@ namespace Net
     {
         assert( bits >= 1 );
         assert( bits <= 32 );
-        if ( bitpacker.BitsRemaining() < bits )
-            return false;
-        if ( journal.IsValid() )
+        if ( IsMeasuring() )
         {
-            unsigned int token = 2 + bits;		// note: 0 = end, 1 = checkpoint, [2,34] = n - 2 bits written
-            if ( IsWriting() )
-            {
-                journal.WriteBits( token, 6 );
-            }
-            else
-            {
-                journal.ReadBits( token, 6 );
-                int bits_written = token - 2;
-                if ( bits != bits_written )
-                {
-                    printf( "desync read/write: attempting to read %d bits when %d bits were written\n", bits, bits_written );
-                    return false;
-                }
-            }
+            if ( GetBitsRemaining() < bits )
+                return false;
+            measured_bits += bits;
+            return true;
         }
+        if ( bitpacker.BitsRemaining() < bits )
+            return false;
+        if ( !JournalBits( bits ) )
+            return false;
         if ( IsReading() )
             bitpacker.ReadBits( value, bits );
         else
@@ -167,45 +173,195 @@ namespace Net
     {
         assert( bits >= 1 );
         assert( bits <= 64 );
+        if ( IsMeasuring() )
+        {
+            if ( GetBitsRemaining() < bits )
+                return false;
+            measured_bits += bits;
+            return true;
+        }
         if ( bitpacker.BitsRemaining() < bits )
             return false;
-        if ( journal.IsValid() )
+        if ( !JournalBits( bits ) )
+            return false;
+        if ( IsReading() )
+            bitpacker.ReadBits( value, bits );
+        else
+            bitpacker.WriteBits( value, bits );
+        return true;
+    }
+    
+    bool Stream::JournalBits( int bits )
+    {
+        if ( !journal.IsValid() )
+            return true;
+        unsigned int token = 2 + bits;		// note: 0 = end, 1 = checkpoint, [2,66] = n - 2 bits written
+        if ( IsWriting() )
         {
-            unsigned int token = 2 + bits;		// note: 0 = end, 1 = checkpoint, [2,66] = n - 2 bits written
-            if ( IsWriting() )
-            {
-                journal.WriteBits( token, 6 );
-            }
+            journal.WriteBits( token, JournalTokenBits );
+            return true;
+        }
+        journal.ReadBits( token, JournalTokenBits );
+        if ( token == JournalBytesToken )
+        {
+            unsigned int length = 0;
+            journal.ReadBits( length, 32 );
+            printf( "desync read/write: attempting to read %d bits when %d bytes were written\n", bits, (int) length );
+            return false;
+        }
+        int bits_written = token - 2;
+        if ( bits != bits_written )
+        {
+            if ( field_name )
+                printf( "desync read/write: attempting to read %d bits for %s at %s:%d when %d bits were written\n", bits, field_name, field_file, field_line, bits_written );
             else
+                printf( "desync read/write: attempting to read %d bits when %d bits were written\n", bits, bits_written );
+            return false;
+        }
+        return true;
+    }
+    
+    bool Stream::JournalBytes( int bytes )
+    {
+        if ( !journal.IsValid() )
+            return true;
+        unsigned int token = JournalBytesToken;
+        unsigned int length = (unsigned int) bytes;
+        if ( IsWriting() )
+        {
+            journal.WriteBits( token, JournalTokenBits );
+            journal.WriteBits( length, 32 );
+            return true;
+        }
+        journal.ReadBits( token, JournalTokenBits );
+        if ( token != JournalBytesToken )
+        {
+            printf( "desync read/write: attempting to read %d bytes when %d bits were written\n", bytes, (int) token - 2 );
+            return false;
+        }
+        journal.ReadBits( length, 32 );
+        if ( length != (unsigned int) bytes )
+        {
+            if ( field_name )
+                printf( "desync read/write: attempting to read %d bytes for %s at %s:%d when %d bytes were written\n", bytes, field_name, field_file, field_line, (int) length );
+            else
+                printf( "desync read/write: attempting to read %d bytes when %d bytes were written\n", bytes, (int) length );
+            return false;
+        }
+        return true;
+    }
+    
+    bool Stream::SerializeArray( unsigned int values[], int count, int bits )
+    {
+        assert( bits >= 1 );
+        assert( bits <= 32 );
+        assert( count >= 0 );
+        if ( IsMeasuring() )
+        {
+            if ( GetBitsRemaining() < count * bits )
+                return false;
+            measured_bits += count * bits;
+            return true;
+        }
+        if ( bitpacker.BitsRemaining() < count * bits )
+            return false;
+        if ( journal.IsValid() )
+        {
+            for ( int i = 0; i < count; ++i )
             {
-                journal.ReadBits( token, 6 );
-                int bits_written = token - 2;
-                if ( bits != bits_written )
-                {
-                    printf( "desync read/write: attempting to read %d bits when %d bits were written\n", bits, bits_written );
+                if ( !SerializeBits( values[i], bits ) )
                     return false;
-                }
             }
+            return true;
         }
         if ( IsReading() )
-            bitpacker.ReadBits( value, bits );
+            bitpacker.ReadArray( values, count, bits );
         else
-            bitpacker.WriteBits( value, bits );
+            bitpacker.WriteArray( values, count, bits );
+        return true;
+    }
+    
+    bool Stream::SerializeAlign()
+    {
+        const int bits = GetAlignBits();
+        if ( IsMeasuring() )
+        {
+            if ( GetBitsRemaining() < bits )
+                return false;
+            measured_bits += bits;
+            return true;
+        }
+        if ( bitpacker.BitsRemaining() < bits )
+            return false;
+        if ( IsReading() )
+            return bitpacker.ReadAlign();
+        bitpacker.WriteAlign();
+        return true;
+    }
+    
+    bool Stream::SerializeBytes( unsigned char data[], int bytes )
+    {
+        assert( bytes >= 0 );
+        if ( !SerializeAlign() )
+            return false;
+        // aligned, so the bits remaining are whole bytes. compared in bytes, a length read from
+        // a packet can't overflow the check and get to the copy
+        if ( bytes > GetBitsRemaining() / 8 )
+            return false;
+        if ( IsMeasuring() )
+        {
+            measured_bits += bytes * 8;
+            return true;
+        }
+        if ( !JournalBytes( bytes ) )
+            return false;
+        if ( IsReading() )
+            bitpacker.ReadBytes( data, bytes );
+        else
+            bitpacker.WriteBytes( data, bytes );
+        return true;
+    }
+    
+    bool Stream::SerializeString( char string[], int buffer_size )
+    {
+        assert( buffer_size >= 2 );
+        unsigned int length = 0;
+        if ( !IsReading() )
+        {
+            length = (unsigned int) strlen( string );
+            assert( length < (unsigned int) buffer_size );
+        }
+        // the length is checked here rather than by SerializeInteger, a bad packet isn't an assert
+        if ( !SerializeBits( length, BitsRequired( 0, buffer_size - 1 ) ) )
+            return false;
+        if ( length >= (unsigned int) buffer_size )
+            return false;
+        if ( !SerializeBytes( (unsigned char*) string, length ) )
+            return false;
+        if ( IsReading() )
+            string[length] = '\0';
         return true;
     }
     
     bool Stream::Checkpoint()
     {
+        if ( IsMeasuring() )
+        {
+            if ( GetBitsRemaining() < 32 )
+                return false;
+            measured_bits += 32;
+            return true;
+        }
         if ( journal.IsValid() )
         {
-            unsigned int token = 1;		// note: 0 = end, 1 = checkpoint, [2,34] = n - 2 bits written
+            unsigned int token = 1;		// note: 0 = end, 1 = checkpoint, [2,66] = n - 2 bits written
             if ( IsWriting() )
             {
-                journal.WriteBits( token, 6 );
+                journal.WriteBits( token, JournalTokenBits );
             }
             else
             {
-                journal.ReadBits( token, 6 );
+                journal.ReadBits( token, JournalTokenBits );
                 if ( token != 1 )
                 {
                     printf( "desync read/write: checkpoint not present in journal\n" );
@@ -234,24 +390,45 @@ namespace Net
     
     bool Stream::IsReading() const
     {
-        return bitpacker.GetMode() == BitPacker::Read;
+        return mode == Read;
     }
     
     bool Stream::IsWriting() const
     {
-        return bitpacker.GetMode() == BitPacker::Write;
+        return mode == Write;
+    }
+    
+    bool Stream::IsMeasuring() const
+    {
+        return mode == Measure;
+    }
+    
+    void Stream::Field( const char * name, const char * file, int line )
+    {
+        field_name = name;
+        field_file = file;
+        field_line = line;
     }
     
     int Stream::GetBitsProcessed() const
     {
+        if ( IsMeasuring() )
+            return measured_bits;
         return bitpacker.GetBits();
     }
     
     int Stream::GetBitsRemaining() const
     {
+        if ( IsMeasuring() )
+            return measure_bytes * 8 - measured_bits;
         return bitpacker.BitsRemaining();
     }
     
+    int Stream::GetAlignBits() const
+    {
+        return ( 8 - GetBitsProcessed() % 8 ) % 8;
+    }
+    
     int Stream::BitsRequired( unsigned int minimum, unsigned int maximum )
     {
         assert( maximum > minimum );
@@ -274,8 +451,19 @@ namespace Net
         return 32;
     }
     
+    void Stream::Flush()
+    {
+        if ( IsMeasuring() )
+            return;
+        bitpacker.FlushBits();
+        if ( journal.IsValid() )
+            journal.FlushBits();
+    }
+    
     int Stream::GetDataBytes() const
     {
+        if ( IsMeasuring() )
+            return ( measured_bits + 7 ) / 8;
         return bitpacker.GetBytes();
     }
     
@@ -290,15 +478,22 @@ namespace Net
         {
             printf( "-----------------------------\n" );
             printf( "dump journal:\n" );
+            journal.FlushBits();
             BitPacker reader( BitPacker::Read, journal.GetData(), journal.GetBytes() );
-            while ( reader.BitsRemaining() > 6 )
+            while ( reader.BitsRemaining() >= JournalTokenBits )
             {
                 unsigned int token = 0;
-                reader.ReadBits( token, 6 );
+                reader.ReadBits( token, JournalTokenBits );
                 if ( token == 0 )
                     break;
                 if ( token == 1 )
                     printf( " (checkpoint)\n" );
+                else if ( token == JournalBytesToken )
+                {
+                    unsigned int length = 0;
+                    reader.ReadBits( length, 32 );
+                    printf( " + %d bytes\n", (int) length );
+                }
                 else
                     printf( " + %d bits\n", token - 2 );
             }
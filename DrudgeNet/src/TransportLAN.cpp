@@ -17,6 +17,7 @@
 #include <string>
 #include <vector>
 #include <cassert>
+#include <chrono>
 
 #ifdef DEBUG
 #define NET_UNIT_TEST
@@ -25,6 +26,13 @@
 
 namespace Net
 {
+    // microseconds on a clock local to this machine, wraps every 71 minutes
+    static unsigned int GetTimestamp()
+    {
+        using namespace std::chrono;
+        return (unsigned int) duration_cast<microseconds>( steady_clock::now().time_since_epoch() ).count();
+    }
+    
     bool TransportLAN::Initialize()
     {
         return InitializeSockets();
@@ -48,9 +56,12 @@ namespace Net
         node = nullptr;
         beacon = nullptr;
         listener = nullptr;
-        beaconAccumulator = 1.0f;
+        beaconAccumulator.Reset( beaconAccumulator.GetInterval() );
         connectingByName = false;
         connectFailed = false;
+        scheduler.SetSendFunction( SendScheduledPacket, this );
+        pacer.SetSendFunction( SendPacedPacket, this );
+        backgroundPacer.SetSendFunction( SendBackgroundPacedPacket, this );
     }
     
     TransportLAN::~TransportLAN()
@@ -62,6 +73,7 @@ namespace Net
     {
         // todo: assert not already running
         this->config = config;
+        scheduler.SetBandwidth( config.uplinkBandwidth );
     }
     
     const TransportLAN::Config & TransportLAN::GetConfig() const
@@ -84,6 +96,7 @@ namespace Net
             return false;
         }
         mesh = new Mesh( config.protocolId, config.maxNodes, config.meshSendRate, config.timeout );
+        mesh->SetChecksum( config.checksum );
         if ( !mesh->Start( config.meshPort ) )
         {
             printf( "LAN Transport:failed to start mesh on port %d\n", config.meshPort );
@@ -91,6 +104,7 @@ namespace Net
             return 1;
         }
         node = new Node( config.protocolId, config.meshSendRate, config.timeout );
+        node->SetChecksum( config.checksum );
         if ( !node->Start( config.serverPort ) )
         {
             printf( "LAN Transport:failed to start node on port %d\n", config.serverPort );
@@ -130,6 +144,7 @@ namespace Net
         {
             printf( "LAN Transport: client connect to address: %d.%d.%d.%d:%d\n", a, b, c, d, port );
             node = new Node( config.protocolId, config.meshSendRate, config.timeout );
+            node->SetChecksum( config.checksum );
             if ( !node->Start( config.clientPort ) )
             {
                 printf( "LAN Transport: failed to start node on port %d\n", config.serverPort );
@@ -227,6 +242,9 @@ namespace Net
         }
         connectingByName = false;
         connectFailed = false;
+        scheduler.Clear();
+        pacer.Clear();
+        backgroundPacer.Clear();
     }
     
     // implement transport interface
@@ -249,24 +267,53 @@ namespace Net
         return node->GetMaxNodes();
     }
     
+    int TransportLAN::GetMaxPacketSize() const
+    {
+        assert( node );
+        return node->GetMaxPacketSize() - HeaderSize;
+    }
+    
     bool TransportLAN::SendPacket( int nodeId, const unsigned char data[], int size )
+    {
+        return SendPacket( nodeId, data, size, SendScheduler::Normal );
+    }
+    
+    bool TransportLAN::SendPacket( int nodeId, const unsigned char data[], int size, SendScheduler::Priority priority )
     {
         assert( node );
+        if ( nodeId < 0 || nodeId >= node->GetMaxNodes() || !node->IsNodeConnected( nodeId ) )
+            return false;
+        if ( size > GetMaxPacketSize() )
+            return false;
         
-        ReliabilitySystem& reliabilitySystem = GetReliability(nodeId);
-
-        const int header = 12;
+        // queued with room for the header, which is written when the pacer releases it
+        const int header = HeaderSize;
         unsigned char * packet = new unsigned char[header+size];
-        unsigned int seq = reliabilitySystem.GetLocalSequence();
-        unsigned int ack = reliabilitySystem.GetRemoteSequence();
-        unsigned int ack_bits = reliabilitySystem.GenerateAckBits();
-        WriteHeader( packet, seq, ack, ack_bits );
+        memset( packet, 0, header );
         memcpy( packet + header, data, size );
         
-        bool success = node->SendPacket( nodeId, packet, size+header );
+        bool success = scheduler.Enqueue( nodeId, packet, size+header, priority );
+        
+        delete [] packet;
+        
+        return success;
+    }
+    
+    bool TransportLAN::SendBackgroundPacket( int nodeId, const unsigned char data[], int size )
+    {
+        assert( node );
+        if ( nodeId < 0 || nodeId >= node->GetMaxNodes() || !node->IsNodeConnected( nodeId ) )
+            return false;
+        if ( size > GetMaxPacketSize() )
+            return false;
+        
+        const int header = HeaderSize;
+        unsigned char * packet = new unsigned char[header+size];
+        memset( packet, 0, header );
+        memcpy( packet + header, data, size );
+        
+        bool success = backgroundPacer.Enqueue( nodeId, packet, size+header );
         
-        if (success) { reliabilitySystem.PacketSent( size ); }
-
         delete [] packet;
         
         return success;
@@ -276,27 +323,38 @@ namespace Net
     {
         assert( node );
         
-        const int header = 12;
+        const int header = HeaderSize;
         if ( size <= header )
             return false;
         unsigned char * packet = new unsigned char[header+size];
-        int received_bytes = node->ReceivePacket( nodeId, packet, size + header );
-        if ( received_bytes == 0 )
-        {
-            delete [] packet;
-            return false;
-        }
-        if ( received_bytes <= header )
-        {
-            delete [] packet;
-            return false;
-        }
-        ReliabilitySystem& reliabilitySystem = GetReliability(nodeId);
-
+        int received_bytes = 0;
         unsigned int packet_sequence = 0;
         unsigned int packet_ack = 0;
         unsigned int packet_ack_bits = 0;
-        ReadHeader( packet, packet_sequence, packet_ack, packet_ack_bits );
+        unsigned int packet_timestamp = 0;
+        unsigned int packet_delay = 0;
+        while ( true )
+        {
+            received_bytes = node->ReceivePacket( nodeId, packet, size + header );
+            if ( received_bytes == 0 )
+            {
+                delete [] packet;
+                return false;
+            }
+            if ( received_bytes < header )
+            {
+                delete [] packet;
+                return false;
+            }
+            ReadHeader( packet, packet_sequence, packet_ack, packet_ack_bits, packet_timestamp, packet_delay );
+            ProcessHeader( nodeId, packet_timestamp, packet_delay );
+            if ( received_bytes > header )
+                break;
+            // ack packet: header only, carries acks but is not sequenced itself
+            GetReliability(nodeId).ProcessAck( packet_ack, packet_ack_bits );
+        }
+        ReliabilitySystem32& reliabilitySystem = GetReliability(nodeId);
+        
         reliabilitySystem.PacketReceived( packet_sequence, received_bytes - header );
         reliabilitySystem.ProcessAck( packet_ack, packet_ack_bits );
         memcpy( data, packet + header, received_bytes - header );
@@ -304,13 +362,49 @@ namespace Net
         return received_bytes - header;
     }
     
-    ReliabilitySystem& TransportLAN::GetReliability( int nodeId )
+    ReliabilitySystem32& TransportLAN::GetReliability( int nodeId )
     {
-        if (id2reliability.find(nodeId) == id2reliability.end()) {
-            reliabilitySystems.resize(reliabilitySystems.size()+1);
-            id2reliability[nodeId] = &reliabilitySystems[reliabilitySystems.size()-1];
+        IdToPeer::iterator itor = id2peer.find( nodeId );
+        if ( itor == id2peer.end() )
+        {
+            itor = id2peer.insert( std::make_pair( nodeId, reliabilityPool.AddPeer() ) ).first;
+            PeerFlowControl & peer = id2flow[nodeId];
+            peer.flowControl.SetMode( config.flowControlMode );
+            peer.flowControl.SetBandwidthLimits( config.minBandwidth, config.maxBandwidth );
+            peer.flowControl.Reset();
+            peer.ackedTotal = 0;
+            peer.background.SetBandwidthLimits( config.minBandwidth, config.maxBandwidth );
+            peer.background.SetTargetDelay( config.backgroundTargetDelay );
+            peer.background.Reset();
+            peer.backgroundAcked = 0;
+            peer.backgroundSent.Reset();
+            peer.remoteDelay = NoDelay;
+            peer.delayBase = 0;
+            peer.delayBaseSet = false;
+            reliabilityPool.GetPeer( itor->second ).SetPacketLostCallback( PacketLost, &peer );
         }
-        return *id2reliability[nodeId];
+        return reliabilityPool.GetPeer( itor->second );
+    }
+    
+    FlowControl & TransportLAN::GetFlowControl( int nodeId )
+    {
+        GetReliability( nodeId );
+        return id2flow[nodeId].flowControl;
+    }
+    
+    FlowControl & TransportLAN::GetBackgroundFlowControl( int nodeId )
+    {
+        GetReliability( nodeId );
+        return id2flow[nodeId].background;
+    }
+    
+    float TransportLAN::GetTimeToNextSend() const
+    {
+        const float next = pacer.GetTimeToNextSend();
+        const float background = backgroundPacer.GetTimeToNextSend();
+        if ( next < 0.0f || ( background >= 0.0f && background < next ) )
+            return background;
+        return next;
     }
     
     void TransportLAN::Update( float deltaTime )
@@ -331,6 +425,7 @@ namespace Net
                            entry.address.GetD(),
                            entry.address.GetPort() );
                     node = new Node( config.protocolId, config.meshSendRate, config.timeout );
+                    node->SetChecksum( config.checksum );
                     if ( !node->Start( config.clientPort ) )
                     {
                         printf( "LAN Transport: failed to start node on port %d\n", config.serverPort );
@@ -351,15 +446,11 @@ namespace Net
                     connectFailed = true;
             }
         }
-
+        
         if ( beacon )
         {
-            beaconAccumulator += deltaTime;
-            while ( beaconAccumulator >= 1.0f )
-            {
+            if ( beaconAccumulator.Update( deltaTime ) )
                 beacon->Update( 1.0f );
-                beaconAccumulator -= 1.0f;
-            }
         }
         if ( listener )
             listener->Update( deltaTime );
@@ -369,23 +460,186 @@ namespace Net
         if ( node )
             node->Update( deltaTime );
         
-        for (int i = 0; i < reliabilitySystems.size(); i++) {
-            reliabilitySystems[i].Update(deltaTime);
+        // acks are cleared by the pool update, pick out the background ones first
+        for ( IdToPeer::iterator itor = id2peer.begin(); itor != id2peer.end(); ++itor )
+        {
+            PeerFlowControl & peer = id2flow[itor->first];
+            unsigned int * acks = NULL;
+            int ack_count = 0;
+            reliabilityPool.GetPeer( itor->second ).GetAcks( &acks, ack_count );
+            for ( int i = 0; i < ack_count; ++i )
+            {
+                const int * size = peer.backgroundSent.Find( acks[i] );
+                if ( !size )
+                    continue;
+                peer.backgroundAcked += *size;
+                peer.backgroundSent.Remove( acks[i] );
+            }
+        }
+        
+        reliabilityPool.Update( deltaTime );
+        
+        for ( IdToPeer::iterator itor = id2peer.begin(); itor != id2peer.end(); ++itor )
+        {
+            ReliabilitySystem32 & reliabilitySystem = reliabilityPool.GetPeer( itor->second );
+            PeerFlowControl & peer = id2flow[itor->first];
+            const float rtt = reliabilitySystem.GetRoundTripTime() * 1000.0f;
+            const float min_rtt = reliabilitySystem.GetMinRoundTripTime() * 1000.0f;
+            peer.flowControl.PacketsAcked( reliabilitySystem.GetAckedTotal() - peer.ackedTotal - peer.backgroundAcked );
+            peer.ackedTotal = reliabilitySystem.GetAckedTotal();
+            peer.flowControl.Update( deltaTime, rtt, min_rtt );
+            pacer.SetRate( itor->first, peer.flowControl.GetBandwidth(), config.pacingBurst );
+            peer.background.PacketsAcked( peer.backgroundAcked );
+            peer.backgroundAcked = 0;
+            peer.background.Update( deltaTime, rtt, min_rtt );
+            backgroundPacer.SetRate( itor->first, peer.background.GetBandwidth(), config.pacingBurst );
+        }
+        
+        // the scheduler decides what fits the uplink, then packets go out spread across the update
+        scheduler.Update( deltaTime );
+        pacer.SetInterval( deltaTime );
+        pacer.Update( deltaTime );
+        backgroundPacer.SetInterval( deltaTime );
+        backgroundPacer.Update( deltaTime );
+        
+        if ( node && node->IsConnected() )
+        {
+            for ( IdToPeer::iterator itor = id2peer.begin(); itor != id2peer.end(); ++itor )
+            {
+                if ( itor->first < 0 || itor->first >= node->GetMaxNodes() )
+                    continue;
+                if ( reliabilityPool.GetPeer( itor->second ).IsAckRequired() && node->IsNodeConnected( itor->first ) )
+                    SendAckPacket( itor->first );
+            }
         }
     }
     
-    void TransportLAN::WriteHeader( unsigned char * header, unsigned int sequence, unsigned int ack, unsigned int ack_bits )
+    bool TransportLAN::SendAckPacket( int nodeId )
+    {
+        ReliabilitySystem32& reliabilitySystem = GetReliability(nodeId);
+        
+        const int header = HeaderSize;
+        unsigned char packet[header];
+        unsigned int seq = reliabilitySystem.GetLocalSequence();
+        unsigned int ack = reliabilitySystem.GetRemoteSequence();
+        unsigned int ack_bits = reliabilitySystem.GenerateAckBits();
+        WriteHeader( packet, seq, ack, ack_bits, GetTimestamp(), id2flow[nodeId].remoteDelay );
+        
+        bool success = node->SendPacket( nodeId, packet, header );
+        
+        if (success) { reliabilitySystem.AckSent(); }
+        
+        return success;
+    }
+    
+    bool TransportLAN::SendQueuedPacket( int nodeId, const unsigned char data[], int size, bool background )
+    {
+        if ( !node || !node->IsConnected() || !node->IsNodeConnected( nodeId ) )
+            return false;
+        
+        // sequenced as it goes out, so time spent queued doesn't count towards rtt or loss
+        ReliabilitySystem32& reliabilitySystem = GetReliability(nodeId);
+        PeerFlowControl & peer = id2flow[nodeId];
+        
+        const int header = HeaderSize;
+        unsigned char * packet = new unsigned char[size];
+        unsigned int seq = reliabilitySystem.GetLocalSequence();
+        unsigned int ack = reliabilitySystem.GetRemoteSequence();
+        unsigned int ack_bits = reliabilitySystem.GenerateAckBits();
+        WriteHeader( packet, seq, ack, ack_bits, GetTimestamp(), peer.remoteDelay );
+        memcpy( packet + header, data + header, size - header );
+        
+        bool success = node->SendPacket( nodeId, packet, size );
+        
+        if (success)
+        {
+            reliabilitySystem.PacketSent( size - header );
+            if ( background )
+            {
+                *peer.backgroundSent.Insert( seq ) = size - header;
+                peer.background.PacketSent( size - header );
+            }
+            else
+            {
+                peer.backgroundSent.Remove( seq );
+                peer.flowControl.PacketSent( size - header );
+            }
+        }
+        
+        delete [] packet;
+        
+        return success;
+    }
+    
+    void TransportLAN::ProcessHeader( int nodeId, unsigned int timestamp, unsigned int delay )
+    {
+        GetReliability( nodeId );
+        PeerFlowControl & peer = id2flow[nodeId];
+        
+        // includes the offset between our clocks, which only matters for comparing samples
+        peer.remoteDelay = GetTimestamp() - timestamp;
+        if ( peer.remoteDelay == NoDelay )
+            peer.remoteDelay++;
+        
+        // the delay of our packets to the node. relative to the first one so it stays small enough for a float
+        if ( delay == NoDelay )
+            return;
+        if ( !peer.delayBaseSet )
+        {
+            peer.delayBase = delay;
+            peer.delayBaseSet = true;
+        }
+        peer.background.DelaySample( (int) ( delay - peer.delayBase ) / 1000.0f );
+    }
+    
+    void TransportLAN::WriteHeader( unsigned char * header, unsigned int sequence, unsigned int ack, unsigned int ack_bits, unsigned int timestamp, unsigned int delay )
     {
         Serialization::WriteInteger( header, sequence );
         Serialization::WriteInteger( header + 4, ack );
         Serialization::WriteInteger( header + 8, ack_bits );
+        Serialization::WriteInteger( header + 12, timestamp );
+        Serialization::WriteInteger( header + 16, delay );
     }
     
-    void TransportLAN::ReadHeader( const unsigned char * header, unsigned int & sequence, unsigned int & ack, unsigned int & ack_bits )
+    void TransportLAN::ReadHeader( const unsigned char * header, unsigned int & sequence, unsigned int & ack, unsigned int & ack_bits, unsigned int & timestamp, unsigned int & delay )
     {
         Serialization::ReadInteger( header, sequence );
         Serialization::ReadInteger( header + 4, ack );
         Serialization::ReadInteger( header + 8, ack_bits );
+        Serialization::ReadInteger( header + 12, timestamp );
+        Serialization::ReadInteger( header + 16, delay );
+    }
+    
+    bool TransportLAN::SendPacedPacket( void * context, int nodeId, const unsigned char data[], int size )
+    {
+        TransportLAN * transport = (TransportLAN*) context;
+        return transport->SendQueuedPacket( nodeId, data, size, false );
+    }
+    
+    bool TransportLAN::SendBackgroundPacedPacket( void * context, int nodeId, const unsigned char data[], int size )
+    {
+        TransportLAN * transport = (TransportLAN*) context;
+        return transport->SendQueuedPacket( nodeId, data, size, true );
+    }
+    
+    bool TransportLAN::SendScheduledPacket( void * context, int nodeId, const unsigned char data[], int size )
+    {
+        TransportLAN * transport = (TransportLAN*) context;
+        return transport->pacer.Enqueue( nodeId, data, size );
+    }
+    
+    void TransportLAN::PacketLost( void * context, unsigned int sequence, int size )
+    {
+        PeerFlowControl * peer = (PeerFlowControl*) context;
+        if ( peer->backgroundSent.Exists( sequence ) )
+        {
+            peer->backgroundSent.Remove( sequence );
+            peer->background.PacketLost( size );
+        }
+        else
+        {
+            peer->flowControl.PacketLost( size );
+        }
     }
     
     TransportType TransportLAN::GetType() const
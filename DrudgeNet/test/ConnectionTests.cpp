@@ -1,8 +1,11 @@
 #include "ConnectionTests.hpp"
 #include "Connection.h"
+#include "Checksum.h"
 #include <cassert>
 #include <string>
 #include <stdio.h>
+#include <vector>
+#include <chrono>
 
 using namespace Net;
 
@@ -417,6 +420,210 @@ void test_connection_payload()
     check( server.IsConnected() );
 }
 
+void test_checksum()
+{
+    printf( "-----------------------------------------------------\n" );
+    printf( "test checksum\n" );
+    printf( "-----------------------------------------------------\n" );
+    
+    // check values from the crc32c definition and rfc 3720
+    const unsigned char digits[] = "123456789";
+    unsigned char zeros[32];
+    unsigned char ones[32];
+    unsigned char ascending[32];
+    for ( int i = 0; i < 32; ++i )
+    {
+        zeros[i] = 0;
+        ones[i] = 0xFF;
+        ascending[i] = (unsigned char) i;
+    }
+    const ChecksumKernel Kernels[] = { TableChecksum, SSE42Checksum, ARMv8Checksum };
+    for ( int k = 0; k < 3; ++k )
+    {
+        check( CRC32C( NULL, 0, 0, Kernels[k] ) == 0 );
+        check( CRC32C( digits, 9, 0, Kernels[k] ) == 0xE3069283 );
+        check( CRC32C( zeros, 32, 0, Kernels[k] ) == 0x8A9136AA );
+        check( CRC32C( ones, 32, 0, Kernels[k] ) == 0x62A8AB43 );
+        check( CRC32C( ascending, 32, 0, Kernels[k] ) == 0x46DD794E );
+    }
+    
+    // every kernel, length and alignment the same, and a checksum continues across blocks
+    unsigned char data[300];
+    for ( int i = 0; i < (int) sizeof( data ); ++i )
+        data[i] = (unsigned char) rand();
+    for ( int offset = 0; offset < 8; ++offset )
+    {
+        for ( int bytes = 0; bytes <= 280; bytes += 1 + bytes / 16 )
+        {
+            const uint32_t crc = CRC32C( data + offset, bytes, 0, TableChecksum );
+            check( CRC32C( data + offset, bytes ) == crc );
+            for ( int k = 0; k < 3; ++k )
+                check( CRC32C( data + offset, bytes, 0, Kernels[k] ) == crc );
+            const int split = bytes / 3;
+            check( CRC32C( data + offset + split, bytes - split, CRC32C( data + offset, split ) ) == crc );
+        }
+    }
+    
+    // a single bit flipped anywhere changes the packet checksum, so does the protocol id
+    const unsigned int ProtocolId = 0x11112222;
+    const uint32_t checksum = PacketChecksum( ProtocolId, data, 200 );
+    check( checksum != PacketChecksum( ProtocolId + 1, data, 200 ) );
+    check( checksum != PacketChecksum( ProtocolId, data, 199 ) );
+    for ( int bit = 0; bit < 200 * 8; ++bit )
+    {
+        data[bit/8] ^= 1 << ( bit % 8 );
+        check( PacketChecksum( ProtocolId, data, 200 ) != checksum );
+        data[bit/8] ^= 1 << ( bit % 8 );
+    }
+}
+
+void test_connection_checksum()
+{
+    printf( "-----------------------------------------------------\n" );
+    printf( "test connection checksum\n" );
+    printf( "-----------------------------------------------------\n" );
+    
+    const int ServerPort = 30000;
+    const int ClientPort = 30001;
+    const int ProtocolId = 0x11112222;
+    const float DeltaTime = 0.001f;
+    const float TimeOut = 0.1f;
+    
+    // packets a listening server must drop, sent ahead of a good one
+    {
+        Connection server( ProtocolId, TimeOut );
+        server.SetChecksum( true );
+        check( server.Start( ServerPort ) );
+        server.Listen();
+        
+        Socket socket;
+        check( socket.Open( ClientPort ) );
+        const Address address( 127, 0, 0, 1, ServerPort );
+        unsigned char packet[] = "....client to server";
+        const int size = sizeof( packet );
+        
+        // protocol id without a checksum
+        WritePacketHeader( packet, size, ProtocolId, false );
+        check( socket.Send( address, packet, size ) );
+        // checksum of another protocol
+        WritePacketHeader( packet, size, ProtocolId + 1, true );
+        check( socket.Send( address, packet, size ) );
+        // truncated
+        WritePacketHeader( packet, size, ProtocolId, true );
+        check( socket.Send( address, packet, size - 1 ) );
+        // corrupted
+        packet[10] ^= 0x04;
+        check( socket.Send( address, packet, size ) );
+        packet[10] ^= 0x04;
+        check( socket.Send( address, packet, size ) );
+        
+        int packets = 0;
+        while ( !server.IsConnected() )
+        {
+            unsigned char received[256];
+            int bytes_read = server.ReceivePacket( received, sizeof(received) );
+            if ( bytes_read == 0 )
+                continue;
+            check( bytes_read == size - 4 );
+            check( strcmp( (const char*) received, "client to server" ) == 0 );
+            packets++;
+        }
+        check( packets == 1 );
+        check( server.IsConnected() );
+    }
+    
+    // both ends with checksums
+    Connection client( ProtocolId, TimeOut );
+    Connection server( ProtocolId, TimeOut );
+    client.SetChecksum( true );
+    server.SetChecksum( true );
+    check( client.IsChecksumEnabled() );
+    check( client.GetHeaderSize() == 4 );
+    
+    check( client.Start( ClientPort ) );
+    check( server.Start( ServerPort ) );
+    
+    client.Connect( Address(127,0,0,1,ServerPort ) );
+    server.Listen();
+    
+    bool clientReceived = false;
+    bool serverReceived = false;
+    
+    while ( !clientReceived || !serverReceived )
+    {
+        if ( !client.IsConnecting() && client.ConnectFailed() )
+            break;
+        
+        unsigned char client_packet[] = "client to server";
+        client.SendPacket( client_packet, sizeof( client_packet ) );
+        
+        unsigned char server_packet[] = "server to client";
+        server.SendPacket( server_packet, sizeof( server_packet ) );
+        
+        while ( true )
+        {
+            unsigned char packet[256];
+            int bytes_read = client.ReceivePacket( packet, sizeof(packet) );
+            if ( bytes_read == 0 )
+                break;
+            check( strcmp( (const char*) packet, "server to client" ) == 0 );
+            clientReceived = true;
+        }
+        
+        while ( true )
+        {
+            unsigned char packet[256];
+            int bytes_read = server.ReceivePacket( packet, sizeof(packet) );
+            if ( bytes_read == 0 )
+                break;
+            check( strcmp( (const char*) packet, "client to server" ) == 0 );
+            serverReceived = true;
+        }
+        
+        client.Update( DeltaTime );
+        server.Update( DeltaTime );
+    }
+    
+    check( client.IsConnected() );
+    check( server.IsConnected() );
+}
+
+void benchmark_checksum()
+{
+    printf( "-----------------------------------------------------\n" );
+    printf( "benchmark checksum\n" );
+    printf( "-----------------------------------------------------\n" );
+    
+    // packet sized blocks, table against the best kernel compiled in
+    const int Sizes[] = { 64, 256, 1200 };
+    const int Megabytes = 256;
+    std::vector<unsigned char> data( 1200 );
+    for ( int i = 0; i < (int) data.size(); ++i )
+        data[i] = (unsigned char) rand();
+    uint32_t sum = 0;
+    
+    printf( "packet     table      best (%s)\n", BestChecksumKernel == SSE42Checksum ? "sse4.2" : BestChecksumKernel == ARMv8Checksum ? "armv8" : "table" );
+    for ( int s = 0; s < (int) ( sizeof( Sizes ) / sizeof( Sizes[0] ) ); ++s )
+    {
+        const int size = Sizes[s];
+        const int iterations = Megabytes * 1024 * 1024 / size;
+        double seconds[2];
+        for ( int best = 0; best < 2; ++best )
+        {
+            const ChecksumKernel kernel = best ? BestChecksumKernel : TableChecksum;
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            for ( int n = 0; n < iterations; ++n )
+            {
+                data[0] = (unsigned char) n;
+                sum += CRC32C( &data[0], size, 0, kernel );
+            }
+            seconds[best] = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+        }
+        printf( "%6d %6.0f MB/s %6.0f MB/s\n", size, Megabytes / seconds[0], Megabytes / seconds[1] );
+    }
+    if ( sum == 0x12345678 )
+        printf( "\n" );
+}
 
 void RunConnectionTests()
 {
@@ -428,6 +635,9 @@ void RunConnectionTests()
     test_connection_join_busy();
     test_connection_rejoin();
     test_connection_payload();
+    test_checksum();
+    test_connection_checksum();
+    benchmark_checksum();
     
     printf( "-----------------------------------------------------\n" );
     printf( "connection tests passed!\n" );
@@ -0,0 +1,898 @@
+//
+//  FlowControlTests.cpp
+//  DrudgeNet
+//
+
+#include "FlowControlTests.hpp"
+#include "FlowControl.h"
+#include "ReliabilitySystem.h"
+#include "Pacer.h"
+#include "SendAccumulator.h"
+#include "SendScheduler.h"
+#include <cassert>
+#include <stdio.h>
+#include <math.h>
+#include <deque>
+
+using namespace Net;
+
+#ifdef DEBUG
+#define check assert
+#else
+#define check(n) if ( !(n) ) { printf( "check failed\n" ); exit(1); }
+#endif
+
+// sends a fraction of the budget each tick and acks it straight away, rtt in milliseconds
+void send_at_budget( FlowControl & flowControl, float fraction, float seconds, float rtt, float min_rtt )
+{
+    const float DeltaTime = 0.01f;
+    const int PacketSize = 200;
+    for ( float t = 0.0f; t < seconds; t += DeltaTime )
+    {
+        const int bytes = (int) ( flowControl.GetBandwidth() * fraction * DeltaTime );
+        for ( int sent = 0; sent < bytes; sent += PacketSize )
+            flowControl.PacketSent( bytes - sent < PacketSize ? bytes - sent : PacketSize );
+        flowControl.PacketsAcked( bytes );
+        flowControl.Update( DeltaTime, rtt, min_rtt );
+    }
+}
+
+void test_flow_control_binary()
+{
+    printf( "-----------------------------------------------------\n" );
+    printf( "test flow control binary mode\n" );
+    printf( "-----------------------------------------------------\n" );
+    
+    FlowControl flowControl;
+    check( flowControl.GetMode() == FlowControl::Binary );
+    check( flowControl.GetSendRate() == 10.0f );
+    for ( int i = 0; i < 5; ++i )
+        flowControl.Update( 1.0f, 100.0f );
+    check( flowControl.GetSendRate() == 30.0f );
+    flowControl.Update( 0.1f, 300.0f );
+    check( flowControl.GetSendRate() == 10.0f );
+    // losses don't matter in binary mode
+    flowControl.PacketLost( 100 );
+    check( flowControl.GetSendRate() == 10.0f );
+}
+
+void test_flow_control_aimd()
+{
+    printf( "-----------------------------------------------------\n" );
+    printf( "test flow control aimd mode\n" );
+    printf( "-----------------------------------------------------\n" );
+    
+    printf( "check additive increase\n" );
+    {
+        FlowControl flowControl( FlowControl::AIMD );
+        const float initial = flowControl.GetBandwidth();
+        send_at_budget( flowControl, 1.0f, 3.0f, 50.0f, 50.0f );
+        // about one step per 50ms round trip once the send rate has caught up
+        check( flowControl.GetBandwidth() > initial + 20 * flowControl.GetAdditiveIncrease() );
+        check( flowControl.GetBandwidth() < initial + 60 * flowControl.GetAdditiveIncrease() );
+        check( fabs( flowControl.GetSendRate() - flowControl.GetBandwidth() / flowControl.GetAveragePacketSize() ) < 0.01f );
+        check( flowControl.GetAveragePacketSize() > 150.0f );
+    }
+    
+    printf( "check no increase while app limited\n" );
+    {
+        FlowControl flowControl( FlowControl::AIMD );
+        const float initial = flowControl.GetBandwidth();
+        send_at_budget( flowControl, 0.1f, 3.0f, 50.0f, 50.0f );
+        check( flowControl.GetBandwidth() == initial );
+    }
+    
+    printf( "check multiplicative decrease once per round trip\n" );
+    {
+        FlowControl flowControl( FlowControl::AIMD );
+        send_at_budget( flowControl, 1.0f, 1.0f, 50.0f, 50.0f );
+        const float before = flowControl.GetBandwidth();
+        flowControl.PacketLost( 200 );
+        flowControl.PacketLost( 200 );
+        flowControl.PacketLost( 200 );
+        check( fabs( flowControl.GetBandwidth() - before * flowControl.GetMultiplicativeDecrease() ) < 1.0f );
+        // no increase during recovery either
+        flowControl.PacketsAcked( 10000 );
+        check( fabs( flowControl.GetBandwidth() - before * flowControl.GetMultiplicativeDecrease() ) < 1.0f );
+        flowControl.Update( 0.06f, 50.0f, 50.0f );
+        const float after = flowControl.GetBandwidth();
+        flowControl.PacketLost( 200 );
+        check( fabs( flowControl.GetBandwidth() - after * flowControl.GetMultiplicativeDecrease() ) < 1.0f );
+    }
+    
+    printf( "check decrease on rtt inflation\n" );
+    {
+        FlowControl flowControl( FlowControl::AIMD );
+        send_at_budget( flowControl, 1.0f, 1.0f, 50.0f, 50.0f );
+        const float before = flowControl.GetBandwidth();
+        // a little jitter is fine
+        flowControl.Update( 0.01f, 65.0f, 50.0f );
+        check( flowControl.GetBandwidth() == before );
+        flowControl.Update( 0.01f, 150.0f, 50.0f );
+        check( fabs( flowControl.GetBandwidth() - before * flowControl.GetMultiplicativeDecrease() ) < 1.0f );
+    }
+    
+    printf( "check min rtt tracked when not given\n" );
+    {
+        FlowControl flowControl( FlowControl::AIMD );
+        send_at_budget( flowControl, 1.0f, 1.0f, 50.0f, 0.0f );
+        const float before = flowControl.GetBandwidth();
+        flowControl.Update( 0.01f, 150.0f );
+        check( flowControl.GetBandwidth() < before );
+    }
+    
+    printf( "check bandwidth limits\n" );
+    {
+        FlowControl flowControl( FlowControl::AIMD );
+        flowControl.SetBandwidthLimits( 4096.0f, 16384.0f );
+        send_at_budget( flowControl, 1.0f, 10.0f, 10.0f, 10.0f );
+        check( flowControl.GetBandwidth() == 16384.0f );
+        for ( int i = 0; i < 100; ++i )
+        {
+            flowControl.PacketLost( 200 );
+            flowControl.Update( 0.1f, 10.0f, 10.0f );
+        }
+        check( flowControl.GetBandwidth() == 4096.0f );
+        flowControl.SetBandwidthLimits( 8192.0f, 16384.0f );
+        check( flowControl.GetBandwidth() == 8192.0f );
+    }
+}
+
+void test_flow_control_bbr()
+{
+    printf( "-----------------------------------------------------\n" );
+    printf( "test flow control bbr mode\n" );
+    printf( "-----------------------------------------------------\n" );
+    
+    printf( "check startup, drain and probe bandwidth\n" );
+    {
+        FlowControl flowControl( FlowControl::BBR );
+        check( flowControl.GetWindow() == 0.0f );
+        // a link that delivers 100 kB/s with a 50 ms round trip, whatever is sent
+        const float DeltaTime = 0.01f;
+        for ( int i = 0; i < 300; ++i )
+        {
+            const int bytes = (int) ( flowControl.GetBandwidth() * DeltaTime );
+            flowControl.PacketSent( bytes );
+            const int delivered = bytes < 1000 ? bytes : 1000;
+            flowControl.PacketsAcked( delivered );
+            if ( bytes > delivered )
+                flowControl.PacketLost( bytes - delivered );
+            flowControl.Update( DeltaTime, 50.0f, 50.0f );
+        }
+        check( fabs( flowControl.GetBottleneckBandwidth() - 100000.0f ) < 1000.0f );
+        check( fabs( flowControl.GetMinRoundTripTime() - 0.05f ) < 0.001f );
+        // paced around the bottleneck, bytes in flight capped at twice the bandwidth delay product
+        check( flowControl.GetBandwidth() >= 0.75f * 100000.0f - 1.0f );
+        check( flowControl.GetBandwidth() <= 1.25f * 100000.0f + 1.0f );
+        check( fabs( flowControl.GetWindow() - 2.0f * 100000.0f * 0.05f ) < 200.0f );
+        // losses alone don't change the model
+        const float before = flowControl.GetBottleneckBandwidth();
+        flowControl.PacketLost( 100 );
+        check( flowControl.GetBottleneckBandwidth() == before );
+    }
+    
+    printf( "check probe rtt\n" );
+    {
+        FlowControl flowControl( FlowControl::BBR );
+        const float DeltaTime = 0.01f;
+        bool probed = false;
+        for ( int i = 0; i < 1200; ++i )
+        {
+            const int bytes = (int) ( flowControl.GetBandwidth() * DeltaTime );
+            const int delivered = bytes < 1000 ? bytes : 1000;
+            flowControl.PacketSent( bytes );
+            flowControl.PacketsAcked( delivered );
+            if ( bytes > delivered )
+                flowControl.PacketLost( bytes - delivered );
+            flowControl.Update( DeltaTime, 50.0f, 50.0f );
+            if ( flowControl.GetWindow() > 0.0f && flowControl.GetWindow() <= 4.0f * flowControl.GetAveragePacketSize() )
+                probed = true;
+        }
+        check( probed );
+    }
+}
+
+void test_flow_control_ledbat()
+{
+    printf( "-----------------------------------------------------\n" );
+    printf( "test flow control ledbat mode\n" );
+    printf( "-----------------------------------------------------\n" );
+    
+    // the clocks at each end are far apart, only changes in one way delay matter
+    const float ClockOffset = 123456.0f;
+    
+    printf( "check increase under the target delay\n" );
+    {
+        FlowControl flowControl( FlowControl::LEDBAT );
+        const float initial = flowControl.GetBandwidth();
+        send_at_budget( flowControl, 1.0f, 1.0f, 20.0f, 20.0f );
+        // nothing to go on without delay samples
+        check( flowControl.GetBandwidth() == initial );
+        flowControl.DelaySample( ClockOffset + 10.0f );
+        check( flowControl.GetQueuingDelay() == 0.0f );
+        // up to one step per 20ms round trip, as the send rate keeps up
+        send_at_budget( flowControl, 1.0f, 2.0f, 20.0f, 20.0f );
+        check( flowControl.GetBandwidth() > initial + 30 * flowControl.GetAdditiveIncrease() );
+        check( flowControl.GetBandwidth() < initial + 100 * flowControl.GetAdditiveIncrease() );
+    }
+    
+    printf( "check no increase while app limited\n" );
+    {
+        FlowControl flowControl( FlowControl::LEDBAT );
+        const float initial = flowControl.GetBandwidth();
+        flowControl.DelaySample( ClockOffset );
+        send_at_budget( flowControl, 0.1f, 1.0f, 20.0f, 20.0f );
+        check( flowControl.GetBandwidth() == initial );
+    }
+    
+    printf( "check increase slows down closer to the target\n" );
+    {
+        FlowControl idle( FlowControl::LEDBAT );
+        FlowControl queuing( FlowControl::LEDBAT );
+        send_at_budget( idle, 1.0f, 1.0f, 20.0f, 20.0f );
+        send_at_budget( queuing, 1.0f, 1.0f, 20.0f, 20.0f );
+        idle.DelaySample( ClockOffset );
+        queuing.DelaySample( ClockOffset );
+        // half way to the target, half the step
+        for ( int i = 0; i < 4; ++i )
+            queuing.DelaySample( ClockOffset + 1000.0f * queuing.GetQueuingTarget() * 0.5f );
+        check( fabs( queuing.GetQueuingDelay() - queuing.GetQueuingTarget() * 0.5f ) < 0.0001f );
+        const float before = idle.GetBandwidth();
+        idle.Update( 0.01f, 20.0f, 20.0f );
+        queuing.Update( 0.01f, 20.0f, 20.0f );
+        check( idle.GetBandwidth() > before );
+        check( fabs( ( queuing.GetBandwidth() - before ) - ( idle.GetBandwidth() - before ) * 0.5f ) < 1.0f );
+    }
+    
+    printf( "check target scales with the round trip\n" );
+    {
+        // the target delay until there's a min RTT, then a quarter of it, with a floor
+        FlowControl flowControl( FlowControl::LEDBAT );
+        check( flowControl.GetQueuingTarget() == flowControl.GetTargetDelay() );
+        flowControl.Update( 0.01f, 20.0f, 20.0f );
+        check( fabs( flowControl.GetQueuingTarget() - 0.005f ) < 0.0001f );
+        flowControl.Update( 0.01f, 1.0f, 1.0f );
+        check( fabs( flowControl.GetQueuingTarget() - 0.002f ) < 0.0001f );
+        FlowControl wan( FlowControl::LEDBAT );
+        wan.Update( 0.01f, 200.0f, 200.0f );
+        check( wan.GetQueuingTarget() == wan.GetTargetDelay() );
+    }
+    
+    printf( "check back off over the target delay\n" );
+    {
+        FlowControl flowControl( FlowControl::LEDBAT );
+        flowControl.DelaySample( ClockOffset );
+        send_at_budget( flowControl, 1.0f, 1.0f, 20.0f, 20.0f );
+        const float before = flowControl.GetBandwidth();
+        // one packet stuck behind a burst isn't a queue
+        flowControl.DelaySample( ClockOffset + 50.0f );
+        flowControl.Update( 0.01f, 20.0f, 20.0f );
+        check( flowControl.GetBandwidth() >= before );
+        for ( int i = 0; i < 4; ++i )
+            flowControl.DelaySample( ClockOffset + 50.0f );
+        check( fabs( flowControl.GetQueuingDelay() - 0.05f ) < 0.0001f );
+        flowControl.Update( 0.01f, 70.0f, 20.0f );
+        const float after = flowControl.GetBandwidth();
+        check( after < before * flowControl.GetMultiplicativeDecrease() + 1.0f );
+        // once per round trip
+        flowControl.Update( 0.01f, 70.0f, 20.0f );
+        check( flowControl.GetBandwidth() == after );
+        flowControl.Update( 0.07f, 70.0f, 20.0f );
+        check( flowControl.GetBandwidth() < after );
+    }
+    
+    printf( "check back off on loss\n" );
+    {
+        FlowControl flowControl( FlowControl::LEDBAT );
+        flowControl.DelaySample( ClockOffset );
+        send_at_budget( flowControl, 1.0f, 1.0f, 20.0f, 20.0f );
+        const float before = flowControl.GetBandwidth();
+        flowControl.PacketLost( 200 );
+        check( fabs( flowControl.GetBandwidth() - before * flowControl.GetMultiplicativeDecrease() ) < 1.0f );
+    }
+}
+
+struct PacedSends
+{
+    int count;
+    int bytes;
+    int peers[64];
+};
+
+bool record_paced_send( void * context, int peer, const unsigned char /*data*/[], int size )
+{
+    PacedSends * sends = (PacedSends*) context;
+    if ( sends->count < 64 )
+        sends->peers[sends->count] = peer;
+    sends->count++;
+    sends->bytes += size;
+    return true;
+}
+
+void test_pacer()
+{
+    printf( "-----------------------------------------------------\n" );
+    printf( "test pacer\n" );
+    printf( "-----------------------------------------------------\n" );
+    
+    unsigned char packet[1000];
+    memset( packet, 0, sizeof( packet ) );
+    
+    printf( "check sends spread across the interval\n" );
+    {
+        const int Peers = 4;
+        const float Interval = 0.1f;
+        Pacer pacer( Peers, Interval );
+        PacedSends sends;
+        memset( &sends, 0, sizeof( sends ) );
+        pacer.SetSendFunction( record_paced_send, &sends );
+        for ( int i = Peers - 1; i >= 0; --i )
+            check( pacer.Enqueue( i, packet, 100 ) );
+        check( pacer.GetTimeToNextSend() == 0.0f );
+        // peer n of 4 goes out n/4 of the way through the interval
+        for ( int step = 0; step < Peers; ++step )
+        {
+            pacer.Update( step == 0 ? 0.0f : Interval / Peers + 0.001f );
+            check( sends.count == step + 1 );
+            check( sends.peers[step] == step );
+        }
+        check( pacer.GetTimeToNextSend() < 0.0f );
+        check( pacer.GetQueuedBytes( 0 ) == 0 );
+    }
+    
+    printf( "check token bucket rate and burst\n" );
+    {
+        Pacer pacer;
+        PacedSends sends;
+        memset( &sends, 0, sizeof( sends ) );
+        pacer.SetSendFunction( record_paced_send, &sends );
+        pacer.SetRate( 0, 10000.0f, 2000.0f );
+        for ( int i = 0; i < 20; ++i )
+            check( pacer.Enqueue( 0, packet, 1000 ) );
+        // the burst goes out straight away, then one packet per 100ms
+        pacer.Update( 0.0f );
+        check( sends.count == 2 );
+        check( fabs( pacer.GetTimeToNextSend() - 0.1f ) < 0.001f );
+        for ( int i = 0; i < 10; ++i )
+            pacer.Update( 0.1f );
+        check( sends.count == 12 );
+        // a stall doesn't turn into a catch up burst, only the burst size builds up
+        pacer.Update( 1.0f );
+        check( sends.count == 14 );
+        check( pacer.GetQueuedPackets( 0 ) == 6 );
+    }
+    
+    printf( "check queue limit\n" );
+    {
+        Pacer pacer;
+        pacer.SetMaxQueuedBytes( 2500 );
+        check( pacer.Enqueue( 3, packet, 1000 ) );
+        check( pacer.Enqueue( 3, packet, 1000 ) );
+        check( !pacer.Enqueue( 3, packet, 1000 ) );
+        check( pacer.Enqueue( 2, packet, 1000 ) );
+        pacer.Clear( 3 );
+        check( pacer.GetQueuedBytes( 3 ) == 0 );
+        check( pacer.GetQueuedBytes( 2 ) == 1000 );
+    }
+}
+
+struct ScheduledSends
+{
+    int count;
+    int tags[64];                   // first byte of each packet, in send order
+    int bytes[4];                   // per peer
+};
+
+bool record_scheduled_send( void * context, int peer, const unsigned char data[], int size )
+{
+    ScheduledSends * sends = (ScheduledSends*) context;
+    if ( sends->count < 64 )
+        sends->tags[sends->count] = data[0];
+    sends->count++;
+    sends->bytes[peer] += size;
+    return true;
+}
+
+void test_send_scheduler()
+{
+    printf( "-----------------------------------------------------\n" );
+    printf( "test send scheduler\n" );
+    printf( "-----------------------------------------------------\n" );
+    
+    unsigned char packet[1000];
+    memset( packet, 0, sizeof( packet ) );
+    
+    printf( "check priority order within a peer\n" );
+    {
+        SendScheduler scheduler;
+        ScheduledSends sends;
+        memset( &sends, 0, sizeof( sends ) );
+        scheduler.SetSendFunction( record_scheduled_send, &sends );
+        const SendScheduler::Priority priorities[] = { SendScheduler::Low, SendScheduler::Normal, SendScheduler::High, SendScheduler::Normal };
+        for ( int i = 0; i < 4; ++i )
+        {
+            packet[0] = (unsigned char) i;
+            check( scheduler.Enqueue( 0, packet, 100, priorities[i] ) );
+        }
+        check( scheduler.GetQueuedPackets( 0 ) == 4 );
+        // unlimited bandwidth, everything goes out, in order within each priority
+        scheduler.Update( 0.1f );
+        check( sends.count == 4 );
+        check( sends.tags[0] == 2 );
+        check( sends.tags[1] == 1 );
+        check( sends.tags[2] == 3 );
+        check( sends.tags[3] == 0 );
+        check( scheduler.GetQueuedBytes( 0 ) == 0 );
+        check( scheduler.GetUsage( 0 ) == 0.0f );
+        packet[0] = 0;
+    }
+    
+    printf( "check weighted fair queuing across peers\n" );
+    {
+        SendScheduler scheduler( 10000.0f );
+        ScheduledSends sends;
+        memset( &sends, 0, sizeof( sends ) );
+        scheduler.SetSendFunction( record_scheduled_send, &sends );
+        scheduler.SetWeight( 1, 3.0f );
+        // peer 2 sends a little, it shouldn't have to wait behind the others
+        for ( int tick = 0; tick < 100; ++tick )
+        {
+            while ( scheduler.GetQueuedBytes( 0 ) < 2000 )
+                scheduler.Enqueue( 0, packet, 100 );
+            while ( scheduler.GetQueuedBytes( 1 ) < 2000 )
+                scheduler.Enqueue( 1, packet, 100 );
+            if ( tick % 10 == 0 )
+                scheduler.Enqueue( 2, packet, 100 );
+            scheduler.Update( 0.1f );
+            check( scheduler.GetQueuedBytes( 2 ) == 0 );
+        }
+        const int total = sends.bytes[0] + sends.bytes[1] + sends.bytes[2];
+        check( total >= 99000 && total <= 101000 );
+        check( sends.bytes[2] == 1000 );
+        check( fabs( sends.bytes[1] / (float) sends.bytes[0] - 3.0f ) < 0.1f );
+        // each backlogged peer uses all of its share. peer 2 had nothing queued last update
+        check( fabs( scheduler.GetBudget( 0 ) - 10000.0f / 4.0f ) < 1.0f );
+        check( fabs( scheduler.GetBudget( 1 ) - 10000.0f * 3.0f / 4.0f ) < 1.0f );
+        check( scheduler.GetUsage( 0 ) > 0.9f );
+        check( scheduler.GetUsage( 1 ) > 0.9f );
+        check( scheduler.GetDroppedPackets( 0 ) == 0 );
+    }
+    
+    printf( "check low priority dropped and the rest deferred when over budget\n" );
+    {
+        SendScheduler scheduler( 10000.0f );
+        ScheduledSends sends;
+        memset( &sends, 0, sizeof( sends ) );
+        scheduler.SetSendFunction( record_scheduled_send, &sends );
+        scheduler.SetBurst( 0.0f );
+        for ( int i = 0; i < 5; ++i )
+        {
+            check( scheduler.Enqueue( 0, packet, 500, SendScheduler::Normal ) );
+            check( scheduler.Enqueue( 0, packet, 500, SendScheduler::Low ) );
+        }
+        // 1000 bytes of budget, the normal packets go first
+        scheduler.Update( 0.1f );
+        check( sends.count == 2 );
+        check( scheduler.GetDroppedPackets( 0 ) == 5 );
+        check( scheduler.GetQueuedPackets( 0 ) == 3 );
+        scheduler.Update( 0.1f );
+        scheduler.Update( 0.1f );
+        check( sends.count == 5 );
+        check( scheduler.GetQueuedPackets( 0 ) == 0 );
+        // nothing dropped with room to spare
+        check( scheduler.Enqueue( 0, packet, 500, SendScheduler::Low ) );
+        scheduler.Update( 0.1f );
+        check( sends.count == 6 );
+        check( scheduler.GetDroppedPackets( 0 ) == 5 );
+        // the queue limit defers back to the caller
+        scheduler.SetMaxQueuedBytes( 1000 );
+        check( scheduler.Enqueue( 0, packet, 1000 ) );
+        check( !scheduler.Enqueue( 0, packet, 1 ) );
+    }
+}
+
+void test_send_accumulator()
+{
+    printf( "-----------------------------------------------------\n" );
+    printf( "test send accumulator\n" );
+    printf( "-----------------------------------------------------\n" );
+    
+    SendAccumulator noCatchUp( 0.25f );
+    SendAccumulator catchUp( 0.25f, SendAccumulator::CatchUp );
+    check( noCatchUp.Update( 0.1f ) == 0 );
+    check( catchUp.Update( 0.1f ) == 0 );
+    check( noCatchUp.Update( 0.2f ) == 1 );
+    check( catchUp.Update( 0.2f ) == 1 );
+    // one second stall: four sends missed
+    check( noCatchUp.Update( 1.0f ) == 1 );
+    check( catchUp.Update( 1.0f ) == 4 );
+    // the phase is kept either way
+    check( noCatchUp.Update( 0.19f ) == 0 );
+    check( noCatchUp.Update( 0.02f ) == 1 );
+    noCatchUp.Reset( 0.25f );
+    check( noCatchUp.Update( 0.0f ) == 1 );
+}
+
+// emulated bottleneck link: a drop tail queue drained at a fixed rate, fixed propagation delay
+// each way. the receiver acks every packet it gets, so the sender sees acks at the delivery rate
+
+struct LinkResult
+{
+    float goodput;                  // bytes per second delivered
+    float queue_delay;              // average seconds packets waited in the bottleneck queue
+    float max_queue_delay;
+    unsigned int lost;
+};
+
+struct LinkPacket
+{
+    double time;                    // time the packet reaches the next hop
+    unsigned int sequence;
+    unsigned int ack;
+    unsigned int ack_bits;
+};
+
+void link_packet_lost( void * context, unsigned int /*sequence*/, int size )
+{
+    FlowControl * flowControl = (FlowControl*) context;
+    flowControl->PacketLost( size );
+}
+
+LinkResult run_emulated_link( FlowControl::Mode mode, float link_bandwidth, float link_delay, int queue_size, float seconds, float warmup )
+{
+    const float DeltaTime = 0.001f;
+    const int PacketSize = 1000;
+    
+    FlowControl flowControl( mode );
+    flowControl.SetBandwidthLimits( 1024.0f, 4.0f * link_bandwidth );
+    ReliabilitySystem sender;
+    ReliabilitySystem receiver;
+    sender.SetPacketLostCallback( link_packet_lost, &flowControl );
+    
+    std::deque<LinkPacket> queue;       // waiting at the bottleneck
+    std::deque<LinkPacket> delivering;  // past the bottleneck, on the way to the receiver
+    std::deque<LinkPacket> acking;      // acks on the way back
+    int queue_bytes = 0;
+    float send_budget = 0.0f;
+    float link_budget = 0.0f;
+    int acked_total = 0;
+    
+    LinkResult result;
+    memset( &result, 0, sizeof( result ) );
+    double delivered = 0.0;
+    double queue_delay = 0.0;
+    int queue_delay_samples = 0;
+    
+    double time = 0.0;
+    for ( int tick = 0; tick * DeltaTime < seconds; ++tick )
+    {
+        time = tick * DeltaTime;
+        const bool measuring = time >= warmup;
+        
+        // sender paces at the flow control rate, no catching up on time spent window limited
+        const float pacing = flowControl.GetBandwidth() * DeltaTime;
+        send_budget += pacing;
+        if ( send_budget > pacing + PacketSize )
+            send_budget = pacing + PacketSize;
+        while ( send_budget >= PacketSize && flowControl.CanSend() )
+        {
+            LinkPacket packet;
+            packet.time = time;
+            packet.sequence = sender.GetLocalSequence();
+            sender.PacketSent( PacketSize );
+            flowControl.PacketSent( PacketSize );
+            send_budget -= PacketSize;
+            if ( queue_bytes + PacketSize > queue_size )
+                continue;
+            queue.push_back( packet );
+            queue_bytes += PacketSize;
+        }
+        
+        // bottleneck
+        link_budget += link_bandwidth * DeltaTime;
+        while ( !queue.empty() && link_budget >= PacketSize )
+        {
+            LinkPacket packet = queue.front();
+            queue.pop_front();
+            queue_bytes -= PacketSize;
+            link_budget -= PacketSize;
+            if ( measuring )
+            {
+                const double delay = time - packet.time;
+                queue_delay += delay;
+                queue_delay_samples++;
+                if ( delay > result.max_queue_delay )
+                    result.max_queue_delay = (float) delay;
+            }
+            packet.time = time + link_delay;
+            delivering.push_back( packet );
+        }
+        if ( queue.empty() && link_budget > PacketSize )
+            link_budget = PacketSize;
+        
+        // receiver acks each packet
+        while ( !delivering.empty() && delivering.front().time <= time )
+        {
+            LinkPacket packet = delivering.front();
+            delivering.pop_front();
+            receiver.PacketReceived( packet.sequence, PacketSize );
+            if ( measuring )
+                delivered += PacketSize;
+            packet.time = time + link_delay;
+            packet.ack = receiver.GetRemoteSequence();
+            packet.ack_bits = receiver.GenerateAckBits();
+            acking.push_back( packet );
+            receiver.AckSent();
+        }
+        
+        while ( !acking.empty() && acking.front().time <= time )
+        {
+            sender.ProcessAck( acking.front().ack, acking.front().ack_bits );
+            acking.pop_front();
+        }
+        
+        sender.Update( DeltaTime );
+        receiver.Update( DeltaTime );
+        flowControl.PacketsAcked( sender.GetAckedTotal() - acked_total );
+        acked_total = sender.GetAckedTotal();
+        flowControl.Update( DeltaTime, sender.GetRoundTripTime() * 1000.0f, sender.GetMinRoundTripTime() * 1000.0f );
+    }
+    
+    result.goodput = (float) ( delivered / ( seconds - warmup ) );
+    result.queue_delay = queue_delay_samples ? (float) ( queue_delay / queue_delay_samples ) : 0.0f;
+    result.lost = sender.GetLostPackets();
+    return result;
+}
+
+void benchmark_flow_control_link()
+{
+    printf( "-----------------------------------------------------\n" );
+    printf( "benchmark flow control on an emulated link\n" );
+    printf( "-----------------------------------------------------\n" );
+    
+    struct Profile
+    {
+        const char * name;
+        float bandwidth;            // bytes per second
+        float delay;                // one way, seconds
+        int queue_size;             // bytes
+    };
+    
+    // a switched lan: 16 Mbit/s, 2 ms round trip and a deep buffer. and a 4 Mbit/s internet path
+    // with a 40 ms round trip and 100 ms of buffer
+    const Profile profiles[] =
+    {
+        { "lan", 2000000.0f, 0.001f, 64000 },
+        { "wan", 500000.0f, 0.02f, 50000 },
+    };
+    const float Seconds = 60.0f;
+    const float Warmup = 30.0f;
+    
+    printf( "link   mode   goodput         queue delay (avg/max)   lost\n" );
+    for ( int i = 0; i < (int) ( sizeof( profiles ) / sizeof( profiles[0] ) ); ++i )
+    {
+        const Profile & profile = profiles[i];
+        const LinkResult aimd = run_emulated_link( FlowControl::AIMD, profile.bandwidth, profile.delay, profile.queue_size, Seconds, Warmup );
+        const LinkResult bbr = run_emulated_link( FlowControl::BBR, profile.bandwidth, profile.delay, profile.queue_size, Seconds, Warmup );
+        printf( "%s    aimd   %7.1f kB/s   %5.1f / %5.1f ms        %d\n", profile.name, aimd.goodput / 1000.0f, aimd.queue_delay * 1000.0f, aimd.max_queue_delay * 1000.0f, aimd.lost );
+        printf( "%s    bbr    %7.1f kB/s   %5.1f / %5.1f ms        %d\n", profile.name, bbr.goodput / 1000.0f, bbr.queue_delay * 1000.0f, bbr.max_queue_delay * 1000.0f, bbr.lost );
+        check( bbr.goodput > 0.9f * profile.bandwidth );
+        check( bbr.goodput >= aimd.goodput );
+        // paced at the model, the queue stays well under a round trip
+        check( bbr.queue_delay < 2.0f * profile.delay + 0.005f );
+    }
+}
+
+// real-time traffic and a bulk transfer sharing the emulated link. the bulk transfer is paced at
+// its flow control budget, one way delays and acks come back after the propagation delay
+
+struct SharedLinkResult
+{
+    float gameplay_delay;           // average seconds gameplay packets waited in the bottleneck queue
+    float bulk_goodput;             // bytes per second of bulk data delivered
+};
+
+struct SharedLinkPacket
+{
+    double time;                    // time the packet reaches the next hop
+    double sent;
+    bool bulk;
+    bool lost;
+    float delay;                    // one way delay, milliseconds, as measured by the receiver
+};
+
+SharedLinkResult run_shared_link( bool bulk, FlowControl::Mode mode, float link_bandwidth, float link_delay, int queue_size, float seconds, float warmup )
+{
+    const float DeltaTime = 0.001f;
+    const int BulkPacketSize = 1000;
+    const int GameplayPacketSize = 200;
+    const float GameplayRate = 60.0f;
+    const float ClockOffset = 5000.0f;
+    
+    FlowControl flowControl( mode );
+    flowControl.SetBandwidthLimits( 1024.0f, 4.0f * link_bandwidth );
+    
+    std::deque<SharedLinkPacket> queue;
+    std::deque<SharedLinkPacket> delivering;
+    std::deque<SharedLinkPacket> acking;
+    int queue_bytes = 0;
+    float bulk_budget = 0.0f;
+    float link_budget = 0.0f;
+    float gameplay_accumulator = 0.0f;
+    float rtt = 2.0f * link_delay;
+    
+    double gameplay_delay = 0.0;
+    int gameplay_samples = 0;
+    double delivered = 0.0;
+    
+    for ( int tick = 0; tick * DeltaTime < seconds; ++tick )
+    {
+        const double time = tick * DeltaTime;
+        const bool measuring = time >= warmup;
+        
+        SharedLinkPacket packet;
+        packet.time = time;
+        packet.sent = time;
+        packet.lost = false;
+        packet.delay = 0.0f;
+        
+        gameplay_accumulator += DeltaTime;
+        if ( gameplay_accumulator >= 1.0f / GameplayRate )
+        {
+            gameplay_accumulator -= 1.0f / GameplayRate;
+            packet.bulk = false;
+            if ( queue_bytes + GameplayPacketSize <= queue_size )
+            {
+                queue.push_back( packet );
+                queue_bytes += GameplayPacketSize;
+            }
+        }
+        
+        if ( bulk )
+        {
+            const float pacing = flowControl.GetBandwidth() * DeltaTime;
+            bulk_budget += pacing;
+            if ( bulk_budget > pacing + BulkPacketSize )
+                bulk_budget = pacing + BulkPacketSize;
+            while ( bulk_budget >= BulkPacketSize )
+            {
+                bulk_budget -= BulkPacketSize;
+                flowControl.PacketSent( BulkPacketSize );
+                packet.bulk = true;
+                if ( queue_bytes + BulkPacketSize > queue_size )
+                {
+                    // the sender finds out a round trip later
+                    packet.lost = true;
+                    packet.time = time + 2.0f * link_delay;
+                    acking.push_back( packet );
+                    continue;
+                }
+                queue.push_back( packet );
+                queue_bytes += BulkPacketSize;
+            }
+        }
+        
+        link_budget += link_bandwidth * DeltaTime;
+        while ( !queue.empty() )
+        {
+            const int size = queue.front().bulk ? BulkPacketSize : GameplayPacketSize;
+            if ( link_budget < size )
+                break;
+            SharedLinkPacket sent = queue.front();
+            queue.pop_front();
+            queue_bytes -= size;
+            link_budget -= size;
+            if ( measuring && !sent.bulk )
+            {
+                gameplay_delay += time - sent.sent;
+                gameplay_samples++;
+            }
+            sent.time = time + link_delay;
+            delivering.push_back( sent );
+        }
+        if ( queue.empty() && link_budget > BulkPacketSize )
+            link_budget = BulkPacketSize;
+        
+        while ( !delivering.empty() && delivering.front().time <= time )
+        {
+            SharedLinkPacket received = delivering.front();
+            delivering.pop_front();
+            if ( !received.bulk )
+                continue;
+            if ( measuring )
+                delivered += BulkPacketSize;
+            received.delay = ClockOffset + (float) ( time - received.sent ) * 1000.0f;
+            received.time = time + link_delay;
+            acking.push_back( received );
+        }
+        
+        // losses were queued out of order, the rest come back in order
+        for ( std::deque<SharedLinkPacket>::iterator itor = acking.begin(); itor != acking.end(); )
+        {
+            if ( itor->time > time )
+            {
+                ++itor;
+                continue;
+            }
+            if ( itor->lost )
+            {
+                flowControl.PacketLost( BulkPacketSize );
+            }
+            else
+            {
+                rtt = (float) ( time - itor->sent );
+                flowControl.DelaySample( itor->delay );
+                flowControl.PacketsAcked( BulkPacketSize );
+            }
+            itor = acking.erase( itor );
+        }
+        
+        flowControl.Update( DeltaTime, rtt * 1000.0f, 2000.0f * link_delay );
+    }
+    
+    SharedLinkResult result;
+    result.gameplay_delay = gameplay_samples ? (float) ( gameplay_delay / gameplay_samples ) : 0.0f;
+    result.bulk_goodput = (float) ( delivered / ( seconds - warmup ) );
+    return result;
+}
+
+void benchmark_background_link()
+{
+    printf( "-----------------------------------------------------\n" );
+    printf( "benchmark a background transfer sharing a link with gameplay\n" );
+    printf( "-----------------------------------------------------\n" );
+    
+    struct Profile
+    {
+        const char * name;
+        float bandwidth;            // bytes per second
+        float delay;                // one way, seconds
+        int queue_size;             // bytes
+    };
+    
+    const Profile profiles[] =
+    {
+        { "lan", 2000000.0f, 0.001f, 64000 },
+        { "wan", 500000.0f, 0.02f, 50000 },
+    };
+    const float Seconds = 40.0f;
+    const float Warmup = 10.0f;
+    const float GameplayBandwidth = 60.0f * 200.0f;
+    
+    printf( "link   bulk     gameplay queue delay   bulk goodput\n" );
+    for ( int i = 0; i < (int) ( sizeof( profiles ) / sizeof( profiles[0] ) ); ++i )
+    {
+        const Profile & profile = profiles[i];
+        const SharedLinkResult alone = run_shared_link( false, FlowControl::LEDBAT, profile.bandwidth, profile.delay, profile.queue_size, Seconds, Warmup );
+        const SharedLinkResult aimd = run_shared_link( true, FlowControl::AIMD, profile.bandwidth, profile.delay, profile.queue_size, Seconds, Warmup );
+        const SharedLinkResult ledbat = run_shared_link( true, FlowControl::LEDBAT, profile.bandwidth, profile.delay, profile.queue_size, Seconds, Warmup );
+        printf( "%s    none     %5.2f ms\n", profile.name, alone.gameplay_delay * 1000.0f );
+        printf( "%s    aimd     %5.2f ms               %7.1f kB/s\n", profile.name, aimd.gameplay_delay * 1000.0f, aimd.bulk_goodput / 1000.0f );
+        printf( "%s    ledbat   %5.2f ms               %7.1f kB/s\n", profile.name, ledbat.gameplay_delay * 1000.0f, ledbat.bulk_goodput / 1000.0f );
+        // gameplay waits no longer than it takes the link to send the one bulk packet it can land
+        // behind, while the transfer uses most of what's spare
+        const float BulkPacketTime = 1000.0f / profile.bandwidth;
+        check( ledbat.gameplay_delay - alone.gameplay_delay < BulkPacketTime );
+        check( ledbat.bulk_goodput > 0.8f * ( profile.bandwidth - GameplayBandwidth ) );
+    }
+}
+
+void RunFlowControlTests()
+{
+    printf( "-----------------------------------------------------\n" );
+    printf( "running flow control tests...\n" );
+    
+    test_flow_control_binary();
+    test_flow_control_aimd();
+    test_flow_control_bbr();
+    test_flow_control_ledbat();
+    test_pacer();
+    test_send_scheduler();
+    test_send_accumulator();
+    benchmark_flow_control_link();
+    benchmark_background_link();
+    
+    printf( "-----------------------------------------------------\n" );
+    printf( "flow control tests passed!\n" );
+}
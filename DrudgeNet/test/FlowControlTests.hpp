@@ -0,0 +1,11 @@
+//
+//  FlowControlTests.hpp
+//  DrudgeNet
+//
+
+#ifndef FlowControlTests_hpp
+#define FlowControlTests_hpp
+
+void RunFlowControlTests();
+
+#endif /* FlowControlTests_hpp */
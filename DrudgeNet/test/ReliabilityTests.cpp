@@ -11,6 +11,7 @@
 #include <cassert>
 #include <string>
 #include <stdio.h>
+#include <math.h>
 
 using namespace Net;
 
@@ -77,6 +78,68 @@ void test_packet_queue()
     }
 }
 
+void test_sequence_buffer()
+{
+    printf( "-----------------------------------------------------\n" );
+    printf( "test sequence buffer\n" );
+    printf( "-----------------------------------------------------\n" );
+    
+    const int BufferSize = 256;
+    
+    SequenceBuffer<PacketData> sequenceBuffer( BufferSize );
+    
+    printf( "check insert and find\n" );
+    for ( unsigned int i = 0; i < 100; ++i )
+    {
+        check( !sequenceBuffer.Exists( i ) );
+        PacketData * data = sequenceBuffer.Insert( i );
+        check( data );
+        data->sequence = i;
+        data->size = (int) i * 10;
+    }
+    for ( unsigned int i = 0; i < 100; ++i )
+    {
+        check( sequenceBuffer.Exists( i ) );
+        PacketData * data = sequenceBuffer.Find( i );
+        check( data );
+        check( data->sequence == i );
+        check( data->size == (int) i * 10 );
+        check( sequenceBuffer.GetSequenceAtIndex( sequenceBuffer.GetIndex( i ) ) == i );
+    }
+    check( !sequenceBuffer.Exists( 100 ) );
+    check( sequenceBuffer.Find( 100 ) == NULL );
+    
+    printf( "check remove\n" );
+    sequenceBuffer.Remove( 50 );
+    check( !sequenceBuffer.Exists( 50 ) );
+    check( sequenceBuffer.Exists( 49 ) );
+    check( sequenceBuffer.Exists( 51 ) );
+    sequenceBuffer.Remove( 50 + BufferSize );       // different sequence, same slot: no effect
+    sequenceBuffer.Remove( 51 + BufferSize );
+    check( sequenceBuffer.Exists( 51 ) );
+    
+    printf( "check overwrite\n" );
+    for ( unsigned int i = BufferSize; i < BufferSize + 10; ++i )
+    {
+        sequenceBuffer.Insert( i )->sequence = i;
+        check( sequenceBuffer.Exists( i ) );
+        check( !sequenceBuffer.Exists( i - BufferSize ) );
+        check( sequenceBuffer.Find( i - BufferSize ) == NULL );
+    }
+    check( sequenceBuffer.Exists( 10 ) );
+    
+    printf( "check reset\n" );
+    sequenceBuffer.Reset();
+    for ( int i = 0; i < sequenceBuffer.GetSize(); ++i )
+        check( sequenceBuffer.GetAtIndex( i ) == NULL );
+    
+    printf( "check wrap around\n" );
+    for ( unsigned int i = 0xFFFFFFFF - 10; i != 10; ++i )
+        sequenceBuffer.Insert( i )->sequence = i;
+    for ( unsigned int i = 0xFFFFFFFF - 10; i != 10; ++i )
+        check( sequenceBuffer.Find( i )->sequence == i );
+}
+
 void test_reliability_system()
 {
     printf( "-----------------------------------------------------\n" );
@@ -307,10 +370,464 @@ void test_reliability_system()
         for ( PacketQueue::iterator itor = ackedQueue.begin(); itor != ackedQueue.end(); ++itor, ++i )
             check( itor->sequence == ( (i+255-15) & 0xFF ) );
     }
+    
+    printf( "check sent, acked and lost packets\n" );
+    {
+        ReliabilitySystem reliabilitySystem( MaximumSequence );
+        for ( int i = 0; i < 33; ++i )
+            reliabilitySystem.PacketSent( 100 );
+        check( reliabilitySystem.GetLocalSequence() == 33 );
+        check( reliabilitySystem.GetSentPackets() == 33 );
+        check( reliabilitySystem.GetRetransmitTimeout() == 1.0f );
+        reliabilitySystem.Update( 0.1f );
+        reliabilitySystem.ProcessAck( 32, 0x0000FFFF );
+        unsigned int * acks = NULL;
+        int ack_count = 0;
+        reliabilitySystem.GetAcks( &acks, ack_count );
+        check( ack_count == 17 );
+        check( reliabilitySystem.GetAckedPackets() == 17 );
+        for ( int i = 0; i < ack_count; ++i )
+            check( acks[i] >= 16 && acks[i] <= 32 );
+        // acking the same packets again does nothing
+        reliabilitySystem.ProcessAck( 32, 0x0000FFFF );
+        reliabilitySystem.GetAcks( &acks, ack_count );
+        check( ack_count == 17 );
+        // one sample of 100ms: rto = srtt + 4 * rttvar = 0.1 + 4 * 0.05
+        check( fabs( reliabilitySystem.GetRoundTripTime() - 0.1f ) < 0.0001f );
+        check( fabs( reliabilitySystem.GetRetransmitTimeout() - 0.3f ) < 0.0001f );
+        // packets 0-15 have more than three later packets acked, so they are lost right away
+        check( reliabilitySystem.GetLostPackets() == 16 );
+        reliabilitySystem.Update( 0.5f );
+        check( reliabilitySystem.GetLostPackets() == 16 );
+        // late acks for lost packets are still reported, but give no round trip time sample
+        reliabilitySystem.ProcessAck( 15, 0xFFFFFFFF );
+        reliabilitySystem.GetAcks( &acks, ack_count );
+        check( ack_count == 16 );
+        check( reliabilitySystem.GetLostPackets() == 0 );
+        check( fabs( reliabilitySystem.GetRoundTripTime() - 0.1f ) < 0.0001f );
+        reliabilitySystem.Validate();
+    }
+    
+    printf( "check sparse ack bits\n" );
+    {
+        ReliabilitySystem reliabilitySystem( MaximumSequence );
+        for ( int i = 0; i < 260; ++i )
+            reliabilitySystem.PacketSent( i );
+        check( reliabilitySystem.GetLocalSequence() == 4 );
+        // ack 3 plus 2, 0, 254 and 227 across the wrap
+        reliabilitySystem.ProcessAck( 3, 0x80000015 );
+        unsigned int * acks = NULL;
+        int ack_count = 0;
+        reliabilitySystem.GetAcks( &acks, ack_count );
+        check( ack_count == 5 );
+        check( acks[0] == 3 );
+        check( acks[1] == 2 );
+        check( acks[2] == 0 );
+        check( acks[3] == 254 );
+        check( acks[4] == 227 );
+        check( reliabilitySystem.GetAckedPackets() == 5 );
+        check( reliabilitySystem.GetAckedTotal() == 259 + 258 + 256 + 254 + 227 );
+        reliabilitySystem.Validate();
+    }
+    {
+        // with fewer than 32 sequences, ack bits past the sequence space are ignored
+        ReliabilitySystem reliabilitySystem( 15 );
+        for ( int i = 0; i < 16; ++i )
+            reliabilitySystem.PacketSent( 100 );
+        reliabilitySystem.ProcessAck( 15, 0xFFFFFFFF );
+        unsigned int * acks = NULL;
+        int ack_count = 0;
+        reliabilitySystem.GetAcks( &acks, ack_count );
+        check( ack_count == 16 );
+        check( reliabilitySystem.GetAckedTotal() == 16 * 100 );
+        reliabilitySystem.Validate();
+    }
+    
+    printf( "check received packets with wrap\n" );
+    {
+        ReliabilitySystem reliabilitySystem( MaximumSequence );
+        for ( int i = 255 - 31; i <= 255 + 1; ++i )
+            reliabilitySystem.PacketReceived( i & 0xFF, 100 );
+        check( reliabilitySystem.GetRemoteSequence() == 0 );
+        check( reliabilitySystem.GenerateAckBits() == 0xFFFFFFFF );
+        reliabilitySystem.PacketReceived( 0, 100 );
+        check( reliabilitySystem.GetReceivedPackets() == 34 );
+        check( reliabilitySystem.GetReceivedTotal() == 33 * 100 );
+        reliabilitySystem.PacketReceived( 16, 100 );
+        check( reliabilitySystem.GenerateAckBits() == 0xFFFF8000 );
+        reliabilitySystem.Validate();
+    }
+    
+    printf( "check incremental ack bits\n" );
+    {
+        // drop, reorder and duplicate packets and compare against ack bits generated from a sorted queue
+        ReliabilitySystem reliabilitySystem( MaximumSequence );
+        PacketQueue receivedQueue;
+        unsigned int sequences[1024];
+        for ( unsigned int i = 0; i < 1024; ++i )
+            sequences[i] = i;
+        for ( int i = 0; i < 1023; ++i )
+        {
+            if ( rand() % 4 == 0 )
+                std::swap( sequences[i], sequences[i+1] );
+        }
+        for ( int i = 0; i < 1024; ++i )
+        {
+            if ( rand() % 5 == 0 )
+                continue;
+            const int count = rand() % 8 == 0 ? 2 : 1;
+            for ( int j = 0; j < count; ++j )
+            {
+                const unsigned int sequence = sequences[i] & MaximumSequence;
+                reliabilitySystem.PacketReceived( sequence, 100 );
+                if ( !receivedQueue.Exists( sequence ) )
+                {
+                    PacketData data;
+                    data.sequence = sequence;
+                    receivedQueue.InsertSorted( data, MaximumSequence );
+                }
+                const unsigned int latest_sequence = receivedQueue.back().sequence;
+                const unsigned int minimum_sequence = latest_sequence >= 33 ? ( latest_sequence - 33 ) : MaximumSequence - ( 32 - latest_sequence );
+                while ( receivedQueue.size() && !ReliabilitySystem::IsSequenceMoreRecent( receivedQueue.front().sequence, minimum_sequence, MaximumSequence ) )
+                    receivedQueue.pop_front();
+                check( reliabilitySystem.GetRemoteSequence() == latest_sequence );
+                check( reliabilitySystem.GenerateAckBits() == ReliabilitySystem::GenerateAckBits( latest_sequence, receivedQueue, MaximumSequence ) );
+            }
+        }
+        reliabilitySystem.Validate();
+    }
+    
+    printf( "check loss detection\n" );
+    {
+        struct LostPackets
+        {
+            static void OnPacketLost( void * context, unsigned int sequence, int size )
+            {
+                LostPackets * lostPackets = (LostPackets*) context;
+                check( size == 100 );
+                lostPackets->sequences.push_back( sequence );
+            }
+            std::vector<unsigned int> sequences;
+        };
+        LostPackets lostPackets;
+        ReliabilitySystem reliabilitySystem( MaximumSequence );
+        reliabilitySystem.SetPacketLostCallback( LostPackets::OnPacketLost, &lostPackets );
+        const float DeltaTime = 0.01f;
+        for ( int i = 0; i < 10; ++i )
+        {
+            reliabilitySystem.PacketSent( 100 );
+            reliabilitySystem.Update( DeltaTime );
+        }
+        // round trip of 50ms sampled from packet 5
+        reliabilitySystem.ProcessAck( 5, 0 );
+        check( reliabilitySystem.GetAckedPackets() == 1 );
+        check( fabs( reliabilitySystem.GetRoundTripTime() - 0.05f ) < 0.001f );
+        // packets 0-2 have three later packets acked, 3 and 4 were sent 9/8 rtt before now and are lost on time
+        check( reliabilitySystem.GetLostPackets() == 5 );
+        check( lostPackets.sequences.size() == 5 );
+        for ( unsigned int i = 0; i < lostPackets.sequences.size(); ++i )
+            check( lostPackets.sequences[i] == i );
+        // packet 6 has only one later packet acked and is younger than 9/8 rtt
+        reliabilitySystem.ProcessAck( 7, 0 );
+        check( reliabilitySystem.GetLostPackets() == 5 );
+        // time passes without acks and pushes it over the time threshold
+        for ( int i = 0; i < 3; ++i )
+            reliabilitySystem.Update( DeltaTime );
+        check( reliabilitySystem.GetLostPackets() == 6 );
+        check( lostPackets.sequences.back() == 6 );
+        // reordered, not lost: a late ack takes it back out of the lost count
+        reliabilitySystem.ProcessAck( 8, 0x3 );
+        check( reliabilitySystem.GetLostPackets() == 5 );
+        check( reliabilitySystem.GetAckedPackets() == 4 );
+        reliabilitySystem.Validate();
+    }
+    
+    printf( "check round trip time estimator\n" );
+    {
+        ReliabilitySystem reliabilitySystem( MaximumSequence );
+        reliabilitySystem.SetMinRoundTripTimeWindow( 2.0f );
+        const float DeltaTime = 0.01f;
+        // steady 20ms round trip: srtt settles, rttvar decays and rto bottoms out at the minimum
+        for ( int i = 0; i < 200; ++i )
+        {
+            reliabilitySystem.PacketSent( 100 );
+            reliabilitySystem.Update( DeltaTime );
+            reliabilitySystem.Update( DeltaTime );
+            reliabilitySystem.ProcessAck( reliabilitySystem.GetLocalSequence() == 0 ? MaximumSequence : reliabilitySystem.GetLocalSequence() - 1, 0 );
+        }
+        check( fabs( reliabilitySystem.GetRoundTripTime() - 0.02f ) < 0.001f );
+        check( reliabilitySystem.GetRoundTripTimeVariance() < 0.001f );
+        check( fabs( reliabilitySystem.GetMinRoundTripTime() - 0.02f ) < 0.001f );
+        check( reliabilitySystem.GetRetransmitTimeout() == reliabilitySystem.GetMinRetransmitTimeout() );
+        check( reliabilitySystem.GetLostPackets() == 0 );
+        // round trip jumps to 100ms: srtt and rto follow, min rtt holds until its window runs out
+        for ( int i = 0; i < 50; ++i )
+        {
+            reliabilitySystem.PacketSent( 100 );
+            for ( int j = 0; j < 10; ++j )
+                reliabilitySystem.Update( DeltaTime );
+            reliabilitySystem.ProcessAck( reliabilitySystem.GetLocalSequence() == 0 ? MaximumSequence : reliabilitySystem.GetLocalSequence() - 1, 0 );
+            if ( i == 10 )
+                check( fabs( reliabilitySystem.GetMinRoundTripTime() - 0.02f ) < 0.001f );
+        }
+        check( fabs( reliabilitySystem.GetRoundTripTime() - 0.1f ) < 0.005f );
+        check( reliabilitySystem.GetRetransmitTimeout() > reliabilitySystem.GetRoundTripTime() );
+        check( fabs( reliabilitySystem.GetMinRoundTripTime() - 0.1f ) < 0.001f );
+        // a packet not acked within rto is lost long before the one second maximum
+        reliabilitySystem.PacketSent( 100 );
+        const float rto = reliabilitySystem.GetRetransmitTimeout();
+        for ( float t = 0.0f; t < rto + 2 * DeltaTime; t += DeltaTime )
+            reliabilitySystem.Update( DeltaTime );
+        check( reliabilitySystem.GetLostPackets() == 1 );
+        reliabilitySystem.Validate();
+    }
+    
+    printf( "check bandwidth and packet rates\n" );
+    {
+        ReliabilitySystem reliabilitySystem( MaximumSequence );
+        reliabilitySystem.SetStatsWindow( 0.5f );
+        check( reliabilitySystem.GetStatsWindow() == 0.5f );
+        const float DeltaTime = 1.0f / 30.0f;
+        unsigned int remote_sequence = 0;
+        for ( int i = 0; i < 150; ++i )
+        {
+            // 30 packets per second each way, 100 bytes out and 200 bytes in
+            reliabilitySystem.PacketSent( 100 );
+            reliabilitySystem.PacketReceived( remote_sequence, 200 );
+            remote_sequence = ( remote_sequence + 1 ) & MaximumSequence;
+            reliabilitySystem.ProcessAck( reliabilitySystem.GetLocalSequence() == 0 ? MaximumSequence : reliabilitySystem.GetLocalSequence() - 1, 0 );
+            reliabilitySystem.Update( DeltaTime );
+        }
+        check( fabs( reliabilitySystem.GetSentPacketRate() - 30.0f ) < 1.0f );
+        check( fabs( reliabilitySystem.GetReceivedPacketRate() - 30.0f ) < 1.0f );
+        check( fabs( reliabilitySystem.GetSentBandwidth() - 24.0f ) < 1.0f );
+        check( fabs( reliabilitySystem.GetAckedBandwidth() - 24.0f ) < 1.0f );
+        check( fabs( reliabilitySystem.GetReceivedBandwidth() - 48.0f ) < 2.0f );
+        // rates decay once traffic stops
+        for ( int i = 0; i < 150; ++i )
+            reliabilitySystem.Update( DeltaTime );
+        check( reliabilitySystem.GetSentPacketRate() < 0.1f );
+        check( reliabilitySystem.GetSentBandwidth() < 0.1f );
+        check( reliabilitySystem.GetReceivedBandwidth() < 0.1f );
+    }
+    
+    printf( "check ack scheduling\n" );
+    {
+        ReliabilitySystem reliabilitySystem( MaximumSequence );
+        reliabilitySystem.SetAckDelay( 0.1f );
+        reliabilitySystem.SetMaxUnackedPackets( 4 );
+        check( !reliabilitySystem.IsAckRequired() );
+        reliabilitySystem.PacketReceived( 0, 100 );
+        check( reliabilitySystem.GetUnackedPackets() == 1 );
+        check( !reliabilitySystem.IsAckRequired() );
+        reliabilitySystem.Update( 0.05f );
+        check( !reliabilitySystem.IsAckRequired() );
+        reliabilitySystem.Update( 0.06f );
+        check( reliabilitySystem.IsAckRequired() );
+        reliabilitySystem.AckSent();
+        check( !reliabilitySystem.IsAckRequired() );
+        check( reliabilitySystem.GetUnackedPackets() == 0 );
+        // duplicates don't need acking again
+        reliabilitySystem.PacketReceived( 0, 100 );
+        check( reliabilitySystem.GetUnackedPackets() == 0 );
+        // too many unacked packets force an ack straight away
+        for ( unsigned int i = 1; i <= 4; ++i )
+            reliabilitySystem.PacketReceived( i, 100 );
+        check( reliabilitySystem.IsAckRequired() );
+        // outgoing packets carry acks, so sending clears the pending acks
+        reliabilitySystem.PacketSent( 100 );
+        check( !reliabilitySystem.IsAckRequired() );
+        reliabilitySystem.Update( 1.0f );
+        check( !reliabilitySystem.IsAckRequired() );
+    }
 }
 
 // --------------------------------------------------------
 
+void test_reliability_pool()
+{
+    printf( "-----------------------------------------------------\n" );
+    printf( "test reliability pool\n" );
+    printf( "-----------------------------------------------------\n" );
+    
+    const unsigned int MaximumSequence = 255;
+    const int PeerCount = 100;
+    
+    printf( "check add and remove peers\n" );
+    {
+        ReliabilityPool reliabilityPool( 4, MaximumSequence );
+        check( reliabilityPool.GetCapacity() == 4 );
+        int peers[PeerCount];
+        for ( int i = 0; i < PeerCount; ++i )
+        {
+            peers[i] = reliabilityPool.AddPeer();
+            check( reliabilityPool.IsPeerActive( peers[i] ) );
+        }
+        check( reliabilityPool.GetPeerCount() == PeerCount );
+        check( reliabilityPool.GetCapacity() >= PeerCount );
+        // handles survive the pool growing
+        ReliabilitySystem & first = reliabilityPool.GetPeer( peers[0] );
+        first.PacketSent( 100 );
+        for ( int i = 0; i < PeerCount; ++i )
+            reliabilityPool.AddPeer();
+        check( &reliabilityPool.GetPeer( peers[0] ) == &first );
+        check( first.GetLocalSequence() == 1 );
+        check( first.GetPeer() == peers[0] );
+        // removed slots are reused and start from scratch
+        reliabilityPool.RemovePeer( peers[0] );
+        check( !reliabilityPool.IsPeerActive( peers[0] ) );
+        check( reliabilityPool.AddPeer() == peers[0] );
+        check( first.GetLocalSequence() == 0 );
+    }
+    
+    printf( "check pool update matches standalone systems\n" );
+    {
+        ReliabilityPool reliabilityPool( PeerCount, MaximumSequence );
+        std::vector<ReliabilitySystem*> standalone;
+        for ( int i = 0; i < PeerCount; ++i )
+        {
+            check( reliabilityPool.AddPeer() == i );
+            standalone.push_back( new ReliabilitySystem( MaximumSequence ) );
+        }
+        const float DeltaTime = 0.01f;
+        for ( int tick = 0; tick < 500; ++tick )
+        {
+            for ( int i = 0; i < PeerCount; ++i )
+            {
+                // every peer sees a different mix of traffic, round trip and loss
+                ReliabilitySystem * systems[] = { &reliabilityPool.GetPeer( i ), standalone[i] };
+                for ( int j = 0; j < 2; ++j )
+                {
+                    ReliabilitySystem & system = *systems[j];
+                    if ( ( tick + i ) % ( 1 + i % 3 ) == 0 )
+                        system.PacketSent( 50 + i );
+                    const int delay = 2 + i % 7;
+                    const unsigned int local_sequence = system.GetLocalSequence();
+                    if ( tick % 5 != i % 5 && system.GetSentPackets() > (unsigned int) delay )
+                    {
+                        const unsigned int ack = ( local_sequence + MaximumSequence + 1 - delay ) & MaximumSequence;
+                        system.ProcessAck( ack, 0xFFFFFFFF & ~( 1u << ( i % 32 ) ) );
+                    }
+                    if ( tick % 2 == 0 )
+                        system.PacketReceived( ( tick / 2 ) & MaximumSequence, 80 );
+                }
+            }
+            reliabilityPool.Update( DeltaTime );
+            for ( int i = 0; i < PeerCount; ++i )
+                standalone[i]->Update( DeltaTime );
+        }
+        for ( int i = 0; i < PeerCount; ++i )
+        {
+            ReliabilitySystem & pooled = reliabilityPool.GetPeer( i );
+            ReliabilitySystem & single = *standalone[i];
+            check( pooled.GetLocalSequence() == single.GetLocalSequence() );
+            check( pooled.GetRemoteSequence() == single.GetRemoteSequence() );
+            check( pooled.GenerateAckBits() == single.GenerateAckBits() );
+            check( pooled.GetSentPackets() == single.GetSentPackets() );
+            check( pooled.GetAckedPackets() == single.GetAckedPackets() );
+            check( pooled.GetLostPackets() == single.GetLostPackets() );
+            check( pooled.GetRoundTripTime() == single.GetRoundTripTime() );
+            check( pooled.GetRetransmitTimeout() == single.GetRetransmitTimeout() );
+            check( fabs( pooled.GetSentBandwidth() - single.GetSentBandwidth() ) < 0.001f );
+            check( fabs( pooled.GetAckedBandwidth() - single.GetAckedBandwidth() ) < 0.001f );
+            check( fabs( pooled.GetReceivedPacketRate() - single.GetReceivedPacketRate() ) < 0.001f );
+            pooled.Validate();
+            delete standalone[i];
+        }
+    }
+}
+
+template <typename FixedSystem> void drive_against_runtime( FixedSystem & fixed, ReliabilitySystem & runtime, int packets )
+{
+    const unsigned int MaximumSequence = runtime.GetMaxSequence();
+    const float DeltaTime = 0.01f;
+    for ( int i = 0; i < packets; ++i )
+    {
+        fixed.PacketSent( 100 );
+        runtime.PacketSent( 100 );
+        check( fixed.GetLocalSequence() == runtime.GetLocalSequence() );
+        // ack a few packets behind, dropping every seventh
+        if ( i >= 4 && i % 7 != 0 )
+        {
+            const unsigned int ack = ( runtime.GetLocalSequence() + MaximumSequence + 1 - 4 ) & MaximumSequence;
+            fixed.ProcessAck( ack, 0xFFFFFFFF & ~( 1u << ( i % 32 ) ) );
+            runtime.ProcessAck( ack, 0xFFFFFFFF & ~( 1u << ( i % 32 ) ) );
+        }
+        fixed.PacketReceived( i & MaximumSequence, 80 );
+        runtime.PacketReceived( i & MaximumSequence, 80 );
+        check( fixed.GetRemoteSequence() == runtime.GetRemoteSequence() );
+        check( fixed.GenerateAckBits() == runtime.GenerateAckBits() );
+        unsigned int * fixed_acks = NULL;
+        unsigned int * runtime_acks = NULL;
+        int fixed_count = 0;
+        int runtime_count = 0;
+        fixed.GetAcks( &fixed_acks, fixed_count );
+        runtime.GetAcks( &runtime_acks, runtime_count );
+        check( fixed_count == runtime_count );
+        for ( int j = 0; j < fixed_count; ++j )
+            check( fixed_acks[j] == runtime_acks[j] );
+        fixed.Update( DeltaTime );
+        runtime.Update( DeltaTime );
+    }
+    check( fixed.GetAckedPackets() == runtime.GetAckedPackets() );
+    check( fixed.GetLostPackets() == runtime.GetLostPackets() );
+    check( fixed.GetRoundTripTime() == runtime.GetRoundTripTime() );
+    fixed.Validate();
+    runtime.Validate();
+}
+
+void test_sequence_width()
+{
+    printf( "-----------------------------------------------------\n" );
+    printf( "test sequence width\n" );
+    printf( "-----------------------------------------------------\n" );
+    
+    printf( "check fixed width arithmetic matches runtime\n" );
+    {
+        // the only disagreement is at exactly half the sequence space, which is never compared
+        Sequence16 sequence16;
+        SequenceRuntime runtime16( 0xFFFF );
+        Sequence32 sequence32;
+        SequenceRuntime runtime32;
+        srand( 1 );
+        for ( int i = 0; i < 100000; ++i )
+        {
+            const uint16_t a = (uint16_t) rand();
+            const uint16_t b = (uint16_t) rand();
+            if ( (uint16_t) ( a - b ) != 0x8000 )
+                check( sequence16.IsMoreRecent( a, b ) == runtime16.IsMoreRecent( a, b ) );
+            check( sequence16.Difference( a, b ) == runtime16.Difference( a, b ) );
+            check( sequence16.Next( a ) == runtime16.Next( a ) );
+            check( sequence16.Previous( a, b & 0xFF ) == runtime16.Previous( a, b & 0xFF ) );
+            const uint32_t c = ( (uint32_t) rand() << 16 ) ^ (uint32_t) rand();
+            const uint32_t d = ( i & 1 ) ? c + ( rand() & 0xFF ) : ( (uint32_t) rand() << 16 ) ^ (uint32_t) rand();
+            if ( c - d != 0x80000000 )
+                check( sequence32.IsMoreRecent( c, d ) == runtime32.IsMoreRecent( c, d ) );
+            check( sequence32.Difference( c, d ) == runtime32.Difference( c, d ) );
+            check( sequence32.Next( c ) == runtime32.Next( c ) );
+        }
+        check( sequence16.Next( 0xFFFF ) == 0 );
+        check( sequence16.Previous( 0, 1 ) == 0xFFFF );
+        check( sequence32.Next( 0xFFFFFFFF ) == 0 );
+    }
+    
+    printf( "check 16 bit reliability system wraps like runtime\n" );
+    {
+        ReliabilitySystem16 fixed;
+        ReliabilitySystem runtime( 0xFFFF );
+        check( fixed.GetMaxSequence() == 0xFFFF );
+        drive_against_runtime( fixed, runtime, 70000 );
+        check( fixed.GetLocalSequence() == 70000 - 65536 );
+    }
+    
+    printf( "check 32 bit reliability system matches runtime\n" );
+    {
+        ReliabilitySystem32 fixed;
+        ReliabilitySystem runtime;
+        drive_against_runtime( fixed, runtime, 5000 );
+    }
+}
+
 void test_reliable_connection_join()
 {
     printf( "-----------------------------------------------------\n" );
@@ -1142,8 +1659,8 @@ void test_reliable_connection_sequence_wrap_around()
     const unsigned int PacketCount = 256;
     const unsigned int MaxSequence = 31;		// [0,31]
     
-    ReliableConnection client( ProtocolId, TimeOut, MaxSequence );
-    ReliableConnection server( ProtocolId, TimeOut, MaxSequence );
+    ReliableConnectionRuntime client( ProtocolId, TimeOut, MaxSequence );
+    ReliableConnectionRuntime server( ProtocolId, TimeOut, MaxSequence );
     
     check( client.Start( ClientPort ) );
     check( server.Start( ServerPort ) );
@@ -1237,13 +1754,110 @@ void test_reliable_connection_sequence_wrap_around()
     check( server.IsConnected() );
 }
 
+void test_reliable_connection_ack_packets()
+{
+    printf( "-----------------------------------------------------\n" );
+    printf( "test reliable connection ack packets\n" );
+    printf( "-----------------------------------------------------\n" );
+    
+    const int ServerPort = 30000;
+    const int ClientPort = 30001;
+    const int ProtocolId = 0x11112222;
+    const float DeltaTime = 0.001f;
+    const float TimeOut = 1.0f;
+    const unsigned int PacketCount = 100;
+    
+    ReliableConnection client( ProtocolId, TimeOut );
+    ReliableConnection server( ProtocolId, TimeOut );
+    
+    check( client.Start( ClientPort ) );
+    check( server.Start( ServerPort ) );
+    
+    client.Connect( Address(127,0,0,1,ServerPort ) );
+    server.Listen();
+    
+    bool clientAckedPackets[PacketCount];
+    for ( unsigned int i = 0; i < PacketCount; ++i )
+        clientAckedPackets[i] = false;
+    
+    bool allPacketsAcked = false;
+    unsigned int packetsSent = 0;
+    
+    // only the client sends data, the server acks it with ack packets
+    
+    while ( true )
+    {
+        if ( !client.IsConnecting() && client.ConnectFailed() )
+            break;
+        
+        if ( allPacketsAcked )
+            break;
+        
+        unsigned char packet[256];
+        for ( unsigned int i = 0; i < sizeof(packet); ++i )
+            packet[i] = (unsigned char) i;
+        
+        if ( packetsSent < PacketCount )
+        {
+            client.SendPacket( packet, sizeof(packet) );
+            packetsSent++;
+        }
+        
+        while ( true )
+        {
+            unsigned char packet[256];
+            int bytes_read = client.ReceivePacket( packet, sizeof(packet) );
+            if ( bytes_read == 0 )
+                break;
+            check( false );     // server never sends any data
+        }
+        
+        while ( true )
+        {
+            unsigned char packet[256];
+            int bytes_read = server.ReceivePacket( packet, sizeof(packet) );
+            if ( bytes_read == 0 )
+                break;
+            check( bytes_read == sizeof(packet) );
+        }
+        
+        int ack_count = 0;
+        unsigned int * acks = NULL;
+        client.GetReliabilitySystem().GetAcks( &acks, ack_count );
+        check( ack_count == 0 || ack_count != 0 && acks );
+        for ( int i = 0; i < ack_count; ++i )
+        {
+            unsigned int ack = acks[i];
+            check( ack < PacketCount );
+            check( !clientAckedPackets[ack] );
+            clientAckedPackets[ack] = true;
+        }
+        
+        unsigned int clientAckCount = 0;
+        for ( unsigned int i = 0; i < PacketCount; ++i )
+            clientAckCount += clientAckedPackets[i];
+        allPacketsAcked = clientAckCount == PacketCount;
+        
+        client.Update( DeltaTime );
+        server.Update( DeltaTime );
+    }
+    
+    check( client.IsConnected() );
+    check( server.IsConnected() );
+    check( client.GetReliabilitySystem().GetLostPackets() == 0 );
+    check( server.GetReliabilitySystem().GetSentPackets() == 0 );
+}
+
 void RunReliabilityTests()
 {
     printf( "-----------------------------------------------------\n" );
     printf( "running reliable connection tests...\n" );
 
     test_packet_queue();
+    test_sequence_buffer();
     test_reliability_system();
+    test_reliability_pool();
+    test_sequence_width();
     
     test_reliable_connection_join();
     test_reliable_connection_join_timeout();
@@ -1254,6 +1868,7 @@ void RunReliabilityTests()
     test_reliable_connection_ack_bits();
     test_reliable_connection_packet_loss();
     test_reliable_connection_sequence_wrap_around();
+    test_reliable_connection_ack_packets();
 
     printf( "-----------------------------------------------------\n" );
     printf( "reliable connection tests passed!\n" );
@@ -8,15 +8,25 @@
 
 #include "StreamTests.hpp"
 #include "Stream.h"
+#include "StaticStream.h"
+#include "SerializeCompressed.h"
+#include "DeltaEncoding.h"
+#include "SerializeVarint.h"
+#include "RangeStream.h"
+#include "ReliabilitySystem.h"
 #include <cassert>
 #include <algorithm>
+#include <vector>
+#include <chrono>
+#include <stdlib.h>
+#include <math.h>
 
 using namespace Net;
 
 #ifdef DEBUG
 #define check assert
 #else
-#define check(n) if ( !n ) { printf( "check failed\n" ); exit(1); }
+#define check(n) if ( !(n) ) { printf( "check failed\n" ); exit(1); }
 #endif
 
 void test_bit_packer()
@@ -228,6 +238,111 @@ void test_bit_packer()
         check( g == g_out );
         check( h == h_out );
     }
+    
+    printf( "read/write bits (64 bit)\n" );
+    {
+        unsigned char buffer[256];
+        memset( buffer, 0, sizeof( buffer ) );
+        
+        const uint64_t values[] = { 1, 0x1FFFFFFFFULL, 0x123456789ABULL, 0xFFFFFFFFFFFFFFFFULL, 0x5A5A5A5A5A5A5ULL, 12345 };
+        const int widths[] = { 1, 33, 41, 64, 51, 47 };
+        const int count = sizeof( values ) / sizeof( values[0] );
+        
+        int used_bits = 0;
+        BitPacker bitpacker( BitPacker::Write, buffer, sizeof(buffer) );
+        for ( int i = 0; i < count; ++i )
+        {
+            bitpacker.WriteBits( values[i], widths[i] );
+            used_bits += widths[i];
+            check( bitpacker.GetBits() == used_bits );
+        }
+        bitpacker.FlushBits();
+        check( bitpacker.GetBytes() == ( used_bits + 7 ) / 8 );
+        
+        bitpacker = BitPacker( BitPacker::Read, buffer, sizeof(buffer) );
+        for ( int i = 0; i < count; ++i )
+        {
+            uint64_t value = 0;
+            bitpacker.ReadBits( value, widths[i] );
+            check( value == values[i] );
+        }
+        check( bitpacker.GetBits() == used_bits );
+    }
+    
+    printf( "read/write bits (buffer not zeroed)\n" );
+    {
+        // an odd sized buffer full of garbage, written to the last bit
+        unsigned char buffer[13];
+        memset( buffer, 0xCD, sizeof( buffer ) );
+        
+        BitPacker bitpacker( BitPacker::Write, buffer, sizeof(buffer) );
+        for ( int i = 0; i < 8; ++i )
+            bitpacker.WriteBits( (unsigned int) i * 3, 13 );
+        check( bitpacker.BitsRemaining() == 0 );
+        bitpacker.FlushBits();
+        
+        bitpacker = BitPacker( BitPacker::Read, buffer, sizeof(buffer) );
+        for ( int i = 0; i < 8; ++i )
+        {
+            unsigned int value = 0xFFFFFFFF;
+            bitpacker.ReadBits( value, 13 );
+            check( value == (unsigned int) i * 3 );
+        }
+        check( bitpacker.BitsRemaining() == 0 );
+    }
+}
+
+// an entity as it might go into a game state packet, the same serialize function reads, writes and
+// measures, with a Stream or any of the static streams
+
+struct TestEntity
+{
+    bool active;
+    unsigned int type;
+    signed int health;
+    float position[3];
+    uint64_t owner;
+    
+    template <typename StreamType> bool Serialize( StreamType & stream )
+    {
+        if ( !NET_SERIALIZE( stream, stream.SerializeBoolean( active ) ) )
+            return false;
+        if ( !active )
+            return true;
+        if ( !NET_SERIALIZE( stream, SerializeInteger<0, 11>( stream, type ) ) )
+            return false;
+        if ( !NET_SERIALIZE( stream, stream.SerializeInteger( health, -100, 1000 ) ) )
+            return false;
+        for ( int i = 0; i < 3; ++i )
+        {
+            if ( !NET_SERIALIZE( stream, stream.SerializeFloat( position[i] ) ) )
+                return false;
+        }
+        return NET_SERIALIZE( stream, stream.SerializeBits( owner, 40 ) );
+    }
+};
+
+void init_test_entities( TestEntity entities[], int count )
+{
+    for ( int i = 0; i < count; ++i )
+    {
+        entities[i].active = ( i % 3 ) != 0;
+        entities[i].type = i % 12;
+        entities[i].health = i * 50 % 1100 - 100;
+        entities[i].position[0] = i * 1.5f;
+        entities[i].position[1] = -i * 0.25f;
+        entities[i].position[2] = 100.0f;
+        entities[i].owner = 0x1000000000ULL + i;
+    }
+}
+
+bool equal_test_entities( const TestEntity & a, const TestEntity & b )
+{
+    if ( a.active != b.active )
+        return false;
+    if ( !a.active )
+        return true;
+    return a.type == b.type && a.health == b.health && a.position[0] == b.position[0] && a.position[1] == b.position[1] && a.position[2] == b.position[2] && a.owner == b.owner;
 }
 
 void test_stream()
@@ -649,6 +764,38 @@ void test_stream()
         check( c == c_out );
     }
     
+    printf( "stream journal (64 bit)\n" );
+    {
+        unsigned char buffer[256];
+        unsigned char journal[256];
+        memset( buffer, 0, sizeof( buffer ) );
+        memset( journal, 0, sizeof( journal ) );
+        
+        uint64_t a = 0xFEDCBA9876543210ULL;
+        uint64_t b = 0x1234567ULL;
+        
+        Stream stream( Stream::Write, buffer, sizeof(buffer), journal, sizeof(journal) );
+        check( stream.SerializeBits( a, 64 ) );
+        check( stream.SerializeBits( b, 37 ) );
+        check( stream.Checkpoint() );
+        
+        uint64_t a_out = 0;
+        uint64_t b_out = 0;
+        
+        stream.Flush();
+        stream = Stream( Stream::Read, buffer, sizeof(buffer ), journal, sizeof(journal) );
+        check( stream.SerializeBits( a_out, 64 ) );
+        check( !stream.SerializeBits( b_out, 36 ) );
+        
+        stream = Stream( Stream::Read, buffer, sizeof(buffer ), journal, sizeof(journal) );
+        check( stream.SerializeBits( a_out, 64 ) );
+        check( stream.SerializeBits( b_out, 37 ) );
+        check( stream.Checkpoint() );
+        
+        check( a == a_out );
+        check( b == b_out );
+    }
+    
     printf( "stream journal\n" );
     {
         unsigned char buffer[256];
@@ -689,9 +836,2207 @@ void test_stream()
         check( c == c_out );
     }
     
+    printf( "stream measure\n" );
+    {
+        const int EntityCount = 16;
+        TestEntity entities[EntityCount];
+        init_test_entities( entities, EntityCount );
+        
+        // measuring needs no buffer and counts exactly what writing would
+        Stream measure( Stream::Measure, NULL, 1024 );
+        for ( int i = 0; i < EntityCount; ++i )
+            check( entities[i].Serialize( measure ) );
+        check( measure.Checkpoint() );
+        
+        unsigned char buffer[1024];
+        Stream stream( Stream::Write, buffer, sizeof(buffer) );
+        for ( int i = 0; i < EntityCount; ++i )
+            check( entities[i].Serialize( stream ) );
+        check( stream.Checkpoint() );
+        check( measure.GetBitsProcessed() == stream.GetBitsProcessed() );
+        check( measure.GetBitsRemaining() == stream.GetBitsRemaining() );
+        check( measure.GetDataBytes() == stream.GetDataBytes() );
+        
+        // fill a packet budget: measure each entity against what's left, write the ones that fit
+        const int Budget = 64;
+        Stream budget( Stream::Measure, NULL, Budget );
+        int fit = 0;
+        while ( fit < EntityCount && entities[fit].Serialize( budget ) )
+            fit++;
+        check( fit > 0 );
+        check( fit < EntityCount );
+        
+        stream = Stream( Stream::Write, buffer, Budget );
+        for ( int i = 0; i < fit; ++i )
+            check( entities[i].Serialize( stream ) );
+        check( !entities[fit].Serialize( stream ) );
+    }
+    
     // todo: add test for integer values with non-zero min
 }
 
+void test_static_stream()
+{
+    printf( "-----------------------------------------------------\n" );
+    printf( "test static stream\n" );
+    printf( "-----------------------------------------------------\n" );
+    
+    printf( "bits required (constexpr)\n" );
+    {
+        static_assert( BitsRequired( 0, 1 ) == 1, "bits required" );
+        static_assert( BitsRequired( 0, 11 ) == 4, "bits required" );
+        static_assert( BitsRequired( 100, 355 ) == 8, "bits required" );
+        static_assert( BitsRequired( 0, 0xFFFFFFFF ) == 32, "bits required" );
+        const unsigned int maximums[] = { 1, 2, 3, 4, 7, 8, 255, 256, 1000, 65535, 65536, 0x7FFFFFE, 0x7FFFFFF, 0x10000000, 0xFFFFFFFF };
+        for ( int i = 0; i < (int) ( sizeof( maximums ) / sizeof( maximums[0] ) ); ++i )
+            check( BitsRequired( 0, maximums[i] ) == Stream::BitsRequired( 0, maximums[i] ) );
+    }
+    
+    printf( "serialize static stream\n" );
+    {
+        unsigned char buffer[256];
+        
+        signed char a = -100;
+        unsigned char b = 200;
+        signed short c = -30000;
+        unsigned short d = 60000;
+        signed int e = -2000000000;
+        unsigned int f = 123456;
+        float g = 1.2345f;
+        double h = -9876.54321;
+        bool i = true;
+        
+        WriteStream stream( buffer, sizeof(buffer) );
+        check( stream.SerializeByte( a ) );
+        check( stream.SerializeByte( b ) );
+        check( stream.SerializeShort( c ) );
+        check( stream.SerializeShort( d ) );
+        check( stream.SerializeInteger( e ) );
+        check( stream.SerializeInteger( f, 100000, 200000 ) );
+        check( stream.SerializeFloat( g ) );
+        check( stream.SerializeDouble( h ) );
+        check( stream.SerializeBoolean( i ) );
+        check( stream.Checkpoint() );
+        check( stream.GetBitsProcessed() == 8 + 8 + 16 + 16 + 32 + 17 + 32 + 64 + 1 + 32 );
+        stream.Flush();
+        
+        signed char a_out = 0;
+        unsigned char b_out = 0;
+        signed short c_out = 0;
+        unsigned short d_out = 0;
+        signed int e_out = 0;
+        unsigned int f_out = 0;
+        float g_out = 0.0f;
+        double h_out = 0.0;
+        bool i_out = false;
+        
+        ReadStream read( buffer, sizeof(buffer) );
+        check( read.SerializeByte( a_out ) );
+        check( read.SerializeByte( b_out ) );
+        check( read.SerializeShort( c_out ) );
+        check( read.SerializeShort( d_out ) );
+        check( read.SerializeInteger( e_out ) );
+        check( read.SerializeInteger( f_out, 100000, 200000 ) );
+        check( read.SerializeFloat( g_out ) );
+        check( read.SerializeDouble( h_out ) );
+        check( read.SerializeBoolean( i_out ) );
+        check( read.Checkpoint() );
+        check( read.GetBitsProcessed() == stream.GetBitsProcessed() );
+        
+        check( a == a_out );
+        check( b == b_out );
+        check( c == c_out );
+        check( d == d_out );
+        check( e == e_out );
+        check( f == f_out );
+        check( g == g_out );
+        check( h == h_out );
+        check( i == i_out );
+    }
+    
+    printf( "static stream matches stream\n" );
+    {
+        const int EntityCount = 16;
+        TestEntity entities[EntityCount];
+        init_test_entities( entities, EntityCount );
+        
+        unsigned char static_buffer[1024];
+        unsigned char stream_buffer[1024];
+        memset( static_buffer, 0, sizeof( static_buffer ) );
+        memset( stream_buffer, 0, sizeof( stream_buffer ) );
+        
+        MeasureStream measure( NULL, sizeof(static_buffer) );
+        WriteStream write( static_buffer, sizeof(static_buffer) );
+        Stream stream( Stream::Write, stream_buffer, sizeof(stream_buffer) );
+        for ( int i = 0; i < EntityCount; ++i )
+        {
+            check( entities[i].Serialize( measure ) );
+            check( entities[i].Serialize( write ) );
+            check( entities[i].Serialize( stream ) );
+        }
+        write.Flush();
+        stream.Flush();
+        check( measure.GetBitsProcessed() == write.GetBitsProcessed() );
+        check( write.GetBitsProcessed() == stream.GetBitsProcessed() );
+        check( memcmp( static_buffer, stream_buffer, write.GetDataBytes() ) == 0 );
+        
+        // and either reads what the other wrote
+        ReadStream read( stream_buffer, sizeof(stream_buffer) );
+        stream = Stream( Stream::Read, static_buffer, sizeof(static_buffer) );
+        for ( int i = 0; i < EntityCount; ++i )
+        {
+            TestEntity a;
+            TestEntity b;
+            check( a.Serialize( read ) );
+            check( b.Serialize( stream ) );
+            check( equal_test_entities( a, entities[i] ) );
+            check( equal_test_entities( b, entities[i] ) );
+        }
+        
+        // the default ranges are the same too, the whole of each type
+        char byte_value = -128;
+        signed char signed_byte_value = 127;
+        short short_value = -32768;
+        int int_value = -2147483647 - 1;
+        int int_max = 2147483647;
+        write = WriteStream( static_buffer, sizeof(static_buffer) );
+        stream = Stream( Stream::Write, stream_buffer, sizeof(stream_buffer) );
+        check( write.SerializeByte( byte_value ) && stream.SerializeByte( byte_value ) );
+        check( write.SerializeByte( signed_byte_value ) && stream.SerializeByte( signed_byte_value ) );
+        check( write.SerializeShort( short_value ) && stream.SerializeShort( short_value ) );
+        check( write.SerializeInteger( int_value ) && stream.SerializeInteger( int_value ) );
+        check( write.SerializeInteger( int_max ) && stream.SerializeInteger( int_max ) );
+        write.Flush();
+        stream.Flush();
+        check( write.GetBitsProcessed() == 8 + 8 + 16 + 32 + 32 );
+        check( stream.GetBitsProcessed() == write.GetBitsProcessed() );
+        check( memcmp( static_buffer, stream_buffer, write.GetDataBytes() ) == 0 );
+        RangeWriteStream range_write( static_buffer, sizeof(static_buffer) );
+        check( range_write.SerializeShort( short_value ) && range_write.SerializeInteger( int_max ) );
+        range_write.Flush();
+        RangeReadStream range_read( static_buffer, range_write.GetDataBytes() );
+        short short_range = 0;
+        int int_range = 0;
+        check( range_read.SerializeShort( short_range ) && range_read.SerializeInteger( int_range ) );
+        check( short_range == short_value && int_range == int_max );
+        
+        ReadStream read_defaults( stream_buffer, sizeof(stream_buffer) );
+        char byte_out = 0;
+        signed char signed_byte_out = 0;
+        short short_out = 0;
+        int int_out = 0;
+        int int_max_out = 0;
+        check( read_defaults.SerializeByte( byte_out ) );
+        check( read_defaults.SerializeByte( signed_byte_out ) );
+        check( read_defaults.SerializeShort( short_out ) );
+        check( read_defaults.SerializeInteger( int_out ) );
+        check( read_defaults.SerializeInteger( int_max_out ) );
+        check( byte_out == byte_value );
+        check( signed_byte_out == signed_byte_value );
+        check( short_out == short_value );
+        check( int_out == int_value );
+        check( int_max_out == int_max );
+    }
+    
+    printf( "static stream journal\n" );
+    {
+        typedef StaticStream<Stream::Write, DebugJournal> JournalWriteStream;
+        typedef StaticStream<Stream::Read, DebugJournal> JournalReadStream;
+        
+        unsigned char buffer[1024];
+        unsigned char journal[1024];
+        
+        const int EntityCount = 8;
+        TestEntity entities[EntityCount];
+        init_test_entities( entities, EntityCount );
+        
+        JournalWriteStream write( buffer, sizeof(buffer), journal, sizeof(journal) );
+        for ( int i = 0; i < EntityCount; ++i )
+            check( entities[i].Serialize( write ) );
+        check( write.Checkpoint() );
+        write.Flush();
+        check( write.GetJournalBytes() > 0 );
+        
+        JournalReadStream read( buffer, sizeof(buffer), journal, sizeof(journal) );
+        for ( int i = 0; i < EntityCount; ++i )
+        {
+            TestEntity entity;
+            check( entity.Serialize( read ) );
+            check( equal_test_entities( entity, entities[i] ) );
+        }
+        check( read.Checkpoint() );
+        check( read.GetJournalError()[0] == '\0' );
+        
+        // fields read in the wrong order are the same size, the journal catches them by name
+        unsigned int a = 10;
+        unsigned int b = 20;
+        write = JournalWriteStream( buffer, sizeof(buffer), journal, sizeof(journal) );
+        write.Field( "a", __FILE__, __LINE__ );
+        check( write.SerializeInteger( a, 0, 255 ) );
+        write.Field( "b", __FILE__, __LINE__ );
+        check( write.SerializeInteger( b, 0, 255 ) );
+        write.Flush();
+        
+        read = JournalReadStream( buffer, sizeof(buffer), journal, sizeof(journal) );
+        read.Field( "b", __FILE__, __LINE__ );
+        check( !read.SerializeInteger( b, 0, 255 ) );
+        check( strstr( read.GetJournalError(), "reading b (8 bits)" ) );
+        check( strstr( read.GetJournalError(), "but a (8 bits)" ) );
+        
+        // a field read with a different range names the field and both sizes
+        read = JournalReadStream( buffer, sizeof(buffer), journal, sizeof(journal) );
+        read.Field( "a", __FILE__, __LINE__ );
+        check( read.SerializeInteger( a, 0, 255 ) );
+        read.Field( "b", __FILE__, __LINE__ );
+        check( !read.SerializeInteger( b, 0, 1023 ) );
+        check( strstr( read.GetJournalError(), "reading b (10 bits)" ) );
+        check( strstr( read.GetJournalError(), "(8 bits)" ) );
+        
+        // a full journal stops recording without failing the stream, the reader stops checking there
+        unsigned char small_journal[16];
+        write = JournalWriteStream( buffer, sizeof(buffer), small_journal, sizeof(small_journal) );
+        for ( int i = 0; i < EntityCount; ++i )
+            check( entities[i].Serialize( write ) );
+        write.Flush();
+        check( write.GetJournalBytes() <= (int) sizeof(small_journal) );
+        read = JournalReadStream( buffer, sizeof(buffer), small_journal, sizeof(small_journal) );
+        for ( int i = 0; i < EntityCount; ++i )
+        {
+            TestEntity entity;
+            check( entity.Serialize( read ) );
+            check( equal_test_entities( entity, entities[i] ) );
+        }
+        
+        // no journal, nothing is recorded even with a buffer
+        StaticStream<Stream::Write, NoJournal> quiet( buffer, sizeof(buffer), journal, sizeof(journal) );
+        for ( int i = 0; i < EntityCount; ++i )
+            check( entities[i].Serialize( quiet ) );
+        quiet.Flush();
+        check( quiet.GetJournalBytes() == 0 );
+    }
+}
+
+float random_float( float min, float max )
+{
+    return min + ( max - min ) * ( (float) rand() / (float) RAND_MAX );
+}
+
+void random_quaternion( float quaternion[4] )
+{
+    float length = 0.0f;
+    while ( length < 0.001f )
+    {
+        for ( int i = 0; i < 4; ++i )
+            quaternion[i] = random_float( -1.0f, 1.0f );
+        length = sqrtf( quaternion[0] * quaternion[0] + quaternion[1] * quaternion[1] + quaternion[2] * quaternion[2] + quaternion[3] * quaternion[3] );
+    }
+    for ( int i = 0; i < 4; ++i )
+        quaternion[i] /= length;
+}
+
+// rigid body state as a physics sync would send it, 52 bytes uncompressed. ranges just under a
+// power of two steps so no bit is wasted: 15 bits a position component, 9 bits a velocity component
+
+struct TestRigidBody
+{
+    float position[3];
+    float orientation[4];
+    float linear_velocity[3];
+    float angular_velocity[3];
+    
+    template <typename StreamType> bool Serialize( StreamType & stream )
+    {
+        if ( !NET_SERIALIZE( stream, SerializeCompressedVector( stream, position, -255.0f, 255.0f, 1.0f / 64.0f ) ) )
+            return false;
+        if ( !NET_SERIALIZE( stream, SerializeQuaternion( stream, orientation, 9 ) ) )
+            return false;
+        if ( !NET_SERIALIZE( stream, SerializeVelocity( stream, linear_velocity, 15.0f, 1.0f / 16.0f ) ) )
+            return false;
+        return NET_SERIALIZE( stream, SerializeVelocity( stream, angular_velocity, 7.5f, 1.0f / 32.0f ) );
+    }
+};
+
+void test_compressed_serialize()
+{
+    printf( "-----------------------------------------------------\n" );
+    printf( "test compressed serialize\n" );
+    printf( "-----------------------------------------------------\n" );
+    
+    printf( "compressed float\n" );
+    {
+        unsigned char buffer[4096];
+        const float Min = -10.0f;
+        const float Max = 10.0f;
+        const float Resolution = 0.01f;
+        const int Count = 1000;
+        float values[Count];
+        for ( int i = 0; i < Count; ++i )
+            values[i] = random_float( Min, Max );
+        values[0] = Min;
+        values[1] = Max;
+        values[2] = 0.0f;
+        
+        WriteStream write( buffer, sizeof(buffer) );
+        for ( int i = 0; i < Count; ++i )
+            check( SerializeCompressedFloat( write, values[i], Min, Max, Resolution ) );
+        check( write.GetBitsProcessed() == Count * 11 );
+        write.Flush();
+        
+        ReadStream read( buffer, sizeof(buffer) );
+        for ( int i = 0; i < Count; ++i )
+        {
+            float value = 0.0f;
+            check( SerializeCompressedFloat( read, value, Min, Max, Resolution ) );
+            check( fabsf( value - values[i] ) <= Resolution * 0.5f + 0.0001f );
+        }
+        
+        // out of range values are clamped
+        float low = -100.0f;
+        float high = 100.0f;
+        write = WriteStream( buffer, sizeof(buffer) );
+        check( SerializeCompressedFloat( write, low, Min, Max, Resolution ) );
+        check( SerializeCompressedFloat( write, high, Min, Max, Resolution ) );
+        write.Flush();
+        read = ReadStream( buffer, sizeof(buffer) );
+        check( SerializeCompressedFloat( read, low, Min, Max, Resolution ) );
+        check( SerializeCompressedFloat( read, high, Min, Max, Resolution ) );
+        check( low == Min );
+        check( high == Max );
+    }
+    
+    printf( "compressed vector and velocity\n" );
+    {
+        unsigned char buffer[256];
+        float position[3] = { 100.3f, -0.7f, 255.9f };
+        float moving[3] = { 3.3f, -15.9f, 0.01f };
+        float resting[3] = { 0.01f, -0.02f, 0.0f };
+        
+        Stream stream( Stream::Write, buffer, sizeof(buffer) );
+        check( SerializeCompressedVector( stream, position, -256.0f, 256.0f, 1.0f / 64.0f ) );
+        check( SerializeVelocity( stream, moving, 16.0f, 1.0f / 16.0f ) );
+        const int moving_bits = stream.GetBitsProcessed();
+        check( SerializeVelocity( stream, resting, 16.0f, 1.0f / 16.0f ) );
+        check( stream.GetBitsProcessed() == moving_bits + 1 );
+        stream.Flush();
+        
+        float position_out[3];
+        float moving_out[3];
+        float resting_out[3] = { 1.0f, 1.0f, 1.0f };
+        stream = Stream( Stream::Read, buffer, sizeof(buffer) );
+        check( SerializeCompressedVector( stream, position_out, -256.0f, 256.0f, 1.0f / 64.0f ) );
+        check( SerializeVelocity( stream, moving_out, 16.0f, 1.0f / 16.0f ) );
+        check( SerializeVelocity( stream, resting_out, 16.0f, 1.0f / 16.0f ) );
+        for ( int i = 0; i < 3; ++i )
+        {
+            check( fabsf( position_out[i] - position[i] ) <= 0.5f / 64.0f + 0.0001f );
+            check( fabsf( moving_out[i] - moving[i] ) <= 0.5f / 16.0f + 0.0001f );
+            check( resting_out[i] == 0.0f );
+        }
+    }
+    
+    printf( "smallest three quaternion\n" );
+    {
+        unsigned char buffer[8192];
+        const int Count = 1000;
+        for ( int bits = 7; bits <= 14; bits += 7 )
+        {
+            // the three smaller components are within half a step, the rebuilt one a few steps
+            const float step = 2.0f * 0.70710678f / ( ( 1 << bits ) - 1 );
+            std::vector<float> quaternions( Count * 4 );
+            for ( int i = 0; i < Count; ++i )
+                random_quaternion( &quaternions[i * 4] );
+            
+            WriteStream write( buffer, sizeof(buffer) );
+            for ( int i = 0; i < Count; ++i )
+                check( SerializeQuaternion( write, &quaternions[i * 4], bits ) );
+            check( write.GetBitsProcessed() == Count * ( 2 + 3 * bits ) );
+            write.Flush();
+            
+            ReadStream read( buffer, sizeof(buffer) );
+            float max_error = 0.0f;
+            for ( int i = 0; i < Count; ++i )
+            {
+                const float * q = &quaternions[i * 4];
+                float q_out[4];
+                check( SerializeQuaternion( read, q_out, bits ) );
+                const float dot = q[0] * q_out[0] + q[1] * q_out[1] + q[2] * q_out[2] + q[3] * q_out[3];
+                const float sign = dot < 0.0f ? -1.0f : 1.0f;
+                float length = 0.0f;
+                for ( int j = 0; j < 4; ++j )
+                {
+                    const float error = fabsf( q_out[j] * sign - q[j] );
+                    max_error = error > max_error ? error : max_error;
+                    length += q_out[j] * q_out[j];
+                }
+                check( fabsf( length - 1.0f ) < 4.0f * step );
+            }
+            printf( "%d bits: max component error %f\n", bits, max_error );
+            check( max_error <= 3.0f * step );
+        }
+    }
+    
+    printf( "rigid body state\n" );
+    {
+        const int Count = 64;
+        TestRigidBody bodies[Count];
+        for ( int i = 0; i < Count; ++i )
+        {
+            TestRigidBody & body = bodies[i];
+            for ( int j = 0; j < 3; ++j )
+            {
+                body.position[j] = random_float( -255.0f, 255.0f );
+                // half the bodies are asleep, as in most physics scenes
+                body.linear_velocity[j] = i % 2 ? random_float( -15.0f, 15.0f ) : 0.0f;
+                body.angular_velocity[j] = i % 2 ? random_float( -7.5f, 7.5f ) : 0.0f;
+            }
+            random_quaternion( body.orientation );
+        }
+        
+        MeasureStream moving( NULL, 1024 );
+        MeasureStream resting( NULL, 1024 );
+        check( bodies[1].Serialize( moving ) );
+        check( bodies[0].Serialize( resting ) );
+        const float uncompressed = (float) sizeof( TestRigidBody );
+        printf( "uncompressed %.1f bytes, moving %.1f bytes, at rest %.1f bytes\n", uncompressed, moving.GetBitsProcessed() / 8.0f, resting.GetBitsProcessed() / 8.0f );
+        check( uncompressed == 52.0f );
+        check( moving.GetBitsProcessed() <= 16 * 8 + 2 );
+        check( resting.GetBitsProcessed() <= 10 * 8 );
+        
+        unsigned char buffer[2048];
+        WriteStream write( buffer, sizeof(buffer) );
+        for ( int i = 0; i < Count; ++i )
+            check( bodies[i].Serialize( write ) );
+        write.Flush();
+        printf( "%d bodies, %.1f bytes each\n", Count, write.GetBitsProcessed() / 8.0f / Count );
+        check( write.GetBitsProcessed() <= Count * 16 * 8 );
+        
+        ReadStream read( buffer, sizeof(buffer) );
+        for ( int i = 0; i < Count; ++i )
+        {
+            TestRigidBody body;
+            check( body.Serialize( read ) );
+            for ( int j = 0; j < 3; ++j )
+            {
+                check( fabsf( body.position[j] - bodies[i].position[j] ) <= 0.5f / 64.0f + 0.0001f );
+                check( fabsf( body.linear_velocity[j] - bodies[i].linear_velocity[j] ) <= 0.5f / 16.0f + 0.0001f );
+                check( fabsf( body.angular_velocity[j] - bodies[i].angular_velocity[j] ) <= 0.5f / 32.0f + 0.0001f );
+            }
+            const float dot = body.orientation[0] * bodies[i].orientation[0] + body.orientation[1] * bodies[i].orientation[1] + body.orientation[2] * bodies[i].orientation[2] + body.orientation[3] * bodies[i].orientation[3];
+            check( fabsf( dot ) > 0.9999f );
+        }
+    }
+}
+
+// entity state for the delta tests, positions at 1/64 (15 bits a component) and health.
+// most entities are still most ticks, as in a game world
+
+struct TestDeltaSnapshot
+{
+    enum { EntityCount = 32 };
+    
+    float position[EntityCount][3];
+    int health[EntityCount];
+    
+    TestDeltaSnapshot()
+    {
+        memset( position, 0, sizeof( position ) );
+        memset( health, 0, sizeof( health ) );
+    }
+    
+    template <typename StreamType> bool Serialize( StreamType & stream, const TestDeltaSnapshot & baseline )
+    {
+        for ( int i = 0; i < EntityCount; ++i )
+        {
+            for ( int j = 0; j < 3; ++j )
+            {
+                if ( !NET_SERIALIZE( stream, SerializeDeltaCompressedFloat( stream, position[i][j], baseline.position[i][j], -255.0f, 255.0f, 1.0f / 64.0f, 6 ) ) )
+                    return false;
+            }
+            if ( !NET_SERIALIZE( stream, SerializeDeltaInteger( stream, health[i], baseline.health[i], 0, 1000 ) ) )
+                return false;
+        }
+        return true;
+    }
+};
+
+// what a snapshot reads back as, sent in full or against any baseline
+bool equal_delta_snapshot( const TestDeltaSnapshot & sent, const TestDeltaSnapshot & received )
+{
+    const unsigned int steps = CompressedFloatSteps( -255.0f, 255.0f, 1.0f / 64.0f );
+    for ( int i = 0; i < TestDeltaSnapshot::EntityCount; ++i )
+    {
+        for ( int j = 0; j < 3; ++j )
+        {
+            if ( received.position[i][j] != DequantizeFloat( QuantizeFloat( sent.position[i][j], -255.0f, 255.0f, steps ), -255.0f, 255.0f, steps ) )
+                return false;
+            if ( fabsf( received.position[i][j] - sent.position[i][j] ) > 0.5f / 64.0f + 0.0001f )
+                return false;
+        }
+        if ( received.health[i] != sent.health[i] )
+            return false;
+    }
+    return true;
+}
+
+void move_delta_snapshot( TestDeltaSnapshot & snapshot )
+{
+    for ( int i = 0; i < TestDeltaSnapshot::EntityCount; ++i )
+    {
+        if ( rand() % 8 == 0 )
+        {
+            for ( int j = 0; j < 3; ++j )
+            {
+                float & value = snapshot.position[i][j];
+                value += random_float( -0.1f, 0.1f );
+                value = value < -255.0f ? -255.0f : value > 255.0f ? 255.0f : value;
+            }
+        }
+        if ( rand() % 50 == 0 )
+            snapshot.health[i] = std::max( 0, std::min( 1000, snapshot.health[i] + rand() % 201 - 100 ) );
+    }
+}
+
+struct DeltaTestPacket
+{
+    int arrival;
+    unsigned int sequence;
+    unsigned int ack;
+    unsigned int ack_bits;
+    int bytes;
+    unsigned char data[1024];
+    TestDeltaSnapshot snapshot;         // as sent, to check what reads back
+};
+
+void test_delta_encoding()
+{
+    printf( "-----------------------------------------------------\n" );
+    printf( "test delta encoding\n" );
+    printf( "-----------------------------------------------------\n" );
+    
+    printf( "delta integer\n" );
+    {
+        unsigned char buffer[256];
+        const int Baseline = 500;
+        int values[] = { 500, 501, 499, 508, 492, 509, 491, 0, 1000 };
+        const int Bits[] = { 1, 2 + 4, 2 + 4, 2 + 4, 2 + 4, 2 + 10, 2 + 10, 2 + 10, 2 + 10 };
+        const int Count = sizeof( values ) / sizeof( values[0] );
+        
+        WriteStream write( buffer, sizeof(buffer) );
+        for ( int i = 0; i < Count; ++i )
+        {
+            const int bits = write.GetBitsProcessed();
+            check( SerializeDeltaInteger( write, values[i], Baseline, 0, 1000 ) );
+            check( write.GetBitsProcessed() - bits == Bits[i] );
+        }
+        write.Flush();
+        
+        ReadStream read( buffer, sizeof(buffer) );
+        for ( int i = 0; i < Count; ++i )
+        {
+            int value = -1;
+            check( SerializeDeltaInteger( read, value, Baseline, 0, 1000 ) );
+            check( value == values[i] );
+        }
+        
+        // a small delta that leaves the range doesn't read
+        int value = 1000;
+        write = WriteStream( buffer, sizeof(buffer) );
+        check( SerializeDeltaInteger( write, value, 995, 0, 1000 ) );
+        write.Flush();
+        read = ReadStream( buffer, sizeof(buffer) );
+        check( !SerializeDeltaInteger( read, value, 999, 0, 1000 ) );
+    }
+    
+    printf( "delta compressed float\n" );
+    {
+        unsigned char buffer[4096];
+        const int Count = 500;
+        float baselines[Count];
+        float values[Count];
+        for ( int i = 0; i < Count; ++i )
+        {
+            baselines[i] = random_float( -10.0f, 10.0f );
+            values[i] = i % 3 == 0 ? baselines[i] : i % 3 == 1 ? baselines[i] + random_float( -0.05f, 0.05f ) : random_float( -10.0f, 10.0f );
+        }
+        
+        WriteStream write( buffer, sizeof(buffer) );
+        for ( int i = 0; i < Count; ++i )
+            check( SerializeDeltaCompressedFloat( write, values[i], baselines[i], -10.0f, 10.0f, 0.01f ) );
+        write.Flush();
+        
+        ReadStream read( buffer, sizeof(buffer) );
+        const unsigned int steps = CompressedFloatSteps( -10.0f, 10.0f, 0.01f );
+        for ( int i = 0; i < Count; ++i )
+        {
+            float value = 0.0f;
+            check( SerializeDeltaCompressedFloat( read, value, baselines[i], -10.0f, 10.0f, 0.01f ) );
+            // exactly what a full send reads back as
+            check( value == DequantizeFloat( QuantizeFloat( values[i], -10.0f, 10.0f, steps ), -10.0f, 10.0f, steps ) );
+            check( fabsf( value - values[i] ) <= 0.005f + 0.0001f );
+        }
+    }
+    
+    printf( "delta sender and receiver\n" );
+    {
+        unsigned char buffer[1024];
+        DeltaSender<TestDeltaSnapshot> sender( 32 );
+        DeltaReceiver<TestDeltaSnapshot> receiver( 32 );
+        TestDeltaSnapshot snapshot;
+        for ( int i = 0; i < TestDeltaSnapshot::EntityCount; ++i )
+        {
+            snapshot.position[i][0] = random_float( -255.0f, 255.0f );
+            snapshot.health[i] = 100;
+        }
+        
+        // nothing acked, sent against the default snapshot
+        Stream stream( Stream::Write, buffer, sizeof(buffer) );
+        check( sender.Serialize( stream, 0, snapshot ) );
+        stream.Flush();
+        const int full_bits = stream.GetBitsProcessed();
+        check( !sender.HasBaseline() );
+        
+        TestDeltaSnapshot received;
+        stream = Stream( Stream::Read, buffer, sizeof(buffer) );
+        check( receiver.Serialize( stream, 0, received ) );
+        check( equal_delta_snapshot( snapshot, received ) );
+        
+        // acks of packets never sent are ignored
+        sender.ProcessAck( 5 );
+        sender.ProcessAck( 7 );
+        check( !sender.HasBaseline() );
+        
+        // the receiver acks what it decoded, the next one goes against it, unchanged fields cost a bit each
+        check( receiver.HasAck() );
+        check( receiver.GetAckSequence() == 0 );
+        stream = Stream( Stream::Write, buffer, sizeof(buffer) );
+        check( receiver.SerializeAcks( stream ) );
+        stream.Flush();
+        check( stream.GetBitsProcessed() == 1 + 32 );
+        stream = Stream( Stream::Read, buffer, sizeof(buffer) );
+        check( sender.SerializeAcks( stream ) );
+        check( sender.HasBaseline() );
+        check( sender.GetBaselineSequence() == 0 );
+        snapshot.position[3][1] += 0.05f;
+        stream = Stream( Stream::Write, buffer, sizeof(buffer) );
+        check( sender.Serialize( stream, 1, snapshot ) );
+        stream.Flush();
+        const int delta_bits = stream.GetBitsProcessed();
+        printf( "full %d bits, delta %d bits\n", full_bits, delta_bits );
+        check( delta_bits == 1 + 5 + TestDeltaSnapshot::EntityCount * 4 + 1 + 6 );
+        stream = Stream( Stream::Read, buffer, sizeof(buffer) );
+        check( receiver.Serialize( stream, 1, received ) );
+        check( equal_delta_snapshot( snapshot, received ) );
+        
+        // measuring doesn't keep a snapshot
+        MeasureStream measure( NULL, sizeof(buffer) );
+        check( sender.Serialize( measure, 2, snapshot ) );
+        check( measure.GetBitsProcessed() == delta_bits );
+        sender.ProcessAck( 2 );
+        check( sender.GetBaselineSequence() == 0 );
+        
+        // a receiver without the baseline drops the snapshot and has nothing to ack
+        DeltaReceiver<TestDeltaSnapshot> late( 32 );
+        stream = Stream( Stream::Read, buffer, sizeof(buffer) );
+        check( !late.Serialize( stream, 1, received ) );
+        check( !late.HasAck() );
+        stream = Stream( Stream::Write, buffer, sizeof(buffer) );
+        check( late.SerializeAcks( stream ) );
+        stream.Flush();
+        check( stream.GetBitsProcessed() == 1 );
+        
+        // a baseline too old for the ring goes back to a full snapshot
+        stream = Stream( Stream::Write, buffer, sizeof(buffer) );
+        check( sender.Serialize( stream, 32, snapshot ) );
+        check( stream.GetBitsProcessed() > full_bits - 8 );
+        stream.Flush();
+        stream = Stream( Stream::Read, buffer, sizeof(buffer) );
+        check( late.Serialize( stream, 32, received ) );
+        check( equal_delta_snapshot( snapshot, received ) );
+    }
+    
+    printf( "delta over a lossy link\n" );
+    {
+        // 20% loss each way, packets arrive 1 to 4 ticks after they are sent so they reorder.
+        // sequences wrap at 255, the rings hold 64. the reliability system acks every packet that
+        // arrives, as the transports do, but 5% arrive cut short and their snapshot doesn't read.
+        // the sender only goes by the receiver's decoded acks
+        const unsigned int MaxSequence = 255;
+        const int RingSize = 64;
+        const int Ticks = 5000;
+        const float DeltaTime = 1.0f / 60.0f;
+        
+        ReliabilitySystem sender( MaxSequence );
+        ReliabilitySystem receiver( MaxSequence );
+        DeltaSender<TestDeltaSnapshot,SequenceRuntime> delta_sender( RingSize, MaxSequence );
+        DeltaReceiver<TestDeltaSnapshot,SequenceRuntime> delta_receiver( RingSize, MaxSequence );
+        TestDeltaSnapshot snapshot;
+        for ( int i = 0; i < TestDeltaSnapshot::EntityCount; ++i )
+        {
+            for ( int j = 0; j < 3; ++j )
+                snapshot.position[i][j] = random_float( -200.0f, 200.0f );
+            snapshot.health[i] = 100;
+        }
+        
+        std::vector<DeltaTestPacket> to_receiver;
+        std::vector<DeltaTestPacket> to_sender;
+        int sent = 0;
+        int received = 0;
+        int dropped = 0;
+        int delta_packets = 0;
+        double total_bits = 0.0;
+        const int plain_bits = TestDeltaSnapshot::EntityCount * ( 3 * BitsRequired( 0, CompressedFloatSteps( -255.0f, 255.0f, 1.0f / 64.0f ) ) + BitsRequired( 0, 1000 ) );
+        
+        for ( int tick = 0; tick < Ticks; ++tick )
+        {
+            move_delta_snapshot( snapshot );
+            
+            DeltaTestPacket packet;
+            packet.sequence = sender.GetLocalSequence();
+            Stream write( Stream::Write, packet.data, sizeof( packet.data ) );
+            check( delta_sender.Serialize( write, packet.sequence, snapshot ) );
+            write.Flush();
+            packet.bytes = write.GetDataBytes();
+            packet.snapshot = snapshot;
+            packet.arrival = tick + 1 + rand() % 4;
+            sender.PacketSent( packet.bytes );
+            total_bits += write.GetBitsProcessed();
+            delta_packets += delta_sender.HasBaseline() ? 1 : 0;
+            sent++;
+            if ( rand() % 5 != 0 )
+                to_receiver.push_back( packet );
+            
+            // receiver reads what arrived
+            bool ack = false;
+            for ( size_t i = 0; i < to_receiver.size(); )
+            {
+                if ( to_receiver[i].arrival > tick )
+                {
+                    ++i;
+                    continue;
+                }
+                receiver.PacketReceived( to_receiver[i].sequence, to_receiver[i].bytes );
+                ack = true;
+                const int bytes = rand() % 20 == 0 ? to_receiver[i].bytes / 2 : to_receiver[i].bytes;
+                TestDeltaSnapshot read_snapshot;
+                Stream read( Stream::Read, to_receiver[i].data, bytes );
+                if ( delta_receiver.Serialize( read, to_receiver[i].sequence, read_snapshot ) )
+                {
+                    check( equal_delta_snapshot( to_receiver[i].snapshot, read_snapshot ) );
+                    received++;
+                }
+                else
+                    dropped++;
+                to_receiver.erase( to_receiver.begin() + i );
+            }
+            if ( ack && rand() % 5 != 0 )
+            {
+                DeltaTestPacket ack_packet;
+                ack_packet.arrival = tick + 1 + rand() % 4;
+                ack_packet.ack = receiver.GetRemoteSequence();
+                ack_packet.ack_bits = receiver.GenerateAckBits();
+                Stream write_acks( Stream::Write, ack_packet.data, sizeof( ack_packet.data ) );
+                check( delta_receiver.SerializeAcks( write_acks ) );
+                write_acks.Flush();
+                ack_packet.bytes = write_acks.GetDataBytes();
+                to_sender.push_back( ack_packet );
+                receiver.AckSent();
+            }
+            
+            for ( size_t i = 0; i < to_sender.size(); )
+            {
+                if ( to_sender[i].arrival > tick )
+                {
+                    ++i;
+                    continue;
+                }
+                sender.ProcessAck( to_sender[i].ack, to_sender[i].ack_bits );
+                Stream read_acks( Stream::Read, to_sender[i].data, to_sender[i].bytes );
+                check( delta_sender.SerializeAcks( read_acks ) );
+                to_sender.erase( to_sender.begin() + i );
+            }
+            sender.Update( DeltaTime );
+            receiver.Update( DeltaTime );
+        }
+        
+        printf( "%d sent, %d received, %d dropped, %d against a baseline\n", sent, received, dropped, delta_packets );
+        printf( "plain %d bits, delta %.1f bits average\n", plain_bits, total_bits / sent );
+        check( received > sent / 2 );
+        check( delta_packets > sent * 9 / 10 );
+        check( total_bits / sent < plain_bits / 2 );
+    }
+}
+
+// integer fields recorded from a simulated game session, for the varint measurements. each field
+// is sent fixed width with the range it is declared with, or with the variable length encoding for it
+
+struct VarintTrace
+{
+    std::vector<uint32_t> sequences;    // packet sequence, each relative to the last
+    std::vector<uint32_t> ids;          // changed entities in [0,1023], sorted, each relative to the last in the packet
+    std::vector<uint32_t> damage;       // damage counter, usually small, as varint
+    std::vector<int32_t> score;         // score change, as zigzag varint
+    std::vector<int32_t> health;        // health in [0,1000], relative to the last one sent for the entity
+    std::vector<int32_t> health_previous;
+};
+
+void record_varint_trace( VarintTrace & trace, int ticks )
+{
+    const int EntityCount = 1000;
+    std::vector<int32_t> health( EntityCount, 1000 );
+    uint32_t sequence = 0xFFFFFF00;
+    for ( int tick = 0; tick < ticks; ++tick )
+    {
+        sequence += rand() % 20 == 0 ? 2 : 1;
+        trace.sequences.push_back( sequence );
+        for ( int id = rand() % 10; id < EntityCount; id += 1 + rand() % 20 )
+        {
+            trace.ids.push_back( id );
+            trace.damage.push_back( rand() % 100 == 0 ? (uint32_t) rand() % 1000000 : rand() % 50 );
+            trace.score.push_back( rand() % 100 == 0 ? rand() % 200001 - 100000 : rand() % 41 - 20 );
+            trace.health_previous.push_back( health[id] );
+            health[id] = std::max( 0, std::min( 1000, health[id] + ( rand() % 8 == 0 ? rand() % 201 - 100 : rand() % 5 - 2 ) ) );
+            trace.health.push_back( health[id] );
+        }
+    }
+}
+
+void test_varint_serialize()
+{
+    printf( "-----------------------------------------------------\n" );
+    printf( "test varint serialize\n" );
+    printf( "-----------------------------------------------------\n" );
+    
+    printf( "zigzag\n" );
+    {
+        check( ZigZagEncode( (int32_t) 0 ) == 0 );
+        check( ZigZagEncode( (int32_t) -1 ) == 1 );
+        check( ZigZagEncode( (int32_t) 1 ) == 2 );
+        check( ZigZagEncode( (int32_t) -2 ) == 3 );
+        check( ZigZagEncode( (int32_t) 2147483647 ) == 0xFFFFFFFE );
+        check( ZigZagEncode( (int32_t) ( -2147483647 - 1 ) ) == 0xFFFFFFFF );
+        check( ZigZagEncode( (int64_t) -1 ) == 1 );
+        check( ZigZagEncode( (int64_t) ( -9223372036854775807LL - 1 ) ) == 0xFFFFFFFFFFFFFFFFULL );
+        const int32_t values[] = { 0, 1, -1, 63, -64, 64, 1000000, -1000000, 2147483647, -2147483647 - 1 };
+        for ( size_t i = 0; i < sizeof( values ) / sizeof( values[0] ); ++i )
+        {
+            check( ZigZagDecode( ZigZagEncode( values[i] ) ) == values[i] );
+            check( ZigZagDecode( ZigZagEncode( (int64_t) values[i] * 3 ) ) == (int64_t) values[i] * 3 );
+        }
+    }
+    
+    printf( "varint\n" );
+    {
+        unsigned char buffer[256];
+        uint32_t values[] = { 0, 1, 127, 128, 16383, 16384, 2097151, 2097152, 268435455, 268435456, 0xFFFFFFFF };
+        const int Bits[] = { 8, 8, 8, 16, 16, 24, 24, 32, 32, 40, 40 };
+        const int Count = sizeof( values ) / sizeof( values[0] );
+        int32_t signed_values[] = { 0, -1, 63, -64, 64, -65, 2147483647, -2147483647 - 1 };
+        const int SignedBits[] = { 8, 8, 8, 8, 16, 16, 40, 40 };
+        const int SignedCount = sizeof( signed_values ) / sizeof( signed_values[0] );
+        uint64_t big = 0xFFFFFFFFFFFFFFFFULL;
+        int64_t big_signed = -9223372036854775807LL - 1;
+        
+        Stream stream( Stream::Write, buffer, sizeof(buffer) );
+        for ( int i = 0; i < Count; ++i )
+        {
+            const int bits = stream.GetBitsProcessed();
+            check( SerializeVarint( stream, values[i] ) );
+            check( stream.GetBitsProcessed() - bits == Bits[i] );
+        }
+        for ( int i = 0; i < SignedCount; ++i )
+        {
+            const int bits = stream.GetBitsProcessed();
+            check( SerializeVarint( stream, signed_values[i] ) );
+            check( stream.GetBitsProcessed() - bits == SignedBits[i] );
+        }
+        int bits = stream.GetBitsProcessed();
+        check( SerializeVarint( stream, big ) );
+        check( SerializeVarint( stream, big_signed ) );
+        check( stream.GetBitsProcessed() - bits == 160 );
+        stream.Flush();
+        
+        ReadStream read( buffer, sizeof(buffer) );
+        for ( int i = 0; i < Count; ++i )
+        {
+            uint32_t value = 12345;
+            check( SerializeVarint( read, value ) );
+            check( value == values[i] );
+        }
+        for ( int i = 0; i < SignedCount; ++i )
+        {
+            int32_t value = 12345;
+            check( SerializeVarint( read, value ) );
+            check( value == signed_values[i] );
+        }
+        uint64_t big_out = 0;
+        int64_t big_signed_out = 0;
+        check( SerializeVarint( read, big_out ) );
+        check( SerializeVarint( read, big_signed_out ) );
+        check( big_out == big );
+        check( big_signed_out == big_signed );
+        
+        // too long or too wide for the type doesn't read
+        uint64_t wide = 0x100000000ULL;
+        WriteStream write( buffer, sizeof(buffer) );
+        check( SerializeVarint( write, wide ) );
+        for ( int i = 0; i < 11; ++i )
+        {
+            unsigned int group = 0xFF;
+            check( write.SerializeBits( group, 8 ) );
+        }
+        write.Flush();
+        read = ReadStream( buffer, sizeof(buffer) );
+        uint32_t narrow = 0;
+        check( !SerializeVarint( read, narrow ) );
+        read = ReadStream( buffer + 5, sizeof(buffer) - 5 );
+        check( !SerializeVarint( read, wide ) );
+        
+        // five groups at most for 32 bits, ten for 64, and a zero last group past the first doesn't read
+        unsigned char max32[] = { 0xFF, 0xFF, 0xFF, 0xFF, 0x0F, 0, 0, 0 };
+        read = ReadStream( max32, sizeof(max32) );
+        check( SerializeVarint( read, narrow ) );
+        check( narrow == 0xFFFFFFFF );
+        unsigned char long32[] = { 0x80, 0x80, 0x80, 0x80, 0x80, 0x01, 0, 0 };
+        read = ReadStream( long32, sizeof(long32) );
+        check( !SerializeVarint( read, narrow ) );
+        read = ReadStream( long32, sizeof(long32) );
+        check( SerializeVarint( read, wide ) );
+        check( wide == 1ULL << 35 );
+        unsigned char padded[] = { 0x80, 0x00, 0, 0 };
+        read = ReadStream( padded, sizeof(padded) );
+        check( !SerializeVarint( read, narrow ) );
+        read = ReadStream( padded, sizeof(padded) );
+        check( !SerializeVarint( read, wide ) );
+        unsigned char padded_value[] = { 0x81, 0x80, 0x00, 0 };
+        read = ReadStream( padded_value, sizeof(padded_value) );
+        check( !SerializeVarint( read, narrow ) );
+    }
+    
+    printf( "relative integer\n" );
+    {
+        unsigned char buffer[256];
+        const uint32_t Previous = 1000;
+        uint32_t values[] = { 1000, 1001, 999, 998, 1002, 1010, 990, 1100, 900, 3000, 0, 30000, 0x7FFFFFFF, 0x80000000 };
+        const int Bits[] = { 3, 3, 3, 3, 6, 11, 6, 11, 11, 16, 16, 21, 37, 37 };
+        const int Count = sizeof( values ) / sizeof( values[0] );
+        
+        WriteStream write( buffer, sizeof(buffer) );
+        for ( int i = 0; i < Count; ++i )
+        {
+            const int bits = write.GetBitsProcessed();
+            check( SerializeRelativeInteger( write, values[i], Previous ) );
+            check( write.GetBitsProcessed() - bits == Bits[i] );
+        }
+        // wraps around
+        uint32_t wrapped = 2;
+        int32_t negative = -5;
+        const int bits = write.GetBitsProcessed();
+        check( SerializeRelativeInteger( write, wrapped, 0xFFFFFFFE ) );
+        check( SerializeRelativeInteger( write, negative, 3 ) );
+        check( write.GetBitsProcessed() - bits == 6 + 6 );
+        write.Flush();
+        
+        ReadStream read( buffer, sizeof(buffer) );
+        for ( int i = 0; i < Count; ++i )
+        {
+            uint32_t value = 0;
+            check( SerializeRelativeInteger( read, value, Previous ) );
+            check( value == values[i] );
+        }
+        uint32_t wrapped_out = 0;
+        int32_t negative_out = 0;
+        check( SerializeRelativeInteger( read, wrapped_out, 0xFFFFFFFE ) );
+        check( SerializeRelativeInteger( read, negative_out, 3 ) );
+        check( wrapped_out == 2 );
+        check( negative_out == -5 );
+    }
+    
+    printf( "recorded traffic\n" );
+    {
+        VarintTrace trace;
+        record_varint_trace( trace, 100 );
+        std::vector<unsigned char> fixed_buffer( 256 * 1024 );
+        std::vector<unsigned char> variable_buffer( 256 * 1024 );
+        Stream fixed( Stream::Write, &fixed_buffer[0], (int) fixed_buffer.size() );
+        Stream variable( Stream::Write, &variable_buffer[0], (int) variable_buffer.size() );
+        int fixed_bits[5];
+        int variable_bits[5];
+        
+        for ( size_t i = 0; i < trace.sequences.size(); ++i )
+        {
+            check( fixed.SerializeBits( trace.sequences[i], 32 ) );
+            check( SerializeRelativeInteger( variable, trace.sequences[i], i ? trace.sequences[i - 1] : 0 ) );
+        }
+        fixed_bits[0] = fixed.GetBitsProcessed();
+        variable_bits[0] = variable.GetBitsProcessed();
+        for ( size_t i = 0; i < trace.ids.size(); ++i )
+        {
+            check( fixed.SerializeInteger( trace.ids[i], 0, 1023 ) );
+            check( SerializeRelativeInteger( variable, trace.ids[i], i && trace.ids[i - 1] < trace.ids[i] ? trace.ids[i - 1] : 0 ) );
+        }
+        fixed_bits[1] = fixed.GetBitsProcessed();
+        variable_bits[1] = variable.GetBitsProcessed();
+        for ( size_t i = 0; i < trace.damage.size(); ++i )
+        {
+            check( fixed.SerializeBits( trace.damage[i], 32 ) );
+            check( SerializeVarint( variable, trace.damage[i] ) );
+        }
+        fixed_bits[2] = fixed.GetBitsProcessed();
+        variable_bits[2] = variable.GetBitsProcessed();
+        for ( size_t i = 0; i < trace.score.size(); ++i )
+        {
+            unsigned int score = (unsigned int) trace.score[i];
+            check( fixed.SerializeBits( score, 32 ) );
+            check( SerializeVarint( variable, trace.score[i] ) );
+        }
+        fixed_bits[3] = fixed.GetBitsProcessed();
+        variable_bits[3] = variable.GetBitsProcessed();
+        for ( size_t i = 0; i < trace.health.size(); ++i )
+        {
+            check( fixed.SerializeInteger( trace.health[i], 0, 1000 ) );
+            check( SerializeRelativeInteger( variable, trace.health[i], trace.health_previous[i] ) );
+        }
+        fixed_bits[4] = fixed.GetBitsProcessed();
+        variable_bits[4] = variable.GetBitsProcessed();
+        fixed.Flush();
+        variable.Flush();
+        
+        // everything reads back
+        Stream read( Stream::Read, &variable_buffer[0], (int) variable_buffer.size() );
+        for ( size_t i = 0; i < trace.sequences.size(); ++i )
+        {
+            uint32_t value = 0;
+            check( SerializeRelativeInteger( read, value, i ? trace.sequences[i - 1] : 0 ) );
+            check( value == trace.sequences[i] );
+        }
+        for ( size_t i = 0; i < trace.ids.size(); ++i )
+        {
+            uint32_t value = 0;
+            check( SerializeRelativeInteger( read, value, i && trace.ids[i - 1] < trace.ids[i] ? trace.ids[i - 1] : 0 ) );
+            check( value == trace.ids[i] );
+        }
+        for ( size_t i = 0; i < trace.damage.size(); ++i )
+        {
+            uint32_t value = 0;
+            check( SerializeVarint( read, value ) );
+            check( value == trace.damage[i] );
+        }
+        for ( size_t i = 0; i < trace.score.size(); ++i )
+        {
+            int32_t value = 0;
+            check( SerializeVarint( read, value ) );
+            check( value == trace.score[i] );
+        }
+        for ( size_t i = 0; i < trace.health.size(); ++i )
+        {
+            int32_t value = 0;
+            check( SerializeRelativeInteger( read, value, trace.health_previous[i] ) );
+            check( value == trace.health[i] );
+        }
+        
+        const char * names[] = { "sequence", "entity id", "damage", "score", "health" };
+        const char * encodings[] = { "relative", "relative", "varint", "zigzag", "relative" };
+        const size_t counts[] = { trace.sequences.size(), trace.ids.size(), trace.damage.size(), trace.score.size(), trace.health.size() };
+        printf( "field       encoding   fixed bits   variable bits\n" );
+        for ( int i = 0; i < 5; ++i )
+        {
+            const int fixed_field = fixed_bits[i] - ( i ? fixed_bits[i - 1] : 0 );
+            const int variable_field = variable_bits[i] - ( i ? variable_bits[i - 1] : 0 );
+            printf( "%-11s %-10s %10.2f %15.2f\n", names[i], encodings[i], (float) fixed_field / counts[i], (float) variable_field / counts[i] );
+            check( variable_field < fixed_field );
+        }
+        printf( "total %.1f KB fixed, %.1f KB variable, %.0f%% saved\n", fixed_bits[4] / 8192.0f, variable_bits[4] / 8192.0f, 100.0f - 100.0f * variable_bits[4] / fixed_bits[4] );
+        check( variable_bits[4] < fixed_bits[4] / 2 );
+    }
+}
+
+// entity state from a simulated game session for the range stream, fields skewed the way game
+// state usually is: most entities active, a few common types, most not moving, small steps
+
+struct TestCodedEntity
+{
+    bool active;
+    unsigned int type;                  // [0,15]
+    bool moved;
+    unsigned int step[3];               // [0,15], a move of step - 8
+    signed int health;                  // [0,100], sent plain
+};
+
+struct TestCodedSnapshot
+{
+    enum { EntityCount = 128 };
+    
+    TestCodedEntity entities[EntityCount];
+    
+    // models start fresh for each packet so a lost one can't desync them
+    template <typename StreamType> bool Serialize( StreamType & stream )
+    {
+        AdaptiveBitModel active_model;
+        AdaptiveBitModel moved_model;
+        AdaptiveModel<16> type_model;
+        AdaptiveModel<16> step_model;
+        for ( int i = 0; i < EntityCount; ++i )
+        {
+            TestCodedEntity & entity = entities[i];
+            if ( !NET_SERIALIZE( stream, SerializeBoolean( stream, entity.active, active_model ) ) )
+                return false;
+            if ( !entity.active )
+                continue;
+            if ( !NET_SERIALIZE( stream, SerializeSymbol( stream, entity.type, type_model ) ) )
+                return false;
+            if ( !NET_SERIALIZE( stream, SerializeBoolean( stream, entity.moved, moved_model ) ) )
+                return false;
+            for ( int j = 0; entity.moved && j < 3; ++j )
+            {
+                if ( !NET_SERIALIZE( stream, SerializeSymbol( stream, entity.step[j], step_model ) ) )
+                    return false;
+            }
+            if ( !NET_SERIALIZE( stream, stream.SerializeInteger( entity.health, 0, 100 ) ) )
+                return false;
+        }
+        return true;
+    }
+};
+
+bool equal_coded_snapshots( const TestCodedSnapshot & a, const TestCodedSnapshot & b )
+{
+    for ( int i = 0; i < TestCodedSnapshot::EntityCount; ++i )
+    {
+        const TestCodedEntity & x = a.entities[i];
+        const TestCodedEntity & y = b.entities[i];
+        if ( x.active != y.active )
+            return false;
+        if ( !x.active )
+            continue;
+        if ( x.type != y.type || x.moved != y.moved || x.health != y.health )
+            return false;
+        if ( x.moved && ( x.step[0] != y.step[0] || x.step[1] != y.step[1] || x.step[2] != y.step[2] ) )
+            return false;
+    }
+    return true;
+}
+
+unsigned int random_skewed( unsigned int common, unsigned int count )
+{
+    // each value half as likely as the one before it, then the rest evenly
+    for ( unsigned int i = 0; i < common; ++i )
+    {
+        if ( rand() % 2 == 0 )
+            return i;
+    }
+    return common + rand() % ( count - common );
+}
+
+void step_coded_snapshot( TestCodedSnapshot & snapshot, bool first )
+{
+    for ( int i = 0; i < TestCodedSnapshot::EntityCount; ++i )
+    {
+        TestCodedEntity & entity = snapshot.entities[i];
+        if ( first )
+        {
+            entity.active = rand() % 10 != 0;
+            entity.type = random_skewed( 3, 16 );
+            entity.health = 100;
+        }
+        entity.moved = rand() % 5 == 0;
+        for ( int j = 0; j < 3; ++j )
+        {
+            const unsigned int size = random_skewed( 3, 8 );
+            entity.step[j] = rand() % 2 ? 8 + size : 8 - size;
+            entity.step[j] = entity.step[j] > 15 ? 15 : entity.step[j];
+        }
+        if ( rand() % 20 == 0 )
+            entity.health = rand() % 101;
+    }
+}
+
+void test_range_stream()
+{
+    printf( "-----------------------------------------------------\n" );
+    printf( "test range stream\n" );
+    printf( "-----------------------------------------------------\n" );
+    
+    printf( "plain fields\n" );
+    {
+        unsigned char buffer[4096];
+        const int Count = 500;
+        std::vector<unsigned int> values( Count );
+        std::vector<int> widths( Count );
+        for ( int i = 0; i < Count; ++i )
+        {
+            widths[i] = 1 + i % 32;
+            values[i] = ( (unsigned int) rand() << 16 ^ (unsigned int) rand() ) & ( widths[i] == 32 ? 0xFFFFFFFF : ( 1u << widths[i] ) - 1 );
+        }
+        values[0] = 1;
+        values[31] = 0xFFFFFFFF;
+        bool flag = true;
+        int integer = -77;
+        float real = 3.25f;
+        double precise = -1.0 / 3.0;
+        uint64_t wide = 0xFEDCBA9876543210ULL;
+        
+        RangeWriteStream write( buffer, sizeof(buffer) );
+        RangeMeasureStream measure( NULL, sizeof(buffer) );
+        for ( int i = 0; i < Count; ++i )
+        {
+            check( write.SerializeBits( values[i], widths[i] ) );
+            check( measure.SerializeBits( values[i], widths[i] ) );
+        }
+        check( measure.GetDataBytes() == write.GetDataBytes() );
+        check( write.SerializeBoolean( flag ) );
+        check( write.SerializeInteger( integer, -100, 100 ) );
+        check( write.Checkpoint() );
+        check( write.SerializeFloat( real ) );
+        check( write.SerializeDouble( precise ) );
+        check( write.SerializeBits( wide, 64 ) );
+        const int expected = write.GetDataBytes();
+        write.Flush();
+        check( write.GetDataBytes() == expected );
+        
+        // raw bits cost what they do in a bitpacker, plus the flush
+        int bits = 1 + 8 + 32 + 32 + 64 + 64;
+        for ( int i = 0; i < Count; ++i )
+            bits += widths[i];
+        printf( "%d bits packed, %d bytes range coded\n", bits, write.GetDataBytes() );
+        check( write.GetDataBytes() <= ( bits + 7 ) / 8 + 5 );
+        
+        RangeReadStream read( buffer, write.GetDataBytes() );
+        for ( int i = 0; i < Count; ++i )
+        {
+            unsigned int value = 0;
+            check( read.SerializeBits( value, widths[i] ) );
+            check( value == values[i] );
+        }
+        bool flag_out = false;
+        int integer_out = 0;
+        float real_out = 0.0f;
+        double precise_out = 0.0;
+        uint64_t wide_out = 0;
+        check( read.SerializeBoolean( flag_out ) );
+        check( read.SerializeInteger( integer_out, -100, 100 ) );
+        check( read.Checkpoint() );
+        check( read.SerializeFloat( real_out ) );
+        check( read.SerializeDouble( precise_out ) );
+        check( read.SerializeBits( wide_out, 64 ) );
+        check( flag_out == flag );
+        check( integer_out == integer );
+        check( real_out == real );
+        check( precise_out == precise );
+        check( wide_out == wide );
+        check( !read.HasFailed() );
+        check( read.GetDataBytes() == write.GetDataBytes() );
+    }
+    
+    printf( "serialize functions written for bitpacked streams\n" );
+    {
+        unsigned char buffer[1024];
+        const int EntityCount = 9;
+        TestEntity entities[EntityCount];
+        init_test_entities( entities, EntityCount );
+        RangeWriteStream write( buffer, sizeof(buffer) );
+        for ( int i = 0; i < EntityCount; ++i )
+            check( entities[i].Serialize( write ) );
+        write.Flush();
+        RangeReadStream read( buffer, write.GetDataBytes() );
+        for ( int i = 0; i < EntityCount; ++i )
+        {
+            TestEntity entity;
+            check( entity.Serialize( read ) );
+            check( equal_test_entities( entity, entities[i] ) );
+        }
+    }
+    
+    printf( "adaptive models\n" );
+    {
+        unsigned char buffer[4096];
+        const int Count = 4000;
+        std::vector<unsigned int> symbols( Count );
+        std::vector<unsigned char> flags( Count );
+        double entropy = 0.0;
+        for ( int i = 0; i < Count; ++i )
+        {
+            symbols[i] = random_skewed( 7, 8 );
+            flags[i] = rand() % 20 == 0;
+        }
+        // each of the first seven symbols half as likely as the one before, flags 1 in 20
+        for ( int i = 0; i < 8; ++i )
+        {
+            const double p = i < 7 ? 1.0 / ( 2 << i ) : 1.0 / 128;
+            entropy -= p * log2( p ) * Count;
+        }
+        entropy -= ( 0.05 * log2( 0.05 ) + 0.95 * log2( 0.95 ) ) * Count;
+        
+        AdaptiveModel<8> model;
+        AdaptiveBitModel flag_model;
+        RangeWriteStream write( buffer, sizeof(buffer) );
+        for ( int i = 0; i < Count; ++i )
+        {
+            bool flag = flags[i] != 0;
+            check( SerializeSymbol( write, symbols[i], model ) );
+            check( SerializeBoolean( write, flag, flag_model ) );
+        }
+        write.Flush();
+        printf( "%d bits packed, entropy %.0f bits, range coded %d bits\n", Count * 4, entropy, write.GetBitsProcessed() );
+        check( write.GetBitsProcessed() < entropy * 1.05 + 64 );
+        
+        // the same calls send a plain stream's fields at a fixed width
+        WriteStream plain( buffer + 2048, 2048 );
+        AdaptiveModel<8> plain_model;
+        AdaptiveBitModel plain_flag_model;
+        for ( int i = 0; i < Count; ++i )
+        {
+            bool flag = flags[i] != 0;
+            check( SerializeSymbol( plain, symbols[i], plain_model ) );
+            check( SerializeBoolean( plain, flag, plain_flag_model ) );
+        }
+        check( plain.GetBitsProcessed() == Count * 4 );
+        
+        model.Reset();
+        flag_model.Reset();
+        RangeReadStream read( buffer, write.GetDataBytes() );
+        for ( int i = 0; i < Count; ++i )
+        {
+            unsigned int symbol = 0;
+            bool flag = false;
+            check( SerializeSymbol( read, symbol, model ) );
+            check( SerializeBoolean( read, flag, flag_model ) );
+            check( symbol == symbols[i] );
+            check( flag == ( flags[i] != 0 ) );
+        }
+        
+        // models halve their counts as they fill up and keep working
+        AdaptiveModel<4> busy;
+        for ( int i = 0; i < 10000; ++i )
+            busy.Update( i % 7 == 0 ? 3 : 0 );
+        check( busy.total <= AdaptiveModel<4>::MaxTotal );
+        check( busy.frequency[1] >= 1 );
+    }
+    
+    printf( "overflow and truncation\n" );
+    {
+        unsigned char buffer[16];
+        RangeWriteStream write( buffer, sizeof(buffer) );
+        unsigned int value = 0xABCDEF;
+        int written = 0;
+        while ( write.SerializeBits( value, 24 ) )
+            written++;
+        check( write.HasFailed() );
+        check( !write.SerializeBits( value, 1 ) );
+        write.Flush();
+        check( write.GetDataBytes() <= (int) sizeof(buffer) );
+        check( written >= 3 );
+        RangeReadStream read( buffer, write.GetDataBytes() );
+        for ( int i = 0; i < written; ++i )
+        {
+            value = 0;
+            check( read.SerializeBits( value, 24 ) );
+            check( value == 0xABCDEF );
+        }
+        
+        // a truncated packet fails to read instead of reading past the end
+        RangeReadStream truncated( buffer, write.GetDataBytes() - 4 );
+        bool ok = true;
+        for ( int i = 0; i < written && ok; ++i )
+            ok = truncated.SerializeBits( value, 24 );
+        check( !ok );
+        check( truncated.HasFailed() );
+    }
+    
+    printf( "captured snapshots\n" );
+    {
+        const int Ticks = 60;
+        unsigned char buffer[4096];
+        TestCodedSnapshot snapshot;
+        int plain_bytes = 0;
+        int range_bytes = 0;
+        for ( int tick = 0; tick < Ticks; ++tick )
+        {
+            step_coded_snapshot( snapshot, tick == 0 );
+            
+            WriteStream plain( buffer, sizeof(buffer) );
+            check( snapshot.Serialize( plain ) );
+            plain.Flush();
+            plain_bytes += plain.GetDataBytes();
+            
+            RangeWriteStream write( buffer, sizeof(buffer) );
+            check( snapshot.Serialize( write ) );
+            write.Flush();
+            range_bytes += write.GetDataBytes();
+            
+            RangeMeasureStream measure( NULL, sizeof(buffer) );
+            check( snapshot.Serialize( measure ) );
+            measure.Flush();
+            check( measure.GetDataBytes() == write.GetDataBytes() );
+            
+            TestCodedSnapshot received;
+            RangeReadStream read( buffer, write.GetDataBytes() );
+            check( received.Serialize( read ) );
+            check( equal_coded_snapshots( snapshot, received ) );
+        }
+        printf( "bitpacked %.1f bytes, range coded %.1f bytes a snapshot, ratio %.2f\n", (float) plain_bytes / Ticks, (float) range_bytes / Ticks, (float) range_bytes / plain_bytes );
+        check( range_bytes < plain_bytes * 0.9f );
+    }
+}
+
+void test_serialize_array()
+{
+    printf( "-----------------------------------------------------\n" );
+    printf( "test serialize array\n" );
+    printf( "-----------------------------------------------------\n" );
+    
+    const BitPacker::ArrayKernel Kernels[] = { BitPacker::ScalarKernel, BitPacker::SSE2Kernel, BitPacker::AVX2Kernel };
+    const int KernelCount = 3;
+    
+    printf( "kernels match one value at a time\n" );
+    {
+        const int Counts[] = { 0, 1, 5, 8, 13, 64, 257 };
+        const int Offsets[] = { 0, 3, 31 };
+        const int BufferSize = 2048;
+        std::vector<unsigned int> values( 257 );
+        std::vector<unsigned int> values_out( 257 );
+        unsigned char expected[BufferSize];
+        unsigned char buffer[BufferSize];
+        for ( int bits = 1; bits <= 32; ++bits )
+        {
+            for ( int c = 0; c < (int) ( sizeof( Counts ) / sizeof( Counts[0] ) ); ++c )
+            {
+                for ( int o = 0; o < (int) ( sizeof( Offsets ) / sizeof( Offsets[0] ) ); ++o )
+                {
+                    const int count = Counts[c];
+                    const int offset = Offsets[o];
+                    const unsigned int mask = bits < 32 ? ( 1u << bits ) - 1 : 0xFFFFFFFF;
+                    // bits above the width are dropped the same way by every path
+                    for ( int i = 0; i < count; ++i )
+                        values[i] = (unsigned int) rand() * 2654435761u ^ (unsigned int) rand();
+                    
+                    memset( expected, 0xCD, BufferSize );
+                    BitPacker reference( BitPacker::Write, expected, BufferSize );
+                    if ( offset )
+                        reference.WriteBits( 0x2AAAAAAAu, offset );
+                    for ( int i = 0; i < count; ++i )
+                        reference.WriteBits( values[i], bits );
+                    reference.WriteBits( 5u, 3 );
+                    reference.FlushBits();
+                    
+                    for ( int k = 0; k < KernelCount; ++k )
+                    {
+                        memset( buffer, 0xCD, BufferSize );
+                        BitPacker write( BitPacker::Write, buffer, BufferSize );
+                        if ( offset )
+                            write.WriteBits( 0x2AAAAAAAu, offset );
+                        write.WriteArray( count ? &values[0] : NULL, count, bits, Kernels[k] );
+                        write.WriteBits( 5u, 3 );
+                        write.FlushBits();
+                        check( write.GetBits() == reference.GetBits() );
+                        check( memcmp( buffer, expected, reference.GetBytes() ) == 0 );
+                        
+                        BitPacker read( BitPacker::Read, expected, reference.GetBytes() );
+                        unsigned int value = 0;
+                        if ( offset )
+                        {
+                            read.ReadBits( value, offset );
+                            check( value == ( 0x2AAAAAAAu & ( ( 1u << offset ) - 1 ) ) );
+                        }
+                        read.ReadArray( count ? &values_out[0] : NULL, count, bits, Kernels[k] );
+                        for ( int i = 0; i < count; ++i )
+                            check( values_out[i] == ( values[i] & mask ) );
+                        read.ReadBits( value, 3 );
+                        check( value == 5 );
+                        check( read.BitsRemaining() < 8 );
+                    }
+                }
+            }
+        }
+    }
+    
+    printf( "streams\n" );
+    {
+        unsigned char buffer[1024];
+        unsigned char journal_buffer[1024];
+        unsigned int tiles[100];
+        unsigned int ids[7];
+        for ( int i = 0; i < 100; ++i )
+            tiles[i] = i * 7 % 13;
+        for ( int i = 0; i < 7; ++i )
+            ids[i] = 1000 + i * 977;
+        
+        Stream write( Stream::Write, buffer, sizeof(buffer), journal_buffer, sizeof(journal_buffer) );
+        bool flag = true;
+        check( write.SerializeBoolean( flag ) );
+        check( write.SerializeArray( tiles, 100, 4 ) );
+        check( write.SerializeArray( ids, 7, 14 ) );
+        check( write.GetBitsProcessed() == 1 + 400 + 98 );
+        write.Flush();
+        
+        // the same bits without a journal and through the static streams
+        unsigned char plain[1024];
+        Stream plain_write( Stream::Write, plain, sizeof(plain) );
+        check( plain_write.SerializeBoolean( flag ) );
+        check( plain_write.SerializeArray( tiles, 100, 4 ) );
+        check( plain_write.SerializeArray( ids, 7, 14 ) );
+        plain_write.Flush();
+        check( memcmp( plain, buffer, write.GetDataBytes() ) == 0 );
+        unsigned char static_buffer[1024];
+        WriteStream static_write( static_buffer, sizeof(static_buffer) );
+        check( static_write.SerializeBoolean( flag ) );
+        check( static_write.SerializeArray( tiles, 100, 4 ) );
+        check( static_write.SerializeArray( ids, 7, 14 ) );
+        static_write.Flush();
+        check( memcmp( static_buffer, buffer, write.GetDataBytes() ) == 0 );
+        MeasureStream measure( NULL, 64 );
+        check( measure.SerializeArray( tiles, 100, 4 ) );
+        check( measure.GetBitsProcessed() == 400 );
+        check( !measure.SerializeArray( tiles, 100, 32 ) );
+        
+        unsigned int tiles_out[100];
+        unsigned int ids_out[7];
+        Stream read( Stream::Read, buffer, sizeof(buffer), journal_buffer, sizeof(journal_buffer) );
+        check( read.SerializeBoolean( flag ) );
+        check( read.SerializeArray( tiles_out, 100, 4 ) );
+        check( read.SerializeArray( ids_out, 7, 14 ) );
+        check( memcmp( tiles, tiles_out, sizeof( tiles ) ) == 0 );
+        check( memcmp( ids, ids_out, sizeof( ids ) ) == 0 );
+        
+        // the journal catches an array read at the wrong width
+        read = Stream( Stream::Read, buffer, sizeof(buffer), journal_buffer, sizeof(journal_buffer) );
+        check( read.SerializeBoolean( flag ) );
+        check( !read.SerializeArray( tiles_out, 100, 5 ) );
+        
+        // not enough room fails before anything is written
+        Stream small( Stream::Write, buffer, 8 );
+        check( !small.SerializeArray( tiles, 100, 4 ) );
+        check( small.GetBitsProcessed() == 0 );
+        
+        RangeWriteStream range_write( buffer, sizeof(buffer) );
+        check( range_write.SerializeArray( ids, 7, 14 ) );
+        range_write.Flush();
+        RangeReadStream range_read( buffer, range_write.GetDataBytes() );
+        check( range_read.SerializeArray( ids_out, 7, 14 ) );
+        check( memcmp( ids, ids_out, sizeof( ids ) ) == 0 );
+    }
+}
+
+void test_serialize_bytes()
+{
+    printf( "-----------------------------------------------------\n" );
+    printf( "test serialize bytes\n" );
+    printf( "-----------------------------------------------------\n" );
+    
+    printf( "bitpacker bytes match one byte at a time\n" );
+    {
+        const int BufferSize = 256;
+        unsigned char data[64];
+        unsigned char data_out[64];
+        unsigned char expected[BufferSize];
+        unsigned char buffer[BufferSize];
+        for ( int i = 0; i < 64; ++i )
+            data[i] = (unsigned char) ( rand() % 256 );
+        for ( int offset = 0; offset < 40; ++offset )
+        {
+            for ( int count = 0; count < 64; count += 1 + count / 8 )
+            {
+                memset( expected, 0xCD, BufferSize );
+                BitPacker reference( BitPacker::Write, expected, BufferSize );
+                if ( offset )
+                    reference.WriteBits( 0x7FFFFFFFu, offset % 32 + 1 );
+                reference.WriteAlign();
+                for ( int i = 0; i < count; ++i )
+                    reference.WriteBits( (unsigned int) data[i], 8 );
+                reference.WriteBits( 3u, 2 );
+                reference.FlushBits();
+                
+                memset( buffer, 0xCD, BufferSize );
+                BitPacker write( BitPacker::Write, buffer, BufferSize );
+                if ( offset )
+                    write.WriteBits( 0x7FFFFFFFu, offset % 32 + 1 );
+                write.WriteAlign();
+                check( write.GetAlignBits() == 0 );
+                write.WriteBytes( data, count );
+                write.WriteBits( 3u, 2 );
+                write.FlushBits();
+                check( write.GetBits() == reference.GetBits() );
+                check( memcmp( buffer, expected, reference.GetBytes() ) == 0 );
+                
+                BitPacker read( BitPacker::Read, buffer, write.GetBytes() );
+                unsigned int value = 0;
+                if ( offset )
+                    read.ReadBits( value, offset % 32 + 1 );
+                check( read.ReadAlign() );
+                memset( data_out, 0, sizeof( data_out ) );
+                read.ReadBytes( data_out, count );
+                check( memcmp( data, data_out, count ) == 0 );
+                read.ReadBits( value, 2 );
+                check( value == 3 );
+            }
+        }
+    }
+    
+    printf( "strings and blobs\n" );
+    {
+        unsigned char buffer[2048];
+        unsigned char journal_buffer[1024];
+        const int NameSize = 32;
+        char name[NameSize] = "The Drudgerist";
+        char chat[256] = "";
+        char longest[NameSize];
+        memset( longest, 'x', NameSize - 1 );
+        longest[NameSize - 1] = '\0';
+        unsigned char blob[1000];
+        for ( int i = 0; i < 1000; ++i )
+            blob[i] = (unsigned char) ( i * 31 );
+        bool flag = true;
+        int health = 73;
+        
+        Stream write( Stream::Write, buffer, sizeof(buffer), journal_buffer, sizeof(journal_buffer) );
+        check( write.SerializeBoolean( flag ) );
+        check( write.SerializeString( name, NameSize ) );
+        check( write.GetBitsProcessed() == 1 + 5 + 2 + 14 * 8 );
+        check( write.SerializeString( chat, sizeof( chat ) ) );
+        check( write.SerializeString( longest, NameSize ) );
+        check( write.SerializeInteger( health, 0, 100 ) );
+        check( write.SerializeBytes( blob, sizeof( blob ) ) );
+        check( write.SerializeBoolean( flag ) );
+        const int bits = write.GetBitsProcessed();
+        write.Flush();
+        
+        // measure and the static streams agree
+        MeasureStream measure( NULL, sizeof(buffer) );
+        check( measure.SerializeBoolean( flag ) );
+        check( measure.SerializeString( name, NameSize ) );
+        check( measure.SerializeString( chat, sizeof( chat ) ) );
+        check( measure.SerializeString( longest, NameSize ) );
+        check( measure.SerializeInteger( health, 0, 100 ) );
+        check( measure.SerializeBytes( blob, sizeof( blob ) ) );
+        check( measure.SerializeBoolean( flag ) );
+        check( measure.GetBitsProcessed() == bits );
+        unsigned char static_buffer[2048];
+        WriteStream static_write( static_buffer, sizeof(static_buffer) );
+        check( static_write.SerializeBoolean( flag ) );
+        check( static_write.SerializeString( name, NameSize ) );
+        check( static_write.SerializeString( chat, sizeof( chat ) ) );
+        check( static_write.SerializeString( longest, NameSize ) );
+        check( static_write.SerializeInteger( health, 0, 100 ) );
+        check( static_write.SerializeBytes( blob, sizeof( blob ) ) );
+        check( static_write.SerializeBoolean( flag ) );
+        static_write.Flush();
+        check( memcmp( static_buffer, buffer, write.GetDataBytes() ) == 0 );
+        
+        char name_out[NameSize];
+        char chat_out[256] = "not empty";
+        char longest_out[NameSize];
+        unsigned char blob_out[1000];
+        int health_out = 0;
+        Stream read( Stream::Read, buffer, write.GetDataBytes(), journal_buffer, sizeof(journal_buffer) );
+        check( read.SerializeBoolean( flag ) );
+        check( read.SerializeString( name_out, NameSize ) );
+        check( read.SerializeString( chat_out, sizeof( chat_out ) ) );
+        check( read.SerializeString( longest_out, NameSize ) );
+        check( read.SerializeInteger( health_out, 0, 100 ) );
+        check( read.SerializeBytes( blob_out, sizeof( blob_out ) ) );
+        check( read.SerializeBoolean( flag ) );
+        check( strcmp( name, name_out ) == 0 );
+        check( chat_out[0] == '\0' );
+        check( strcmp( longest, longest_out ) == 0 );
+        check( health_out == health );
+        check( memcmp( blob, blob_out, sizeof( blob ) ) == 0 );
+        
+        RangeWriteStream range_write( buffer, sizeof(buffer) );
+        check( range_write.SerializeString( name, NameSize ) );
+        check( range_write.SerializeBytes( blob, 100 ) );
+        range_write.Flush();
+        RangeReadStream range_read( buffer, range_write.GetDataBytes() );
+        check( range_read.SerializeString( name_out, NameSize ) );
+        check( range_read.SerializeBytes( blob_out, 100 ) );
+        check( strcmp( name, name_out ) == 0 );
+        check( memcmp( blob, blob_out, 100 ) == 0 );
+    }
+    
+    printf( "bad lengths and padding\n" );
+    {
+        unsigned char buffer[256];
+        char message[200];
+        memset( message, 'm', 150 );
+        message[150] = '\0';
+        
+        // a length past what the reader's buffer holds fails
+        Stream write( Stream::Write, buffer, sizeof(buffer) );
+        check( write.SerializeString( message, 256 ) );
+        write.Flush();
+        char name[100];
+        ReadStream read( buffer, sizeof(buffer) );
+        check( !read.SerializeString( name, 256 / 2 ) );
+        
+        // so does a length that fits the bits but not the buffer
+        char small[100] = "hello";
+        write = Stream( Stream::Write, buffer, sizeof(buffer) );
+        unsigned int length = 120;
+        check( write.SerializeBits( length, 7 ) );
+        write.Flush();
+        Stream stream( Stream::Read, buffer, sizeof(buffer) );
+        check( !stream.SerializeString( small, sizeof( small ) ) );
+        
+        // padding that isn't zero
+        write = Stream( Stream::Write, buffer, sizeof(buffer) );
+        unsigned int bits = 0x1F;
+        check( write.SerializeBits( bits, 5 ) );
+        write.Flush();
+        stream = Stream( Stream::Read, buffer, sizeof(buffer) );
+        check( stream.SerializeBits( bits, 3 ) );
+        check( stream.GetAlignBits() == 5 );
+        check( !stream.SerializeAlign() );
+        
+        // a block longer than the packet, and one long enough that its bit count overflows an int
+        stream = Stream( Stream::Read, buffer, 16 );
+        check( !stream.SerializeBytes( (unsigned char*) message, 17 ) );
+        check( !stream.SerializeBytes( (unsigned char*) message, 0x20000001 ) );
+        ReadStream static_read( buffer, 16 );
+        check( !static_read.SerializeBytes( (unsigned char*) message, 0x20000001 ) );
+    }
+    
+    printf( "journaled byte blocks\n" );
+    {
+        // a block is journaled with its length, reading it back with another length is a desync
+        unsigned char buffer[256];
+        unsigned char journal_buffer[256];
+        unsigned char block[32];
+        memset( block, 0x5A, sizeof( block ) );
+        Stream write( Stream::Write, buffer, sizeof(buffer), journal_buffer, sizeof(journal_buffer) );
+        check( write.SerializeBytes( block, 20 ) );
+        write.Flush();
+        Stream read( Stream::Read, buffer, sizeof(buffer), journal_buffer, sizeof(journal_buffer) );
+        check( !read.SerializeBytes( block, 16 ) );
+        read = Stream( Stream::Read, buffer, sizeof(buffer), journal_buffer, sizeof(journal_buffer) );
+        check( read.SerializeBytes( block, 20 ) );
+        
+        typedef StaticStream<Stream::Write, DebugJournal> JournalWriteStream;
+        typedef StaticStream<Stream::Read, DebugJournal> JournalReadStream;
+        JournalWriteStream static_write( buffer, sizeof(buffer), journal_buffer, sizeof(journal_buffer) );
+        check( static_write.SerializeBytes( block, 20 ) );
+        static_write.Flush();
+        JournalReadStream static_read( buffer, sizeof(buffer), journal_buffer, sizeof(journal_buffer) );
+        check( !static_read.SerializeBytes( block, 16 ) );
+        check( strstr( static_read.GetJournalError(), "20 bytes" ) != NULL );
+        JournalReadStream static_reread( buffer, sizeof(buffer), journal_buffer, sizeof(journal_buffer) );
+        check( static_reread.SerializeBytes( block, 20 ) );
+    }
+}
+
+// the byte at a time bitpacker this one replaced, kept as a baseline for the benchmark
+
+class ByteBitPacker
+{
+public:
+    
+    ByteBitPacker( unsigned char * buffer, int bytes );
+    
+    void WriteBits( unsigned int value, int bits );
+    
+    void ReadBits( unsigned int & value, int bits );
+    
+private:
+    
+    int bit_index;
+    unsigned char * ptr;
+    unsigned char * buffer;
+    int bytes;
+};
+
+ByteBitPacker::ByteBitPacker( unsigned char * buffer, int bytes )
+{
+    this->buffer = buffer;
+    this->ptr = buffer;
+    this->bytes = bytes;
+    bit_index = 0;
+}
+
+void ByteBitPacker::WriteBits( unsigned int value, int bits )
+{
+    assert( ptr );
+    assert( buffer );
+    assert( bits > 0 );
+    assert( bits <= 32 );
+    if ( bits < 32 )
+    {
+        const unsigned int mask = ( 1u << bits ) - 1;
+        value &= mask;
+    }
+    do
+    {
+        assert( ptr - buffer < bytes );
+        *ptr |= (unsigned char) ( value << bit_index );
+        assert( bit_index < 8 );
+        const int bits_written = std::min( bits, 8 - bit_index );
+        assert( bits_written > 0 );
+        assert( bits_written <= 8 );
+        bit_index += bits_written;
+        if ( bit_index >= 8 )
+        {
+            ptr++;
+            bit_index = 0;
+            value >>= bits_written;
+        }
+        bits -= bits_written;
+        assert( bits >= 0 );
+        assert( bits <= 32 );
+    }
+    while ( bits > 0 );
+}
+
+void ByteBitPacker::ReadBits( unsigned int & value, int bits )
+{
+    assert( ptr );
+    assert( buffer );
+    assert( bits > 0 );
+    assert( bits <= 32 );
+    int original_bits = bits;
+    int value_index = 0;
+    value = 0;
+    do
+    {
+        assert( ptr - buffer < bytes );
+        assert( bits >= 0 );
+        assert( bits <= 32 );
+        int bits_to_read = std::min( 8 - bit_index, bits );
+        assert( bits_to_read > 0 );
+        assert( bits_to_read <= 8 );
+        value |= (uint32_t) ( *ptr >> bit_index ) << value_index;
+        bits -= bits_to_read;
+        bit_index += bits_to_read;
+        value_index += bits_to_read;
+        assert( value_index >= 0 );
+        assert( value_index <= 32 );
+        if ( bit_index >= 8 )
+        {
+            ptr++;
+            bit_index = 0;
+        }
+    }
+    while ( bits > 0 );
+    if ( original_bits < 32 )
+    {
+        const unsigned int mask = ( 1u << original_bits ) - 1;
+        value &= mask;
+    }
+}
+
+double seconds_since( std::chrono::steady_clock::time_point start )
+{
+    return std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+}
+
+void benchmark_bit_packer()
+{
+    printf( "-----------------------------------------------------\n" );
+    printf( "benchmark bit packer\n" );
+    printf( "-----------------------------------------------------\n" );
+    
+    // a mix of widths like a game state packet: flags, small enums, quantized values, full words
+    const int Widths[] = { 1, 3, 7, 12, 1, 16, 5, 32, 9, 2, 20, 1, 11, 24, 6, 4 };
+    const int WidthCount = sizeof( Widths ) / sizeof( Widths[0] );
+    const int BufferSize = 64 * 1024;
+    const int Iterations = 200;
+    
+    int values_per_buffer = 0;
+    int bits_per_buffer = 0;
+    while ( bits_per_buffer + Widths[values_per_buffer % WidthCount] <= BufferSize * 8 )
+        bits_per_buffer += Widths[values_per_buffer++ % WidthCount];
+    
+    std::vector<unsigned int> values( values_per_buffer );
+    for ( int i = 0; i < values_per_buffer; ++i )
+        values[i] = (unsigned int) rand() * 2654435761u;
+    std::vector<unsigned char> byte_buffer( BufferSize );
+    std::vector<unsigned char> word_buffer( BufferSize );
+    unsigned int sum = 0;
+    
+    // the byte at a time packer needs a zeroed buffer, clearing it is part of its cost
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for ( int n = 0; n < Iterations; ++n )
+    {
+        memset( &byte_buffer[0], 0, BufferSize );
+        ByteBitPacker packer( &byte_buffer[0], BufferSize );
+        for ( int i = 0; i < values_per_buffer; ++i )
+            packer.WriteBits( values[i], Widths[i % WidthCount] );
+    }
+    const double byte_write = seconds_since( start );
+    
+    start = std::chrono::steady_clock::now();
+    for ( int n = 0; n < Iterations; ++n )
+    {
+        BitPacker packer( BitPacker::Write, &word_buffer[0], BufferSize );
+        for ( int i = 0; i < values_per_buffer; ++i )
+            packer.WriteBits( values[i], Widths[i % WidthCount] );
+        packer.FlushBits();
+    }
+    const double word_write = seconds_since( start );
+    
+    // same layout for widths up to 32 bits
+    check( memcmp( &byte_buffer[0], &word_buffer[0], ( bits_per_buffer + 7 ) / 8 ) == 0 );
+    
+    start = std::chrono::steady_clock::now();
+    for ( int n = 0; n < Iterations; ++n )
+    {
+        ByteBitPacker packer( &byte_buffer[0], BufferSize );
+        for ( int i = 0; i < values_per_buffer; ++i )
+        {
+            unsigned int value;
+            packer.ReadBits( value, Widths[i % WidthCount] );
+            sum += value;
+        }
+    }
+    const double byte_read = seconds_since( start );
+    
+    start = std::chrono::steady_clock::now();
+    for ( int n = 0; n < Iterations; ++n )
+    {
+        BitPacker packer( BitPacker::Read, &word_buffer[0], BufferSize );
+        for ( int i = 0; i < values_per_buffer; ++i )
+        {
+            unsigned int value;
+            packer.ReadBits( value, Widths[i % WidthCount] );
+            sum -= value;
+        }
+    }
+    const double word_read = seconds_since( start );
+    
+    // both read the same values back
+    check( sum == 0 );
+    
+    const double megabytes = (double) bits_per_buffer / 8.0 * Iterations / ( 1024.0 * 1024.0 );
+    printf( "packer        write         read\n" );
+    printf( "byte      %7.1f MB/s  %7.1f MB/s\n", megabytes / byte_write, megabytes / byte_read );
+    printf( "word      %7.1f MB/s  %7.1f MB/s\n", megabytes / word_write, megabytes / word_read );
+    printf( "speedup   %7.2fx      %7.2fx\n", byte_write / word_write, byte_read / word_read );
+}
+
+void benchmark_static_stream()
+{
+    printf( "-----------------------------------------------------\n" );
+    printf( "benchmark static stream\n" );
+    printf( "-----------------------------------------------------\n" );
+    
+    const int EntityCount = 256;
+    const int Iterations = 500;
+    TestEntity entities[EntityCount];
+    init_test_entities( entities, EntityCount );
+    for ( int i = 0; i < EntityCount; ++i )
+        entities[i].active = true;
+    
+    std::vector<unsigned char> buffer( 64 * 1024 );
+    const int bytes = (int) buffer.size();
+    int bits = 0;
+    unsigned int sum = 0;
+    
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for ( int n = 0; n < Iterations; ++n )
+    {
+        Stream stream( Stream::Write, &buffer[0], bytes );
+        for ( int i = 0; i < EntityCount; ++i )
+            entities[i].Serialize( stream );
+        stream.Flush();
+        bits = stream.GetBitsProcessed();
+    }
+    const double stream_write = seconds_since( start );
+    
+    start = std::chrono::steady_clock::now();
+    for ( int n = 0; n < Iterations; ++n )
+    {
+        Stream stream( Stream::Read, &buffer[0], bytes );
+        for ( int i = 0; i < EntityCount; ++i )
+        {
+            TestEntity entity;
+            entity.Serialize( stream );
+            sum += entity.type;
+        }
+    }
+    const double stream_read = seconds_since( start );
+    
+    start = std::chrono::steady_clock::now();
+    for ( int n = 0; n < Iterations; ++n )
+    {
+        WriteStream stream( &buffer[0], bytes );
+        for ( int i = 0; i < EntityCount; ++i )
+            entities[i].Serialize( stream );
+        stream.Flush();
+        check( stream.GetBitsProcessed() == bits );
+    }
+    const double static_write = seconds_since( start );
+    
+    start = std::chrono::steady_clock::now();
+    for ( int n = 0; n < Iterations; ++n )
+    {
+        ReadStream stream( &buffer[0], bytes );
+        for ( int i = 0; i < EntityCount; ++i )
+        {
+            TestEntity entity;
+            entity.Serialize( stream );
+            sum -= entity.type;
+        }
+    }
+    const double static_read = seconds_since( start );
+    
+    check( sum == 0 );
+    
+    const double megabytes = (double) bits / 8.0 * Iterations / ( 1024.0 * 1024.0 );
+    printf( "stream        write         read\n" );
+    printf( "runtime   %7.1f MB/s  %7.1f MB/s\n", megabytes / stream_write, megabytes / stream_read );
+    printf( "static    %7.1f MB/s  %7.1f MB/s\n", megabytes / static_write, megabytes / static_read );
+    printf( "speedup   %7.2fx      %7.2fx\n", stream_write / static_write, stream_read / static_read );
+}
+
+void benchmark_serialize_array()
+{
+    printf( "-----------------------------------------------------\n" );
+    printf( "benchmark serialize array\n" );
+    printf( "-----------------------------------------------------\n" );
+    
+    const int Widths[] = { 1, 4, 8, 12, 16, 24, 32 };
+    const int WidthCount = sizeof( Widths ) / sizeof( Widths[0] );
+    const BitPacker::ArrayKernel Kernels[] = { BitPacker::ScalarKernel, BitPacker::SSE2Kernel, BitPacker::AVX2Kernel };
+    const int KernelCount = BitPacker::BestArrayKernel + 1;
+    const int BufferSize = 64 * 1024;
+    const int Iterations = 100;
+    std::vector<unsigned char> buffer( BufferSize );
+    unsigned int sum = 0;
+    
+    // MB/s of packed data, one SerializeBits per value against the array kernels
+    const char * KernelNames[] = { "scalar", "sse2", "avx2" };
+    printf( "bits   per value w/r" );
+    for ( int k = 0; k < KernelCount; ++k )
+        printf( "    %6s w/r", KernelNames[k] );
+    printf( "\n" );
+    for ( int w = 0; w < WidthCount; ++w )
+    {
+        const int bits = Widths[w];
+        const int count = BufferSize * 8 / bits;
+        std::vector<unsigned int> values( count );
+        std::vector<unsigned int> values_out( count );
+        for ( int i = 0; i < count; ++i )
+            values[i] = (unsigned int) rand() * 2654435761u;
+        const double megabytes = (double) count * bits / 8.0 * Iterations / ( 1024.0 * 1024.0 );
+        printf( "%4d", bits );
+        
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for ( int n = 0; n < Iterations; ++n )
+        {
+            WriteStream stream( &buffer[0], BufferSize );
+            for ( int i = 0; i < count; ++i )
+                stream.SerializeBits( values[i], bits );
+            stream.Flush();
+        }
+        const double write = seconds_since( start );
+        start = std::chrono::steady_clock::now();
+        for ( int n = 0; n < Iterations; ++n )
+        {
+            ReadStream stream( &buffer[0], BufferSize );
+            for ( int i = 0; i < count; ++i )
+            {
+                unsigned int value;
+                stream.SerializeBits( value, bits );
+                sum += value;
+            }
+        }
+        const double read = seconds_since( start );
+        printf( "  %7.0f %7.0f", megabytes / write, megabytes / read );
+        
+        for ( int k = 0; k < KernelCount; ++k )
+        {
+            start = std::chrono::steady_clock::now();
+            for ( int n = 0; n < Iterations; ++n )
+            {
+                BitPacker packer( BitPacker::Write, &buffer[0], BufferSize );
+                packer.WriteArray( &values[0], count, bits, Kernels[k] );
+                packer.FlushBits();
+            }
+            const double array_write = seconds_since( start );
+            start = std::chrono::steady_clock::now();
+            for ( int n = 0; n < Iterations; ++n )
+            {
+                BitPacker packer( BitPacker::Read, &buffer[0], BufferSize );
+                packer.ReadArray( &values_out[0], count, bits, Kernels[k] );
+                sum += values_out[n % count];
+            }
+            const double array_read = seconds_since( start );
+            printf( "  %7.0f %7.0f", megabytes / array_write, megabytes / array_read );
+        }
+        printf( "\n" );
+    }
+    // keeps the reads from being optimized away
+    if ( sum == 0x12345678 )
+        printf( "\n" );
+}
+
+void benchmark_serialize_bytes()
+{
+    printf( "-----------------------------------------------------\n" );
+    printf( "benchmark serialize bytes\n" );
+    printf( "-----------------------------------------------------\n" );
+    
+    // blobs of a few sizes packed after a flag, so they start off a byte boundary
+    const int Sizes[] = { 16, 256, 1024 };
+    const int BufferSize = 64 * 1024;
+    const int Megabytes = 64;
+    std::vector<unsigned char> buffer( BufferSize );
+    std::vector<unsigned char> blob( 1024 );
+    for ( int i = 0; i < 1024; ++i )
+        blob[i] = (unsigned char) rand();
+    unsigned int sum = 0;
+    
+    printf( "blob      SerializeByte w/r       SerializeBytes w/r\n" );
+    for ( int s = 0; s < (int) ( sizeof( Sizes ) / sizeof( Sizes[0] ) ); ++s )
+    {
+        const int size = Sizes[s];
+        const int blobs = ( BufferSize - 64 ) / ( size + 1 );
+        const int iterations = Megabytes * 1024 * 1024 / ( blobs * size );
+        bool flag = true;
+        double seconds[4];
+        for ( int bulk = 0; bulk < 2; ++bulk )
+        {
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            for ( int n = 0; n < iterations; ++n )
+            {
+                WriteStream stream( &buffer[0], BufferSize );
+                for ( int b = 0; b < blobs; ++b )
+                {
+                    stream.SerializeBoolean( flag );
+                    if ( bulk )
+                        stream.SerializeBytes( &blob[0], size );
+                    else
+                    {
+                        for ( int i = 0; i < size; ++i )
+                            stream.SerializeByte( blob[i] );
+                    }
+                }
+                stream.Flush();
+            }
+            seconds[bulk * 2] = seconds_since( start );
+            start = std::chrono::steady_clock::now();
+            std::vector<unsigned char> blob_out( size );
+            for ( int n = 0; n < iterations; ++n )
+            {
+                ReadStream stream( &buffer[0], BufferSize );
+                for ( int b = 0; b < blobs; ++b )
+                {
+                    stream.SerializeBoolean( flag );
+                    if ( bulk )
+                        stream.SerializeBytes( &blob_out[0], size );
+                    else
+                    {
+                        for ( int i = 0; i < size; ++i )
+                            stream.SerializeByte( blob_out[i] );
+                    }
+                }
+                sum += blob_out[n % size];
+            }
+            seconds[bulk * 2 + 1] = seconds_since( start );
+            check( memcmp( &blob[0], &blob_out[0], size ) == 0 );
+        }
+        const double megabytes = (double) blobs * size * iterations / ( 1024.0 * 1024.0 );
+        printf( "%4d   %8.0f %8.0f MB/s   %8.0f %8.0f MB/s\n", size, megabytes / seconds[0], megabytes / seconds[1], megabytes / seconds[2], megabytes / seconds[3] );
+    }
+    if ( sum == 0x12345678 )
+        printf( "\n" );
+}
+
 void RunStreamTests()
 {
     printf( "-----------------------------------------------------\n" );
@@ -699,6 +3044,17 @@ void RunStreamTests()
     
     test_bit_packer();
     test_stream();
+    test_static_stream();
+    test_compressed_serialize();
+    test_delta_encoding();
+    test_varint_serialize();
+    test_range_stream();
+    test_serialize_array();
+    test_serialize_bytes();
+    benchmark_bit_packer();
+    benchmark_static_stream();
+    benchmark_serialize_array();
+    benchmark_serialize_bytes();
     
     printf( "-----------------------------------------------------\n" );
     printf( "stream tests passed!\n" );
@@ -16,6 +16,9 @@
 
 #include <cassert>
 #include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
 
 // -------------------------------------------------------------------------------
 // unit tests for transport layer
@@ -26,7 +29,7 @@ using namespace Net;
 #ifdef DEBUG
 #define check assert
 #else
-#define check(n) if ( !n ) { printf( "check failed\n" ); exit(1); }
+#define check(n) if ( !(n) ) { printf( "check failed\n" ); exit(1); }
 #endif
 
 void test_lan_transport_connect()
@@ -621,6 +624,328 @@ void test_lan_transport_reliability()
     Transport::Destroy( server );
 }
 
+void test_lan_transport_background()
+{
+    printf( "-----------------------------------------------------\n" );
+    printf( "test LAN transport background\n" );
+    printf( "-----------------------------------------------------\n" );
+    
+    Transport * server = Transport::Create();
+    check( server != nullptr );
+    
+    Transport * client = Transport::Create();
+    check( client != nullptr );
+    
+    TransportLAN * lan_transport_server = dynamic_cast<TransportLAN*>( server );
+    std::string hostname = "testhostname";
+    lan_transport_server->StartServer( hostname.c_str() );
+    
+    TransportLAN * lan_transport_client = dynamic_cast<TransportLAN*>( client );
+    lan_transport_client->ConnectClient( "127.0.0.1:30000" );
+    
+    const float DeltaTime = 1.0f / 30.0f;
+    const int BackgroundCount = 200;
+    const int GameplayCount = 60;
+    
+    // the client streams bulk data as fast as it's let, alongside a packet per tick of gameplay
+    int backgroundSent = 0;
+    int backgroundReceived = 0;
+    int gameplayReceived = 0;
+    float initialBandwidth = 0.0f;
+    
+    while ( backgroundReceived < BackgroundCount || gameplayReceived < GameplayCount )
+    {
+        if ( lan_transport_client->ConnectFailed() )
+            break;
+        
+        if ( lan_transport_client->IsConnected() && client->IsNodeConnected( 0 ) )
+        {
+            if ( initialBandwidth == 0.0f )
+                initialBandwidth = lan_transport_client->GetBackgroundFlowControl( 0 ).GetBandwidth();
+            
+            unsigned char packet[] = "gameplay";
+            client->SendPacket( 0, packet, sizeof(packet) );
+            
+            for ( int i = 0; i < 8; ++i )
+            {
+                unsigned char data[200];
+                data[0] = 'b';
+                data[1] = (unsigned char) backgroundSent;
+                for ( int j = 2; j < (int) sizeof(data); ++j )
+                    data[j] = (unsigned char) ( data[1] + j );
+                if ( !lan_transport_client->SendBackgroundPacket( 0, data, sizeof(data) ) )
+                    break;
+                backgroundSent++;
+            }
+        }
+        
+        while ( true )
+        {
+            int nodeId = -1;
+            unsigned char packet[256];
+            int bytes_read = server->ReceivePacket( nodeId, packet, sizeof(packet) );
+            if ( bytes_read == 0 )
+                break;
+            check( nodeId == 1 );
+            if ( packet[0] == 'b' )
+            {
+                check( bytes_read == 200 );
+                for ( int j = 2; j < bytes_read; ++j )
+                    check( packet[j] == (unsigned char) ( packet[1] + j ) );
+                backgroundReceived++;
+            }
+            else
+            {
+                check( strcmp( (const char*) packet, "gameplay" ) == 0 );
+                gameplayReceived++;
+            }
+        }
+        
+        // acks and delay echoes come back on the server's packets
+        while ( true )
+        {
+            int nodeId = -1;
+            unsigned char packet[256];
+            if ( client->ReceivePacket( nodeId, packet, sizeof(packet) ) == 0 )
+                break;
+        }
+        
+        client->Update( DeltaTime );
+        server->Update( DeltaTime );
+    }
+    
+    check( lan_transport_client->IsConnected() );
+    check( lan_transport_server->IsConnected() );
+    
+    // nothing queues up on loopback, so the background budget only grew
+    FlowControl & background = lan_transport_client->GetBackgroundFlowControl( 0 );
+    check( background.GetMode() == FlowControl::LEDBAT );
+    check( background.GetQueuingDelay() < background.GetQueuingTarget() );
+    check( background.GetBandwidth() > initialBandwidth );
+    
+    Transport::Destroy( client );
+    Transport::Destroy( server );
+}
+
+double median_seconds( std::vector<double> samples )
+{
+    std::sort( samples.begin(), samples.end() );
+    return samples[samples.size() / 2];
+}
+
+void test_lan_transport_background_latency()
+{
+    printf( "-----------------------------------------------------\n" );
+    printf( "test LAN transport background latency\n" );
+    printf( "-----------------------------------------------------\n" );
+    
+    Transport * server = Transport::Create();
+    check( server != nullptr );
+    
+    Transport * client = Transport::Create();
+    check( client != nullptr );
+    
+    TransportLAN * lan_transport_server = dynamic_cast<TransportLAN*>( server );
+    std::string hostname = "testhostname";
+    lan_transport_server->StartServer( hostname.c_str() );
+    
+    TransportLAN * lan_transport_client = dynamic_cast<TransportLAN*>( client );
+    lan_transport_client->ConnectClient( "127.0.0.1:30000" );
+    
+    const float DeltaTime = 1.0f / 30.0f;
+    const int Pings = 100;
+    const int Warmup = 30;                  // ticks of background transfer before its pings count
+    const double Tolerance = 0.001;         // seconds the median gameplay rtt may rise by
+    
+    // the client pings the server once a tick and the server echoes each one straight back, with
+    // the wall clock time it was sent. the first pings go on an idle link, the rest alongside a
+    // background transfer sent as fast as it's let
+    std::vector<double> idle;
+    std::vector<double> busy;
+    int busyTicks = 0;
+    int backgroundReceived = 0;
+    
+    while ( (int) busy.size() < Pings )
+    {
+        check( !lan_transport_client->ConnectFailed() );
+        
+        if ( lan_transport_client->IsConnected() && client->IsNodeConnected( 0 ) )
+        {
+            const bool background = (int) idle.size() >= Pings;
+            if ( background )
+            {
+                busyTicks++;
+                for ( int i = 0; i < 8; ++i )
+                {
+                    unsigned char data[200];
+                    memset( data, 'b', sizeof(data) );
+                    if ( !lan_transport_client->SendBackgroundPacket( 0, data, sizeof(data) ) )
+                        break;
+                }
+            }
+            
+            unsigned char ping[2 + sizeof(double)];
+            ping[0] = 'p';
+            ping[1] = background && busyTicks > Warmup ? 1 : 0;
+            const double sent = std::chrono::duration<double>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+            memcpy( ping + 2, &sent, sizeof(sent) );
+            client->SendPacket( 0, ping, sizeof(ping) );
+        }
+        
+        while ( true )
+        {
+            int nodeId = -1;
+            unsigned char packet[256];
+            int bytes_read = server->ReceivePacket( nodeId, packet, sizeof(packet) );
+            if ( bytes_read == 0 )
+                break;
+            if ( packet[0] == 'p' )
+                server->SendPacket( nodeId, packet, bytes_read );
+            else
+                backgroundReceived++;
+        }
+        
+        while ( true )
+        {
+            int nodeId = -1;
+            unsigned char packet[256];
+            int bytes_read = client->ReceivePacket( nodeId, packet, sizeof(packet) );
+            if ( bytes_read == 0 )
+                break;
+            if ( packet[0] != 'p' || bytes_read != 2 + (int) sizeof(double) )
+                continue;
+            double sent = 0.0;
+            memcpy( &sent, packet + 2, sizeof(sent) );
+            const double now = std::chrono::duration<double>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+            if ( packet[1] )
+                busy.push_back( now - sent );
+            else if ( (int) idle.size() < Pings )
+                idle.push_back( now - sent );
+        }
+        
+        client->Update( DeltaTime );
+        server->Update( DeltaTime );
+    }
+    
+    const double idleRtt = median_seconds( idle );
+    const double busyRtt = median_seconds( busy );
+    printf( "gameplay rtt %.3f ms idle, %.3f ms with a background transfer, %d background packets\n", idleRtt * 1000.0, busyRtt * 1000.0, backgroundReceived );
+    check( backgroundReceived > 0 );
+    check( busyRtt - idleRtt < Tolerance );
+    
+    Transport::Destroy( client );
+    Transport::Destroy( server );
+}
+
+void test_lan_transport_checksum()
+{
+    printf( "-----------------------------------------------------\n" );
+    printf( "test LAN transport checksum\n" );
+    printf( "-----------------------------------------------------\n" );
+    const float DeltaTime = 1.0f / 30.0f;
+    
+    Transport * server = Transport::Create();
+    check( server != nullptr );
+    
+    Transport * client = Transport::Create();
+    check( client != nullptr );
+    
+    // both sides with checksums on
+    TransportLAN::Config config;
+    config.checksum = true;
+    
+    TransportLAN * lan_transport_server = dynamic_cast<TransportLAN*>( server );
+    lan_transport_server->Configure( config );
+    std::string hostname = "testhostname";
+    lan_transport_server->StartServer( hostname.c_str() );
+    
+    TransportLAN * lan_transport_client = dynamic_cast<TransportLAN*>( client );
+    lan_transport_client->Configure( config );
+    lan_transport_client->ConnectClient( hostname.c_str() );
+    
+    bool serverReceivedPacketFromClient = false;
+    bool clientReceivedPacketFromServer = false;
+    
+    while ( !serverReceivedPacketFromClient || !clientReceivedPacketFromServer )
+    {
+        check( !lan_transport_client->ConnectFailed() );
+        
+        if ( lan_transport_client->IsConnected() )
+        {
+            unsigned char packet[] = "client to server";
+            client->SendPacket( 0, packet, sizeof(packet) );
+        }
+        
+        if ( lan_transport_server->IsConnected() )
+        {
+            unsigned char packet[] = "server to client";
+            server->SendPacket( 1, packet, sizeof(packet) );
+        }
+        
+        if ( lan_transport_client->IsConnected() )
+        {
+            while ( true )
+            {
+                int nodeId = -1;
+                unsigned char packet[256];
+                int bytes_read = client->ReceivePacket( nodeId, packet, sizeof(packet) );
+                if ( bytes_read == 0 )
+                    break;
+                if ( nodeId == 0 && strcmp( (const char*) packet, "server to client" ) == 0 )
+                    clientReceivedPacketFromServer = true;
+            }
+        }
+        
+        if ( lan_transport_server->IsConnected() )
+        {
+            while ( true )
+            {
+                int nodeId = -1;
+                unsigned char packet[256];
+                int bytes_read = server->ReceivePacket( nodeId, packet, sizeof(packet) );
+                if ( bytes_read == 0 )
+                    break;
+                if ( nodeId == 1 && strcmp( (const char*) packet, "client to server" ) == 0 )
+                    serverReceivedPacketFromClient = true;
+            }
+        }
+        
+        client->Update( DeltaTime );
+        server->Update( DeltaTime );
+    }
+    
+    check( lan_transport_client->IsConnected() );
+    check( lan_transport_server->IsConnected() );
+    
+    // the checksum comes out of the payload, the largest packet still fits the node's datagrams
+    const int MaxPacketSize = client->GetMaxPacketSize();
+    check( MaxPacketSize == 1024 - 20 - 4 );
+    check( server->GetMaxPacketSize() == MaxPacketSize );
+    std::vector<unsigned char> large( MaxPacketSize + 1, 0x5A );
+    check( !client->SendPacket( 0, &large[0], MaxPacketSize + 1 ) );
+    check( client->SendPacket( 0, &large[0], MaxPacketSize ) );
+    bool serverReceivedLargePacket = false;
+    for ( int i = 0; i < 100 && !serverReceivedLargePacket; ++i )
+    {
+        client->Update( DeltaTime );
+        server->Update( DeltaTime );
+        while ( true )
+        {
+            int nodeId = -1;
+            std::vector<unsigned char> packet( MaxPacketSize );
+            int bytes_read = server->ReceivePacket( nodeId, &packet[0], MaxPacketSize );
+            if ( bytes_read == 0 )
+                break;
+            if ( nodeId == 1 && bytes_read == MaxPacketSize && packet[MaxPacketSize-1] == 0x5A )
+                serverReceivedLargePacket = true;
+        }
+    }
+    check( serverReceivedLargePacket );
+    
+    Transport::Destroy( client );
+    Transport::Destroy( server );
+}
+
 void RunTransportTests()
 {
     printf( "-----------------------------------------------------\n" );
@@ -639,6 +964,9 @@ void RunTransportTests()
     test_lan_transport_client_server();
     test_lan_transport_peer_to_peer();
     test_lan_transport_reliability();
+    test_lan_transport_background();
+    test_lan_transport_background_latency();
+    test_lan_transport_checksum();
     
     Transport::Shutdown();
     
@@ -9,6 +9,7 @@
 #include "SocketTests.hpp"
 #include "ConnectionTests.hpp"
 #include "ReliabilityTests.hpp"
+#include "FlowControlTests.hpp"
 #include "MeshTests.hpp"
 #include "StreamTests.hpp"
 #include "TransportLANTests.hpp"
@@ -23,7 +24,7 @@ void WaitForInput() {
 int main(int argc, const char * argv[])
 {
     RunSocketTests();
-
+    
     WaitForInput();
     
     RunConnectionTests();
@@ -31,11 +32,15 @@ int main(int argc, const char * argv[])
     WaitForInput();
     
     RunReliabilityTests();
-
+    
     WaitForInput(),
     
+    RunFlowControlTests();
+    
+    WaitForInput();
+    
     RunMeshTests();
-
+    
     WaitForInput();
     
     RunStreamTests();